@@ -0,0 +1,411 @@
+﻿#include "asset_loader.h"
+#include <stdio.h>
+#include <iostream>
+#include <cstring>
+#include <stb/stb_image.h>
+#include "profiler.h"
+#include "thread_pool.h"
+
+// One submitted copy pass and the assets waiting on it
+struct UploadBatch {
+    Uint64 submission;
+    std::vector<Asset*> assets;
+};
+
+// Copy pass being recorded in update_asset_loader
+struct BatchRecorder {
+    SDL_GPUCommandBuffer* command_buffer;
+    SDL_GPUCopyPass* copy_pass;
+    std::vector<SDL_GPUTexture*> generate_mipmaps;
+    UploadBatch batch;
+};
+
+struct AssetLoader {
+    SDL_GPUDevice* device;
+    UploadRing* ring;
+    AssetLoaderOptions options;
+    ThreadPool* pool;
+    CompletionQueue completed;
+    std::vector<Asset*> assets;
+    std::vector<UploadBatch> uploads;
+    SDL_GPUTexture* placeholder_texture;
+    bool codec_supported[TEXTURE_CODEC_BC7 + 1];
+};
+
+static double elapsed_ms(Uint64 start) {
+    return (double)(SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency();
+}
+
+static SDL_GPUTexture* create_placeholder_texture(SDL_GPUDevice* device, UploadRing* ring) {
+    SDL_GPUTextureCreateInfo textureCreateInfo = {};
+    textureCreateInfo.format = SDL_GPU_TEXTUREFORMAT_R8G8B8A8_UNORM;
+    textureCreateInfo.usage = SDL_GPU_TEXTUREUSAGE_SAMPLER;
+    textureCreateInfo.width = 1;
+    textureCreateInfo.height = 1;
+    textureCreateInfo.layer_count_or_depth = 1;
+    textureCreateInfo.num_levels = 1;
+    SDL_GPUTexture* texture = SDL_CreateGPUTexture(device, &textureCreateInfo);
+
+    UploadAllocation allocation;
+    if (!upload_ring_allocate(ring, 4, UPLOAD_TEXTURE_ALIGNMENT, allocation)) {
+        return texture;
+    }
+    allocation.data[0] = allocation.data[1] = allocation.data[2] = allocation.data[3] = 255;
+
+    SDL_GPUCommandBuffer* commandBuffer = SDL_AcquireGPUCommandBuffer(device);
+    SDL_GPUCopyPass* copyPass = SDL_BeginGPUCopyPass(commandBuffer);
+    SDL_GPUTextureTransferInfo transferInfo = {};
+    transferInfo.transfer_buffer = allocation.transfer_buffer;
+    transferInfo.offset = allocation.offset;
+    SDL_GPUTextureRegion region = {};
+    region.texture = texture;
+    region.w = 1;
+    region.h = 1;
+    region.d = 1;
+    SDL_UploadToGPUTexture(copyPass, &transferInfo, &region, false);
+    SDL_EndGPUCopyPass(copyPass);
+    upload_ring_submit(ring, commandBuffer);
+    return texture;
+}
+
+AssetLoader* create_asset_loader(SDL_GPUDevice* device, UploadRing* ring, const AssetLoaderOptions& options) {
+    AssetLoader* loader = new AssetLoader();
+    loader->device = device;
+    loader->ring = ring;
+    loader->options = options;
+    loader->pool = create_thread_pool(options.num_threads);
+    completion_queue_init(loader->completed);
+    loader->placeholder_texture = create_placeholder_texture(device, ring);
+
+    // Workers must not touch the device, so format support is resolved up front
+    for (int codec = TEXTURE_CODEC_RGBA8; codec <= TEXTURE_CODEC_BC7; ++codec) {
+        loader->codec_supported[codec] = SDL_GPUTextureSupportsFormat(device, texture_codec_gpu_format((TextureCodec)codec),
+            SDL_GPU_TEXTURETYPE_2D, SDL_GPU_TEXTUREUSAGE_SAMPLER);
+    }
+    return loader;
+}
+
+static void release_payload(AssetPayload& payload) {
+    close_mesh_cache(payload.mesh_cache);
+    close_cooked_texture(payload.cooked_texture);
+    payload.mip_chain = MipChain();
+    payload.levels = NULL;
+    payload.data = NULL;
+}
+
+static void decode_mesh(AssetLoader* loader, Asset* asset) {
+    AssetPayload& payload = asset->payload;
+    if (!load_mesh_cached(asset->path, loader->options.packed_vertices, payload.mesh_cache)) {
+        asset->state = ASSET_STATE_FAILED;
+        return;
+    }
+    payload.data_size = payload.mesh_cache.vertex_data_size + payload.mesh_cache.index_data_size;
+    asset->state = ASSET_STATE_DECODED;
+}
+
+static void decode_texture(AssetLoader* loader, Asset* asset) {
+    AssetPayload& payload = asset->payload;
+    SDL_GPUTextureCreateInfo& info = payload.texture_info;
+    info = {};
+    info.format = SDL_GPU_TEXTUREFORMAT_R8G8B8A8_UNORM;
+    info.usage = SDL_GPU_TEXTUREUSAGE_SAMPLER;
+    info.layer_count_or_depth = 1;
+
+    // Prefer the cooked block-compressed chain; decode it on the CPU when the device lacks the format,
+    // and only fall back to the source image when nothing has been cooked or the source changed since
+    std::string cookedPath = asset->path + COOKED_TEXTURE_EXTENSION;
+    std::string imagePath = asset->path + ".png";
+    bool useCooked = open_cooked_texture(cookedPath.c_str(), payload.cooked_texture);
+    // Without the source image (a cooked-only install) the chain is used as is
+    Uint64 sourceHash = useCooked ? hash_file(imagePath.c_str()) : 0;
+    if (useCooked && sourceHash != 0 && payload.cooked_texture.header->source_hash != sourceHash) {
+        SDL_Log("%s is out of date with %s, loading the source image; rerun texture_cooker", cookedPath.c_str(), imagePath.c_str());
+        close_cooked_texture(payload.cooked_texture);
+        useCooked = false;
+    }
+    if (useCooked) {
+        CookedTexture& cooked = payload.cooked_texture;
+        info.width = cooked.header->width;
+        info.height = cooked.header->height;
+        info.num_levels = cooked.header->num_levels;
+        if (loader->codec_supported[cooked.codec]) {
+            info.format = texture_codec_gpu_format(cooked.codec);
+            payload.levels = cooked.levels;
+            payload.data = cooked.data;
+            payload.data_size = (Uint32)cooked.header->data_size;
+        } else {
+            SDL_Log("%s textures unsupported, decoding on the CPU", texture_codec_name(cooked.codec));
+            payload.mip_chain = decode_cooked_texture(cooked);
+            close_cooked_texture(cooked);
+        }
+        payload.upload_levels = info.num_levels;
+    } else {
+        int imageW, imageH;
+        stbi_uc* image_data = stbi_load(imagePath.c_str(), &imageW, &imageH, NULL, 4);
+        if (image_data == NULL) {
+            fprintf(stderr, "ERROR: stbi_load(%s) failed: %s\n", imagePath.c_str(), stbi_failure_reason());
+            asset->state = ASSET_STATE_FAILED;
+            return;
+        }
+        MipmapMode mipmapMode = loader->options.mipmap_mode;
+        info.width = imageW;
+        info.height = imageH;
+        info.num_levels = mipmapMode == MIPMAP_NONE ? 1 : mip_level_count(imageW, imageH);
+        if (mipmapMode == MIPMAP_GPU) {
+            // SDL blits level to level, which needs the texture to be a render target
+            info.usage |= SDL_GPU_TEXTUREUSAGE_COLOR_TARGET;
+        }
+
+        // The GPU path only uploads the base level and lets SDL fill the rest
+        payload.upload_levels = mipmapMode == MIPMAP_CPU ? info.num_levels : 1;
+        payload.mip_chain = generate_mip_chain(image_data, imageW, imageH, payload.upload_levels);
+        stbi_image_free(image_data);
+    }
+
+    if (payload.data == NULL) {
+        payload.levels = payload.mip_chain.levels.data();
+        payload.data = payload.mip_chain.data.data();
+        payload.data_size = (Uint32)payload.mip_chain.data.size();
+    }
+    asset->state = ASSET_STATE_DECODED;
+}
+
+static Asset* request_asset(AssetLoader* loader, AssetType type, const std::string& path) {
+    Asset* asset = new Asset();
+    asset->type = type;
+    asset->path = path;
+    asset->state = ASSET_STATE_LOADING;
+    asset->request_time = SDL_GetPerformanceCounter();
+    asset->texture = loader->placeholder_texture;
+    asset->mesh.dequantize = glm::mat4(1.0f);
+    asset->node.owner = asset;
+    loader->assets.push_back(asset);
+
+    thread_pool_submit(loader->pool, [loader, asset]() {
+        PROFILE_SCOPE(asset->type == ASSET_MESH ? "Decode mesh" : "Decode texture");
+        if (asset->type == ASSET_MESH) {
+            decode_mesh(loader, asset);
+        } else {
+            decode_texture(loader, asset);
+        }
+        // Failed assets go through the queue too so the render thread can release their payload
+        completion_queue_push(loader->completed, &asset->node);
+    });
+    return asset;
+}
+
+Asset* request_mesh(AssetLoader* loader, const std::string& path) {
+    return request_asset(loader, ASSET_MESH, path);
+}
+
+Asset* request_texture(AssetLoader* loader, const std::string& path) {
+    return request_asset(loader, ASSET_TEXTURE, path);
+}
+
+static void retire_uploads(AssetLoader* loader, bool wait) {
+    upload_ring_update(loader->ring);
+    for (size_t i = 0; i < loader->uploads.size();) {
+        UploadBatch& batch = loader->uploads[i];
+        if (wait) {
+            upload_ring_wait(loader->ring, batch.submission);
+        } else if (!upload_ring_complete(loader->ring, batch.submission)) {
+            ++i;
+            continue;
+        }
+
+        // Swap placeholders for the real resources now that the GPU has them
+        for (Asset* asset : batch.assets) {
+            if (asset->type == ASSET_MESH) {
+                asset->mesh = std::move(asset->pending_mesh);
+                asset->pending_mesh = {};
+            } else {
+                asset->texture = asset->pending_texture;
+                asset->pending_texture = NULL;
+            }
+            asset->state = ASSET_STATE_READY;
+            SDL_Log("Asset %s ready %.1f ms after request", asset->path.c_str(), elapsed_ms(asset->request_time));
+        }
+        loader->uploads.erase(loader->uploads.begin() + i);
+    }
+}
+
+static void release_gpu_resources(AssetLoader* loader, MeshAsset& mesh, SDL_GPUTexture*& texture) {
+    SDL_ReleaseGPUBuffer(loader->device, mesh.vertex_buffer);
+    SDL_ReleaseGPUBuffer(loader->device, mesh.index_buffer);
+    mesh = {};
+    if (texture != NULL && texture != loader->placeholder_texture) {
+        SDL_ReleaseGPUTexture(loader->device, texture);
+    }
+    texture = NULL;
+}
+
+static bool create_gpu_resources(AssetLoader* loader, Asset* asset, MeshAsset& mesh, SDL_GPUTexture*& texture) {
+    const AssetPayload& payload = asset->payload;
+    if (asset->type == ASSET_MESH) {
+        const MeshCache& cache = payload.mesh_cache;
+        SDL_GPUBufferCreateInfo vertexBufferInfo = {};
+        vertexBufferInfo.usage = SDL_GPU_BUFFERUSAGE_VERTEX;
+        vertexBufferInfo.size = cache.vertex_data_size;
+        mesh.vertex_buffer = SDL_CreateGPUBuffer(loader->device, &vertexBufferInfo);
+
+        SDL_GPUBufferCreateInfo indexBufferInfo = {};
+        indexBufferInfo.usage = SDL_GPU_BUFFERUSAGE_INDEX;
+        indexBufferInfo.size = cache.index_data_size;
+        mesh.index_buffer = SDL_CreateGPUBuffer(loader->device, &indexBufferInfo);
+
+        if (!mesh.vertex_buffer || !mesh.index_buffer) {
+            std::cout << "Failed to create mesh buffers. Error: " << SDL_GetError() << std::endl;
+            release_gpu_resources(loader, mesh, texture);
+            return false;
+        }
+        mesh.vertex_format = cache.vertex_format;
+        mesh.dequantize = dequantization_matrix(cache.header->quantization);
+        mesh.submeshes.assign(cache.submeshes, cache.submeshes + cache.header->submesh_count);
+        mesh.meshlets.assign(cache.meshlets, cache.meshlets + cache.header->meshlet_count);
+        return true;
+    }
+
+    texture = SDL_CreateGPUTexture(loader->device, &payload.texture_info);
+    if (!texture) {
+        std::cout << "Failed to create texture. Error: " << SDL_GetError() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+static void submit_batch(AssetLoader* loader, BatchRecorder& recorder) {
+    SDL_EndGPUCopyPass(recorder.copy_pass);
+    for (SDL_GPUTexture* texture : recorder.generate_mipmaps) {
+        SDL_GenerateMipmapsForGPUTexture(recorder.command_buffer, texture);
+    }
+
+    UploadBatch& batch = recorder.batch;
+    batch.submission = upload_ring_submit(loader->ring, recorder.command_buffer);
+    if (batch.submission == 0) {
+        for (Asset* asset : batch.assets) {
+            asset->state = ASSET_STATE_FAILED;
+            release_gpu_resources(loader, asset->pending_mesh, asset->pending_texture);
+        }
+    } else {
+        loader->uploads.push_back(batch);
+    }
+    recorder = BatchRecorder();
+}
+
+void update_asset_loader(AssetLoader* loader) {
+    PROFILE_SCOPE("Update asset loader");
+    retire_uploads(loader, false);
+
+    BatchRecorder recorder = {};
+    while (CompletionNode* node = completion_queue_pop(loader->completed)) {
+        Asset* asset = (Asset*)node->owner;
+        AssetPayload& payload = asset->payload;
+        if (asset->state == ASSET_STATE_FAILED) {
+            release_payload(payload);
+            continue;
+        }
+
+        MeshAsset mesh = {};
+        SDL_GPUTexture* texture = NULL;
+        if (!create_gpu_resources(loader, asset, mesh, texture)) {
+            asset->state = ASSET_STATE_FAILED;
+            release_payload(payload);
+            continue;
+        }
+
+        // When the batch recorded so far holds the space it needs, submit that first and retry
+        UploadAllocation allocation;
+        bool allocated = upload_ring_allocate(loader->ring, payload.data_size, UPLOAD_TEXTURE_ALIGNMENT, allocation);
+        if (!allocated && recorder.copy_pass) {
+            submit_batch(loader, recorder);
+            allocated = upload_ring_allocate(loader->ring, payload.data_size, UPLOAD_TEXTURE_ALIGNMENT, allocation);
+        }
+        if (!allocated) {
+            asset->state = ASSET_STATE_FAILED;
+            release_gpu_resources(loader, mesh, texture);
+            release_payload(payload);
+            continue;
+        }
+        if (!recorder.copy_pass) {
+            recorder.command_buffer = SDL_AcquireGPUCommandBuffer(loader->device);
+            recorder.copy_pass = SDL_BeginGPUCopyPass(recorder.command_buffer);
+        }
+
+        if (asset->type == ASSET_MESH) {
+            const MeshCache& cache = payload.mesh_cache;
+            // Copy vertex and index data straight out of the mapped cache
+            std::memcpy(allocation.data, cache.vertex_data, cache.vertex_data_size);
+            std::memcpy(allocation.data + cache.vertex_data_size, cache.index_data, cache.index_data_size);
+
+            SDL_GPUTransferBufferLocation vertexTransferLocation = {};
+            vertexTransferLocation.transfer_buffer = allocation.transfer_buffer;
+            vertexTransferLocation.offset = allocation.offset;
+            SDL_GPUBufferRegion vertexBufferRegion = {};
+            vertexBufferRegion.buffer = mesh.vertex_buffer;
+            vertexBufferRegion.size = cache.vertex_data_size;
+            SDL_UploadToGPUBuffer(recorder.copy_pass, &vertexTransferLocation, &vertexBufferRegion, false);
+
+            SDL_GPUTransferBufferLocation indexTransferLocation = {};
+            indexTransferLocation.transfer_buffer = allocation.transfer_buffer;
+            indexTransferLocation.offset = allocation.offset + cache.vertex_data_size;
+            SDL_GPUBufferRegion indexBufferRegion = {};
+            indexBufferRegion.buffer = mesh.index_buffer;
+            indexBufferRegion.size = cache.index_data_size;
+            SDL_UploadToGPUBuffer(recorder.copy_pass, &indexTransferLocation, &indexBufferRegion, false);
+
+            asset->pending_mesh = std::move(mesh);
+        } else {
+            std::memcpy(allocation.data, payload.data, payload.data_size);
+            for (Uint32 level = 0; level < payload.upload_levels; ++level) {
+                SDL_GPUTextureTransferInfo textureTransferInfo = {};
+                textureTransferInfo.transfer_buffer = allocation.transfer_buffer;
+                textureTransferInfo.offset = allocation.offset + payload.levels[level].offset;
+
+                SDL_GPUTextureRegion textureRegion = {};
+                textureRegion.texture = texture;
+                textureRegion.mip_level = level;
+                textureRegion.w = payload.levels[level].width;
+                textureRegion.h = payload.levels[level].height;
+                textureRegion.d = 1;
+                SDL_UploadToGPUTexture(recorder.copy_pass, &textureTransferInfo, &textureRegion, false);
+            }
+            if (payload.upload_levels < payload.texture_info.num_levels) {
+                recorder.generate_mipmaps.push_back(texture);
+            }
+            asset->pending_texture = texture;
+        }
+
+        asset->state = ASSET_STATE_UPLOADING;
+        release_payload(payload);
+        recorder.batch.assets.push_back(asset);
+    }
+
+    if (recorder.copy_pass) {
+        submit_batch(loader, recorder);
+    }
+}
+
+bool asset_ready(const Asset* asset) {
+    return asset->state == ASSET_STATE_READY;
+}
+
+void destroy_asset_loader(AssetLoader* loader) {
+    if (loader == NULL) {
+        return;
+    }
+
+    destroy_thread_pool(loader->pool);
+    while (CompletionNode* node = completion_queue_pop(loader->completed)) {
+        release_payload(((Asset*)node->owner)->payload);
+    }
+    retire_uploads(loader, true);
+
+    for (Asset* asset : loader->assets) {
+        release_payload(asset->payload);
+        release_gpu_resources(loader, asset->mesh, asset->texture);
+        release_gpu_resources(loader, asset->pending_mesh, asset->pending_texture);
+        delete asset;
+    }
+    SDL_ReleaseGPUTexture(loader->device, loader->placeholder_texture);
+    delete loader;
+}
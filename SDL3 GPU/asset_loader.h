@@ -0,0 +1,88 @@
+﻿#pragma once
+#include <atomic>
+#include <string>
+#include <vector>
+#include <SDL3/SDL.h>
+#include <glm/glm.hpp>
+#include "completion_queue.h"
+#include "cooked_texture.h"
+#include "mesh_cache.h"
+#include "texture.h"
+#include "upload_ring.h"
+
+enum AssetType {
+    ASSET_MESH,
+    ASSET_TEXTURE
+};
+
+enum AssetState {
+    ASSET_STATE_LOADING,   // decoding on a worker
+    ASSET_STATE_DECODED,   // waiting in the completion queue
+    ASSET_STATE_UPLOADING, // copy pass submitted, fence pending
+    ASSET_STATE_READY,
+    ASSET_STATE_FAILED
+};
+
+struct MeshAsset {
+    SDL_GPUBuffer* vertex_buffer;
+    SDL_GPUBuffer* index_buffer;
+    VertexFormat vertex_format;
+    glm::mat4 dequantize;
+    std::vector<Submesh> submeshes;
+    std::vector<Meshlet> meshlets;
+};
+
+// What a worker hands to the render thread: mapped files or decoded memory ready to memcpy
+struct AssetPayload {
+    MeshCache mesh_cache;
+    CookedTexture cooked_texture;
+    MipChain mip_chain;
+    SDL_GPUTextureCreateInfo texture_info;
+    const MipLevel* levels;
+    const Uint8* data;
+    Uint32 data_size;
+    Uint32 upload_levels;
+};
+
+struct Asset {
+    AssetType type;
+    std::string path;
+    std::atomic<int> state;
+    Uint64 request_time;
+
+    // Resident resources. texture is the shared placeholder until the upload fence signals;
+    // mesh.submeshes stays empty until then so nothing is drawn.
+    MeshAsset mesh;
+    SDL_GPUTexture* texture;
+
+    // Real resources while their upload is in flight
+    MeshAsset pending_mesh;
+    SDL_GPUTexture* pending_texture;
+
+    CompletionNode node;
+    AssetPayload payload;
+};
+
+struct AssetLoaderOptions {
+    int num_threads;
+    bool packed_vertices;
+    MipmapMode mipmap_mode;
+};
+
+struct AssetLoader;
+
+// Uploads are staged through ring, which must outlive the loader
+AssetLoader* create_asset_loader(SDL_GPUDevice* device, UploadRing* ring, const AssetLoaderOptions& options);
+// Waits for outstanding decodes and uploads, then releases every asset's resources
+void destroy_asset_loader(AssetLoader* loader);
+
+// Returns immediately; the asset starts out with placeholder resources
+Asset* request_mesh(AssetLoader* loader, const std::string& path);
+// path without extension: the cooked .gputex is preferred over the .png
+Asset* request_texture(AssetLoader* loader, const std::string& path);
+
+// Call once per frame on the render thread: retires finished uploads and batches newly
+// decoded assets into a single copy pass
+void update_asset_loader(AssetLoader* loader);
+
+bool asset_ready(const Asset* asset);
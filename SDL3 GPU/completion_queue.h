@@ -0,0 +1,56 @@
+﻿#pragma once
+#include <atomic>
+
+// Intrusive multi-producer / single-consumer queue (Vyukov). push never blocks or
+// allocates; pop is only called from the consuming thread and may briefly return
+// NULL while a push is halfway through.
+struct CompletionNode {
+    std::atomic<CompletionNode*> next;
+    void* owner;
+};
+
+struct CompletionQueue {
+    std::atomic<CompletionNode*> head;
+    CompletionNode* tail;
+    CompletionNode stub;
+};
+
+inline void completion_queue_init(CompletionQueue& queue) {
+    queue.stub.next.store(nullptr, std::memory_order_relaxed);
+    queue.stub.owner = nullptr;
+    queue.head.store(&queue.stub, std::memory_order_relaxed);
+    queue.tail = &queue.stub;
+}
+
+inline void completion_queue_push(CompletionQueue& queue, CompletionNode* node) {
+    node->next.store(nullptr, std::memory_order_relaxed);
+    CompletionNode* previous = queue.head.exchange(node, std::memory_order_acq_rel);
+    previous->next.store(node, std::memory_order_release);
+}
+
+inline CompletionNode* completion_queue_pop(CompletionQueue& queue) {
+    CompletionNode* tail = queue.tail;
+    CompletionNode* next = tail->next.load(std::memory_order_acquire);
+    if (tail == &queue.stub) {
+        if (next == nullptr) {
+            return nullptr;
+        }
+        queue.tail = next;
+        tail = next;
+        next = next->next.load(std::memory_order_acquire);
+    }
+    if (next != nullptr) {
+        queue.tail = next;
+        return tail;
+    }
+    if (tail != queue.head.load(std::memory_order_acquire)) {
+        return nullptr;
+    }
+    completion_queue_push(queue, &queue.stub);
+    next = tail->next.load(std::memory_order_acquire);
+    if (next != nullptr) {
+        queue.tail = next;
+        return tail;
+    }
+    return nullptr;
+}
@@ -0,0 +1,104 @@
+﻿#include "cooked_texture.h"
+#include <stdio.h>
+#include <cstring>
+#include <string>
+
+bool write_cooked_texture(const char* path, Uint64 source_hash, TextureCodec codec, const MipChain& chain) {
+    CookedTextureHeader header = {};
+    header.magic = COOKED_TEXTURE_MAGIC;
+    header.version = COOKED_TEXTURE_VERSION;
+    header.codec = codec;
+    header.width = chain.levels[0].width;
+    header.height = chain.levels[0].height;
+    header.num_levels = (Uint32)chain.levels.size();
+    header.source_hash = source_hash;
+    header.data_offset = (sizeof(CookedTextureHeader) + chain.levels.size() * sizeof(MipLevel) + 15) & ~15ull;
+
+    std::vector<MipLevel> levels;
+    Uint32 offset = 0;
+    for (const MipLevel& source : chain.levels) {
+        MipLevel level = { source.width, source.height, offset, texture_codec_level_size(codec, source.width, source.height) };
+        levels.push_back(level);
+        // Keep every level 16 byte aligned for the copy engine
+        offset = (offset + level.size + 15) & ~15u;
+    }
+    header.data_size = offset;
+
+    std::vector<Uint8> blob(header.data_offset + header.data_size, 0);
+    std::memcpy(blob.data(), &header, sizeof(header));
+    std::memcpy(blob.data() + sizeof(header), levels.data(), levels.size() * sizeof(MipLevel));
+    for (size_t i = 0; i < levels.size(); ++i) {
+        encode_texture_level(codec, chain.data.data() + chain.levels[i].offset, levels[i].width, levels[i].height,
+            blob.data() + header.data_offset + levels[i].offset);
+    }
+
+    std::string tmpPath = std::string(path) + ".tmp";
+    if (!SDL_SaveFile(tmpPath.c_str(), blob.data(), blob.size())) {
+        fprintf(stderr, "ERROR: SDL_SaveFile(%s) failed: %s\n", tmpPath.c_str(), SDL_GetError());
+        return false;
+    }
+    if (!SDL_RenamePath(tmpPath.c_str(), path)) {
+        fprintf(stderr, "ERROR: SDL_RenamePath(%s) failed: %s\n", path, SDL_GetError());
+        SDL_RemovePath(tmpPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool open_cooked_texture(const char* path, CookedTexture& texture) {
+    texture = {};
+    if (!map_file(path, texture.file)) {
+        return false;
+    }
+
+    const CookedTextureHeader* header = (const CookedTextureHeader*)texture.file.data;
+    size_t fileSize = texture.file.size;
+    bool valid = fileSize >= sizeof(CookedTextureHeader)
+        && header->magic == COOKED_TEXTURE_MAGIC
+        && header->version == COOKED_TEXTURE_VERSION
+        && header->codec <= TEXTURE_CODEC_BC7
+        && header->num_levels > 0
+        && sizeof(CookedTextureHeader) + (Uint64)header->num_levels * sizeof(MipLevel) <= header->data_offset
+        && header->data_offset + header->data_size <= fileSize;
+
+    if (valid) {
+        const MipLevel* levels = (const MipLevel*)(texture.file.data + sizeof(CookedTextureHeader));
+        for (Uint32 i = 0; i < header->num_levels && valid; ++i) {
+            valid = (Uint64)levels[i].offset + levels[i].size <= header->data_size;
+        }
+    }
+
+    if (!valid) {
+        fprintf(stderr, "ERROR: Cooked texture (%s) is invalid or from another version.\n", path);
+        close_cooked_texture(texture);
+        return false;
+    }
+
+    texture.header = header;
+    texture.codec = (TextureCodec)header->codec;
+    texture.levels = (const MipLevel*)(texture.file.data + sizeof(CookedTextureHeader));
+    texture.data = texture.file.data + header->data_offset;
+    return true;
+}
+
+void close_cooked_texture(CookedTexture& texture) {
+    unmap_file(texture.file);
+    texture = {};
+}
+
+MipChain decode_cooked_texture(const CookedTexture& texture) {
+    MipChain chain;
+    Uint32 offset = 0;
+    for (Uint32 i = 0; i < texture.header->num_levels; ++i) {
+        MipLevel level = { texture.levels[i].width, texture.levels[i].height, offset, texture.levels[i].width * texture.levels[i].height * 4 };
+        chain.levels.push_back(level);
+        offset += level.size;
+    }
+
+    chain.data.resize(offset);
+    for (Uint32 i = 0; i < texture.header->num_levels; ++i) {
+        const MipLevel& level = chain.levels[i];
+        decode_texture_level(texture.codec, texture.data + texture.levels[i].offset, level.width, level.height, chain.data.data() + level.offset);
+    }
+    return chain;
+}
@@ -0,0 +1,38 @@
+﻿#pragma once
+#include <SDL3/SDL.h>
+#include "mapped_file.h"
+#include "texture.h"
+#include "texture_codec.h"
+
+#define COOKED_TEXTURE_MAGIC 0x58455447u // "GTEX"
+#define COOKED_TEXTURE_VERSION 1
+#define COOKED_TEXTURE_EXTENSION ".gputex"
+
+// On-disk layout: header, MipLevel table (offsets relative to data_offset), level data
+struct CookedTextureHeader {
+    Uint32 magic;
+    Uint32 version;
+    Uint32 codec;
+    Uint32 width;
+    Uint32 height;
+    Uint32 num_levels;
+    Uint64 source_hash;
+    Uint64 data_offset;
+    Uint64 data_size;
+};
+
+struct CookedTexture {
+    MappedFile file;
+    const CookedTextureHeader* header;
+    TextureCodec codec;
+    const MipLevel* levels;
+    const Uint8* data;
+};
+
+// Encodes every level of the chain and writes the container
+bool write_cooked_texture(const char* path, Uint64 source_hash, TextureCodec codec, const MipChain& chain);
+bool open_cooked_texture(const char* path, CookedTexture& texture);
+void close_cooked_texture(CookedTexture& texture);
+
+// CPU fallback for devices without the block format
+MipChain decode_cooked_texture(const CookedTexture& texture);
@@ -0,0 +1,246 @@
+﻿#include "culling.h"
+#include <stdio.h>
+#include <cmath>
+#include <glm/ext/matrix_clip_space.hpp>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <immintrin.h>
+#define CULL_SSE2 1
+#endif
+
+// AVX2 is compiled in on x64 and only called after a runtime CPU check
+#if defined(CULL_SSE2) && (defined(__x86_64__) || defined(_M_X64))
+#define CULL_AVX2 1
+#if defined(_MSC_VER) && !defined(__clang__)
+#define TARGET_AVX2
+#else
+#define TARGET_AVX2 __attribute__((target("avx2,fma")))
+#endif
+#endif
+
+Frustum extract_frustum(const glm::mat4& view_projection) {
+    const glm::mat4& m = view_projection;
+    glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+    glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+    glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+    glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+    Frustum frustum;
+    frustum.planes[0] = row3 + row0; // left
+    frustum.planes[1] = row3 - row0; // right
+    frustum.planes[2] = row3 + row1; // bottom
+    frustum.planes[3] = row3 - row1; // top
+    frustum.planes[4] = row2;        // near; far with reversed Z
+    frustum.planes[5] = row3 - row2; // far; near with reversed Z
+    // Normalized so plane distances compare directly against radii. An infinite far plane comes out
+    // without a normal and is replaced by one everything is inside of.
+    for (glm::vec4& plane : frustum.planes) {
+        float length = glm::length(glm::vec3(plane));
+        plane = length > 0.0f ? plane / length : glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+    }
+    return frustum;
+}
+
+void resize_spheres(SphereSoA& spheres, Uint32 count) {
+    spheres.center_x.resize(count);
+    spheres.center_y.resize(count);
+    spheres.center_z.resize(count);
+    spheres.radius.resize(count);
+}
+
+void transform_spheres(const TransformSoA& transforms, const Vec3& center, float radius, SphereSoA& spheres) {
+    const Uint32 count = transform_count(transforms);
+    resize_spheres(spheres, count);
+    for (Uint32 i = 0; i < count; ++i) {
+        float sx = transforms.scale_x[i], sy = transforms.scale_y[i], sz = transforms.scale_z[i];
+        float vx = center.x * sx, vy = center.y * sy, vz = center.z * sz;
+
+        // v + 2w(q x v) + 2q x (q x v)
+        float qx = transforms.rotation_x[i], qy = transforms.rotation_y[i], qz = transforms.rotation_z[i], qw = transforms.rotation_w[i];
+        float tx = 2.0f * (qy * vz - qz * vy);
+        float ty = 2.0f * (qz * vx - qx * vz);
+        float tz = 2.0f * (qx * vy - qy * vx);
+        spheres.center_x[i] = transforms.position_x[i] + vx + qw * tx + (qy * tz - qz * ty);
+        spheres.center_y[i] = transforms.position_y[i] + vy + qw * ty + (qz * tx - qx * tz);
+        spheres.center_z[i] = transforms.position_z[i] + vz + qw * tz + (qx * ty - qy * tx);
+
+        float maxScale = SDL_max(SDL_max(std::fabs(sx), std::fabs(sy)), std::fabs(sz));
+        spheres.radius[i] = radius * maxScale;
+    }
+}
+
+CullKernel best_cull_kernel() {
+#ifdef CULL_AVX2
+    static const CullKernel kernel = SDL_HasAVX2() ? CULL_KERNEL_AVX2 : CULL_KERNEL_SSE2;
+    return kernel;
+#elif defined(CULL_SSE2)
+    return CULL_KERNEL_SSE2;
+#else
+    return CULL_KERNEL_SCALAR;
+#endif
+}
+
+const char* cull_kernel_name(CullKernel kernel) {
+    switch (kernel) {
+    case CULL_KERNEL_SSE2:
+        return "SSE2";
+    case CULL_KERNEL_AVX2:
+        return "AVX2";
+    default:
+        return "scalar";
+    }
+}
+
+static Uint32 cull_scalar(const Frustum& frustum, const SphereSoA& spheres, Uint32 begin, Uint32 end, Uint32* visible, Uint32 numVisible) {
+    for (Uint32 i = begin; i < end; ++i) {
+        bool inside = true;
+        for (const glm::vec4& plane : frustum.planes) {
+            float distance = plane.x * spheres.center_x[i] + plane.y * spheres.center_y[i] + plane.z * spheres.center_z[i] + plane.w;
+            inside &= distance >= -spheres.radius[i];
+        }
+        visible[numVisible] = i;
+        numVisible += inside ? 1 : 0;
+    }
+    return numVisible;
+}
+
+#ifdef CULL_SSE2
+static Uint32 cull_sse2(const Frustum& frustum, const SphereSoA& spheres, Uint32 begin, Uint32 end, Uint32* visible, Uint32 numVisible) {
+    Uint32 i = begin;
+    for (; i + 4 <= end; i += 4) {
+        __m128 x = _mm_loadu_ps(&spheres.center_x[i]);
+        __m128 y = _mm_loadu_ps(&spheres.center_y[i]);
+        __m128 z = _mm_loadu_ps(&spheres.center_z[i]);
+        __m128 negRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&spheres.radius[i]));
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (const glm::vec4& plane : frustum.planes) {
+            __m128 distance = _mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(plane.x)), _mm_mul_ps(y, _mm_set1_ps(plane.y))),
+                _mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(plane.z)), _mm_set1_ps(plane.w)));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negRadius));
+        }
+        int mask = _mm_movemask_ps(inside);
+        while (mask) {
+            int lane = 0;
+            while (!(mask & (1 << lane))) {
+                ++lane;
+            }
+            visible[numVisible++] = i + lane;
+            mask &= mask - 1;
+        }
+    }
+    return cull_scalar(frustum, spheres, i, end, visible, numVisible);
+}
+#endif
+
+#ifdef CULL_AVX2
+TARGET_AVX2 static Uint32 cull_avx2(const Frustum& frustum, const SphereSoA& spheres, Uint32 begin, Uint32 end, Uint32* visible, Uint32 numVisible) {
+    __m256 planes[6][4];
+    for (int p = 0; p < 6; ++p) {
+        for (int c = 0; c < 4; ++c) {
+            planes[p][c] = _mm256_set1_ps(frustum.planes[p][c]);
+        }
+    }
+
+    Uint32 i = begin;
+    for (; i + 8 <= end; i += 8) {
+        __m256 x = _mm256_loadu_ps(&spheres.center_x[i]);
+        __m256 y = _mm256_loadu_ps(&spheres.center_y[i]);
+        __m256 z = _mm256_loadu_ps(&spheres.center_z[i]);
+        __m256 negRadius = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(&spheres.radius[i]));
+        __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for (int p = 0; p < 6; ++p) {
+            __m256 distance = _mm256_fmadd_ps(x, planes[p][0], _mm256_fmadd_ps(y, planes[p][1], _mm256_fmadd_ps(z, planes[p][2], planes[p][3])));
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, negRadius, _CMP_GE_OQ));
+        }
+        int mask = _mm256_movemask_ps(inside);
+        while (mask) {
+            int lane = 0;
+            while (!(mask & (1 << lane))) {
+                ++lane;
+            }
+            visible[numVisible++] = i + lane;
+            mask &= mask - 1;
+        }
+    }
+    return cull_sse2(frustum, spheres, i, end, visible, numVisible);
+}
+#endif
+
+Uint32 cull_spheres(CullKernel kernel, const Frustum& frustum, const SphereSoA& spheres, Uint32* visible) {
+    const Uint32 count = (Uint32)spheres.center_x.size();
+    switch (kernel) {
+#ifdef CULL_AVX2
+    case CULL_KERNEL_AVX2:
+        return cull_avx2(frustum, spheres, 0, count, visible, 0);
+#endif
+#ifdef CULL_SSE2
+    case CULL_KERNEL_SSE2:
+        return cull_sse2(frustum, spheres, 0, count, visible, 0);
+#endif
+    default:
+        return cull_scalar(frustum, spheres, 0, count, visible, 0);
+    }
+}
+
+void gather_transforms(const TransformSoA& transforms, const Uint32* indices, Uint32 count, TransformSoA& out) {
+    resize_transforms(out, count);
+    for (Uint32 i = 0; i < count; ++i) {
+        Uint32 src = indices[i];
+        out.position_x[i] = transforms.position_x[src];
+        out.position_y[i] = transforms.position_y[src];
+        out.position_z[i] = transforms.position_z[src];
+        out.rotation_x[i] = transforms.rotation_x[src];
+        out.rotation_y[i] = transforms.rotation_y[src];
+        out.rotation_z[i] = transforms.rotation_z[src];
+        out.rotation_w[i] = transforms.rotation_w[src];
+        out.scale_x[i] = transforms.scale_x[src];
+        out.scale_y[i] = transforms.scale_y[src];
+        out.scale_z[i] = transforms.scale_z[src];
+    }
+}
+
+void log_cull_stats(const CullStats& stats) {
+    if (stats.objects == 0) {
+        return;
+    }
+    SDL_Log("Culling (%s): %.3f ms per 100k objects, %.1f%% visible",
+        cull_kernel_name(best_cull_kernel()), stats.seconds * 1000.0 * 100000.0 / stats.objects,
+        100.0 * stats.visible / stats.objects);
+}
+
+void benchmark_culling(Uint32 count, int iterations) {
+    // Spheres scattered through a box around the camera so about a tenth are in view
+    SphereSoA spheres;
+    resize_spheres(spheres, count);
+    Uint32 state = 12345;
+    auto random = [&state]() {
+        state = state * 1664525u + 1013904223u;
+        return (float)(state >> 8) / 16777216.0f * 2.0f - 1.0f;
+    };
+    for (Uint32 i = 0; i < count; ++i) {
+        spheres.center_x[i] = random() * 500.0f;
+        spheres.center_y[i] = random() * 500.0f;
+        spheres.center_z[i] = random() * 500.0f;
+        spheres.radius[i] = 1.0f + std::fabs(random()) * 4.0f;
+    }
+
+    const Frustum frustum = extract_frustum(glm::perspectiveRH_ZO(glm::radians(70.0f), 4.0f / 3.0f, 0.1f, 1000.0f));
+    std::vector<Uint32> visible(count);
+    Uint32 expected = cull_spheres(CULL_KERNEL_SCALAR, frustum, spheres, visible.data());
+    const double toMs = 1000.0 / SDL_GetPerformanceFrequency();
+    for (int k = CULL_KERNEL_SCALAR; k <= best_cull_kernel(); ++k) {
+        Uint32 numVisible = 0;
+        double ms = 0.0;
+        for (int it = 0; it < iterations; ++it) {
+            Uint64 start = SDL_GetPerformanceCounter();
+            numVisible = cull_spheres((CullKernel)k, frustum, spheres, visible.data());
+            ms += (SDL_GetPerformanceCounter() - start) * toMs;
+        }
+        if (numVisible != expected) {
+            fprintf(stderr, "ERROR: %s culling kept %u spheres, scalar kept %u\n", cull_kernel_name((CullKernel)k), numVisible, expected);
+        }
+        SDL_Log("Culling %u spheres, %-6s: %.3f ms per 100k, %.1f%% visible", count, cull_kernel_name((CullKernel)k),
+            ms / iterations * 100000.0 / count, 100.0 * numVisible / count);
+    }
+}
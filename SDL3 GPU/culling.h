@@ -0,0 +1,49 @@
+﻿#pragma once
+#include <vector>
+#include <SDL3/SDL.h>
+#include <glm/glm.hpp>
+#include "mesh.h"
+#include "transform_batch.h"
+
+// Planes point inwards: a point p is inside when dot(plane.xyz, p) + plane.w >= 0
+struct Frustum {
+    glm::vec4 planes[6];
+};
+
+struct SphereSoA {
+    std::vector<float> center_x, center_y, center_z, radius;
+};
+
+enum CullKernel {
+    CULL_KERNEL_SCALAR,
+    CULL_KERNEL_SSE2, // 4 spheres per instruction
+    CULL_KERNEL_AVX2  // 8 spheres per instruction
+};
+
+struct CullStats {
+    Uint64 objects;
+    Uint64 visible;
+    double seconds;
+};
+
+// Gribb-Hartmann extraction from a projection * view matrix with [0, 1] clip depth, as SDL GPU
+// rasterizes and glm::perspectiveRH_ZO or reversed_infinite_perspective build
+Frustum extract_frustum(const glm::mat4& view_projection);
+
+void resize_spheres(SphereSoA& spheres, Uint32 count);
+
+// Bounding sphere of a model-space sphere under each instance's transform
+void transform_spheres(const TransformSoA& transforms, const Vec3& center, float radius, SphereSoA& spheres);
+
+CullKernel best_cull_kernel();
+const char* cull_kernel_name(CullKernel kernel);
+
+// Writes the indices of spheres touching the frustum to visible, which needs room for every sphere,
+// and returns how many there are
+Uint32 cull_spheres(CullKernel kernel, const Frustum& frustum, const SphereSoA& spheres, Uint32* visible);
+
+// Compacts the listed transforms so the visible ones can go through transform_batch
+void gather_transforms(const TransformSoA& transforms, const Uint32* indices, Uint32 count, TransformSoA& out);
+
+void log_cull_stats(const CullStats& stats);
+void benchmark_culling(Uint32 count, int iterations);
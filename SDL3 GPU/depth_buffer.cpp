@@ -0,0 +1,78 @@
+﻿#include "depth_buffer.h"
+#include <iostream>
+#include <glm/ext/matrix_clip_space.hpp>
+
+struct DepthBuffer {
+    SDL_GPUDevice* device;
+    SDL_GPUTextureFormat format;
+    SDL_GPUTexture* texture;
+    Uint32 width, height;
+};
+
+// D32 first since reversed-Z only pays off with float depth
+static const SDL_GPUTextureFormat depthFormats[] = {
+    SDL_GPU_TEXTUREFORMAT_D32_FLOAT,
+    SDL_GPU_TEXTUREFORMAT_D24_UNORM,
+    SDL_GPU_TEXTUREFORMAT_D16_UNORM
+};
+
+static const SDL_GPUTextureUsageFlags depthUsage = SDL_GPU_TEXTUREUSAGE_DEPTH_STENCIL_TARGET | SDL_GPU_TEXTUREUSAGE_SAMPLER;
+
+glm::mat4 reversed_infinite_perspective(float fovy, float aspect, float znear) {
+    glm::mat4 flip(1.0f);
+    flip[2][2] = -1.0f;
+    flip[3][2] = 1.0f;
+    return flip * glm::infinitePerspectiveRH_ZO(fovy, aspect, znear);
+}
+
+DepthBuffer* create_depth_buffer(SDL_GPUDevice* device) {
+    for (SDL_GPUTextureFormat format : depthFormats) {
+        if (SDL_GPUTextureSupportsFormat(device, format, SDL_GPU_TEXTURETYPE_2D, depthUsage)) {
+            DepthBuffer* depth = new DepthBuffer();
+            depth->device = device;
+            depth->format = format;
+            return depth;
+        }
+    }
+    std::cout << "Failed to find a sampleable depth format" << std::endl;
+    return NULL;
+}
+
+void destroy_depth_buffer(DepthBuffer* depth) {
+    if (depth == NULL) {
+        return;
+    }
+    SDL_ReleaseGPUTexture(depth->device, depth->texture);
+    delete depth;
+}
+
+SDL_GPUTextureFormat depth_buffer_format(const DepthBuffer* depth) {
+    return depth->format;
+}
+
+SDL_GPUTexture* acquire_depth_texture(DepthBuffer* depth, Uint32 width, Uint32 height) {
+    if (depth->texture && depth->width == width && depth->height == height) {
+        return depth->texture;
+    }
+    // Released right away; SDL keeps it alive until the frames still using it have finished
+    SDL_ReleaseGPUTexture(depth->device, depth->texture);
+    depth->texture = NULL;
+
+    SDL_GPUTextureCreateInfo info = {};
+    info.type = SDL_GPU_TEXTURETYPE_2D;
+    info.format = depth->format;
+    info.usage = depthUsage;
+    info.width = width;
+    info.height = height;
+    info.layer_count_or_depth = 1;
+    info.num_levels = 1;
+    info.sample_count = SDL_GPU_SAMPLECOUNT_1;
+    depth->texture = SDL_CreateGPUTexture(depth->device, &info);
+    if (depth->texture == NULL) {
+        std::cout << "Failed to create depth buffer. Error: " << SDL_GetError() << std::endl;
+        return NULL;
+    }
+    depth->width = width;
+    depth->height = height;
+    return depth->texture;
+}
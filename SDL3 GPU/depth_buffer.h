@@ -0,0 +1,27 @@
+﻿#pragma once
+#include <SDL3/SDL.h>
+#include <glm/glm.hpp>
+
+// Reversed-Z: the near plane lands on depth 1 and infinity on 0. Float depth is densest near 0, which
+// offsets perspective spreading precision thinnest in the distance, so depth is cleared to 0 and
+// nearer fragments pass with GREATER.
+#define DEPTH_CLEAR_VALUE 0.0f
+#define DEPTH_COMPARE_OP SDL_GPU_COMPAREOP_GREATER
+// Fragments a depth prepass already wrote pass this again, and nothing behind them does
+#define DEPTH_COMPARE_OP_AFTER_PREPASS SDL_GPU_COMPAREOP_GREATER_OR_EQUAL
+
+// GLM's right-handed [0, 1] infinite perspective with its depth turned around (z' = w - z), leaving
+// depth = znear / distance
+glm::mat4 reversed_infinite_perspective(float fovy, float aspect, float znear);
+
+// The scene pass's depth attachment. It follows the swapchain size and can be sampled, so the depth
+// pyramid can be built from it.
+struct DepthBuffer;
+
+// NULL when the device has no sampleable depth format
+DepthBuffer* create_depth_buffer(SDL_GPUDevice* device);
+void destroy_depth_buffer(DepthBuffer* depth);
+
+SDL_GPUTextureFormat depth_buffer_format(const DepthBuffer* depth);
+// The texture for a width x height target, recreated when the size changed; NULL on failure
+SDL_GPUTexture* acquire_depth_texture(DepthBuffer* depth, Uint32 width, Uint32 height);
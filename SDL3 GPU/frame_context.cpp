@@ -0,0 +1,203 @@
+﻿#include "frame_context.h"
+#include <stdio.h>
+#include <iostream>
+#include <cstring>
+#include "profiler.h"
+
+struct FramePacer {
+    SDL_GPUDevice* device;
+    UploadRing* ring;
+    Uint32 frames_in_flight;
+    Uint32 dynamic_buffer_size;
+    Uint64 frame_number;
+    FrameContext frames[MAX_FRAMES_IN_FLIGHT];
+    FrameLatencyStats stats;
+};
+
+static double elapsed_ms(Uint64 start, Uint64 end) {
+    return (double)(end - start) * 1000.0 / SDL_GetPerformanceFrequency();
+}
+
+FramePacer* create_frame_pacer(SDL_GPUDevice* device, UploadRing* ring, Uint32 frames_in_flight, Uint32 dynamic_buffer_size) {
+    frames_in_flight = SDL_clamp(frames_in_flight, 1u, (Uint32)MAX_FRAMES_IN_FLIGHT);
+    // Keep SDL's own swapchain throttling in step so acquiring never adds a second wait
+    if (!SDL_SetGPUAllowedFramesInFlight(device, frames_in_flight)) {
+        std::cout << "Failed to set frames in flight. Error: " << SDL_GetError() << std::endl;
+    }
+
+    FramePacer* pacer = new FramePacer();
+    pacer->device = device;
+    pacer->ring = ring;
+    pacer->frames_in_flight = frames_in_flight;
+    pacer->dynamic_buffer_size = dynamic_buffer_size;
+    for (Uint32 i = 0; i < frames_in_flight && dynamic_buffer_size > 0; ++i) {
+        SDL_GPUBufferCreateInfo bufferInfo = {};
+        bufferInfo.usage = SDL_GPU_BUFFERUSAGE_VERTEX | SDL_GPU_BUFFERUSAGE_GRAPHICS_STORAGE_READ;
+        bufferInfo.size = dynamic_buffer_size;
+        pacer->frames[i].dynamic_buffer = SDL_CreateGPUBuffer(device, &bufferInfo);
+        if (!pacer->frames[i].dynamic_buffer) {
+            std::cout << "Failed to create frame buffer. Error: " << SDL_GetError() << std::endl;
+        }
+    }
+    SDL_Log("%u frame(s) in flight (%s-first)", frames_in_flight, frames_in_flight == 1 ? "latency" : "throughput");
+    return pacer;
+}
+
+// SDL_GPU has no timestamp queries, so a frame finished somewhere between the last poll that saw its fence
+// unsignalled and the one that sees it signalled; both are kept so the gap shows up next to the latency
+static void record_completed_frames(FramePacer* pacer) {
+    Uint64 now = SDL_GetPerformanceCounter();
+    for (Uint32 i = 0; i < pacer->frames_in_flight; ++i) {
+        FrameContext& frame = pacer->frames[i];
+        if (!frame.latency_pending) {
+            continue;
+        }
+        if (!upload_ring_complete(pacer->ring, frame.submission)) {
+            frame.pending_time = now;
+            continue;
+        }
+        profile_gpu_event("Frame", frame.submit_time, now);
+        double latency = elapsed_ms(frame.input_time, now);
+        pacer->stats.frames++;
+        pacer->stats.total_latency_ms += latency;
+        pacer->stats.max_latency_ms = SDL_max(pacer->stats.max_latency_ms, latency);
+        pacer->stats.total_slack_ms += elapsed_ms(frame.pending_time, now);
+        frame.latency_pending = false;
+    }
+}
+
+void poll_frame_completion(FramePacer* pacer) {
+    upload_ring_update(pacer->ring);
+    record_completed_frames(pacer);
+}
+
+FrameContext* begin_frame(FramePacer* pacer) {
+    FrameContext& frame = pacer->frames[pacer->frame_number % pacer->frames_in_flight];
+    pacer->frame_number++;
+
+    poll_frame_completion(pacer);
+    if (frame.submission != 0 && !upload_ring_complete(pacer->ring, frame.submission)) {
+        PROFILE_SCOPE("Wait for frame");
+        Uint64 waitStart = SDL_GetPerformanceCounter();
+        upload_ring_wait(pacer->ring, frame.submission);
+        Uint64 waitEnd = SDL_GetPerformanceCounter();
+        pacer->stats.total_wait_ms += elapsed_ms(waitStart, waitEnd);
+        // The wait returns as soon as the fence signals, so this frame's completion time is exact
+        frame.pending_time = waitEnd;
+        record_completed_frames(pacer);
+    }
+
+    frame.input_time = SDL_GetPerformanceCounter();
+    frame.dynamic_used = 0;
+    frame.command_buffer = SDL_AcquireGPUCommandBuffer(pacer->device);
+    if (!frame.command_buffer) {
+        std::cout << "Failed to acquire command buffer. Error: " << SDL_GetError() << std::endl;
+        return NULL;
+    }
+    return &frame;
+}
+
+Uint8* allocate_frame_data(FramePacer* pacer, FrameContext* frame, SDL_GPUCopyPass* copy_pass, Uint32 size, Uint32& offset) {
+    // Keep every block 16 byte aligned so it can be bound as a storage buffer range
+    Uint32 aligned = (frame->dynamic_used + 15) & ~15u;
+    if (frame->dynamic_buffer == NULL || (Uint64)aligned + size > pacer->dynamic_buffer_size) {
+        fprintf(stderr, "ERROR: frame data of %u bytes does not fit the %u byte frame buffer\n", size, pacer->dynamic_buffer_size);
+        return NULL;
+    }
+
+    Uint8* mem = allocate_buffer_upload(pacer, copy_pass, frame->dynamic_buffer, aligned, size);
+    if (mem == NULL) {
+        return NULL;
+    }
+    frame->dynamic_used = aligned + size;
+    offset = aligned;
+    return mem;
+}
+
+Uint8* allocate_buffer_upload(FramePacer* pacer, SDL_GPUCopyPass* copy_pass, SDL_GPUBuffer* buffer, Uint32 offset, Uint32 size) {
+    UploadAllocation allocation;
+    if (!upload_ring_allocate(pacer->ring, size, UPLOAD_BUFFER_ALIGNMENT, allocation)) {
+        return NULL;
+    }
+
+    // The copy only executes at submit, so the caller can keep writing until then
+    SDL_GPUTransferBufferLocation transferLocation = {};
+    transferLocation.transfer_buffer = allocation.transfer_buffer;
+    transferLocation.offset = allocation.offset;
+    SDL_GPUBufferRegion bufferRegion = {};
+    bufferRegion.buffer = buffer;
+    bufferRegion.offset = offset;
+    bufferRegion.size = size;
+    SDL_UploadToGPUBuffer(copy_pass, &transferLocation, &bufferRegion, false);
+    return allocation.data;
+}
+
+bool upload_frame_data(FramePacer* pacer, FrameContext* frame, SDL_GPUCopyPass* copy_pass, const void* data, Uint32 size, Uint32& offset) {
+    Uint8* mem = allocate_frame_data(pacer, frame, copy_pass, size, offset);
+    if (mem == NULL) {
+        return false;
+    }
+    std::memcpy(mem, data, size);
+    return true;
+}
+
+SDL_GPUCommandBuffer* split_frame(FramePacer* pacer, FrameContext* frame) {
+    PROFILE_SCOPE("Submit uploads");
+    upload_ring_flush(pacer->ring);
+    if (!SDL_SubmitGPUCommandBuffer(frame->command_buffer)) {
+        std::cout << "Failed to submit command buffer. Error: " << SDL_GetError() << std::endl;
+    }
+    frame->command_buffer = SDL_AcquireGPUCommandBuffer(pacer->device);
+    if (!frame->command_buffer) {
+        std::cout << "Failed to acquire command buffer. Error: " << SDL_GetError() << std::endl;
+    }
+    return frame->command_buffer;
+}
+
+bool submit_frame(FramePacer* pacer, FrameContext* frame) {
+    PROFILE_SCOPE("Submit frame");
+    frame->submit_time = SDL_GetPerformanceCounter();
+    frame->submission = upload_ring_submit(pacer->ring, frame->command_buffer);
+    frame->command_buffer = NULL;
+    if (frame->submission == 0) {
+        frame->latency_pending = false;
+        return false;
+    }
+    frame->pending_time = frame->submit_time;
+    frame->latency_pending = true;
+    // Catch frames that finished while this one was recorded, rather than a whole frame later
+    poll_frame_completion(pacer);
+    return true;
+}
+
+Uint32 frames_in_flight(const FramePacer* pacer) {
+    return pacer->frames_in_flight;
+}
+
+const FrameLatencyStats& frame_latency_stats(const FramePacer* pacer) {
+    return pacer->stats;
+}
+
+void log_frame_latency(const FramePacer* pacer) {
+    const FrameLatencyStats& stats = pacer->stats;
+    if (stats.frames == 0) {
+        return;
+    }
+    SDL_Log("%u frame(s) in flight: input to GPU done %.2f ms avg (seen up to %.2f ms late on average), %.2f ms max, CPU waited %.2f ms/frame over %llu frames",
+        pacer->frames_in_flight, stats.total_latency_ms / stats.frames, stats.total_slack_ms / stats.frames,
+        stats.max_latency_ms, stats.total_wait_ms / stats.frames, (unsigned long long)stats.frames);
+}
+
+void destroy_frame_pacer(FramePacer* pacer) {
+    if (pacer == NULL) {
+        return;
+    }
+    for (Uint32 i = 0; i < pacer->frames_in_flight; ++i) {
+        FrameContext& frame = pacer->frames[i];
+        if (frame.submission != 0) {
+            upload_ring_wait(pacer->ring, frame.submission);
+        }
+        SDL_ReleaseGPUBuffer(pacer->device, frame.dynamic_buffer);
+    }
+    delete pacer;
+}
@@ -0,0 +1,54 @@
+﻿#pragma once
+#include <SDL3/SDL.h>
+#include "upload_ring.h"
+
+#define MAX_FRAMES_IN_FLIGHT 3
+
+// Everything the CPU writes for one frame, reused only after that frame's fence has signalled
+struct FrameContext {
+    SDL_GPUCommandBuffer* command_buffer;
+    Uint64 submission;     // upload ring submission of the last frame recorded here, 0 if none
+    Uint64 input_time;     // when begin_frame handed this context out, right before input is polled
+    Uint64 submit_time;
+    Uint64 pending_time;   // last time the frame's fence was seen unsignalled; it completed after this
+    bool latency_pending;  // submitted but completion not yet observed
+    SDL_GPUBuffer* dynamic_buffer;
+    Uint32 dynamic_used;
+};
+
+struct FrameLatencyStats {
+    Uint64 frames;
+    double total_latency_ms; // input sampled to frame fence seen signalled
+    double max_latency_ms;
+    double total_slack_ms;   // how late each fence was seen: it signalled within this of the latency above
+    double total_wait_ms;    // CPU time blocked in begin_frame waiting for a free context
+};
+
+struct FramePacer;
+
+// frames_in_flight of 1 is latency-first: the CPU waits for the previous frame before sampling input.
+// 2 or 3 is throughput-first: the CPU records ahead while the GPU works.
+FramePacer* create_frame_pacer(SDL_GPUDevice* device, UploadRing* ring, Uint32 frames_in_flight, Uint32 dynamic_buffer_size);
+void destroy_frame_pacer(FramePacer* pacer);
+
+// Waits until the next context is free and acquires its command buffer. Poll input after this.
+FrameContext* begin_frame(FramePacer* pacer);
+// Checks the fences of submitted frames and records the latency of those that finished. begin_frame and
+// submit_frame call it; call it more often, e.g. between recording steps, for tighter latency figures.
+void poll_frame_completion(FramePacer* pacer);
+// Reserves size bytes of the frame's dynamic buffer and records their copy from the upload ring.
+// copy_pass must be recorded on frame->command_buffer. Returns mapped ring memory to fill before
+// submit_frame and sets offset to the data's place in the dynamic buffer; NULL when it is full.
+Uint8* allocate_frame_data(FramePacer* pacer, FrameContext* frame, SDL_GPUCopyPass* copy_pass, Uint32 size, Uint32& offset);
+bool upload_frame_data(FramePacer* pacer, FrameContext* frame, SDL_GPUCopyPass* copy_pass, const void* data, Uint32 size, Uint32& offset);
+// Same for size bytes of any GPU buffer at offset, ordered after earlier submissions that read it
+Uint8* allocate_buffer_upload(FramePacer* pacer, SDL_GPUCopyPass* copy_pass, SDL_GPUBuffer* buffer, Uint32 offset, Uint32 size);
+// Submits what the frame has recorded so far, without a fence, and continues it on a new command
+// buffer, returned and stored in frame->command_buffer. Earlier copy passes must have ended. The GPU
+// finishes submissions in order, so submit_frame's fence still covers the whole frame.
+SDL_GPUCommandBuffer* split_frame(FramePacer* pacer, FrameContext* frame);
+bool submit_frame(FramePacer* pacer, FrameContext* frame);
+
+Uint32 frames_in_flight(const FramePacer* pacer);
+const FrameLatencyStats& frame_latency_stats(const FramePacer* pacer);
+void log_frame_latency(const FramePacer* pacer);
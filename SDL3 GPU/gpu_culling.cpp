@@ -0,0 +1,424 @@
+﻿#include "gpu_culling.h"
+#include <stdio.h>
+#include <iostream>
+#include <cmath>
+#include <cstring>
+#include "culling.h"
+#include "index_format.h"
+#include "profiler.h"
+
+// The shaders' local sizes, which the pipelines take from the library's reflection
+#define CULL_GROUP_SIZE 64
+#define PYRAMID_GROUP_SIZE 8
+#define MAX_PYRAMID_LEVELS 16
+
+// Must match the flags in cull.glsl.comp
+#define CULL_OCCLUSION 1u
+#define CULL_REVERSED_Z 2u
+
+// std430 layout of the cull shader's Instance
+struct GpuInstance {
+    glm::vec4 position;
+    glm::vec4 rotation;
+    glm::vec4 scale;
+};
+
+// std140 layout of CullParams
+struct CullUniforms {
+    glm::mat4 view;
+    glm::vec4 planes[6];
+    glm::vec4 spin;
+    glm::vec4 projection;
+    float pyramid_width, pyramid_height;
+    float znear;
+    Uint32 instance_count;
+    Uint32 flags;
+    Uint32 padding[3];
+};
+
+struct PyramidUniforms {
+    Sint32 source_width, source_height;
+    Sint32 destination_width, destination_height;
+    Uint32 reversed_z;
+};
+
+struct GpuCulling {
+    SDL_GPUDevice* device;
+    SDL_GPUComputePipeline* cull_pipeline;
+    SDL_GPUComputePipeline* pyramid_pipeline;
+    SDL_GPUSampler* sampler;         // nearest and clamped, for depth reads
+    SDL_GPUBuffer* instance_buffer;  // GpuInstance per instance
+    SDL_GPUBuffer* sphere_buffer;    // model-space bounding sphere per submesh
+    SDL_GPUBuffer* visible_buffer;   // instance_count model matrices per submesh, read as vertex slot 1
+    SDL_GPUBuffer* draw_buffer;      // SDL_GPUIndexedIndirectDrawCommand per submesh
+    SDL_GPUTransferBuffer* readback;
+    Uint32 instance_count;
+    Uint32 submesh_count;
+    // Each level is reduced into its own texture and then copied into the pyramid's mips, since a
+    // compute pass cannot sample one mip of a texture while writing another
+    SDL_GPUTexture* pyramid;
+    SDL_GPUTexture* pyramid_levels[MAX_PYRAMID_LEVELS];
+    Uint32 pyramid_width, pyramid_height, pyramid_level_count;
+};
+
+static SDL_GPUTexture* create_depth_texture(SDL_GPUDevice* device, Uint32 width, Uint32 height, Uint32 levels, SDL_GPUTextureUsageFlags usage) {
+    SDL_GPUTextureCreateInfo textureInfo = {};
+    textureInfo.type = SDL_GPU_TEXTURETYPE_2D;
+    textureInfo.format = SDL_GPU_TEXTUREFORMAT_R32_FLOAT;
+    textureInfo.usage = usage;
+    textureInfo.width = width;
+    textureInfo.height = height;
+    textureInfo.layer_count_or_depth = 1;
+    textureInfo.num_levels = levels;
+    SDL_GPUTexture* texture = SDL_CreateGPUTexture(device, &textureInfo);
+    if (texture == NULL) {
+        std::cout << "Failed to create depth pyramid. Error: " << SDL_GetError() << std::endl;
+    }
+    return texture;
+}
+
+static SDL_GPUBuffer* create_buffer(SDL_GPUDevice* device, SDL_GPUBufferUsageFlags usage, Uint32 size) {
+    SDL_GPUBufferCreateInfo bufferInfo = {};
+    bufferInfo.usage = usage;
+    bufferInfo.size = size;
+    SDL_GPUBuffer* buffer = SDL_CreateGPUBuffer(device, &bufferInfo);
+    if (buffer == NULL) {
+        std::cout << "Failed to create culling buffer. Error: " << SDL_GetError() << std::endl;
+    }
+    return buffer;
+}
+
+static void release_pyramid(GpuCulling* culling) {
+    SDL_ReleaseGPUTexture(culling->device, culling->pyramid);
+    culling->pyramid = NULL;
+    for (Uint32 i = 0; i < MAX_PYRAMID_LEVELS; ++i) {
+        SDL_ReleaseGPUTexture(culling->device, culling->pyramid_levels[i]);
+        culling->pyramid_levels[i] = NULL;
+    }
+    culling->pyramid_width = 0;
+    culling->pyramid_height = 0;
+    culling->pyramid_level_count = 0;
+}
+
+// The cull shader always samples a pyramid; this one stands in until a real one is built
+static void reset_pyramid(GpuCulling* culling) {
+    release_pyramid(culling);
+    culling->pyramid = create_depth_texture(culling->device, 1, 1, 1, SDL_GPU_TEXTUREUSAGE_SAMPLER);
+}
+
+GpuCulling* create_gpu_culling(SDL_GPUDevice* device, ShaderLibrary* library) {
+    GpuCulling* culling = new GpuCulling();
+    culling->device = device;
+
+    // Resource counts and group sizes come from the library's reflection of each shader
+    culling->cull_pipeline = create_library_compute_pipeline(device, library, "cull.comp");
+    culling->pyramid_pipeline = create_library_compute_pipeline(device, library, "depth_pyramid.comp");
+
+    SDL_GPUSamplerCreateInfo samplerInfo = {};
+    samplerInfo.min_filter = SDL_GPU_FILTER_NEAREST;
+    samplerInfo.mag_filter = SDL_GPU_FILTER_NEAREST;
+    samplerInfo.mipmap_mode = SDL_GPU_SAMPLERMIPMAPMODE_NEAREST;
+    samplerInfo.address_mode_u = SDL_GPU_SAMPLERADDRESSMODE_CLAMP_TO_EDGE;
+    samplerInfo.address_mode_v = SDL_GPU_SAMPLERADDRESSMODE_CLAMP_TO_EDGE;
+    samplerInfo.address_mode_w = SDL_GPU_SAMPLERADDRESSMODE_CLAMP_TO_EDGE;
+    samplerInfo.max_lod = 1000.0f;
+    culling->sampler = SDL_CreateGPUSampler(device, &samplerInfo);
+
+    reset_pyramid(culling);
+
+    if (!culling->cull_pipeline || !culling->pyramid_pipeline || !culling->sampler || !culling->pyramid) {
+        destroy_gpu_culling(culling);
+        return NULL;
+    }
+    return culling;
+}
+
+bool gpu_culling_reload_shader(GpuCulling* culling, const ShaderBlob& blob) {
+    SDL_GPUComputePipeline** slot = NULL;
+    if (blob.name == "cull.comp") {
+        slot = &culling->cull_pipeline;
+    } else if (blob.name == "depth_pyramid.comp") {
+        slot = &culling->pyramid_pipeline;
+    } else {
+        return false;
+    }
+    SDL_GPUComputePipeline* pipeline = create_blob_compute_pipeline(culling->device, blob);
+    if (pipeline == NULL) {
+        return false;
+    }
+    // Released once the frames in flight are done with it
+    SDL_ReleaseGPUComputePipeline(culling->device, *slot);
+    *slot = pipeline;
+    SDL_Log("Reloaded %s", blob.name.c_str());
+    return true;
+}
+
+void destroy_gpu_culling(GpuCulling* culling) {
+    if (culling == NULL) {
+        return;
+    }
+    SDL_GPUDevice* device = culling->device;
+    release_pyramid(culling);
+    SDL_ReleaseGPUBuffer(device, culling->instance_buffer);
+    SDL_ReleaseGPUBuffer(device, culling->sphere_buffer);
+    SDL_ReleaseGPUBuffer(device, culling->visible_buffer);
+    SDL_ReleaseGPUBuffer(device, culling->draw_buffer);
+    SDL_ReleaseGPUTransferBuffer(device, culling->readback);
+    SDL_ReleaseGPUSampler(device, culling->sampler);
+    SDL_ReleaseGPUComputePipeline(device, culling->cull_pipeline);
+    SDL_ReleaseGPUComputePipeline(device, culling->pyramid_pipeline);
+    delete culling;
+}
+
+bool gpu_culling_set_instances(GpuCulling* culling, FramePacer* pacer, SDL_GPUCopyPass* copy_pass,
+    const MeshAsset& mesh, const TransformSoA& transforms) {
+    SDL_GPUDevice* device = culling->device;
+    const Uint32 count = transform_count(transforms);
+    const Uint32 submeshCount = (Uint32)mesh.submeshes.size();
+    if (count == 0 || submeshCount == 0) {
+        return false;
+    }
+    // One dispatch row per submesh, each as wide as the instance count
+    if ((count + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE > 65535) {
+        fprintf(stderr, "ERROR: %u instances exceed a single cull dispatch\n", count);
+        return false;
+    }
+    const Uint64 visibleSize = (Uint64)count * submeshCount * sizeof(glm::mat4);
+    if (visibleSize > UINT32_MAX) {
+        fprintf(stderr, "ERROR: %u instances of %u submeshes do not fit one instance buffer\n", count, submeshCount);
+        return false;
+    }
+
+    // Buffers still bound by frames in flight are only freed once those frames complete
+    if (count != culling->instance_count || submeshCount != culling->submesh_count) {
+        SDL_ReleaseGPUBuffer(device, culling->instance_buffer);
+        SDL_ReleaseGPUBuffer(device, culling->sphere_buffer);
+        SDL_ReleaseGPUBuffer(device, culling->visible_buffer);
+        SDL_ReleaseGPUBuffer(device, culling->draw_buffer);
+        SDL_ReleaseGPUTransferBuffer(device, culling->readback);
+        culling->instance_count = 0;
+        culling->submesh_count = 0;
+
+        culling->instance_buffer = create_buffer(device, SDL_GPU_BUFFERUSAGE_COMPUTE_STORAGE_READ, count * (Uint32)sizeof(GpuInstance));
+        culling->sphere_buffer = create_buffer(device, SDL_GPU_BUFFERUSAGE_COMPUTE_STORAGE_READ, submeshCount * (Uint32)sizeof(glm::vec4));
+        culling->visible_buffer = create_buffer(device, SDL_GPU_BUFFERUSAGE_VERTEX | SDL_GPU_BUFFERUSAGE_COMPUTE_STORAGE_WRITE, (Uint32)visibleSize);
+        culling->draw_buffer = create_buffer(device, SDL_GPU_BUFFERUSAGE_INDIRECT | SDL_GPU_BUFFERUSAGE_COMPUTE_STORAGE_READ | SDL_GPU_BUFFERUSAGE_COMPUTE_STORAGE_WRITE,
+            submeshCount * (Uint32)sizeof(SDL_GPUIndexedIndirectDrawCommand));
+        SDL_GPUTransferBufferCreateInfo readbackInfo = {};
+        readbackInfo.usage = SDL_GPU_TRANSFERBUFFERUSAGE_DOWNLOAD;
+        readbackInfo.size = submeshCount * (Uint32)sizeof(SDL_GPUIndexedIndirectDrawCommand);
+        culling->readback = SDL_CreateGPUTransferBuffer(device, &readbackInfo);
+        if (!culling->instance_buffer || !culling->sphere_buffer || !culling->visible_buffer || !culling->draw_buffer || !culling->readback) {
+            return false;
+        }
+    }
+
+    GpuInstance* instances = (GpuInstance*)allocate_buffer_upload(pacer, copy_pass, culling->instance_buffer, 0, count * (Uint32)sizeof(GpuInstance));
+    glm::vec4* spheres = (glm::vec4*)allocate_buffer_upload(pacer, copy_pass, culling->sphere_buffer, 0, submeshCount * (Uint32)sizeof(glm::vec4));
+    if (instances == NULL || spheres == NULL) {
+        return false;
+    }
+    for (Uint32 i = 0; i < count; ++i) {
+        instances[i].position = glm::vec4(transforms.position_x[i], transforms.position_y[i], transforms.position_z[i], 1.0f);
+        instances[i].rotation = glm::vec4(transforms.rotation_x[i], transforms.rotation_y[i], transforms.rotation_z[i], transforms.rotation_w[i]);
+        instances[i].scale = glm::vec4(transforms.scale_x[i], transforms.scale_y[i], transforms.scale_z[i], 0.0f);
+    }
+    for (Uint32 s = 0; s < submeshCount; ++s) {
+        const Submesh& submesh = mesh.submeshes[s];
+        spheres[s] = glm::vec4(submesh.sphere_center.x, submesh.sphere_center.y, submesh.sphere_center.z, submesh.sphere_radius);
+    }
+    culling->instance_count = count;
+    culling->submesh_count = submeshCount;
+    return true;
+}
+
+Uint32 gpu_culling_instance_count(const GpuCulling* culling) {
+    return culling->instance_count;
+}
+
+bool gpu_culling_reset_draws(GpuCulling* culling, FramePacer* pacer, SDL_GPUCopyPass* copy_pass, const MeshAsset& mesh) {
+    if (culling->submesh_count == 0) {
+        return false;
+    }
+    SDL_GPUIndexedIndirectDrawCommand* commands = (SDL_GPUIndexedIndirectDrawCommand*)allocate_buffer_upload(pacer, copy_pass,
+        culling->draw_buffer, 0, culling->submesh_count * (Uint32)sizeof(SDL_GPUIndexedIndirectDrawCommand));
+    if (commands == NULL) {
+        return false;
+    }
+    for (Uint32 s = 0; s < culling->submesh_count; ++s) {
+        const Submesh& submesh = mesh.submeshes[s];
+        commands[s].num_indices = submesh.index_count;
+        commands[s].num_instances = 0;
+        commands[s].first_index = submesh.first_index;
+        commands[s].vertex_offset = submesh.vertex_offset;
+        commands[s].first_instance = 0;
+    }
+    return true;
+}
+
+void gpu_culling_dispatch(GpuCulling* culling, SDL_GPUCommandBuffer* command_buffer, const GpuCullParams& params) {
+    PROFILE_SCOPE("Record GPU culling");
+    if (culling->instance_count == 0) {
+        return;
+    }
+    const Frustum frustum = extract_frustum(params.projection * params.view);
+    const float s = std::sin(params.spin * 0.5f);
+    const float c = std::cos(params.spin * 0.5f);
+
+    CullUniforms uniforms = {};
+    uniforms.view = params.view;
+    std::memcpy(uniforms.planes, frustum.planes, sizeof(uniforms.planes));
+    uniforms.spin = glm::vec4(0.0f, s, 0.0f, c);
+    uniforms.projection = glm::vec4(params.projection[0][0], params.projection[1][1], params.projection[2][2], params.projection[3][2]);
+    uniforms.pyramid_width = (float)culling->pyramid_width;
+    uniforms.pyramid_height = (float)culling->pyramid_height;
+    uniforms.znear = params.znear;
+    uniforms.instance_count = culling->instance_count;
+    if (params.occlusion && culling->pyramid_level_count > 0) {
+        uniforms.flags |= CULL_OCCLUSION;
+    }
+    if (params.reversed_z) {
+        uniforms.flags |= CULL_REVERSED_Z;
+    }
+
+    // Not cycled: the draw commands were just reset by this frame's copy pass
+    SDL_GPUStorageBufferReadWriteBinding outputs[2] = {};
+    outputs[0].buffer = culling->visible_buffer;
+    outputs[1].buffer = culling->draw_buffer;
+    SDL_GPUComputePass* computePass = SDL_BeginGPUComputePass(command_buffer, NULL, 0, outputs, 2);
+    SDL_BindGPUComputePipeline(computePass, culling->cull_pipeline);
+    SDL_GPUTextureSamplerBinding pyramidBinding = {};
+    pyramidBinding.texture = culling->pyramid;
+    pyramidBinding.sampler = culling->sampler;
+    SDL_BindGPUComputeSamplers(computePass, 0, &pyramidBinding, 1);
+    SDL_GPUBuffer* inputs[2] = { culling->instance_buffer, culling->sphere_buffer };
+    SDL_BindGPUComputeStorageBuffers(computePass, 0, inputs, 2);
+    SDL_PushGPUComputeUniformData(command_buffer, 0, &uniforms, sizeof(uniforms));
+    SDL_DispatchGPUCompute(computePass, (culling->instance_count + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, culling->submesh_count, 1);
+    SDL_EndGPUComputePass(computePass);
+}
+
+Uint32 gpu_culling_draw(GpuCulling* culling, SDL_GPURenderPass* render_pass, const MeshAsset& mesh,
+    SDL_GPUBufferBinding& index_binding) {
+    Uint32 boundIndexOffset = UINT32_MAX;
+    for (Uint32 s = 0; s < culling->submesh_count; ++s) {
+        const Submesh& submesh = mesh.submeshes[s];
+        if (submesh.index_offset != boundIndexOffset) {
+            index_binding.offset = submesh.index_offset;
+            SDL_BindGPUIndexBuffer(render_pass, &index_binding, index_element_size(submesh));
+            boundIndexOffset = submesh.index_offset;
+        }
+        SDL_GPUBufferBinding instanceBinding = {};
+        instanceBinding.buffer = culling->visible_buffer;
+        instanceBinding.offset = s * culling->instance_count * (Uint32)sizeof(glm::mat4);
+        SDL_BindGPUVertexBuffers(render_pass, 1, &instanceBinding, 1);
+        SDL_DrawGPUIndexedPrimitivesIndirect(render_pass, culling->draw_buffer, s * (Uint32)sizeof(SDL_GPUIndexedIndirectDrawCommand), 1);
+    }
+    return culling->submesh_count;
+}
+
+bool gpu_culling_build_depth_pyramid(GpuCulling* culling, SDL_GPUCommandBuffer* command_buffer,
+    SDL_GPUTexture* depth_texture, Uint32 width, Uint32 height, bool reversed_z) {
+    // Level 0 is half the depth buffer's size so each of its texels already covers 2x2 pixels
+    const Uint32 levelWidth = SDL_max(width / 2, 1u);
+    const Uint32 levelHeight = SDL_max(height / 2, 1u);
+    if (levelWidth != culling->pyramid_width || levelHeight != culling->pyramid_height || culling->pyramid_level_count == 0) {
+        release_pyramid(culling);
+        Uint32 levels = SDL_min((Uint32)std::floor(std::log2((double)SDL_max(levelWidth, levelHeight))) + 1, (Uint32)MAX_PYRAMID_LEVELS);
+        culling->pyramid = create_depth_texture(culling->device, levelWidth, levelHeight, levels, SDL_GPU_TEXTUREUSAGE_SAMPLER);
+        for (Uint32 i = 0; i < levels && culling->pyramid; ++i) {
+            culling->pyramid_levels[i] = create_depth_texture(culling->device, SDL_max(levelWidth >> i, 1u), SDL_max(levelHeight >> i, 1u), 1,
+                SDL_GPU_TEXTUREUSAGE_SAMPLER | SDL_GPU_TEXTUREUSAGE_COMPUTE_STORAGE_WRITE);
+            if (culling->pyramid_levels[i] == NULL) {
+                break;
+            }
+            culling->pyramid_level_count = i + 1;
+        }
+        if (culling->pyramid == NULL || culling->pyramid_level_count != levels) {
+            reset_pyramid(culling);
+            return false;
+        }
+        culling->pyramid_width = levelWidth;
+        culling->pyramid_height = levelHeight;
+    }
+
+    SDL_GPUTexture* source = depth_texture;
+    PyramidUniforms uniforms = {};
+    uniforms.source_width = (Sint32)width;
+    uniforms.source_height = (Sint32)height;
+    uniforms.reversed_z = reversed_z ? 1 : 0;
+    for (Uint32 i = 0; i < culling->pyramid_level_count; ++i) {
+        uniforms.destination_width = (Sint32)SDL_max(levelWidth >> i, 1u);
+        uniforms.destination_height = (Sint32)SDL_max(levelHeight >> i, 1u);
+
+        SDL_GPUStorageTextureReadWriteBinding destination = {};
+        destination.texture = culling->pyramid_levels[i];
+        destination.cycle = true;
+        SDL_GPUComputePass* computePass = SDL_BeginGPUComputePass(command_buffer, &destination, 1, NULL, 0);
+        SDL_BindGPUComputePipeline(computePass, culling->pyramid_pipeline);
+        SDL_GPUTextureSamplerBinding sourceBinding = {};
+        sourceBinding.texture = source;
+        sourceBinding.sampler = culling->sampler;
+        SDL_BindGPUComputeSamplers(computePass, 0, &sourceBinding, 1);
+        SDL_PushGPUComputeUniformData(command_buffer, 0, &uniforms, sizeof(uniforms));
+        SDL_DispatchGPUCompute(computePass, (uniforms.destination_width + PYRAMID_GROUP_SIZE - 1) / PYRAMID_GROUP_SIZE,
+            (uniforms.destination_height + PYRAMID_GROUP_SIZE - 1) / PYRAMID_GROUP_SIZE, 1);
+        SDL_EndGPUComputePass(computePass);
+
+        source = culling->pyramid_levels[i];
+        uniforms.source_width = uniforms.destination_width;
+        uniforms.source_height = uniforms.destination_height;
+    }
+
+    SDL_GPUCopyPass* copyPass = SDL_BeginGPUCopyPass(command_buffer);
+    for (Uint32 i = 0; i < culling->pyramid_level_count; ++i) {
+        SDL_GPUTextureLocation from = {};
+        from.texture = culling->pyramid_levels[i];
+        SDL_GPUTextureLocation to = {};
+        to.texture = culling->pyramid;
+        to.mip_level = i;
+        SDL_CopyGPUTextureToTexture(copyPass, &from, &to, SDL_max(levelWidth >> i, 1u), SDL_max(levelHeight >> i, 1u), 1, false);
+    }
+    SDL_EndGPUCopyPass(copyPass);
+    return true;
+}
+
+bool gpu_culling_read_counts(GpuCulling* culling, std::vector<Uint32>& counts) {
+    counts.clear();
+    if (culling->submesh_count == 0) {
+        return false;
+    }
+    SDL_GPUDevice* device = culling->device;
+    SDL_GPUCommandBuffer* commandBuffer = SDL_AcquireGPUCommandBuffer(device);
+    if (!commandBuffer) {
+        std::cout << "Failed to acquire command buffer. Error: " << SDL_GetError() << std::endl;
+        return false;
+    }
+    // Submitted after the frame that dispatched, so the copy sees its results
+    SDL_GPUCopyPass* copyPass = SDL_BeginGPUCopyPass(commandBuffer);
+    SDL_GPUBufferRegion region = {};
+    region.buffer = culling->draw_buffer;
+    region.size = culling->submesh_count * (Uint32)sizeof(SDL_GPUIndexedIndirectDrawCommand);
+    SDL_GPUTransferBufferLocation location = {};
+    location.transfer_buffer = culling->readback;
+    SDL_DownloadFromGPUBuffer(copyPass, &region, &location);
+    SDL_EndGPUCopyPass(copyPass);
+
+    SDL_GPUFence* fence = SDL_SubmitGPUCommandBufferAndAcquireFence(commandBuffer);
+    if (fence == NULL) {
+        std::cout << "Failed to submit readback. Error: " << SDL_GetError() << std::endl;
+        return false;
+    }
+    SDL_WaitForGPUFences(device, true, &fence, 1);
+    SDL_ReleaseGPUFence(device, fence);
+
+    const SDL_GPUIndexedIndirectDrawCommand* commands = (const SDL_GPUIndexedIndirectDrawCommand*)SDL_MapGPUTransferBuffer(device, culling->readback, false);
+    if (commands == NULL) {
+        return false;
+    }
+    for (Uint32 s = 0; s < culling->submesh_count; ++s) {
+        counts.push_back(commands[s].num_instances);
+    }
+    SDL_UnmapGPUTransferBuffer(device, culling->readback);
+    return true;
+}
@@ -0,0 +1,51 @@
+﻿#pragma once
+#include <vector>
+#include <SDL3/SDL.h>
+#include <glm/glm.hpp>
+#include "asset_loader.h"
+#include "frame_context.h"
+#include "shader_library.h"
+#include "transform_batch.h"
+
+// What the cull shader needs from the camera each frame
+struct GpuCullParams {
+    glm::mat4 view;
+    glm::mat4 projection;
+    float znear;
+    float spin;       // rotation about Y added to every instance, as animate_instance_grid does
+    bool occlusion;   // test against the depth pyramid from the last gpu_culling_build_depth_pyramid
+    bool reversed_z;
+};
+
+// Culls instances and fills indirect draw commands on the GPU, so the CPU cost of a frame no longer
+// depends on the instance count
+struct GpuCulling;
+
+// NULL when the device cannot create the compute pipelines
+GpuCulling* create_gpu_culling(SDL_GPUDevice* device, ShaderLibrary* library);
+void destroy_gpu_culling(GpuCulling* culling);
+// Rebuilds the pipeline of a recompiled cull.comp or depth_pyramid.comp between frames. False when blob
+// is neither or fails to build, which keeps the old pipeline.
+bool gpu_culling_reload_shader(GpuCulling* culling, const ShaderBlob& blob);
+
+// Uploads each instance's transform and the mesh's submesh spheres into buffers that stay resident.
+// Only needed when the instances or mesh change; rotations are composed with GpuCullParams::spin.
+bool gpu_culling_set_instances(GpuCulling* culling, FramePacer* pacer, SDL_GPUCopyPass* copy_pass,
+    const MeshAsset& mesh, const TransformSoA& transforms);
+Uint32 gpu_culling_instance_count(const GpuCulling* culling);
+
+// Writes one draw command per submesh with no instances; record in the frame's copy pass
+bool gpu_culling_reset_draws(GpuCulling* culling, FramePacer* pacer, SDL_GPUCopyPass* copy_pass, const MeshAsset& mesh);
+// Records the compute pass that culls every instance; must follow the copy pass and precede the render pass
+void gpu_culling_dispatch(GpuCulling* culling, SDL_GPUCommandBuffer* command_buffer, const GpuCullParams& params);
+// Binds each submesh's instance range to vertex slot 1 and draws it indirectly. Returns the draw count.
+Uint32 gpu_culling_draw(GpuCulling* culling, SDL_GPURenderPass* render_pass, const MeshAsset& mesh,
+    SDL_GPUBufferBinding& index_binding);
+
+// Reduces depth_texture, which needs SAMPLER usage, into the pyramid the next frames' occlusion
+// tests read. Record after the render pass that wrote it.
+bool gpu_culling_build_depth_pyramid(GpuCulling* culling, SDL_GPUCommandBuffer* command_buffer,
+    SDL_GPUTexture* depth_texture, Uint32 width, Uint32 height, bool reversed_z);
+
+// Waits for the GPU and reads back the visible instance count of each submesh from the last dispatch
+bool gpu_culling_read_counts(GpuCulling* culling, std::vector<Uint32>& counts);
@@ -0,0 +1,178 @@
+﻿#include "headless.h"
+#include <iostream>
+#include <stdio.h>
+#include <cstring>
+
+struct HeadlessTarget {
+    SDL_GPUDevice* device;
+    SDL_GPUTexture* color;
+    SDL_GPUTransferBuffer* readback; // width * height RGBA pixels
+    Uint32 width, height;
+    bool downloaded;
+};
+
+HeadlessTarget* create_headless_target(SDL_GPUDevice* device, Uint32 width, Uint32 height) {
+    HeadlessTarget* target = new HeadlessTarget();
+    target->device = device;
+    target->width = width;
+    target->height = height;
+    target->downloaded = false;
+
+    SDL_GPUTextureCreateInfo info = {};
+    info.type = SDL_GPU_TEXTURETYPE_2D;
+    info.format = HEADLESS_FORMAT;
+    info.usage = SDL_GPU_TEXTUREUSAGE_COLOR_TARGET | SDL_GPU_TEXTUREUSAGE_SAMPLER;
+    info.width = width;
+    info.height = height;
+    info.layer_count_or_depth = 1;
+    info.num_levels = 1;
+    info.sample_count = SDL_GPU_SAMPLECOUNT_1;
+    target->color = SDL_CreateGPUTexture(device, &info);
+
+    SDL_GPUTransferBufferCreateInfo readbackInfo = {};
+    readbackInfo.usage = SDL_GPU_TRANSFERBUFFERUSAGE_DOWNLOAD;
+    readbackInfo.size = width * height * 4;
+    target->readback = SDL_CreateGPUTransferBuffer(device, &readbackInfo);
+    if (target->color == NULL || target->readback == NULL) {
+        std::cout << "Failed to create headless target. Error: " << SDL_GetError() << std::endl;
+        destroy_headless_target(target);
+        return NULL;
+    }
+    return target;
+}
+
+void destroy_headless_target(HeadlessTarget* target) {
+    if (target == NULL) {
+        return;
+    }
+    SDL_ReleaseGPUTexture(target->device, target->color);
+    SDL_ReleaseGPUTransferBuffer(target->device, target->readback);
+    delete target;
+}
+
+SDL_GPUTexture* headless_color(HeadlessTarget* target) {
+    return target->color;
+}
+
+void download_headless_frame(HeadlessTarget* target, SDL_GPUCommandBuffer* command_buffer, SDL_GPUTexture* texture) {
+    SDL_GPUCopyPass* copyPass = SDL_BeginGPUCopyPass(command_buffer);
+    SDL_GPUTextureRegion region = {};
+    region.texture = texture;
+    region.w = target->width;
+    region.h = target->height;
+    region.d = 1;
+    SDL_GPUTextureTransferInfo destination = {};
+    destination.transfer_buffer = target->readback;
+    SDL_DownloadFromGPUTexture(copyPass, &region, &destination);
+    SDL_EndGPUCopyPass(copyPass);
+    target->downloaded = true;
+}
+
+bool read_headless_frame(HeadlessTarget* target, std::vector<Uint8>& rgba) {
+    if (!target->downloaded) {
+        return false;
+    }
+    SDL_WaitForGPUIdle(target->device);
+    const Uint8* pixels = (const Uint8*)SDL_MapGPUTransferBuffer(target->device, target->readback, false);
+    if (pixels == NULL) {
+        std::cout << "Failed to map headless readback. Error: " << SDL_GetError() << std::endl;
+        return false;
+    }
+    rgba.assign(pixels, pixels + (size_t)target->width * target->height * 4);
+    SDL_UnmapGPUTransferBuffer(target->device, target->readback);
+    return true;
+}
+
+Uint64 frame_checksum(const std::vector<Uint8>& rgba) {
+    Uint64 hash = 0xcbf29ce484222325ull;
+    for (Uint8 byte : rgba) {
+        hash ^= byte;
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+static Uint32 crc32(const Uint8* data, size_t size, Uint32 crc = 0) {
+    static Uint32 table[256];
+    static bool initialized = false;
+    if (!initialized) {
+        for (Uint32 i = 0; i < 256; ++i) {
+            Uint32 c = i;
+            for (int k = 0; k < 8; ++k) {
+                c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            table[i] = c;
+        }
+        initialized = true;
+    }
+    crc = ~crc;
+    for (size_t i = 0; i < size; ++i) {
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+static void append_u32(std::vector<Uint8>& out, Uint32 value) {
+    out.push_back((Uint8)(value >> 24));
+    out.push_back((Uint8)(value >> 16));
+    out.push_back((Uint8)(value >> 8));
+    out.push_back((Uint8)value);
+}
+
+static void append_chunk(std::vector<Uint8>& png, const char* type, const std::vector<Uint8>& data) {
+    append_u32(png, (Uint32)data.size());
+    size_t start = png.size();
+    png.insert(png.end(), type, type + 4);
+    png.insert(png.end(), data.begin(), data.end());
+    append_u32(png, crc32(png.data() + start, png.size() - start));
+}
+
+bool write_png(const char* path, const Uint8* rgba, Uint32 width, Uint32 height) {
+    // Each row starts with filter type 0
+    const size_t rowSize = (size_t)width * 4;
+    std::vector<Uint8> raw;
+    raw.reserve((rowSize + 1) * height);
+    for (Uint32 y = 0; y < height; ++y) {
+        raw.push_back(0);
+        raw.insert(raw.end(), rgba + y * rowSize, rgba + (y + 1) * rowSize);
+    }
+
+    // zlib stream of stored deflate blocks: compression is not worth a dependency for test output
+    std::vector<Uint8> zlib = { 0x78, 0x01 };
+    size_t offset = 0;
+    bool last = false;
+    while (!last) {
+        const size_t size = SDL_min(raw.size() - offset, (size_t)65535);
+        last = offset + size == raw.size();
+        zlib.push_back(last ? 1 : 0);
+        zlib.push_back((Uint8)size);
+        zlib.push_back((Uint8)(size >> 8));
+        zlib.push_back((Uint8)~size);
+        zlib.push_back((Uint8)(~size >> 8));
+        zlib.insert(zlib.end(), raw.begin() + offset, raw.begin() + offset + size);
+        offset += size;
+    }
+    Uint32 a = 1, b = 0;
+    for (Uint8 byte : raw) {
+        a = (a + byte) % 65521;
+        b = (b + a) % 65521;
+    }
+    append_u32(zlib, (b << 16) | a);
+
+    std::vector<Uint8> header;
+    append_u32(header, width);
+    append_u32(header, height);
+    // 8 bits per channel, RGBA, deflate, adaptive filtering, no interlacing
+    header.insert(header.end(), { 8, 6, 0, 0, 0 });
+
+    std::vector<Uint8> png = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    append_chunk(png, "IHDR", header);
+    append_chunk(png, "IDAT", zlib);
+    append_chunk(png, "IEND", {});
+
+    if (!SDL_SaveFile(path, png.data(), png.size())) {
+        fprintf(stderr, "ERROR: SDL_SaveFile(%s) failed: %s\n", path, SDL_GetError());
+        return false;
+    }
+    return true;
+}
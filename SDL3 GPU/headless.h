@@ -0,0 +1,29 @@
+﻿#pragma once
+#include <vector>
+#include <SDL3/SDL.h>
+
+// Byte order the readback, checksums and PNGs expect
+#define HEADLESS_FORMAT SDL_GPU_TEXTUREFORMAT_R8G8B8A8_UNORM
+// Offscreen resolution, independent of the window's
+#define HEADLESS_WIDTH 800
+#define HEADLESS_HEIGHT 600
+#define HEADLESS_DEFAULT_FRAMES 120
+// Simulated frame time, so every run animates the same frames
+#define HEADLESS_TIMESTEP (1.0f / 60.0f)
+
+// Stands in for the swapchain when there is no window: a color target frames can be read back from
+struct HeadlessTarget;
+
+HeadlessTarget* create_headless_target(SDL_GPUDevice* device, Uint32 width, Uint32 height);
+void destroy_headless_target(HeadlessTarget* target);
+SDL_GPUTexture* headless_color(HeadlessTarget* target);
+
+// Records the download of texture, a HEADLESS_FORMAT image of the target's size; record after the passes drawing it
+void download_headless_frame(HeadlessTarget* target, SDL_GPUCommandBuffer* command_buffer, SDL_GPUTexture* texture);
+// Waits for the GPU and copies out the last downloaded frame as tightly packed RGBA rows
+bool read_headless_frame(HeadlessTarget* target, std::vector<Uint8>& rgba);
+
+// FNV-1a of the pixels, for comparing frames across runs
+Uint64 frame_checksum(const std::vector<Uint8>& rgba);
+// Uncompressed 8-bit RGBA PNG
+bool write_png(const char* path, const Uint8* rgba, Uint32 width, Uint32 height);
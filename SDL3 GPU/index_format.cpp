@@ -0,0 +1,84 @@
+﻿#include "index_format.h"
+#include <cstring>
+
+bool submesh_fits_16bit(const Submesh& submesh) {
+    // 0xFFFF stays unused so it can never be taken for a primitive restart
+    return submesh.vertex_count < 0xFFFF;
+}
+
+PackedIndices pack_indices(const MeshData& mesh) {
+    PackedIndices packed = {};
+    packed.submeshes = mesh.submeshes;
+
+    // Every level of detail moves with its submesh, so the draw ranges stay relative to first_index
+    for (const Submesh& submesh : mesh.submeshes) {
+        if (submesh_fits_16bit(submesh)) {
+            packed.index16_count += submesh_index_span(submesh);
+        } else {
+            packed.index32_count += submesh_index_span(submesh);
+        }
+    }
+
+    const Uint32 region32Offset = (packed.index16_count * sizeof(Uint16) + 3) & ~3u;
+    packed.data.resize(region32Offset + packed.index32_count * sizeof(Uint32), 0);
+
+    Uint32 next16 = 0, next32 = 0;
+    for (Submesh& submesh : packed.submeshes) {
+        const Uint32* source = mesh.indices.data() + submesh.first_index;
+        const Uint32 span = submesh_index_span(submesh);
+        if (submesh_fits_16bit(submesh)) {
+            Uint16* dest = (Uint16*)packed.data.data() + next16;
+            for (Uint32 i = 0; i < span; ++i) {
+                dest[i] = (Uint16)source[i];
+            }
+            submesh.index_size = sizeof(Uint16);
+            submesh.index_offset = 0;
+            submesh.first_index = next16;
+            next16 += span;
+        } else {
+            std::memcpy(packed.data.data() + region32Offset + next32 * sizeof(Uint32), source, span * sizeof(Uint32));
+            submesh.index_size = sizeof(Uint32);
+            submesh.index_offset = region32Offset;
+            submesh.first_index = next32;
+            next32 += span;
+        }
+    }
+    return packed;
+}
+
+bool validate_packed_indices(const MeshData& mesh, const PackedIndices& packed) {
+    if (packed.submeshes.size() != mesh.submeshes.size()) {
+        return false;
+    }
+    for (size_t s = 0; s < mesh.submeshes.size(); ++s) {
+        const Submesh& original = mesh.submeshes[s];
+        const Submesh& submesh = packed.submeshes[s];
+        const Uint32 span = submesh_index_span(submesh);
+        if (submesh.index_count != original.index_count || span != submesh_index_span(original)
+            || submesh.vertex_offset != original.vertex_offset || submesh.index_offset % submesh.index_size != 0) {
+            return false;
+        }
+        const Uint8* base = packed.data.data() + submesh.index_offset + (size_t)submesh.first_index * submesh.index_size;
+        if (base + (size_t)span * submesh.index_size > packed.data.data() + packed.data.size()) {
+            return false;
+        }
+        for (Uint32 i = 0; i < span; ++i) {
+            Uint32 index;
+            if (submesh.index_size == sizeof(Uint16)) {
+                Uint16 narrow;
+                std::memcpy(&narrow, base + i * sizeof(Uint16), sizeof(narrow));
+                index = narrow;
+            } else {
+                std::memcpy(&index, base + i * sizeof(Uint32), sizeof(index));
+            }
+            if (index != mesh.indices[original.first_index + i]) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+SDL_GPUIndexElementSize index_element_size(const Submesh& submesh) {
+    return submesh.index_size == sizeof(Uint16) ? SDL_GPU_INDEXELEMENTSIZE_16BIT : SDL_GPU_INDEXELEMENTSIZE_32BIT;
+}
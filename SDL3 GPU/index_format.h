@@ -0,0 +1,22 @@
+﻿#pragma once
+#include <vector>
+#include <SDL3/SDL.h>
+#include "mesh.h"
+
+// Index blob with all 16-bit submeshes first, then the 32-bit ones on a 4 byte boundary.
+// Submeshes of one width share an index_offset so consecutive draws need no rebind.
+struct PackedIndices {
+    std::vector<Uint8> data;
+    std::vector<Submesh> submeshes;
+    Uint32 index16_count;
+    Uint32 index32_count;
+};
+
+bool submesh_fits_16bit(const Submesh& submesh);
+
+PackedIndices pack_indices(const MeshData& mesh);
+
+// Decodes every packed draw range and compares it with the 32-bit source
+bool validate_packed_indices(const MeshData& mesh, const PackedIndices& packed);
+
+SDL_GPUIndexElementSize index_element_size(const Submesh& submesh);
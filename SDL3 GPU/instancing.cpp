@@ -0,0 +1,247 @@
+﻿#include "instancing.h"
+#include <algorithm>
+#include <cmath>
+#include <glm/gtc/quaternion.hpp>
+#include "index_format.h"
+#include "profiler.h"
+
+#define INSTANCE_GRID_SPACING 3.0f
+#define BENCHMARK_STAGE_FRAMES 120
+
+static const Uint32 benchmarkCounts[] = { 1000, 10000, 100000 };
+static const float lodBenchmarkThresholds[] = { 0.0f, 1.0f, 4.0f };
+
+void build_instance_grid(InstanceGrid& grid, Uint32 count, float distance) {
+    resize_transforms(grid.transforms, count);
+    grid.base_sin.resize(count);
+    grid.base_cos.resize(count);
+    Uint32 side = (Uint32)std::ceil(std::sqrt((double)count));
+    for (Uint32 i = 0; i < count; ++i) {
+        grid.transforms.position_x[i] = ((float)(i % side) - (side - 1) * 0.5f) * INSTANCE_GRID_SPACING;
+        grid.transforms.position_y[i] = 0.0f;
+        grid.transforms.position_z[i] = -distance - (float)(i / side) * INSTANCE_GRID_SPACING;
+        grid.base_sin[i] = std::sin(i * 0.05f);
+        grid.base_cos[i] = std::cos(i * 0.05f);
+    }
+}
+
+void animate_instance_grid(InstanceGrid& grid, float rotation) {
+    // Composing with one spin quaternion about Y avoids a sin/cos per instance
+    const float s = std::sin(rotation * 0.5f);
+    const float c = std::cos(rotation * 0.5f);
+    const Uint32 count = transform_count(grid.transforms);
+    float* y = grid.transforms.rotation_y.data();
+    float* w = grid.transforms.rotation_w.data();
+    for (Uint32 i = 0; i < count; ++i) {
+        y[i] = grid.base_sin[i] * c + grid.base_cos[i] * s;
+        w[i] = grid.base_cos[i] * c - grid.base_sin[i] * s;
+    }
+}
+
+bool upload_instances(FramePacer* pacer, FrameContext* frame, SDL_GPUCopyPass* copy_pass, ThreadPool* pool,
+    const TransformSoA& transforms, SDL_GPUBufferBinding& binding) {
+    PROFILE_SCOPE("Upload instances");
+    Uint32 offset = 0;
+    Uint8* mem = allocate_frame_data(pacer, frame, copy_pass, transform_count(transforms) * (Uint32)sizeof(InstanceData), offset);
+    if (mem == NULL) {
+        return false;
+    }
+    transform_batch(pool, transforms, TRANSFORM_OUTPUT_MAT4, NULL, mem);
+    binding.buffer = frame->dynamic_buffer;
+    binding.offset = offset;
+    return true;
+}
+
+bool upload_instance_data(FramePacer* pacer, FrameContext* frame, SDL_GPUCopyPass* copy_pass,
+    const InstanceData* instances, Uint32 count, SDL_GPUBufferBinding& binding) {
+    Uint32 offset = 0;
+    if (!upload_frame_data(pacer, frame, copy_pass, instances, count * (Uint32)sizeof(InstanceData), offset)) {
+        return false;
+    }
+    binding.buffer = frame->dynamic_buffer;
+    binding.offset = offset;
+    return true;
+}
+
+void cull_instances(const Frustum& frustum, const TransformSoA& transforms, const MeshAsset& mesh,
+    std::vector<VisibleSubmesh>& visible, CullStats& stats) {
+    PROFILE_SCOPE("Cull instances");
+    const Uint64 start = SDL_GetPerformanceCounter();
+    const CullKernel kernel = best_cull_kernel();
+    const Uint32 count = transform_count(transforms);
+    visible.resize(mesh.submeshes.size());
+    for (size_t s = 0; s < mesh.submeshes.size(); ++s) {
+        const Submesh& submesh = mesh.submeshes[s];
+        VisibleSubmesh& result = visible[s];
+        transform_spheres(transforms, submesh.sphere_center, submesh.sphere_radius, result.spheres);
+        result.indices.resize(count);
+        result.indices.resize(cull_spheres(kernel, frustum, result.spheres, result.indices.data()));
+        gather_transforms(transforms, result.indices.data(), (Uint32)result.indices.size(), result.transforms);
+        stats.objects += count;
+        stats.visible += result.indices.size();
+    }
+    stats.seconds += (double)(SDL_GetPerformanceCounter() - start) / SDL_GetPerformanceFrequency();
+}
+
+Uint32 select_submesh_lod(const Submesh& submesh, const LodSelection& selection, float distance, float scale) {
+    if (selection.threshold <= 0.0f) {
+        return 0;
+    }
+    // Projected error in pixels is error * scale * pixels_per_unit / distance; compare without dividing
+    const float budget = selection.threshold * SDL_max(distance, 1e-4f) / (selection.pixels_per_unit * scale);
+    Uint32 lod = 0;
+    while (lod + 1 < submesh.lod_count && submesh.lods[lod + 1].error <= budget) {
+        lod++;
+    }
+    return lod;
+}
+
+void sort_instances_by_lod(const TransformSoA& transforms, const Submesh& submesh, const LodSelection& selection,
+    VisibleSubmesh& visible) {
+    const Uint32 count = (Uint32)visible.indices.size();
+    const SphereSoA& spheres = visible.spheres;
+    const float invRadius = submesh.sphere_radius > 0.0f ? 1.0f / submesh.sphere_radius : 0.0f;
+    visible.lods.resize(count);
+    std::fill(std::begin(visible.lod_instances), std::end(visible.lod_instances), 0u);
+    for (Uint32 k = 0; k < count; ++k) {
+        const Uint32 i = visible.indices[k];
+        const glm::vec3 center(spheres.center_x[i], spheres.center_y[i], spheres.center_z[i]);
+        // The world sphere's radius carries the instance's largest scale
+        const float radius = spheres.radius[i];
+        const float scale = invRadius > 0.0f ? radius * invRadius : 1.0f;
+        const Uint32 lod = select_submesh_lod(submesh, selection, glm::length(center - selection.eye) - radius, scale);
+        visible.lods[k] = (Uint8)lod;
+        visible.lod_instances[lod]++;
+    }
+
+    // Counting sort, stable so each level keeps the culling order
+    Uint32 next[MAX_MESH_LODS];
+    Uint32 first = 0;
+    for (Uint32 lod = 0; lod < MAX_MESH_LODS; ++lod) {
+        visible.lod_first[lod] = next[lod] = first;
+        first += visible.lod_instances[lod];
+    }
+    if (visible.lod_instances[0] == count) {
+        return;
+    }
+    std::vector<Uint32> sorted(count);
+    for (Uint32 k = 0; k < count; ++k) {
+        sorted[next[visible.lods[k]]++] = visible.indices[k];
+    }
+    visible.indices.swap(sorted);
+    for (Uint32 lod = 0, k = 0; lod < MAX_MESH_LODS; ++lod) {
+        for (Uint32 n = 0; n < visible.lod_instances[lod]; ++n) {
+            visible.lods[k++] = (Uint8)lod;
+        }
+    }
+    gather_transforms(transforms, visible.indices.data(), count, visible.transforms);
+}
+
+void cull_instance_meshlets(const MeshAsset& mesh, size_t submesh, const glm::vec3& eye, VisibleSubmesh& visible,
+    MeshletCullStats& stats) {
+    const Submesh& part = mesh.submeshes[submesh];
+    const TransformSoA& t = visible.transforms;
+    visible.meshlet_draws.clear();
+    visible.meshlet_draw_offsets.assign(1, 0);
+    for (size_t k = 0; k < visible.mvps.size(); ++k) {
+        if (visible.lods[k] != 0) {
+            visible.meshlet_draw_offsets.push_back((Uint32)visible.meshlet_draws.size());
+            continue;
+        }
+        // Planes pulled from the full MVP and the eye moved into model space; assumes uniform scale
+        const Frustum frustum = extract_frustum(visible.mvps[k]);
+        const glm::quat rotation(t.rotation_w[k], t.rotation_x[k], t.rotation_y[k], t.rotation_z[k]);
+        const glm::vec3 position(t.position_x[k], t.position_y[k], t.position_z[k]);
+        const glm::vec3 local = glm::conjugate(rotation) * (eye - position) / t.scale_x[k];
+        cull_meshlets(mesh.meshlets.data() + part.first_meshlet, part.meshlet_count, frustum, Vec3{ local.x, local.y, local.z },
+            visible.meshlet_draws, stats);
+        visible.meshlet_draw_offsets.push_back((Uint32)visible.meshlet_draws.size());
+    }
+}
+
+Uint32 submesh_draw_item(const Submesh& submesh, Uint32 lod, SDL_GPUBuffer* index_buffer, Uint32 instance_count, DrawItem& item) {
+    // Submeshes are grouped by index width, so the queue rebinds indices at most once per width
+    item.index_buffer.buffer = index_buffer;
+    item.index_buffer.offset = submesh.index_offset;
+    item.index_element_size = index_element_size(submesh);
+    item.first_index = submesh.first_index + (lod == 0 ? 0 : submesh.lods[lod].first_index);
+    item.num_indices = lod == 0 ? submesh.index_count : submesh.lods[lod].index_count;
+    item.num_instances = instance_count;
+    item.vertex_offset = submesh.vertex_offset;
+    return item.num_indices / 3 * instance_count;
+}
+
+const char* instance_draw_mode_name(InstanceDrawMode mode) {
+    switch (mode) {
+    case INSTANCE_DRAW_INSTANCED:
+        return "instanced";
+    case INSTANCE_DRAW_PER_OBJECT:
+        return "per-object";
+    case INSTANCE_DRAW_GPU_CULLED:
+        return "gpu-culled";
+    }
+    return "unknown";
+}
+
+bool instancing_benchmark_stage(const InstancingBenchmark& bench, Uint32& instance_count, InstanceDrawMode& mode) {
+    if (bench.stage >= SDL_arraysize(benchmarkCounts) * INSTANCE_DRAW_MODE_COUNT) {
+        return false;
+    }
+    instance_count = benchmarkCounts[bench.stage / INSTANCE_DRAW_MODE_COUNT];
+    mode = (InstanceDrawMode)(bench.stage % INSTANCE_DRAW_MODE_COUNT);
+    return true;
+}
+
+// True when the stage is complete and its averages are in bench
+static bool accumulate_benchmark_frame(InstancingBenchmark& bench, double cpu_ms, double frame_ms) {
+    // The first frames of a stage still carry the previous stage's GPU work
+    if (bench.frame++ >= MAX_FRAMES_IN_FLIGHT) {
+        bench.cpu_ms += cpu_ms;
+        bench.frame_ms += frame_ms;
+    }
+    if (bench.frame < BENCHMARK_STAGE_FRAMES) {
+        return false;
+    }
+    const double measured = BENCHMARK_STAGE_FRAMES - MAX_FRAMES_IN_FLIGHT;
+    bench.cpu_ms /= measured;
+    bench.frame_ms /= measured;
+    return true;
+}
+
+static void next_benchmark_stage(InstancingBenchmark& bench) {
+    bench.stage++;
+    bench.frame = 0;
+    bench.cpu_ms = 0.0;
+    bench.frame_ms = 0.0;
+}
+
+void instancing_benchmark_frame(InstancingBenchmark& bench, double cpu_ms, double frame_ms, Uint32 draw_calls) {
+    if (!accumulate_benchmark_frame(bench, cpu_ms, frame_ms)) {
+        return;
+    }
+    Uint32 instanceCount;
+    InstanceDrawMode mode;
+    instancing_benchmark_stage(bench, instanceCount, mode);
+    SDL_Log("%6u instances %-10s: %8.3f ms CPU, %8.3f ms frame, %u draws/frame", instanceCount,
+        instance_draw_mode_name(mode), bench.cpu_ms, bench.frame_ms, draw_calls);
+    next_benchmark_stage(bench);
+}
+
+bool lod_benchmark_stage(const InstancingBenchmark& bench, float& threshold) {
+    if (bench.stage >= SDL_arraysize(lodBenchmarkThresholds)) {
+        return false;
+    }
+    threshold = lodBenchmarkThresholds[bench.stage];
+    return true;
+}
+
+void lod_benchmark_frame(InstancingBenchmark& bench, double cpu_ms, double frame_ms, Uint64 triangles) {
+    if (!accumulate_benchmark_frame(bench, cpu_ms, frame_ms)) {
+        return;
+    }
+    float threshold;
+    lod_benchmark_stage(bench, threshold);
+    SDL_Log("LOD threshold %4.1f px: %8.3f ms CPU, %8.3f ms frame, %llu triangles/frame", threshold,
+        bench.cpu_ms, bench.frame_ms, (unsigned long long)triangles);
+    next_benchmark_stage(bench);
+}
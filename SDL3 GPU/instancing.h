@@ -0,0 +1,107 @@
+﻿#pragma once
+#include <vector>
+#include <SDL3/SDL.h>
+#include <glm/glm.hpp>
+#include "asset_loader.h"
+#include "frame_context.h"
+#include "transform_batch.h"
+#include "culling.h"
+#include "meshlet.h"
+#include "render_queue.h"
+
+// Per-instance vertex data, read from vertex buffer slot 1 at INSTANCE_ATTRIBUTE_LOCATION
+struct InstanceData {
+    glm::mat4 model;
+};
+
+enum InstanceDrawMode {
+    INSTANCE_DRAW_INSTANCED,  // one draw per submesh for every instance
+    INSTANCE_DRAW_PER_OBJECT, // one uniform push and draw per instance and submesh
+    INSTANCE_DRAW_GPU_CULLED  // culled by a compute pass, one indirect draw per submesh
+};
+
+#define INSTANCE_DRAW_MODE_COUNT 3
+
+const char* instance_draw_mode_name(InstanceDrawMode mode);
+
+// Copies of a mesh laid out on a grid in front of the camera, each spinning about Y.
+// A single instance sits where the original lone model did.
+struct InstanceGrid {
+    TransformSoA transforms;
+    std::vector<float> base_sin, base_cos; // half angle of each instance's fixed offset about Y
+};
+
+// The first row sits distance units in front of the camera
+void build_instance_grid(InstanceGrid& grid, Uint32 count, float distance);
+// Sets every rotation to the instance's offset plus rotation
+void animate_instance_grid(InstanceGrid& grid, float rotation);
+
+// Builds the model matrices straight into the frame's dynamic buffer and fills binding for slot 1
+bool upload_instances(FramePacer* pacer, FrameContext* frame, SDL_GPUCopyPass* copy_pass, ThreadPool* pool,
+    const TransformSoA& transforms, SDL_GPUBufferBinding& binding);
+bool upload_instance_data(FramePacer* pacer, FrameContext* frame, SDL_GPUCopyPass* copy_pass,
+    const InstanceData* instances, Uint32 count, SDL_GPUBufferBinding& binding);
+
+// The instances whose copy of one submesh survived culling, and where their data went this frame
+struct VisibleSubmesh {
+    SphereSoA spheres;
+    std::vector<Uint32> indices;
+    TransformSoA transforms;
+    std::vector<glm::mat4> mvps;  // per-object mode
+    SDL_GPUBufferBinding binding; // instanced mode
+    // Per-object mode with meshlet culling: the k-th visible instance draws
+    // meshlet_draws[meshlet_draw_offsets[k]] up to meshlet_draw_offsets[k + 1]
+    std::vector<MeshletDraw> meshlet_draws;
+    std::vector<Uint32> meshlet_draw_offsets;
+    // Level of detail of each visible instance after sort_instances_by_lod, and the instance range of each level
+    std::vector<Uint8> lods;
+    Uint32 lod_first[MAX_MESH_LODS];
+    Uint32 lod_instances[MAX_MESH_LODS];
+};
+
+// Picks levels of detail by the pixels their error covers on screen
+struct LodSelection {
+    glm::vec3 eye;
+    float pixels_per_unit; // Projection[1][1] * viewport height / 2: pixels per unit at distance 1
+    float threshold;       // pixels; 0 keeps everything at full detail
+};
+
+// The coarsest level of submesh whose error, seen from distance, stays within the threshold
+Uint32 select_submesh_lod(const Submesh& submesh, const LodSelection& selection, float distance, float scale);
+// Orders the visible instances of a submesh by level of detail, measuring distance to the closest point of
+// each instance's bounding sphere, and regathers visible.transforms from transforms in that order
+void sort_instances_by_lod(const TransformSoA& transforms, const Submesh& submesh, const LodSelection& selection,
+    VisibleSubmesh& visible);
+
+// Tests every instance's copy of each submesh against frustum, filling one entry per submesh
+void cull_instances(const Frustum& frustum, const TransformSoA& transforms, const MeshAsset& mesh,
+    std::vector<VisibleSubmesh>& visible, CullStats& stats);
+
+// Tests the clusters of every visible instance of mesh.submeshes[submesh] in that instance's model space.
+// visible.mvps and visible.lods must be filled; eye is the camera's world position. Instances drawn at a
+// coarser level of detail get no clusters.
+void cull_instance_meshlets(const MeshAsset& mesh, size_t submesh, const glm::vec3& eye, VisibleSubmesh& visible,
+    MeshletCullStats& stats);
+
+// Fills the index binding and range of a draw of submesh at level of detail lod. Returns the triangles drawn.
+Uint32 submesh_draw_item(const Submesh& submesh, Uint32 lod, SDL_GPUBuffer* index_buffer, Uint32 instance_count, DrawItem& item);
+
+// Steps through 1k, 10k and 100k instances in every draw mode, a fixed number of frames each
+struct InstancingBenchmark {
+    Uint32 stage;
+    Uint32 frame;
+    double cpu_ms;
+    double frame_ms;
+};
+
+// False once every stage has run
+bool instancing_benchmark_stage(const InstancingBenchmark& bench, Uint32& instance_count, InstanceDrawMode& mode);
+void instancing_benchmark_frame(InstancingBenchmark& bench, double cpu_ms, double frame_ms, Uint32 draw_calls);
+
+// Same fixed-length stages over a distant field of instances, with levels of detail off and at
+// growing error thresholds
+#define LOD_BENCHMARK_INSTANCES 10000
+#define LOD_BENCHMARK_DISTANCE 150.0f
+
+bool lod_benchmark_stage(const InstancingBenchmark& bench, float& threshold);
+void lod_benchmark_frame(InstancingBenchmark& bench, double cpu_ms, double frame_ms, Uint64 triangles);
@@ -5,355 +5,369 @@
 #include <glm/ext/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <stdio.h>
-#include <stb/stb_image.h>
-#include <assimp/Importer.hpp>
-#include <assimp/scene.h>
-#include <assimp/postprocess.h>
+#include "asset_loader.h"
+#include "depth_buffer.h"
+#include "frame_context.h"
+#include "gpu_culling.h"
+#include "headless.h"
+#include "instancing.h"
+#include "overdraw.h"
+#include "parallel_recording.h"
+#include "pipeline_cache.h"
+#include "profiler.h"
+#include "render_queue.h"
+#include "scene_pipeline.h"
+#include "shader_library.h"
+#include "shader_reloader.h"
+
+// Staging memory shared by every upload; large enough for an uncompressed 2k texture with mips
+#define UPLOAD_RING_SIZE (64 * 1024 * 1024)
+// Per frame-in-flight buffer for data rewritten every frame
+#define FRAME_DYNAMIC_BUFFER_SIZE (8 * 1024 * 1024)
+// A depth prepass and the pass shading on top of it
+#define SCENE_MAX_PASSES 2
+#define RECORDING_BENCHMARK_INSTANCES 100000
+// Initial size of the window, which can be resized afterwards
+#define WINDOW_WIDTH 800
+#define WINDOW_HEIGHT 600
+// Pipelines the last run created, prewarmed on startup and rewritten on exit
+#define PIPELINE_MANIFEST "res/pipelines.manifest"
+// Packed by shader_packer from every stage the build compiled
+#define SHADER_LIBRARY "../../../../SDL3 GPU/shader/shaders" SHADER_LIBRARY_EXTENSION
+#define SHADER_SOURCE_DIR "../../../../SDL3 GPU/shader"
+
+// Library shaders the build compiles with a define, for --hot-reload to rebuild the same way
+static const ShaderVariant shaderVariants[] = {
+    { "shader_packed.glsl.vert", "shader_packed_color.vert", "PACKED_COLOR" },
+};
 
 struct UBO {
     glm::mat4 mvp;
+    glm::mat4 dequantize;
 };
 
-struct Vec3 {
-    float x, y, z;
-};
-
-struct Vec2 {
-    float x, y;
-};
-
-struct VertexData {
-    Vec3 position;
-    Vec2 texcoord;
-    SDL_FColor color;
-};
-
-SDL_GPUShader* load_shader(
-    SDL_GPUDevice* device,
-    const char* filename,
-    SDL_GPUShaderStage stage,
-    Uint32 sampler_count,
-    Uint32 uniform_buffer_count,
-    Uint32 storage_buffer_count,
-    Uint32 storage_texture_count) {
-
-    if (!SDL_GetPathInfo(filename, NULL)) {
-        fprintf(stdout, "File (%s) does not exist.\n", filename);
-        return NULL;
+// Acquires the swapchain texture on command_buffer and scales the offscreen scene onto it
+void present_scene_color(SDL_GPUCommandBuffer* command_buffer, SDL_Window* window, SDL_GPUTexture* scene, Uint32 width, Uint32 height) {
+    SDL_GPUTexture* swapchainTexture = NULL;
+    Uint32 swapchainWidth = 0, swapchainHeight = 0;
+    if (!SDL_WaitAndAcquireGPUSwapchainTexture(command_buffer, window, &swapchainTexture, &swapchainWidth, &swapchainHeight)) {
+        std::cout << "Failed to acquire swapchain texture. Error: " << SDL_GetError() << std::endl;
     }
-
-    const char* entrypoint;
-    SDL_GPUShaderFormat backend_formats = SDL_GetGPUShaderFormats(device);
-    SDL_GPUShaderFormat format = SDL_GPU_SHADERFORMAT_INVALID;
-    if (backend_formats & SDL_GPU_SHADERFORMAT_SPIRV) {
-        format = SDL_GPU_SHADERFORMAT_SPIRV;
-        entrypoint = "main";
+    // Minimized since the frame started
+    if (swapchainTexture == NULL) {
+        return;
     }
-
-    size_t code_size;
-    void* code = SDL_LoadFile(filename, &code_size);
-    if (code == NULL) {
-        fprintf(stderr, "ERROR: SDL_LoadFile(%s) failed: %s\n", filename, SDL_GetError());
-        return NULL;
-    }
-
-    SDL_GPUShaderCreateInfo shader_info = {};
-    shader_info.code = (const Uint8*)code;
-    shader_info.code_size = code_size;
-    shader_info.entrypoint = entrypoint;
-    shader_info.format = format;
-    shader_info.stage = stage;
-    shader_info.num_samplers = sampler_count;
-    shader_info.num_uniform_buffers = uniform_buffer_count;
-    shader_info.num_storage_buffers = storage_buffer_count;
-    shader_info.num_storage_textures = storage_texture_count;
-
-    SDL_GPUShader* shader = SDL_CreateGPUShader(device, &shader_info);
-
-    if (shader == NULL) {
-        fprintf(stderr, "ERROR: SDL_CreateGPUShader failed: %s\n", SDL_GetError());
-        SDL_free(code);
-        return NULL;
-    }
-    SDL_free(code);
-    return shader;
+    SDL_GPUBlitInfo blitInfo = {};
+    blitInfo.source.texture = scene;
+    blitInfo.source.w = width;
+    blitInfo.source.h = height;
+    blitInfo.destination.texture = swapchainTexture;
+    blitInfo.destination.w = swapchainWidth;
+    blitInfo.destination.h = swapchainHeight;
+    blitInfo.load_op = SDL_GPU_LOADOP_DONT_CARE;
+    blitInfo.filter = SDL_GPU_FILTER_LINEAR;
+    SDL_BlitGPUTexture(command_buffer, &blitInfo);
 }
 
-std::vector<VertexData> load_model(const std::string& path, std::vector<Uint32>& indices) {
-    Assimp::Importer importer;
-    const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs);
-
-    if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) {
-        std::cerr << "ERROR::ASSIMP::" << importer.GetErrorString() << std::endl;
-        return {};
-    }
-
-    std::vector<VertexData> vertices;
-
-    for (size_t i = 0; i < scene->mNumMeshes; ++i) {
-        const auto& mesh = scene->mMeshes[i];
-
-        // Process vertices
-        for (size_t j = 0; j < mesh->mNumVertices; ++j) {
-            VertexData vertex;
-            vertex.position = { mesh->mVertices[j].x, mesh->mVertices[j].y, mesh->mVertices[j].z };
-            vertex.texcoord = mesh->mTextureCoords[0] ? Vec2{ mesh->mTextureCoords[0][j].x, mesh->mTextureCoords[0][j].y } : Vec2{ 0.0f, 0.0f };
-            vertex.color = { 1.0f, 1.0f, 1.0f, 1.0f }; // Default white color
-            vertices.push_back(vertex);
+int main(int argc, char* argv[]) {
+    bool packedVertices = true;
+    MipmapMode mipmapMode = MIPMAP_CPU;
+    float anisotropy = 8.0f;
+    Uint32 framesInFlight = 2;
+    Uint32 instanceCount = 1;
+    InstanceDrawMode instanceDrawMode = INSTANCE_DRAW_INSTANCED;
+    bool benchInstancing = false;
+    bool verifyGpuCulling = false;
+    bool meshletCulling = false;
+    bool depthPrepass = false;
+    bool measureOverdraw = false;
+    bool occlusionCulling = false;
+    float lodThreshold = 1.0f;
+    bool benchLod = false;
+    Uint32 recordJobs = 1;
+    bool benchRecording = false;
+    const char* gpuDriver = NULL;
+    bool hotReload = false;
+    const char* shaderCompiler = "glslc";
+    bool headless = false;
+    Uint32 frameLimit = 0;
+    const char* screenshotPath = NULL;
+    bool printChecksum = false;
+    const char* expectedChecksum = NULL;
+    bool profile = false;
+    const char* profileTrace = NULL;
+    for (int i = 1; i < argc; ++i) {
+        if (SDL_strcmp(argv[i], "--bench-mesh-cache") == 0) {
+            benchmark_mesh_cache("res/viking_room.obj", 10);
+            return 0;
         }
-
-        // Process indices
-        for (size_t j = 0; j < mesh->mNumFaces; ++j) {
-            const auto& face = mesh->mFaces[j];
-            for (size_t k = 0; k < face.mNumIndices; ++k) {
-                indices.push_back(face.mIndices[k]);
-            }
+        if (SDL_strcmp(argv[i], "--bench-transforms") == 0) {
+            benchmark_transform_batch(100000, 20);
+            return 0;
+        }
+        if (SDL_strcmp(argv[i], "--bench-culling") == 0) {
+            benchmark_culling(100000, 20);
+            return 0;
+        }
+        if (SDL_strcmp(argv[i], "--bench-render-queue") == 0) {
+            benchmark_render_queue(100000, 20);
+            return 0;
+        }
+        if (SDL_strcmp(argv[i], "--bench-mips") == 0) {
+            benchmark_mip_generation(2048, 2048, 10);
+            return 0;
+        }
+        if (SDL_strcmp(argv[i], "--full-vertices") == 0) {
+            packedVertices = false;
+        }
+        if (SDL_strcmp(argv[i], "--mipmaps=none") == 0) {
+            mipmapMode = MIPMAP_NONE;
+        }
+        if (SDL_strcmp(argv[i], "--mipmaps=gpu") == 0) {
+            mipmapMode = MIPMAP_GPU;
+        }
+        if (SDL_strcmp(argv[i], "--anisotropy") == 0 && i + 1 < argc) {
+            anisotropy = (float)SDL_atoi(argv[++i]);
+        }
+        if (SDL_strcmp(argv[i], "--instances") == 0 && i + 1 < argc) {
+            // SDL_max evaluates its arguments twice
+            instanceCount = (Uint32)SDL_max(SDL_atoi(argv[i + 1]), 1);
+            i++;
+        }
+        if (SDL_strcmp(argv[i], "--per-object") == 0) {
+            instanceDrawMode = INSTANCE_DRAW_PER_OBJECT;
+        }
+        // Per-object draws that also skip each instance's clusters outside the frustum or facing away
+        if (SDL_strcmp(argv[i], "--meshlets") == 0) {
+            instanceDrawMode = INSTANCE_DRAW_PER_OBJECT;
+            meshletCulling = true;
+        }
+        // Largest on-screen error in pixels a level of detail may have; 0 always draws full detail
+        if (SDL_strcmp(argv[i], "--lod-threshold") == 0 && i + 1 < argc) {
+            lodThreshold = (float)SDL_atof(argv[++i]);
+        }
+        if (SDL_strcmp(argv[i], "--gpu-culling") == 0) {
+            instanceDrawMode = INSTANCE_DRAW_GPU_CULLED;
+        }
+        // GPU-culled draws that also skip instances hidden behind last frame's depth
+        if (SDL_strcmp(argv[i], "--occlusion") == 0) {
+            instanceDrawMode = INSTANCE_DRAW_GPU_CULLED;
+            occlusionCulling = true;
+        }
+        // Lays down depth first so the textured shader runs at most once per pixel
+        if (SDL_strcmp(argv[i], "--depth-prepass") == 0) {
+            depthPrepass = true;
+        }
+        // Counts shaded fragments per pixel on the first full frame, with and without a depth prepass
+        if (SDL_strcmp(argv[i], "--measure-overdraw") == 0) {
+            measureOverdraw = true;
+        }
+        // Compares the first GPU-culled frame's visible counts against the CPU culling path and exits
+        if (SDL_strcmp(argv[i], "--verify-gpu-culling") == 0) {
+            instanceDrawMode = INSTANCE_DRAW_GPU_CULLED;
+            verifyGpuCulling = true;
+        }
+        // e.g. vulkan, to run on a software implementation such as lavapipe
+        if (SDL_strcmp(argv[i], "--gpu-driver") == 0 && i + 1 < argc) {
+            gpuDriver = argv[++i];
+        }
+        // Recompile edited GLSL sources in the background and swap them in while running
+        if (SDL_strcmp(argv[i], "--hot-reload") == 0) {
+            hotReload = true;
+        }
+        if (SDL_strcmp(argv[i], "--shader-compiler") == 0 && i + 1 < argc) {
+            shaderCompiler = argv[++i];
+        }
+        if (SDL_strcmp(argv[i], "--bench-instancing") == 0) {
+            benchInstancing = true;
+        }
+        if (SDL_strcmp(argv[i], "--bench-lod") == 0) {
+            instanceCount = LOD_BENCHMARK_INSTANCES;
+            instanceDrawMode = INSTANCE_DRAW_INSTANCED;
+            benchLod = true;
+        }
+        // Splits the CPU-culled scene over this many command buffers, recorded on the worker threads
+        if (SDL_strcmp(argv[i], "--record-jobs") == 0 && i + 1 < argc) {
+            // SDL_max evaluates its arguments twice
+            recordJobs = (Uint32)SDL_max(SDL_atoi(argv[i + 1]), 1);
+            i++;
+        }
+        // Times recording the first frame's draws of a large per-object scene on 1 to 16 threads, then exits
+        if (SDL_strcmp(argv[i], "--bench-recording") == 0) {
+            instanceCount = RECORDING_BENCHMARK_INSTANCES;
+            instanceDrawMode = INSTANCE_DRAW_PER_OBJECT;
+            benchRecording = true;
+        }
+        if (SDL_strcmp(argv[i], "--latency") == 0) {
+            framesInFlight = 1;
+        }
+        if (SDL_strcmp(argv[i], "--frames-in-flight") == 0 && i + 1 < argc) {
+            framesInFlight = (Uint32)SDL_atoi(argv[++i]);
+        }
+        // Renders offscreen without a window or swapchain, so it also runs on software drivers and CI machines
+        if (SDL_strcmp(argv[i], "--headless") == 0) {
+            headless = true;
+        }
+        // Quits after this many frames of the loaded scene
+        if (SDL_strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            // SDL_max evaluates its arguments twice
+            frameLimit = (Uint32)SDL_max(SDL_atoi(argv[i + 1]), 1);
+            i++;
+        }
+        if (SDL_strcmp(argv[i], "--screenshot") == 0 && i + 1 < argc) {
+            screenshotPath = argv[++i];
+        }
+        if (SDL_strcmp(argv[i], "--checksum") == 0) {
+            printChecksum = true;
+        }
+        if (SDL_strcmp(argv[i], "--expect-checksum") == 0 && i + 1 < argc) {
+            expectedChecksum = argv[++i];
+        }
+        // Frame time percentiles; with a path, also a Chrome trace of the CPU scopes and GPU frames
+        if (SDL_strcmp(argv[i], "--profile") == 0) {
+            profile = true;
+        }
+        if (SDL_strcmp(argv[i], "--profile-trace") == 0 && i + 1 < argc) {
+            profile = true;
+            profileTrace = argv[++i];
         }
     }
+    if (headless && frameLimit == 0) {
+        frameLimit = HEADLESS_DEFAULT_FRAMES;
+    }
+    const bool readBackFrame = headless && (screenshotPath || printChecksum || expectedChecksum);
 
-    return vertices;
-}
-
-int main(int argc, char* argv[]) {
+    if (headless) {
+        SDL_SetHint(SDL_HINT_VIDEO_DRIVER, "offscreen,dummy");
+    }
     if (!SDL_Init(SDL_INIT_VIDEO)) {
         std::cout << "Failed to initialize SDL. Error: " << SDL_GetError() << std::endl;
     }
 
     SDL_SetLogPriorities(SDL_LOG_PRIORITY_VERBOSE);
+    if (profile) {
+        enable_profiler(profileTrace != NULL);
+    }
 
     SDL_Window* window = NULL;
-    window = SDL_CreateWindow("SDL3 GPU", 800, 600, 0);
-    if (!window) {
-        std::cout << "Failed to initialize window. Error: " << SDL_GetError() << std::endl;
+    if (!headless) {
+        window = SDL_CreateWindow("SDL3 GPU", WINDOW_WIDTH, WINDOW_HEIGHT, SDL_WINDOW_RESIZABLE);
+        if (!window) {
+            std::cout << "Failed to initialize window. Error: " << SDL_GetError() << std::endl;
+        }
+    }
+
+    // Any backend that can run one of the formats the library holds
+    ShaderLibrary* shaderLibrary = open_shader_library(SHADER_LIBRARY);
+    if (!shaderLibrary) {
+        return 1;
     }
 
     SDL_GPUDevice* device = NULL;
-    device = SDL_CreateGPUDevice(SDL_GPU_SHADERFORMAT_SPIRV, true, NULL);
+    device = SDL_CreateGPUDevice(shader_library_formats(shaderLibrary), true, gpuDriver);
     if (!device) {
         std::cout << "Failed to initialize GPU. Error: " << SDL_GetError() << std::endl;
     }
 
-    if (!SDL_ClaimWindowForGPUDevice(device, window)) {
+    // The headless target stands in for the swapchain
+    HeadlessTarget* headlessTarget = NULL;
+    if (headless) {
+        headlessTarget = create_headless_target(device, HEADLESS_WIDTH, HEADLESS_HEIGHT);
+        if (!headlessTarget) {
+            return 1;
+        }
+    } else if (!SDL_ClaimWindowForGPUDevice(device, window)) {
         std::cout << "Failed to claim GPU. Error: " << SDL_GetError() << std::endl;
     }
-    // Textures
-    int imageH, imageW;
-    stbi_uc* image_data = stbi_load("res/viking_room.png", &imageW, &imageH, NULL, 4);
-    assert(image_data != NULL);
-    SDL_GPUTextureCreateInfo textureCreateInfo = {};
-    textureCreateInfo.format = SDL_GPU_TEXTUREFORMAT_R8G8B8A8_UNORM;
-    textureCreateInfo.usage = SDL_GPU_TEXTUREUSAGE_SAMPLER;
-    textureCreateInfo.width = imageW;
-    textureCreateInfo.height = imageH;
-    textureCreateInfo.layer_count_or_depth = 1;
-    textureCreateInfo.num_levels = 1;
-    SDL_GPUTexture* texture = SDL_CreateGPUTexture(device, &textureCreateInfo);
-
-
-    std::vector<Uint32> indices;
-    std::vector<VertexData> vertices = load_model("res/viking_room.obj", indices);
-    assert(!vertices.empty());
-    assert(!indices.empty());
-
-    //VertexData vertices[] = {
-
-    //std::cout << vertices[].position.x;
-
-    //color
-    SDL_GPUColorTargetInfo colorInfo = {};
-
-    //Shaders
-    SDL_GPUShader* vertexShader = load_shader(device, "../../../../SDL3 GPU/shader/shader.spv.vert", SDL_GPU_SHADERSTAGE_VERTEX, 0, 1, 0, NULL);
-    SDL_GPUShader* fragmentShader = load_shader(device, "../../../../SDL3 GPU/shader/shader.spv.frag", SDL_GPU_SHADERSTAGE_FRAGMENT, 1, 0, NULL, NULL);
-
-    SDL_GPUColorTargetBlendState blendState = {};
-    blendState.enable_blend = false;
-
-    SDL_GPUColorTargetDescription color_target_descriptions;
-    color_target_descriptions.format = SDL_GetGPUSwapchainTextureFormat(device, window);
-    color_target_descriptions.blend_state = blendState;
-
-    SDL_GPUGraphicsPipelineTargetInfo target_info = {};
-    target_info.num_color_targets = 1;
-    target_info.color_target_descriptions = &color_target_descriptions;
-
-    //position, color
-    //VertexData vertices[] = {
-    //    {{-0.5f,  0.5f, 0.0f },{0,1} , {1.0f, 0.0f, 0.0f, 1.0f}}, // Triangle 1
-    //    {{ 0.5f,  0.5f, 0.0f },{1,1} , {0.0f, 1.0f, 0.0f, 1.0f}},
-    //    {{-0.5f, -0.5f, 0.0f },{0,0} , {0.0f, 0.0f, 1.0f, 1.0f}},
-    //    {{ 0.5f, -0.5f, 0.0f },{1,0} , {1.0f, 1.0f, 0.0f, 1.0f}}, // Triangle 2
-    //};
-
-    //Uint32 indices[] {
-    //    0, 1, 2,
-    //    2, 1, 3
-    //};
-
-    // Create and upload the vertex buffer
-    SDL_GPUBufferCreateInfo vertexBufferInfo = {};
-    vertexBufferInfo.usage = SDL_GPU_BUFFERUSAGE_VERTEX;
-    vertexBufferInfo.size = vertices.size() * sizeof(VertexData);
-    SDL_GPUBuffer* vertexBuffer = SDL_CreateGPUBuffer(device, &vertexBufferInfo);
-    if (!vertexBuffer) {
-        std::cout << "Failed to create vertex buffer. Error: " << SDL_GetError() << std::endl;
-    }
-
-    // Create and upload the index buffer
-    SDL_GPUBufferCreateInfo indexBufferInfo = {};
-    indexBufferInfo.usage = SDL_GPU_BUFFERUSAGE_INDEX;
-    indexBufferInfo.size = indices.size() * sizeof(Uint32);
-    SDL_GPUBuffer* indexBuffer = SDL_CreateGPUBuffer(device, &indexBufferInfo);
-    if (!indexBuffer) {
-        std::cout << "Failed to create index buffer. Error: " << SDL_GetError() << std::endl;
-    }
-
-    // Upload vertex and index data
-
-    //Transfer Buffer
-    SDL_GPUTransferBufferCreateInfo transferBufferInfo = {};
-    transferBufferInfo.usage = SDL_GPU_TRANSFERBUFFERUSAGE_UPLOAD;
-    transferBufferInfo.size = vertices.size() * sizeof(VertexData) + indices.size() * sizeof(Uint32);
-    SDL_GPUTransferBuffer* transferBuffer = SDL_CreateGPUTransferBuffer(device, &transferBufferInfo);
-
-    if (!transferBuffer) {
-        std::cout << "Failed to create transfer buffer. Error: " << SDL_GetError() << std::endl;
-        return -1; // Handle error appropriately
-    }
-
-    void* transferMem = SDL_MapGPUTransferBuffer(device, transferBuffer, false);
-    if (!transferMem) {
-        std::cout << "Failed to map transfer buffer. Error: " << SDL_GetError() << std::endl;
-        return -1; // Handle error appropriately
+    DepthBuffer* depthBuffer = create_depth_buffer(device);
+    if (!depthBuffer) {
+        return 1;
     }
-
-    // Copy vertex data
-    std::memcpy(transferMem, vertices.data(), vertices.size() * sizeof(VertexData));
-
-    // Copy index data
-    std::memcpy(static_cast<char*>(transferMem) + vertices.size() * sizeof(VertexData), indices.data(), indices.size() * sizeof(Uint32));
-
-    SDL_UnmapGPUTransferBuffer(device, transferBuffer);
-
-    //Transfer Buffer
-    SDL_GPUTransferBufferCreateInfo textureTransferBufferInfo = {};
-    textureTransferBufferInfo.usage = SDL_GPU_TRANSFERBUFFERUSAGE_UPLOAD;
-    textureTransferBufferInfo.size = imageW * imageH * 4;
-    SDL_GPUTransferBuffer* textureTransferBuffer = SDL_CreateGPUTransferBuffer(device, &textureTransferBufferInfo);
-    assert(textureTransferBuffer!=NULL);
-    void* textureTransferMem = SDL_MapGPUTransferBuffer(device, textureTransferBuffer, false);
-    assert(textureTransferMem != NULL);
-    memcpy(textureTransferMem, image_data, imageW * imageH * 4);
-    SDL_UnmapGPUTransferBuffer(device, textureTransferBuffer);
-
-    SDL_GPUCommandBuffer* copyCommandBuffer = SDL_AcquireGPUCommandBuffer(device);
-    SDL_GPUCopyPass* copyPass = SDL_BeginGPUCopyPass(copyCommandBuffer);
-
-    SDL_GPUTransferBufferLocation vertexTransferLocation = {};
-    vertexTransferLocation.transfer_buffer = transferBuffer;
-    vertexTransferLocation.offset = 0;
-
-    SDL_GPUBufferRegion vertexBufferRegion = {};
-    vertexBufferRegion.buffer = vertexBuffer;
-    vertexBufferRegion.size = vertices.size() * sizeof(VertexData);
-
-    SDL_UploadToGPUBuffer(copyPass, &vertexTransferLocation, &vertexBufferRegion, false);
-
-
-    SDL_GPUTransferBufferLocation indexTransferLocation = {};
-    indexTransferLocation.transfer_buffer = transferBuffer;
-    indexTransferLocation.offset = vertices.size() * sizeof(VertexData);
-
-    SDL_GPUBufferRegion indexBufferRegion = {};
-    indexBufferRegion.buffer = indexBuffer;
-    indexBufferRegion.size = indices.size() * sizeof(Uint32);
-
-    SDL_GPUTextureTransferInfo textureTransferInfo = {};
-    textureTransferInfo.transfer_buffer = textureTransferBuffer;
-    textureTransferInfo.offset = 0;
-
-    SDL_GPUTextureRegion textureRegion = {};
-    textureRegion.texture = texture;
-    textureRegion.w = imageW;
-    textureRegion.h = imageH;
-    textureRegion.d = 1;
-
-    SDL_UploadToGPUBuffer(copyPass, &indexTransferLocation, &indexBufferRegion, false);
-    SDL_UploadToGPUTexture(copyPass, &textureTransferInfo, &textureRegion, false);
-    SDL_EndGPUCopyPass(copyPass);
-    assert(SDL_SubmitGPUCommandBuffer(copyCommandBuffer));
-
-    SDL_ReleaseGPUTransferBuffer(device, transferBuffer);
-    SDL_ReleaseGPUTransferBuffer(device, textureTransferBuffer);
+    // Assets decode on worker threads and are uploaded by update_asset_loader
+    AssetLoaderOptions loaderOptions = {};
+    loaderOptions.num_threads = 0;
+    loaderOptions.packed_vertices = packedVertices;
+    loaderOptions.mipmap_mode = mipmapMode;
+    UploadRing* uploadRing = create_upload_ring(device, UPLOAD_RING_SIZE);
+    AssetLoader* assetLoader = create_asset_loader(device, uploadRing, loaderOptions);
+    FramePacer* framePacer = create_frame_pacer(device, uploadRing, framesInFlight, FRAME_DYNAMIC_BUFFER_SIZE);
+    Asset* textureAsset = request_texture(assetLoader, "res/viking_room");
+    Asset* meshAsset = request_mesh(assetLoader, "res/viking_room.obj");
 
     //GPU sampler
-    SDL_GPUSamplerCreateInfo samplerCreateInfo = {};
-    SDL_GPUSampler* sampler = SDL_CreateGPUSampler(device, &samplerCreateInfo);
-
-    // Vertex input state
-    SDL_GPUVertexBufferDescription vertexBufferDescription = {};
-    vertexBufferDescription.slot = 0;
-    vertexBufferDescription.pitch = sizeof(VertexData);
-    vertexBufferDescription.input_rate = SDL_GPU_VERTEXINPUTRATE_VERTEX;
-
-    //vertex attributes
-    SDL_GPUVertexAttribute vertexAttributes[3] = {};
-    //Position
-    vertexAttributes[0].location = 0;
-    vertexAttributes[0].format = SDL_GPU_VERTEXELEMENTFORMAT_FLOAT3;
-    vertexAttributes[0].offset = offsetof(VertexData, position);
-    //Texcoord
-    vertexAttributes[1].location = 1;
-    vertexAttributes[1].format = SDL_GPU_VERTEXELEMENTFORMAT_FLOAT2;
-    vertexAttributes[1].offset = offsetof(VertexData, texcoord);
-    //color
-    vertexAttributes[2].location = 2;
-    vertexAttributes[2].format = SDL_GPU_VERTEXELEMENTFORMAT_FLOAT4;
-    vertexAttributes[2].offset = offsetof(VertexData, color);
-
-    SDL_GPUVertexInputState vertexInputState = {};
-    vertexInputState.num_vertex_buffers = 1;
-    vertexInputState.vertex_buffer_descriptions = &vertexBufferDescription;
-    vertexInputState.num_vertex_attributes = 3;
-    vertexInputState.vertex_attributes = vertexAttributes;
-
-    // Pipeline creation
-    SDL_GPUGraphicsPipelineCreateInfo pipelineInfo = {};
-    pipelineInfo.vertex_shader = vertexShader;
-    pipelineInfo.fragment_shader = fragmentShader;
-    pipelineInfo.primitive_type = SDL_GPU_PRIMITIVETYPE_TRIANGLELIST;
-    pipelineInfo.target_info = target_info;
-    pipelineInfo.vertex_input_state = vertexInputState;
-
-    SDL_GPUGraphicsPipeline* pipeline = SDL_CreateGPUGraphicsPipeline(device, &pipelineInfo);
-    if (!pipeline) {
-        std::cout << "Failed to create pipeline. Error: " << SDL_GetError() << std::endl;
-    }
-
-    int width, height;
-    SDL_GetWindowSize(window, &width, &height);
+    SDL_GPUSampler* sampler = create_texture_sampler(device, anisotropy);
+
+    // Pipelines depend on the vertex format the mesh was cached in, so they are created once the mesh arrives
+    SDL_GPUGraphicsPipeline* pipeline = NULL;
+    SDL_GPUGraphicsPipeline* prepassPipeline = NULL;      // depth only
+    SDL_GPUGraphicsPipeline* afterPrepassPipeline = NULL; // shades what the prepass left visible
+    // Overdraw counting without and with a prepass, and that prepass into the count target
+    SDL_GPUGraphicsPipeline* countPipelines[OVERDRAW_SLOTS] = {};
+    SDL_GPUGraphicsPipeline* countPrepassPipeline = NULL;
+    OverdrawCounter* overdrawCounter = measureOverdraw ? create_overdraw_counter(device) : NULL;
+    const SDL_GPUTextureFormat swapchainFormat = headless ? HEADLESS_FORMAT : SDL_GetGPUSwapchainTextureFormat(device, window);
 
     const float rotationSpeed = glm::radians(90.0f);
     float rotation = 0.0f;
 
-    glm::mat4 Projection = glm::perspective(70.0f, (float)width / height, 0.0000001f, 10000.0f);
-    glm::mat4 model = glm::translate(glm::mat4(1.0f), glm::vec3(-0.0f, 0.0f, -10.0f)) * glm::rotate(glm::mat4(1.0f), rotation, glm::vec3(0.0f, 1.0f, -0.0f));
-
-    SDL_GPUBufferBinding vertexBufferBinding = {};
-    vertexBufferBinding.buffer = vertexBuffer;
-    vertexBufferBinding.offset = 0;
+    // With reversed-Z and no far plane the near plane can sit close without losing depth precision
+    const float zNear = 0.1f;
+    glm::mat4 View = glm::mat4(1.0f);
+    // Instance matrices are built on all cores with the widest SIMD kernel available
+    ThreadPool* transformPool = create_thread_pool(0);
+    SDL_Log("Transform kernel: %s", transform_kernel_name(best_transform_kernel()));
+    // Last run's pipelines compile on the pool while the assets load
+    PipelineCache* pipelineCache = create_pipeline_cache(device, shaderLibrary);
+    prewarm_pipeline_cache(pipelineCache, transformPool, PIPELINE_MANIFEST, build_scene_pipeline);
+    ShaderReloader* shaderReloader = NULL;
+    if (hotReload) {
+        shaderReloader = create_shader_reloader(SHADER_SOURCE_DIR, shaderCompiler, shaderVariants, SDL_arraysize(shaderVariants));
+    }
+    Uint64 shaderEditedAt = 0;
+    InstanceGrid instanceGrid;
+    std::vector<VisibleSubmesh> visibleSubmeshes;
+    CullStats cullStats = {};
+    MeshletCullStats meshletStats = {};
+    RenderQueue* renderQueue = create_render_queue();
+    ParallelRecorder* parallelRecorder = create_parallel_recorder(device);
+    RenderQueueStats renderQueueStats = {};
+    // Per-object draws read the model matrix from the uniform and this identity instance
+    const InstanceData identityInstance = { glm::mat4(1.0f) };
+    // Without compute support the GPU-culled mode falls back to CPU culling
+    GpuCulling* gpuCulling = create_gpu_culling(device, shaderLibrary);
+    if (gpuCulling == NULL) {
+        std::cout << "GPU culling unavailable, culling on the CPU" << std::endl;
+    }
+    int exitCode = 0;
+    InstancingBenchmark instancingBench = {};
+    InstancingBenchmark lodBench = {};
+    const float gridDistance = benchLod ? LOD_BENCHMARK_DISTANCE : 10.0f;
+    Uint64 lastFrameStart = SDL_GetPerformanceCounter();
+    // Frames drawn with every asset resident, which is what --frames counts
+    Uint32 sceneFrames = 0;
+    Uint64 sceneStart = 0;
+    Uint64 sceneRecordTicks = 0;
+
+    SDL_GPUBufferBinding vertexBufferBindings[2] = {};
 
     SDL_GPUBufferBinding indexBufferBinding = {};
-    indexBufferBinding.buffer = indexBuffer;
 
     SDL_GPUTextureSamplerBinding textureSamplerBinding = {};
-    textureSamplerBinding.texture = texture;
     textureSamplerBinding.sampler = sampler;
 
     Uint64 lastTime = SDL_GetPerformanceCounter();
     SDL_Event event;
     bool running = true;
     while (running) {
+        PROFILE_SCOPE("Frame");
+        // Waits for a free frame context first, so input is sampled as late as the pacing allows
+        FrameContext* frame = begin_frame(framePacer);
+        if (!frame) {
+            break;
+        }
+        Uint64 frameStart = SDL_GetPerformanceCounter();
+        SDL_GPUCommandBuffer* commandBuffer = frame->command_buffer;
+
         Uint64 currentTime = SDL_GetPerformanceCounter();
         float deltaTime = (float)(currentTime - lastTime) / SDL_GetPerformanceFrequency();
         lastTime = currentTime;
@@ -364,10 +378,105 @@ int main(int argc, char* argv[]) {
             }
         }
 
-        UBO ubo = { Projection * model };
-        SDL_GPUCommandBuffer* commandBuffer = SDL_AcquireGPUCommandBuffer(device);
-        SDL_GPUTexture* texture;
-        SDL_WaitAndAcquireGPUSwapchainTexture(commandBuffer, window, &texture, NULL, NULL);
+        update_asset_loader(assetLoader);
+        // Swaps every shader of an edit at once, between frames
+        ShaderReload shaderReload;
+        if (shaderReloader && poll_shader_reloader(shaderReloader, shaderReload)) {
+            for (const ShaderBlob& blob : shaderReload.shaders) {
+                if (blob.stage == SHADER_STAGE_COMPUTE) {
+                    if (gpuCulling) {
+                        gpu_culling_reload_shader(gpuCulling, blob);
+                    }
+                } else {
+                    pipeline_cache_reload_shader(pipelineCache, blob);
+                }
+            }
+            // Released pipelines would otherwise keep their ids and push new ones past the sort key's pipeline bits
+            clear_render_queue_pipelines(renderQueue);
+            // Fetched again below: rebuilt where a shader changed, straight from the cache elsewhere
+            pipeline = NULL;
+            prepassPipeline = NULL;
+            afterPrepassPipeline = NULL;
+            countPrepassPipeline = NULL;
+            for (SDL_GPUGraphicsPipeline*& countPipeline : countPipelines) {
+                countPipeline = NULL;
+            }
+            shaderEditedAt = shaderReload.changed_at;
+        }
+        if (!pipeline && asset_ready(meshAsset)) {
+            ScenePipelineDesc desc = {};
+            desc.color_format = swapchainFormat;
+            desc.depth_format = depth_buffer_format(depthBuffer);
+            desc.vertex_format = meshAsset->mesh.vertex_format;
+            desc.fragment_shader = "shader.frag";
+            desc.cull_backfaces = meshletCulling;
+            pipeline = get_scene_pipeline(pipelineCache, desc);
+
+            ScenePipelineDesc prepass = desc;
+            prepass.fragment_shader = "depth_only.frag";
+            prepass.depth_only = true;
+            ScenePipelineDesc afterPrepass = desc;
+            afterPrepass.after_prepass = true;
+            if (depthPrepass) {
+                prepassPipeline = get_scene_pipeline(pipelineCache, prepass);
+                afterPrepassPipeline = get_scene_pipeline(pipelineCache, afterPrepass);
+            }
+            if (measureOverdraw) {
+                prepass.color_format = OVERDRAW_FORMAT;
+                countPrepassPipeline = get_scene_pipeline(pipelineCache, prepass);
+                ScenePipelineDesc count = desc;
+                count.color_format = OVERDRAW_FORMAT;
+                count.fragment_shader = "overdraw.frag";
+                count.additive = true;
+                countPipelines[0] = get_scene_pipeline(pipelineCache, count);
+                count.after_prepass = true;
+                countPipelines[1] = get_scene_pipeline(pipelineCache, count);
+            }
+        }
+
+        if (shaderEditedAt && pipeline) {
+            SDL_Log("Shader edit live %.0f ms after saving", (double)(SDL_GetPerformanceCounter() - shaderEditedAt) * 1000.0 / SDL_GetPerformanceFrequency());
+            shaderEditedAt = 0;
+        }
+
+        if (benchInstancing && pipeline && !instancing_benchmark_stage(instancingBench, instanceCount, instanceDrawMode)) {
+            running = false;
+        }
+        if (benchLod && pipeline && !lod_benchmark_stage(lodBench, lodThreshold)) {
+            running = false;
+        }
+        if (instanceDrawMode == INSTANCE_DRAW_GPU_CULLED && gpuCulling == NULL) {
+            instanceDrawMode = INSTANCE_DRAW_INSTANCED;
+        }
+        // Parallel jobs draw offscreen at the window's size; the swapchain texture is only acquired to present it
+        const bool recordParallel = (recordJobs > 1 || benchRecording) && instanceDrawMode != INSTANCE_DRAW_GPU_CULLED && !measureOverdraw;
+        SDL_GPUTexture* texture = NULL;
+        Uint32 swapchainWidth = 0, swapchainHeight = 0;
+        if (recordParallel) {
+            int pixelWidth = HEADLESS_WIDTH, pixelHeight = HEADLESS_HEIGHT;
+            if (!headless) {
+                SDL_GetWindowSizeInPixels(window, &pixelWidth, &pixelHeight);
+            }
+            swapchainWidth = (Uint32)pixelWidth;
+            swapchainHeight = (Uint32)pixelHeight;
+            texture = acquire_scene_color(parallelRecorder, swapchainFormat, swapchainWidth, swapchainHeight);
+        } else if (headless) {
+            texture = headless_color(headlessTarget);
+            swapchainWidth = HEADLESS_WIDTH;
+            swapchainHeight = HEADLESS_HEIGHT;
+        } else if (!SDL_WaitAndAcquireGPUSwapchainTexture(commandBuffer, window, &texture, &swapchainWidth, &swapchainHeight)) {
+            std::cout << "Failed to acquire swapchain texture. Error: " << SDL_GetError() << std::endl;
+        }
+        // Acquiring can block on presentation; time the frames that finished meanwhile now, not at the next begin_frame
+        poll_frame_completion(framePacer);
+        // No swapchain texture while minimized; the empty command buffer still has to be submitted
+        SDL_GPUTexture* depthTexture = texture ? acquire_depth_texture(depthBuffer, swapchainWidth, swapchainHeight) : NULL;
+        if (depthTexture == NULL) {
+            submit_frame(framePacer, frame);
+            continue;
+        }
+        // Follows the swapchain, so a resized window keeps its aspect ratio
+        const glm::mat4 Projection = reversed_infinite_perspective(glm::radians(70.0f), (float)swapchainWidth / swapchainHeight, zNear);
 
         SDL_GPUColorTargetInfo colorInfo = {};
         colorInfo.texture = texture;
@@ -375,21 +484,367 @@ int main(int argc, char* argv[]) {
         colorInfo.clear_color = { 1.0f, 1.0f, 1.0f, 1.0f };
         colorInfo.store_op = SDL_GPU_STOREOP_STORE;
 
-        SDL_GPURenderPass* renderPass = SDL_BeginGPURenderPass(commandBuffer, &colorInfo, 1, NULL);
+        SDL_GPUDepthStencilTargetInfo depthInfo = {};
+        depthInfo.texture = depthTexture;
+        depthInfo.clear_depth = DEPTH_CLEAR_VALUE;
+        depthInfo.load_op = SDL_GPU_LOADOP_CLEAR;
+        // Only the depth pyramid reads depth after the pass
+        depthInfo.store_op = occlusionCulling ? SDL_GPU_STOREOP_STORE : SDL_GPU_STOREOP_DONT_CARE;
+        depthInfo.stencil_load_op = SDL_GPU_LOADOP_DONT_CARE;
+        depthInfo.stencil_store_op = SDL_GPU_STOREOP_DONT_CARE;
+        depthInfo.cycle = true;
+
+        // The scene only counts once nothing on screen is a placeholder
+        const bool sceneReady = pipeline && asset_ready(textureAsset);
+        if (sceneReady && sceneFrames == 0) {
+            sceneStart = frameStart;
+        }
+        const bool lastFrame = sceneReady && frameLimit && sceneFrames + 1 == frameLimit;
+        // Headless runs advance a fixed step per scene frame, so frame N looks the same on every run
+        if (headless) {
+            deltaTime = sceneReady ? HEADLESS_TIMESTEP : 0.0f;
+            if (meshAsset->state == ASSET_STATE_FAILED || textureAsset->state == ASSET_STATE_FAILED) {
+                std::cout << "Failed to load the scene" << std::endl;
+                exitCode = 1;
+                running = false;
+            }
+        }
         rotation += rotationSpeed * deltaTime;
-        model = glm::translate(glm::mat4(1.0f), glm::vec3(-0.0f, 0.0f, -10.0f)) * glm::rotate(glm::mat4(1.0f), rotation, glm::vec3(0.0f, 1.0f, -0.0f));
-
-        SDL_BindGPUGraphicsPipeline(renderPass, pipeline);
-        SDL_BindGPUVertexBuffers(renderPass, 0, &vertexBufferBinding, 1);
-        SDL_BindGPUIndexBuffer(renderPass, &indexBufferBinding, SDL_GPU_INDEXELEMENTSIZE_32BIT);
-        SDL_PushGPUVertexUniformData(commandBuffer, 0, &ubo, sizeof(ubo));
-        SDL_BindGPUFragmentSamplers(renderPass, 0, &textureSamplerBinding, 1);
-        SDL_DrawGPUIndexedPrimitives(renderPass, indices.size(), 1, 0, 0, 0);
-        SDL_EndGPURenderPass(renderPass);
-        assert(SDL_SubmitGPUCommandBuffer(commandBuffer));
+        if (transform_count(instanceGrid.transforms) != instanceCount) {
+            build_instance_grid(instanceGrid, instanceCount, gridDistance);
+        }
+        const bool gpuCulled = instanceDrawMode == INSTANCE_DRAW_GPU_CULLED;
+        if (!gpuCulled) {
+            animate_instance_grid(instanceGrid, rotation);
+        }
+
+        // Only instances inside the frustum get matrices, staged through the upload ring before the render pass
+        const glm::mat4 viewProjection = Projection * View;
+        const glm::vec3 eye = glm::vec3(glm::inverse(View)[3]);
+        bool drawInstances = false;
+        if (pipeline && gpuCulled) {
+            // Instances stay resident and are spun by the cull shader, so nothing here scales with their count
+            SDL_GPUCopyPass* copyPass = SDL_BeginGPUCopyPass(commandBuffer);
+            bool resident = gpu_culling_instance_count(gpuCulling) == instanceCount;
+            if (!resident) {
+                animate_instance_grid(instanceGrid, 0.0f);
+                resident = gpu_culling_set_instances(gpuCulling, framePacer, copyPass, meshAsset->mesh, instanceGrid.transforms);
+            }
+            drawInstances = resident && gpu_culling_reset_draws(gpuCulling, framePacer, copyPass, meshAsset->mesh);
+            SDL_EndGPUCopyPass(copyPass);
+            if (drawInstances) {
+                GpuCullParams cullParams = {};
+                cullParams.view = View;
+                cullParams.projection = Projection;
+                cullParams.znear = zNear;
+                cullParams.spin = rotation;
+                cullParams.occlusion = occlusionCulling;
+                cullParams.reversed_z = true;
+                gpu_culling_dispatch(gpuCulling, commandBuffer, cullParams);
+            }
+        } else if (pipeline) {
+            cull_instances(extract_frustum(viewProjection), instanceGrid.transforms, meshAsset->mesh, visibleSubmeshes, cullStats);
+            const LodSelection lodSelection = { eye, Projection[1][1] * swapchainHeight * 0.5f, lodThreshold };
+            for (size_t s = 0; s < visibleSubmeshes.size(); ++s) {
+                sort_instances_by_lod(instanceGrid.transforms, meshAsset->mesh.submeshes[s], lodSelection, visibleSubmeshes[s]);
+            }
+            SDL_GPUCopyPass* copyPass = SDL_BeginGPUCopyPass(commandBuffer);
+            if (instanceDrawMode == INSTANCE_DRAW_INSTANCED) {
+                drawInstances = true;
+                for (VisibleSubmesh& visible : visibleSubmeshes) {
+                    if (!visible.indices.empty()) {
+                        drawInstances &= upload_instances(framePacer, frame, copyPass, transformPool, visible.transforms, visible.binding);
+                    }
+                }
+            } else {
+                drawInstances = upload_instance_data(framePacer, frame, copyPass, &identityInstance, 1, vertexBufferBindings[1]);
+                for (VisibleSubmesh& visible : visibleSubmeshes) {
+                    visible.mvps.resize(visible.indices.size());
+                    transform_batch(transformPool, visible.transforms, TRANSFORM_OUTPUT_MAT4, &viewProjection, visible.mvps.data());
+                }
+                if (meshletCulling) {
+                    for (size_t s = 0; s < visibleSubmeshes.size(); ++s) {
+                        cull_instance_meshlets(meshAsset->mesh, s, eye, visibleSubmeshes[s], meshletStats);
+                    }
+                }
+            }
+            SDL_EndGPUCopyPass(copyPass);
+        }
+
+        // Fills and sorts the render queue with the CPU-culled scene once per pipeline, each pipeline its own pass of the sort key
+        auto queueScene = [&](SDL_GPUGraphicsPipeline* const* passPipelines, Uint32 passCount, Uint64& triangles) {
+            PROFILE_SCOPE("Queue scene");
+            const MeshAsset& mesh = meshAsset->mesh;
+            vertexBufferBindings[0].buffer = mesh.vertex_buffer;
+            indexBufferBinding.buffer = mesh.index_buffer;
+            textureSamplerBinding.texture = textureAsset->texture;
+
+            reset_render_queue(renderQueue);
+            Uint32 pipelineIds[SCENE_MAX_PASSES];
+            for (Uint32 pass = 0; pass < passCount; ++pass) {
+                pipelineIds[pass] = render_queue_pipeline(renderQueue, passPipelines[pass]);
+            }
+            auto queueDraw = [&](DrawItem& item, float depth) {
+                for (Uint32 pass = 0; pass < passCount; ++pass) {
+                    item.pipeline = pipelineIds[pass];
+                    item.key = render_key(pass, item.pipeline, item.material, depth);
+                    queue_draw(renderQueue, item);
+                }
+            };
+
+            DrawItem item = {};
+            item.material = render_queue_material(renderQueue, textureSamplerBinding);
+            item.vertex_buffers[0] = vertexBufferBindings[0];
+            item.vertex_buffers[1] = vertexBufferBindings[1];
+            item.vertex_buffer_count = 2;
+            item.uniform_size = sizeof(UBO);
+            if (instanceDrawMode == INSTANCE_DRAW_INSTANCED) {
+                UBO ubo = { viewProjection, mesh.dequantize };
+                item.uniform = queue_uniforms(renderQueue, &ubo, sizeof(ubo));
+            }
+            for (size_t s = 0; s < mesh.submeshes.size(); ++s) {
+                const Submesh& submesh = mesh.submeshes[s];
+                const VisibleSubmesh& visible = visibleSubmeshes[s];
+                const Uint32 visibleCount = (Uint32)visible.indices.size();
+                if (instanceDrawMode == INSTANCE_DRAW_INSTANCED) {
+                    // Each submesh has its own compacted instance range, sorted so every level of detail is one draw
+                    for (Uint32 lod = 0; lod < MAX_MESH_LODS && visibleCount > 0; ++lod) {
+                        if (visible.lod_instances[lod] == 0) {
+                            continue;
+                        }
+                        item.vertex_buffers[1] = visible.binding;
+                        item.vertex_buffers[1].offset += visible.lod_first[lod] * (Uint32)sizeof(InstanceData);
+                        triangles += submesh_draw_item(submesh, lod, mesh.index_buffer, visible.lod_instances[lod], item);
+                        // Coarser levels are farther away
+                        queueDraw(item, (float)lod);
+                    }
+                    continue;
+                }
+                for (Uint32 k = 0; k < visibleCount; ++k) {
+                    UBO ubo = { visible.mvps[k], mesh.dequantize };
+                    item.uniform = queue_uniforms(renderQueue, &ubo, sizeof(ubo));
+                    // Clip-space w of the instance's origin, its distance along the view direction
+                    const float depth = visible.mvps[k][3][3];
+                    triangles += submesh_draw_item(submesh, visible.lods[k], mesh.index_buffer, 1, item);
+                    // Clusters only exist for full detail; coarser levels draw whole
+                    if (!meshletCulling || visible.lods[k] != 0) {
+                        queueDraw(item, depth);
+                        continue;
+                    }
+                    triangles -= item.num_indices / 3;
+                    for (Uint32 d = visible.meshlet_draw_offsets[k]; d < visible.meshlet_draw_offsets[k + 1]; ++d) {
+                        item.first_index = submesh.first_index + visible.meshlet_draws[d].first_index;
+                        item.num_indices = visible.meshlet_draws[d].index_count;
+                        triangles += item.num_indices / 3;
+                        queueDraw(item, depth);
+                    }
+                }
+            }
+            sort_render_queue(renderQueue, renderQueueStats);
+        };
+        // Draws the scene once per pipeline, in order
+        auto drawScene = [&](SDL_GPURenderPass* renderPass, SDL_GPUGraphicsPipeline* const* passPipelines, Uint32 passCount,
+            Uint64& triangles) {
+            PROFILE_SCOPE("Record scene");
+            if (!gpuCulled) {
+                queueScene(passPipelines, passCount, triangles);
+                return submit_render_queue(renderQueue, renderPass, commandBuffer, renderQueueStats);
+            }
+
+            const MeshAsset& mesh = meshAsset->mesh;
+            vertexBufferBindings[0].buffer = mesh.vertex_buffer;
+            indexBufferBinding.buffer = mesh.index_buffer;
+            textureSamplerBinding.texture = textureAsset->texture;
+            Uint32 drawCalls = 0;
+            for (Uint32 pass = 0; pass < passCount; ++pass) {
+                SDL_BindGPUGraphicsPipeline(renderPass, passPipelines[pass]);
+                SDL_BindGPUFragmentSamplers(renderPass, 0, &textureSamplerBinding, 1);
+                SDL_BindGPUVertexBuffers(renderPass, 0, vertexBufferBindings, 1);
+                UBO ubo = { viewProjection, mesh.dequantize };
+                SDL_PushGPUVertexUniformData(commandBuffer, 0, &ubo, sizeof(ubo));
+                drawCalls += gpu_culling_draw(gpuCulling, renderPass, mesh, indexBufferBinding);
+            }
+            return drawCalls;
+        };
+
+        // Until the mesh is resident only the clear is presented; the texture may still be the placeholder
+        Uint32 drawCalls = 0;
+        Uint64 triangles = 0;
+        // The prepass leaves final depth, so the textured shader only runs for visible fragments
+        const bool prepass = prepassPipeline && afterPrepassPipeline;
+        SDL_GPUGraphicsPipeline* scenePasses[SCENE_MAX_PASSES] = { prepass ? prepassPipeline : pipeline, afterPrepassPipeline };
+        if (recordParallel) {
+            reset_render_queue(renderQueue);
+            if (drawInstances) {
+                queueScene(scenePasses, prepass ? 2 : 1, triangles);
+            }
+            // The uploads go first, then the jobs drawing offscreen, then this command buffer presenting their result
+            commandBuffer = split_frame(framePacer, frame);
+            if (benchRecording && drawInstances) {
+                benchmark_parallel_recording(parallelRecorder, renderQueue, colorInfo, depthInfo, 20);
+                running = false;
+            }
+            if (!record_render_queue_parallel(parallelRecorder, transformPool, renderQueue, recordJobs, colorInfo, depthInfo, renderQueueStats)) {
+                running = false;
+            }
+            drawCalls = render_queue_size(renderQueue);
+            if (!headless) {
+                present_scene_color(commandBuffer, window, texture, swapchainWidth, swapchainHeight);
+            }
+        } else {
+            SDL_GPURenderPass* renderPass = SDL_BeginGPURenderPass(commandBuffer, &colorInfo, 1, &depthInfo);
+            if (drawInstances) {
+                drawCalls = drawScene(renderPass, scenePasses, prepass ? 2 : 1, triangles);
+            }
+            SDL_EndGPURenderPass(renderPass);
+        }
+        // Next frame's occlusion test reads this frame's depth
+        if (drawInstances && gpuCulled && occlusionCulling) {
+            gpu_culling_build_depth_pyramid(gpuCulling, commandBuffer, depthTexture, swapchainWidth, swapchainHeight, true);
+        }
+
+        // One-off: counts shaded fragments into a separate target, first with depth testing alone, then after a prepass
+        bool overdrawRecorded = false;
+        SDL_GPUTexture* countTarget = NULL;
+        if (measureOverdraw && drawInstances && countPipelines[0] && countPipelines[1] && countPrepassPipeline) {
+            countTarget = overdraw_target(overdrawCounter, swapchainWidth, swapchainHeight);
+        }
+        if (countTarget) {
+            for (Uint32 slot = 0; slot < OVERDRAW_SLOTS; ++slot) {
+                SDL_GPUColorTargetInfo countInfo = {};
+                countInfo.texture = countTarget;
+                countInfo.clear_color = { 0.0f, 0.0f, 0.0f, 0.0f };
+                countInfo.load_op = SDL_GPU_LOADOP_CLEAR;
+                countInfo.store_op = SDL_GPU_STOREOP_STORE;
+                SDL_GPUDepthStencilTargetInfo countDepth = depthInfo;
+                countDepth.store_op = SDL_GPU_STOREOP_DONT_CARE;
+
+                SDL_GPURenderPass* countPass = SDL_BeginGPURenderPass(commandBuffer, &countInfo, 1, &countDepth);
+                Uint64 countTriangles = 0;
+                SDL_GPUGraphicsPipeline* countPasses[SCENE_MAX_PASSES] = { slot == 0 ? countPipelines[0] : countPrepassPipeline, countPipelines[1] };
+                drawScene(countPass, countPasses, slot + 1, countTriangles);
+                SDL_EndGPURenderPass(countPass);
+                download_overdraw(overdrawCounter, commandBuffer, slot);
+            }
+            overdrawRecorded = true;
+        }
+        if (lastFrame && readBackFrame) {
+            download_headless_frame(headlessTarget, commandBuffer, texture);
+        }
+        Uint64 recordEnd = SDL_GetPerformanceCounter();
+        if (!submit_frame(framePacer, frame)) {
+            running = false;
+        }
+        if (sceneReady) {
+            ++sceneFrames;
+            sceneRecordTicks += recordEnd - frameStart;
+        }
+        if (lastFrame) {
+            running = false;
+        }
+
+        if (verifyGpuCulling && gpuCulled && drawInstances) {
+            std::vector<Uint32> gpuCounts;
+            CullStats referenceStats = {};
+            animate_instance_grid(instanceGrid, rotation);
+            cull_instances(extract_frustum(viewProjection), instanceGrid.transforms, meshAsset->mesh, visibleSubmeshes, referenceStats);
+            if (!gpu_culling_read_counts(gpuCulling, gpuCounts)) {
+                exitCode = 1;
+            }
+            for (size_t s = 0; s < gpuCounts.size(); ++s) {
+                Uint32 cpuCount = (Uint32)visibleSubmeshes[s].indices.size();
+                SDL_Log("Submesh %u: %u of %u instances visible on the GPU, %u on the CPU", (Uint32)s, gpuCounts[s], instanceCount, cpuCount);
+                // Spheres grazing a plane may land either side of it between the two float paths
+                Uint32 difference = gpuCounts[s] > cpuCount ? gpuCounts[s] - cpuCount : cpuCount - gpuCounts[s];
+                if (difference > 1 + cpuCount / 1000) {
+                    exitCode = 1;
+                }
+            }
+            SDL_Log("GPU culling %s the CPU path", exitCode == 0 ? "matches" : "DOES NOT match");
+            running = false;
+        }
+
+        if (overdrawRecorded) {
+            OverdrawStats overdraw[OVERDRAW_SLOTS] = {};
+            if (read_overdraw(overdrawCounter, overdraw) && overdraw[0].covered_pixels > 0) {
+                SDL_Log("Overdraw: %.2f shaded fragments per covered pixel with depth testing alone, %.2f after a depth prepass (%llu pixels covered)",
+                    (double)overdraw[0].fragments / overdraw[0].covered_pixels,
+                    (double)overdraw[1].fragments / SDL_max(overdraw[1].covered_pixels, 1),
+                    (unsigned long long)overdraw[0].covered_pixels);
+            }
+            measureOverdraw = false;
+        }
+
+        if (benchInstancing && drawInstances) {
+            const double frequency = (double)SDL_GetPerformanceFrequency();
+            instancing_benchmark_frame(instancingBench, (recordEnd - frameStart) * 1000.0 / frequency,
+                (frameStart - lastFrameStart) * 1000.0 / frequency, drawCalls);
+        }
+        if (benchLod && drawInstances) {
+            const double frequency = (double)SDL_GetPerformanceFrequency();
+            lod_benchmark_frame(lodBench, (recordEnd - frameStart) * 1000.0 / frequency,
+                (frameStart - lastFrameStart) * 1000.0 / frequency, triangles);
+        }
+        profiler_end_frame(lastFrameStart, frameStart);
+        lastFrameStart = frameStart;
+    }
+
+    SDL_WaitForGPUIdle(device);
+    if (frameLimit && sceneFrames > 0) {
+        const double frequency = (double)SDL_GetPerformanceFrequency();
+        SDL_Log("%u frames: %.3f ms recording, %.3f ms wall time per frame", sceneFrames,
+            sceneRecordTicks * 1000.0 / frequency / sceneFrames, (SDL_GetPerformanceCounter() - sceneStart) * 1000.0 / frequency / sceneFrames);
+    }
+    std::vector<Uint8> framePixels;
+    if (readBackFrame && !read_headless_frame(headlessTarget, framePixels)) {
+        std::cout << "Failed to read back the last frame" << std::endl;
+        exitCode = 1;
+    }
+    if (!framePixels.empty()) {
+        const Uint64 checksum = frame_checksum(framePixels);
+        char checksumText[17];
+        SDL_snprintf(checksumText, sizeof(checksumText), "%016llx", (unsigned long long)checksum);
+        if (printChecksum || expectedChecksum) {
+            SDL_Log("Frame %u checksum: %s", sceneFrames, checksumText);
+        }
+        if (expectedChecksum && SDL_strcasecmp(expectedChecksum, checksumText) != 0) {
+            SDL_Log("Checksum DOES NOT match the expected %s", expectedChecksum);
+            exitCode = 1;
+        }
+        if (screenshotPath && !write_png(screenshotPath, framePixels.data(), HEADLESS_WIDTH, HEADLESS_HEIGHT)) {
+            exitCode = 1;
+        }
+    }
+    log_frame_latency(framePacer);
+    log_profiler_frame_stats();
+    if (profileTrace) {
+        write_profiler_trace(profileTrace);
     }
+    log_cull_stats(cullStats);
+    log_meshlet_cull_stats(meshletStats);
+    log_render_queue_stats(renderQueueStats);
+    destroy_render_queue(renderQueue);
+    destroy_parallel_recorder(parallelRecorder);
+    destroy_shader_reloader(shaderReloader);
+    destroy_gpu_culling(gpuCulling);
+    destroy_frame_pacer(framePacer);
+    save_pipeline_manifest(pipelineCache, PIPELINE_MANIFEST, SCENE_PIPELINE_MANIFEST_HEADER);
+    log_pipeline_cache_stats(pipelineCache);
+    // Before the pool, which may still be prewarming
+    destroy_pipeline_cache(pipelineCache);
+    destroy_thread_pool(transformPool);
+    destroy_asset_loader(assetLoader);
+    log_upload_ring_stats(uploadRing);
+    destroy_upload_ring(uploadRing);
+    destroy_overdraw_counter(overdrawCounter);
+    destroy_depth_buffer(depthBuffer);
+    destroy_headless_target(headlessTarget);
+    SDL_ReleaseGPUSampler(device, sampler);
+    // After every thread recording scopes has been joined
+    shutdown_profiler();
+    close_shader_library(shaderLibrary);
 
     SDL_DestroyWindow(window);
     SDL_Quit();
-    return 0;
+    return exitCode;
 }
\ No newline at end of file
@@ -0,0 +1,114 @@
+﻿#include "mapped_file.h"
+#include <stdio.h>
+#include <cstring>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+bool map_file(const char* path, MappedFile& file) {
+    file = {};
+
+#ifdef _WIN32
+    HANDLE handle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (handle == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(handle, &size) || size.QuadPart == 0) {
+        CloseHandle(handle);
+        return false;
+    }
+
+    HANDLE mapping = CreateFileMappingA(handle, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping == NULL) {
+        fprintf(stderr, "ERROR: CreateFileMapping(%s) failed: %lu\n", path, GetLastError());
+        CloseHandle(handle);
+        return false;
+    }
+
+    void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (view == NULL) {
+        fprintf(stderr, "ERROR: MapViewOfFile(%s) failed: %lu\n", path, GetLastError());
+        CloseHandle(mapping);
+        CloseHandle(handle);
+        return false;
+    }
+
+    file.data = (const Uint8*)view;
+    file.size = (size_t)size.QuadPart;
+    file.file_handle = handle;
+    file.mapping_handle = mapping;
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return false;
+    }
+
+    void* view = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (view == MAP_FAILED) {
+        fprintf(stderr, "ERROR: mmap(%s) failed\n", path);
+        return false;
+    }
+
+    file.data = (const Uint8*)view;
+    file.size = (size_t)st.st_size;
+#endif
+
+    return true;
+}
+
+void unmap_file(MappedFile& file) {
+    if (file.data == NULL) {
+        return;
+    }
+
+#ifdef _WIN32
+    UnmapViewOfFile(file.data);
+    CloseHandle((HANDLE)file.mapping_handle);
+    CloseHandle((HANDLE)file.file_handle);
+#else
+    munmap((void*)file.data, file.size);
+#endif
+
+    file = {};
+}
+
+// FNV-1a style hash that consumes 8 bytes per step
+Uint64 hash_file(const char* path) {
+    MappedFile file;
+    if (!map_file(path, file)) {
+        return 0;
+    }
+
+    const Uint64 prime = 0x100000001b3ull;
+    Uint64 hash = 0xcbf29ce484222325ull ^ file.size;
+
+    size_t i = 0;
+    for (; i + 8 <= file.size; i += 8) {
+        Uint64 word;
+        std::memcpy(&word, file.data + i, 8);
+        hash = (hash ^ word) * prime;
+    }
+    for (; i < file.size; ++i) {
+        hash = (hash ^ file.data[i]) * prime;
+    }
+
+    unmap_file(file);
+    return hash;
+}
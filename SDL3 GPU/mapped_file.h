@@ -0,0 +1,16 @@
+﻿#pragma once
+#include <SDL3/SDL.h>
+
+// Read-only memory mapping of a whole file
+struct MappedFile {
+    const Uint8* data;
+    size_t size;
+    void* file_handle;
+    void* mapping_handle;
+};
+
+bool map_file(const char* path, MappedFile& file);
+void unmap_file(MappedFile& file);
+
+// Content hash of a whole file, 0 if it cannot be read
+Uint64 hash_file(const char* path);
@@ -0,0 +1,88 @@
+﻿#include "mesh.h"
+#include <cmath>
+#include <iostream>
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+
+// AABB over the submesh's vertices; the sphere is centred on the box and reaches the farthest vertex
+static void compute_submesh_bounds(const MeshData& mesh, Submesh& submesh) {
+    if (submesh.vertex_count == 0) {
+        return;
+    }
+    const VertexData* vertices = mesh.vertices.data() + submesh.vertex_offset;
+    Vec3 lo = vertices[0].position;
+    Vec3 hi = vertices[0].position;
+    for (Uint32 i = 1; i < submesh.vertex_count; ++i) {
+        const Vec3& p = vertices[i].position;
+        lo = { SDL_min(lo.x, p.x), SDL_min(lo.y, p.y), SDL_min(lo.z, p.z) };
+        hi = { SDL_max(hi.x, p.x), SDL_max(hi.y, p.y), SDL_max(hi.z, p.z) };
+    }
+
+    Vec3 center = { (lo.x + hi.x) * 0.5f, (lo.y + hi.y) * 0.5f, (lo.z + hi.z) * 0.5f };
+    float radiusSq = 0.0f;
+    for (Uint32 i = 0; i < submesh.vertex_count; ++i) {
+        const Vec3& p = vertices[i].position;
+        float dx = p.x - center.x, dy = p.y - center.y, dz = p.z - center.z;
+        radiusSq = SDL_max(radiusSq, dx * dx + dy * dy + dz * dz);
+    }
+    submesh.bounds_min = lo;
+    submesh.bounds_max = hi;
+    submesh.sphere_center = center;
+    submesh.sphere_radius = std::sqrt(radiusSq);
+}
+
+Uint32 submesh_index_span(const Submesh& submesh) {
+    Uint32 span = submesh.index_count;
+    for (Uint32 i = 1; i < submesh.lod_count; ++i) {
+        span = SDL_max(span, submesh.lods[i].first_index + submesh.lods[i].index_count);
+    }
+    return span;
+}
+
+MeshData load_model(const std::string& path) {
+    Assimp::Importer importer;
+    const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs);
+
+    if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) {
+        std::cerr << "ERROR::ASSIMP::" << importer.GetErrorString() << std::endl;
+        return {};
+    }
+
+    MeshData mesh;
+
+    for (size_t i = 0; i < scene->mNumMeshes; ++i) {
+        const auto& aimesh = scene->mMeshes[i];
+
+        Submesh submesh = {};
+        submesh.first_index = (Uint32)mesh.indices.size();
+        submesh.vertex_offset = (Sint32)mesh.vertices.size();
+        submesh.vertex_count = aimesh->mNumVertices;
+        submesh.material_id = aimesh->mMaterialIndex;
+        submesh.index_size = sizeof(Uint32);
+
+        // Process vertices
+        for (size_t j = 0; j < aimesh->mNumVertices; ++j) {
+            VertexData vertex;
+            vertex.position = { aimesh->mVertices[j].x, aimesh->mVertices[j].y, aimesh->mVertices[j].z };
+            vertex.texcoord = aimesh->mTextureCoords[0] ? Vec2{ aimesh->mTextureCoords[0][j].x, aimesh->mTextureCoords[0][j].y } : Vec2{ 0.0f, 0.0f };
+            vertex.color = { 1.0f, 1.0f, 1.0f, 1.0f }; // Default white color
+            mesh.vertices.push_back(vertex);
+        }
+
+        // Process indices, kept local to this submesh
+        for (size_t j = 0; j < aimesh->mNumFaces; ++j) {
+            const auto& face = aimesh->mFaces[j];
+            for (size_t k = 0; k < face.mNumIndices; ++k) {
+                mesh.indices.push_back(face.mIndices[k]);
+            }
+        }
+        submesh.index_count = (Uint32)mesh.indices.size() - submesh.first_index;
+        submesh.lods[0] = { 0, submesh.index_count, 0.0f };
+        submesh.lod_count = 1;
+        compute_submesh_bounds(mesh, submesh);
+        mesh.submeshes.push_back(submesh);
+    }
+
+    return mesh;
+}
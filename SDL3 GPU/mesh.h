@@ -0,0 +1,83 @@
+﻿#pragma once
+#include <string>
+#include <vector>
+#include <SDL3/SDL.h>
+
+struct Vec3 {
+    float x, y, z;
+};
+
+struct Vec2 {
+    float x, y;
+};
+
+struct VertexData {
+    Vec3 position;
+    Vec2 texcoord;
+    SDL_FColor color;
+};
+
+// Levels of detail kept per submesh, the full-detail level included
+#define MAX_MESH_LODS 5
+
+// A simplified copy of a submesh indexing the same vertices. Its indices follow the submesh's
+// full-detail ones, first_index counting from the submesh's own first_index like a meshlet's.
+struct SubmeshLod {
+    Uint32 first_index;
+    Uint32 index_count;
+    // Worst simplification error against the full-detail level, in model units
+    float error;
+};
+
+// One aiMesh inside the shared buffers. Indices are relative to vertex_offset,
+// which is passed as the base vertex of the draw. first_index counts index_size
+// elements from index_offset, the byte offset the index buffer is bound at.
+struct Submesh {
+    Uint32 first_index;
+    Uint32 index_count;
+    Sint32 vertex_offset;
+    Uint32 vertex_count;
+    Uint32 material_id;
+    Uint32 index_size;
+    Uint32 index_offset;
+    // Model-space bounds, computed at import
+    Vec3 bounds_min;
+    Vec3 bounds_max;
+    Vec3 sphere_center;
+    float sphere_radius;
+    // Clusters of this submesh in MeshData::meshlets, built by optimize_mesh
+    Uint32 first_meshlet;
+    Uint32 meshlet_count;
+    // lods[0] is the full-detail range above, coarser levels come after it; built by optimize_mesh
+    SubmeshLod lods[MAX_MESH_LODS];
+    Uint32 lod_count;
+};
+
+// A run of at most MESHLET_MAX_TRIANGLES triangles touching at most MESHLET_MAX_VERTICES vertices.
+// Its indices are contiguous, first_index counting from the submesh's own first_index.
+struct Meshlet {
+    Uint32 first_index;
+    Uint32 index_count;
+    Uint32 vertex_count;
+    // Model-space bounding sphere
+    Vec3 center;
+    float radius;
+    // Normal cone: every triangle faces away from eyes where dot(normalize(apex - eye), axis) >= cutoff.
+    // A cutoff of 1 means the normals spread too far to ever reject the cluster.
+    Vec3 cone_apex;
+    Vec3 cone_axis;
+    float cone_cutoff;
+};
+
+struct MeshData {
+    std::vector<VertexData> vertices;
+    std::vector<Uint32> indices;
+    std::vector<Submesh> submeshes;
+    std::vector<Meshlet> meshlets;
+};
+
+// Indices of the submesh including every level of detail
+Uint32 submesh_index_span(const Submesh& submesh);
+
+// Imports a model through Assimp, returns an empty mesh on failure
+MeshData load_model(const std::string& path);
@@ -0,0 +1,187 @@
+﻿#include "mesh_cache.h"
+#include "mesh_optimizer.h"
+#include "index_format.h"
+#include <stdio.h>
+#include <cstring>
+#include <vector>
+
+static Uint64 align_up(Uint64 value, Uint64 alignment) {
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+static double elapsed_ms(Uint64 start) {
+    return (double)(SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency();
+}
+
+bool write_mesh_cache(const char* path, Uint64 source_hash, const MeshData& mesh, VertexFormat format) {
+    VertexQuantization quantization = compute_vertex_quantization(mesh);
+    std::vector<Uint8> vertexBlob = pack_vertices(mesh, format, quantization);
+
+    PackedIndices indexBlob = pack_indices(mesh);
+    if (!validate_packed_indices(mesh, indexBlob)) {
+        fprintf(stderr, "ERROR: Packed index ranges for %s do not match the source indices.\n", path);
+        return false;
+    }
+    SDL_Log("Index format: %u 16-bit + %u 32-bit indices, %zu -> %zu bytes",
+        indexBlob.index16_count, indexBlob.index32_count, mesh.indices.size() * sizeof(Uint32), indexBlob.data.size());
+
+    MeshCacheHeader header = {};
+    header.magic = MESH_CACHE_MAGIC;
+    header.version = MESH_CACHE_VERSION;
+    header.source_hash = source_hash;
+    header.vertex_format = format;
+    header.vertex_stride = vertex_format_stride(format);
+    header.vertex_count = (Uint32)mesh.vertices.size();
+    header.index_count = (Uint32)mesh.indices.size();
+    header.index_data_size = (Uint32)indexBlob.data.size();
+    header.submesh_count = (Uint32)mesh.submeshes.size();
+    header.meshlet_count = (Uint32)mesh.meshlets.size();
+    header.submesh_offset = align_up(sizeof(MeshCacheHeader), 16);
+    header.meshlet_offset = align_up(header.submesh_offset + mesh.submeshes.size() * sizeof(Submesh), 16);
+    header.vertex_offset = align_up(header.meshlet_offset + mesh.meshlets.size() * sizeof(Meshlet), 16);
+    header.index_offset = align_up(header.vertex_offset + vertexBlob.size(), 16);
+    header.quantization = quantization;
+
+    std::vector<Uint8> blob(header.index_offset + indexBlob.data.size(), 0);
+    std::memcpy(blob.data(), &header, sizeof(header));
+    std::memcpy(blob.data() + header.submesh_offset, indexBlob.submeshes.data(), indexBlob.submeshes.size() * sizeof(Submesh));
+    std::memcpy(blob.data() + header.meshlet_offset, mesh.meshlets.data(), mesh.meshlets.size() * sizeof(Meshlet));
+    std::memcpy(blob.data() + header.vertex_offset, vertexBlob.data(), vertexBlob.size());
+    std::memcpy(blob.data() + header.index_offset, indexBlob.data.data(), indexBlob.data.size());
+
+    // Write next to the target and rename so a crash never leaves a torn cache behind
+    std::string tmpPath = std::string(path) + ".tmp";
+    if (!SDL_SaveFile(tmpPath.c_str(), blob.data(), blob.size())) {
+        fprintf(stderr, "ERROR: SDL_SaveFile(%s) failed: %s\n", tmpPath.c_str(), SDL_GetError());
+        return false;
+    }
+    if (!SDL_RenamePath(tmpPath.c_str(), path)) {
+        fprintf(stderr, "ERROR: SDL_RenamePath(%s) failed: %s\n", path, SDL_GetError());
+        SDL_RemovePath(tmpPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool open_mesh_cache(const char* path, Uint64 source_hash, bool allow_packed, MeshCache& cache) {
+    cache = {};
+    if (!map_file(path, cache.file)) {
+        return false;
+    }
+
+    const MeshCacheHeader* header = (const MeshCacheHeader*)cache.file.data;
+    size_t fileSize = cache.file.size;
+    bool valid = fileSize >= sizeof(MeshCacheHeader)
+        && header->magic == MESH_CACHE_MAGIC
+        && header->version == MESH_CACHE_VERSION
+        && header->source_hash == source_hash
+        && header->vertex_format <= VERTEX_FORMAT_PACKED_NO_COLOR
+        && allow_packed == (header->vertex_format != VERTEX_FORMAT_FULL)
+        && header->vertex_stride == vertex_format_stride((VertexFormat)header->vertex_format)
+        && header->submesh_offset + (Uint64)header->submesh_count * sizeof(Submesh) <= fileSize
+        && header->meshlet_offset + (Uint64)header->meshlet_count * sizeof(Meshlet) <= fileSize
+        && header->vertex_offset + (Uint64)header->vertex_count * header->vertex_stride <= fileSize
+        && header->index_offset + (Uint64)header->index_data_size <= fileSize;
+
+    if (!valid) {
+        close_mesh_cache(cache);
+        return false;
+    }
+
+    cache.header = header;
+    cache.vertex_format = (VertexFormat)header->vertex_format;
+    cache.submeshes = (const Submesh*)(cache.file.data + header->submesh_offset);
+    cache.meshlets = (const Meshlet*)(cache.file.data + header->meshlet_offset);
+    cache.vertex_data = cache.file.data + header->vertex_offset;
+    cache.index_data = cache.file.data + header->index_offset;
+    cache.vertex_data_size = header->vertex_count * header->vertex_stride;
+    cache.index_data_size = header->index_data_size;
+    return true;
+}
+
+void close_mesh_cache(MeshCache& cache) {
+    unmap_file(cache.file);
+    cache = {};
+}
+
+bool load_mesh_cached(const std::string& source_path, bool allow_packed, MeshCache& cache) {
+    Uint64 start = SDL_GetPerformanceCounter();
+    std::string cachePath = source_path + MESH_CACHE_EXTENSION;
+
+    Uint64 sourceHash = hash_file(source_path.c_str());
+    if (sourceHash == 0) {
+        fprintf(stderr, "ERROR: Mesh source (%s) does not exist.\n", source_path.c_str());
+        return false;
+    }
+
+    if (open_mesh_cache(cachePath.c_str(), sourceHash, allow_packed, cache)) {
+        SDL_Log("Mesh cache hit: %s mapped in %.3f ms", cachePath.c_str(), elapsed_ms(start));
+        return true;
+    }
+
+    MeshData mesh = load_model(source_path);
+    if (mesh.vertices.empty() || mesh.indices.empty()) {
+        return false;
+    }
+    optimize_mesh(mesh);
+
+    VertexFormat format = select_vertex_format(mesh, allow_packed);
+    size_t fullSize = mesh.vertices.size() * sizeof(VertexData);
+    size_t packedSize = mesh.vertices.size() * vertex_format_stride(format);
+    SDL_Log("Vertex format: %s, %u bytes/vertex, %zu -> %zu bytes (%.0f%% of the full layout's fetch bandwidth)",
+        vertex_format_name(format), vertex_format_stride(format), fullSize, packedSize, 100.0 * packedSize / fullSize);
+
+    if (!write_mesh_cache(cachePath.c_str(), sourceHash, mesh, format)) {
+        return false;
+    }
+    if (!open_mesh_cache(cachePath.c_str(), sourceHash, allow_packed, cache)) {
+        fprintf(stderr, "ERROR: Freshly written mesh cache (%s) failed validation.\n", cachePath.c_str());
+        return false;
+    }
+
+    SDL_Log("Mesh cache miss: %s imported and cached in %.3f ms", source_path.c_str(), elapsed_ms(start));
+    return true;
+}
+
+void benchmark_mesh_cache(const std::string& source_path, int iterations) {
+    std::string cachePath = source_path + MESH_CACHE_EXTENSION;
+    double coldTotal = 0.0, coldMin = 1e30;
+    double warmTotal = 0.0, warmMin = 1e30;
+    std::vector<Uint8> staging;
+
+    for (int i = 0; i < iterations; ++i) {
+        // Cold: hash, full Assimp import, optimization and cache write
+        Uint64 start = SDL_GetPerformanceCounter();
+        Uint64 sourceHash = hash_file(source_path.c_str());
+        MeshData mesh = load_model(source_path);
+        if (mesh.vertices.empty()) {
+            return;
+        }
+        optimize_mesh(mesh);
+        if (!write_mesh_cache(cachePath.c_str(), sourceHash, mesh, select_vertex_format(mesh, true))) {
+            return;
+        }
+        double cold = elapsed_ms(start);
+
+        // Warm: hash, map and copy into staging memory like the upload path does
+        start = SDL_GetPerformanceCounter();
+        MeshCache cache;
+        if (!open_mesh_cache(cachePath.c_str(), hash_file(source_path.c_str()), true, cache)) {
+            return;
+        }
+        staging.resize(cache.vertex_data_size + cache.index_data_size);
+        std::memcpy(staging.data(), cache.vertex_data, cache.vertex_data_size);
+        std::memcpy(staging.data() + cache.vertex_data_size, cache.index_data, cache.index_data_size);
+        close_mesh_cache(cache);
+        double warm = elapsed_ms(start);
+
+        coldTotal += cold;
+        warmTotal += warm;
+        coldMin = SDL_min(coldMin, cold);
+        warmMin = SDL_min(warmMin, warm);
+    }
+
+    SDL_Log("Mesh cache benchmark (%s, %d iterations, %zu bytes staged)", source_path.c_str(), iterations, staging.size());
+    SDL_Log("  cold import: avg %.3f ms, min %.3f ms", coldTotal / iterations, coldMin);
+    SDL_Log("  warm mapped: avg %.3f ms, min %.3f ms", warmTotal / iterations, warmMin);
+}
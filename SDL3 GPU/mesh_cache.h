@@ -0,0 +1,54 @@
+﻿#pragma once
+#include <string>
+#include <SDL3/SDL.h>
+#include "mesh.h"
+#include "vertex_format.h"
+#include "mapped_file.h"
+
+#define MESH_CACHE_MAGIC 0x4853454Du // "MESH"
+#define MESH_CACHE_VERSION 8
+#define MESH_CACHE_EXTENSION ".meshcache"
+
+// On-disk layout: header, submesh table, meshlet table, vertex blob, index blob.
+// Every blob starts on a 16 byte boundary so it can be used in place.
+struct MeshCacheHeader {
+    Uint32 magic;
+    Uint32 version;
+    Uint64 source_hash;
+    Uint32 vertex_format;
+    Uint32 vertex_stride;
+    Uint32 vertex_count;
+    Uint32 index_count;
+    Uint32 index_data_size;
+    Uint32 submesh_count;
+    Uint32 meshlet_count;
+    Uint64 submesh_offset;
+    Uint64 meshlet_offset;
+    Uint64 vertex_offset;
+    Uint64 index_offset;
+    VertexQuantization quantization;
+};
+
+// A validated, memory-mapped cache file. All pointers point into the mapping.
+struct MeshCache {
+    MappedFile file;
+    const MeshCacheHeader* header;
+    VertexFormat vertex_format;
+    const Submesh* submeshes;
+    const Meshlet* meshlets;
+    const Uint8* vertex_data;
+    const Uint8* index_data;
+    Uint32 vertex_data_size;
+    Uint32 index_data_size;
+};
+
+bool write_mesh_cache(const char* path, Uint64 source_hash, const MeshData& mesh, VertexFormat format);
+// Rejects caches built from another source, an older layout, or with the other packing choice
+bool open_mesh_cache(const char* path, Uint64 source_hash, bool allow_packed, MeshCache& cache);
+void close_mesh_cache(MeshCache& cache);
+
+// Maps the cache next to source_path, re-importing the source when the cache is missing or stale
+bool load_mesh_cached(const std::string& source_path, bool allow_packed, MeshCache& cache);
+
+// Compares a cold Assimp import + cache write with a warm mapped load
+void benchmark_mesh_cache(const std::string& source_path, int iterations);
@@ -0,0 +1,304 @@
+﻿#include "mesh_optimizer.h"
+#include "meshlet.h"
+#include "mesh_simplifier.h"
+#include <cfloat>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+// Levels below this many triangles are not worth a draw range of their own
+#define LOD_MIN_TRIANGLES 32
+// A level has to drop at least this share of the previous level's triangles to be kept
+#define LOD_MIN_REDUCTION 0.1f
+
+struct VertexKey {
+    const VertexData* vertex;
+
+    bool operator==(const VertexKey& other) const {
+        return std::memcmp(vertex, other.vertex, sizeof(VertexData)) == 0;
+    }
+};
+
+struct VertexKeyHash {
+    size_t operator()(const VertexKey& key) const {
+        const Uint8* bytes = (const Uint8*)key.vertex;
+        Uint64 hash = 0xcbf29ce484222325ull;
+        for (size_t i = 0; i < sizeof(VertexData); ++i) {
+            hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+        }
+        return (size_t)hash;
+    }
+};
+
+void weld_vertices(MeshData& mesh) {
+    std::unordered_map<VertexKey, Uint32, VertexKeyHash> unique;
+    unique.reserve(mesh.vertices.size());
+
+    std::vector<Uint32> remap(mesh.vertices.size());
+    std::vector<VertexData> welded;
+    welded.reserve(mesh.vertices.size());
+
+    for (size_t i = 0; i < mesh.vertices.size(); ++i) {
+        auto result = unique.emplace(VertexKey{ &mesh.vertices[i] }, (Uint32)welded.size());
+        if (result.second) {
+            welded.push_back(mesh.vertices[i]);
+        }
+        remap[i] = result.first->second;
+    }
+
+    for (Uint32& index : mesh.indices) {
+        index = remap[index];
+    }
+    mesh.vertices.swap(welded);
+}
+
+// Returns the next fanning vertex once the current one has no live neighbours
+static Sint64 skip_dead_end(const std::vector<Uint32>& live, std::vector<Uint32>& deadEnd, size_t& cursor) {
+    while (!deadEnd.empty()) {
+        Uint32 vertex = deadEnd.back();
+        deadEnd.pop_back();
+        if (live[vertex] > 0) {
+            return vertex;
+        }
+    }
+    while (cursor < live.size()) {
+        if (live[cursor] > 0) {
+            return (Sint64)cursor;
+        }
+        ++cursor;
+    }
+    return -1;
+}
+
+void optimize_vertex_cache(Uint32* indices, size_t count, size_t vertex_count) {
+    const size_t triangleCount = count / 3;
+    if (triangleCount == 0 || vertex_count == 0) {
+        return;
+    }
+
+    // Vertex -> triangle adjacency in CSR form
+    std::vector<Uint32> live(vertex_count, 0);
+    for (size_t i = 0; i < triangleCount * 3; ++i) {
+        live[indices[i]]++;
+    }
+    std::vector<Uint32> adjacencyOffset(vertex_count + 1, 0);
+    for (size_t v = 0; v < vertex_count; ++v) {
+        adjacencyOffset[v + 1] = adjacencyOffset[v] + live[v];
+    }
+    std::vector<Uint32> adjacency(triangleCount * 3);
+    std::vector<Uint32> fill(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+    for (size_t t = 0; t < triangleCount; ++t) {
+        for (size_t k = 0; k < 3; ++k) {
+            adjacency[fill[indices[t * 3 + k]]++] = (Uint32)t;
+        }
+    }
+
+    std::vector<Uint32> cacheTime(vertex_count, 0);
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<Uint32> deadEnd;
+    std::vector<Uint32> candidates;
+    std::vector<Uint32> output;
+    output.reserve(triangleCount * 3);
+
+    const Uint32 cacheSize = VERTEX_CACHE_SIZE;
+    Uint32 timestamp = cacheSize + 1;
+    size_t cursor = 0;
+    Sint64 fanning = skip_dead_end(live, deadEnd, cursor);
+
+    while (fanning >= 0) {
+        candidates.clear();
+
+        // Emit every remaining triangle around the fanning vertex
+        for (Uint32 a = adjacencyOffset[fanning]; a < adjacencyOffset[fanning + 1]; ++a) {
+            Uint32 t = adjacency[a];
+            if (emitted[t]) {
+                continue;
+            }
+            for (size_t k = 0; k < 3; ++k) {
+                Uint32 v = indices[t * 3 + k];
+                output.push_back(v);
+                deadEnd.push_back(v);
+                candidates.push_back(v);
+                live[v]--;
+                if (timestamp - cacheTime[v] > cacheSize) {
+                    cacheTime[v] = timestamp++;
+                }
+            }
+            emitted[t] = true;
+        }
+
+        // Prefer the candidate that stays in cache while its remaining triangles are emitted
+        Sint64 next = -1;
+        Sint64 bestPriority = -1;
+        for (Uint32 v : candidates) {
+            if (live[v] == 0) {
+                continue;
+            }
+            Sint64 priority = 0;
+            if (timestamp - cacheTime[v] + 2 * live[v] <= cacheSize) {
+                priority = timestamp - cacheTime[v];
+            }
+            if (priority > bestPriority) {
+                bestPriority = priority;
+                next = v;
+            }
+        }
+        fanning = next >= 0 ? next : skip_dead_end(live, deadEnd, cursor);
+    }
+
+    std::memcpy(indices, output.data(), output.size() * sizeof(Uint32));
+}
+
+void optimize_vertex_fetch(MeshData& mesh) {
+    const Uint32 unused = 0xFFFFFFFFu;
+    std::vector<Uint32> remap(mesh.vertices.size(), unused);
+    std::vector<VertexData> reordered;
+    reordered.reserve(mesh.vertices.size());
+
+    for (Uint32& index : mesh.indices) {
+        if (remap[index] == unused) {
+            remap[index] = (Uint32)reordered.size();
+            reordered.push_back(mesh.vertices[index]);
+        }
+        index = remap[index];
+    }
+    mesh.vertices.swap(reordered);
+}
+
+struct VertexCacheCounts {
+    Uint32 misses;
+    Uint32 triangles;
+    Uint32 unique;
+};
+
+// FIFO cache simulation: a vertex is a hit if it entered the cache less than VERTEX_CACHE_SIZE misses ago
+static VertexCacheCounts simulate_vertex_cache(const Uint32* indices, size_t count, size_t vertex_count) {
+    VertexCacheCounts counts = {};
+    std::vector<Uint32> insertedAt(vertex_count, 0);
+    std::vector<bool> seen(vertex_count, false);
+
+    for (size_t i = 0; i < count; ++i) {
+        Uint32 v = indices[i];
+        if (!seen[v]) {
+            seen[v] = true;
+            counts.unique++;
+        } else if (counts.misses - insertedAt[v] < VERTEX_CACHE_SIZE) {
+            continue;
+        }
+        insertedAt[v] = counts.misses++;
+    }
+    counts.triangles = (Uint32)(count / 3);
+    return counts;
+}
+
+static VertexCacheStats to_stats(const VertexCacheCounts& counts) {
+    VertexCacheStats stats = {};
+    if (counts.triangles > 0 && counts.unique > 0) {
+        stats.acmr = (float)counts.misses / (float)counts.triangles;
+        stats.atvr = (float)counts.misses / (float)counts.unique;
+    }
+    return stats;
+}
+
+VertexCacheStats analyze_vertex_cache(const Uint32* indices, size_t count, size_t vertex_count) {
+    return to_stats(simulate_vertex_cache(indices, count, vertex_count));
+}
+
+// Totals over all submeshes; indices of each submesh are relative to its own vertex range
+static VertexCacheStats analyze_submeshes(const MeshData& mesh) {
+    VertexCacheCounts total = {};
+    for (const Submesh& submesh : mesh.submeshes) {
+        VertexCacheCounts counts = simulate_vertex_cache(mesh.indices.data() + submesh.first_index, submesh.index_count, submesh.vertex_count);
+        total.misses += counts.misses;
+        total.triangles += counts.triangles;
+        total.unique += counts.unique;
+    }
+    return to_stats(total);
+}
+
+// Halves the triangle count per level. Every level is simplified from the full-detail indices so
+// errors do not stack, and the chain ends early once simplification stalls.
+// Coarser levels' indices go to lod_indices, lods[i].first_index counting from the full-detail range.
+static Uint32 build_lod_chain(const MeshData& part, SubmeshLod* lods, std::vector<Uint32>& lod_indices) {
+    const Uint32 baseCount = (Uint32)part.indices.size();
+    lods[0] = { 0, baseCount, 0.0f };
+    Uint32 lodCount = 1;
+    std::vector<Uint32> level;
+    for (; lodCount < MAX_MESH_LODS; ++lodCount) {
+        const Uint32 target = (baseCount >> lodCount) / 3 * 3;
+        if (target < LOD_MIN_TRIANGLES * 3) {
+            break;
+        }
+        float error = simplify_mesh(part.vertices.data(), (Uint32)part.vertices.size(), part.indices.data(), baseCount,
+            target, FLT_MAX, level);
+        const SubmeshLod& previous = lods[lodCount - 1];
+        if (level.empty() || (float)level.size() > previous.index_count * (1.0f - LOD_MIN_REDUCTION)) {
+            break;
+        }
+        optimize_vertex_cache(level.data(), level.size(), part.vertices.size());
+        lods[lodCount] = { baseCount + (Uint32)lod_indices.size(), (Uint32)level.size(), SDL_max(error, previous.error) };
+        lod_indices.insert(lod_indices.end(), level.begin(), level.end());
+    }
+    return lodCount;
+}
+
+MeshOptimizeStats optimize_mesh(MeshData& mesh) {
+    MeshOptimizeStats stats = {};
+    stats.vertices_before = (Uint32)mesh.vertices.size();
+    stats.cache_before = analyze_submeshes(mesh);
+
+    // Each submesh is optimized on its own so vertex ranges stay disjoint and base-vertex draws keep working
+    MeshData optimized;
+    optimized.vertices.reserve(mesh.vertices.size());
+    optimized.indices.reserve(mesh.indices.size());
+
+    for (const Submesh& submesh : mesh.submeshes) {
+        MeshData part;
+        part.vertices.assign(mesh.vertices.begin() + submesh.vertex_offset, mesh.vertices.begin() + submesh.vertex_offset + submesh.vertex_count);
+        part.indices.assign(mesh.indices.begin() + submesh.first_index, mesh.indices.begin() + submesh.first_index + submesh.index_count);
+
+        weld_vertices(part);
+        // Simplified after welding; duplicates left by the import would otherwise lock every edge they touch
+        Submesh result = submesh;
+        std::vector<Uint32> lodIndices;
+        result.lod_count = build_lod_chain(part, result.lods, lodIndices);
+        optimize_vertex_cache(part.indices.data(), part.indices.size(), part.vertices.size());
+        part.indices.insert(part.indices.end(), lodIndices.begin(), lodIndices.end());
+        optimize_vertex_fetch(part);
+
+        for (Uint32 i = 0; i < result.lod_count; ++i) {
+            stats.lod_triangles[i] += result.lods[i].index_count / 3;
+            stats.lod_error[i] = SDL_max(stats.lod_error[i], result.lods[i].error);
+        }
+        result.first_index = (Uint32)optimized.indices.size();
+        result.vertex_offset = (Sint32)optimized.vertices.size();
+        result.vertex_count = (Uint32)part.vertices.size();
+        // Clusters follow the cache-optimized triangle order, so they come out spatially coherent
+        result.first_meshlet = (Uint32)optimized.meshlets.size();
+        result.meshlet_count = build_meshlets(part.vertices.data(), part.indices.data(), result.index_count,
+            (Uint32)part.vertices.size(), optimized.meshlets);
+        optimized.vertices.insert(optimized.vertices.end(), part.vertices.begin(), part.vertices.end());
+        optimized.indices.insert(optimized.indices.end(), part.indices.begin(), part.indices.end());
+        optimized.submeshes.push_back(result);
+    }
+    mesh = std::move(optimized);
+
+    stats.vertices_after = (Uint32)mesh.vertices.size();
+    stats.cache_after = analyze_submeshes(mesh);
+    SDL_Log("Mesh optimize: %u -> %u vertices (%zu -> %zu bytes), ACMR %.3f -> %.3f, ATVR %.3f -> %.3f",
+        stats.vertices_before, stats.vertices_after,
+        (size_t)stats.vertices_before * sizeof(VertexData), (size_t)stats.vertices_after * sizeof(VertexData),
+        stats.cache_before.acmr, stats.cache_after.acmr,
+        stats.cache_before.atvr, stats.cache_after.atvr);
+    for (Uint32 i = 1; i < MAX_MESH_LODS && stats.lod_triangles[i] > 0; ++i) {
+        SDL_Log("Mesh LOD %u: %u triangles (%.1f%% of LOD 0), max error %g",
+            i, stats.lod_triangles[i], 100.0f * stats.lod_triangles[i] / stats.lod_triangles[0], stats.lod_error[i]);
+    }
+    MeshletStats meshletStats = analyze_meshlets(mesh.meshlets.data(), (Uint32)mesh.meshlets.size());
+    if (meshletStats.meshlets > 0) {
+        SDL_Log("Meshlets: %u clusters, %.1f triangles and %.1f vertices each, %.0f%% with a normal cone",
+            meshletStats.meshlets, (float)meshletStats.triangles / meshletStats.meshlets,
+            (float)meshletStats.vertices / meshletStats.meshlets, 100.0f * meshletStats.cones / meshletStats.meshlets);
+    }
+    return stats;
+}
@@ -0,0 +1,36 @@
+﻿#pragma once
+#include <SDL3/SDL.h>
+#include "mesh.h"
+
+// Post-transform cache size the optimizer targets and the statistics simulate
+#define VERTEX_CACHE_SIZE 16
+
+struct VertexCacheStats {
+    float acmr; // transformed vertices per triangle
+    float atvr; // transformed vertices per unique vertex
+};
+
+struct MeshOptimizeStats {
+    Uint32 vertices_before;
+    Uint32 vertices_after;
+    VertexCacheStats cache_before;
+    VertexCacheStats cache_after;
+    // Totals over all submeshes for each level of detail, and the worst error among them
+    Uint32 lod_triangles[MAX_MESH_LODS];
+    float lod_error[MAX_MESH_LODS];
+};
+
+// Merges byte-identical vertices and rewrites the index buffer
+void weld_vertices(MeshData& mesh);
+
+// Tipsify triangle reordering of count indices in place
+void optimize_vertex_cache(Uint32* indices, size_t count, size_t vertex_count);
+
+// Renumbers vertices in first-use order and drops unreferenced ones
+void optimize_vertex_fetch(MeshData& mesh);
+
+VertexCacheStats analyze_vertex_cache(const Uint32* indices, size_t count, size_t vertex_count);
+
+// Runs the whole pipeline on every submesh, builds its levels of detail and meshlets and logs
+// before/after statistics
+MeshOptimizeStats optimize_mesh(MeshData& mesh);
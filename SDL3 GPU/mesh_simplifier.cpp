@@ -0,0 +1,531 @@
+﻿#include "mesh_simplifier.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+#include <unordered_set>
+
+// x, y, z in the unit cube of the mesh, then u and v
+#define QUADRIC_SIZE 5
+// Weight of the plane through a border or seam edge, standing on its face, so those edges keep their shape
+#define BORDER_WEIGHT 10.0
+
+enum VertexKind {
+    VERTEX_MANIFOLD, // interior, collapses onto any neighbour
+    VERTEX_BORDER,   // on an open edge loop, collapses along it
+    VERTEX_SEAM,     // has one twin across a UV seam, both collapse along the seam
+    VERTEX_LOCKED
+};
+
+// Error of a point p: p^T A p + 2 b.p + c, summed over planes with total weight w.
+// A is symmetric and stored as its upper triangle.
+struct Quadric {
+    double a[QUADRIC_SIZE * (QUADRIC_SIZE + 1) / 2];
+    double b[QUADRIC_SIZE];
+    double c;
+    double w;
+};
+
+struct Collapse {
+    double cost;
+    Uint32 from, to;
+    Uint32 twin_from, twin_to; // UINT32_MAX unless collapsing a seam
+};
+
+static void add_quadric(Quadric& q, const Quadric& r, double weight) {
+    for (size_t i = 0; i < SDL_arraysize(q.a); ++i) {
+        q.a[i] += r.a[i] * weight;
+    }
+    for (int i = 0; i < QUADRIC_SIZE; ++i) {
+        q.b[i] += r.b[i] * weight;
+    }
+    q.c += r.c * weight;
+    q.w += r.w * weight;
+}
+
+static double evaluate_quadric(const Quadric& q, const double* p) {
+    double error = q.c;
+    int k = 0;
+    for (int i = 0; i < QUADRIC_SIZE; ++i) {
+        for (int j = i; j < QUADRIC_SIZE; ++j) {
+            double term = q.a[k++] * p[i] * p[j];
+            error += i == j ? term : 2.0 * term;
+        }
+        error += 2.0 * q.b[i] * p[i];
+    }
+    return error;
+}
+
+static double dot(const double* a, const double* b, int n) {
+    double sum = 0.0;
+    for (int i = 0; i < n; ++i) {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+// Squared distance to the plane spanned by the triangle in position + UV space, with unit weight.
+// False for degenerate triangles.
+static bool triangle_quadric(const double* p, const double* q, const double* r, Quadric& out) {
+    double e1[QUADRIC_SIZE], e2[QUADRIC_SIZE];
+    for (int i = 0; i < QUADRIC_SIZE; ++i) {
+        e1[i] = q[i] - p[i];
+        e2[i] = r[i] - p[i];
+    }
+    double length = std::sqrt(dot(e1, e1, QUADRIC_SIZE));
+    if (length == 0.0) {
+        return false;
+    }
+    for (double& e : e1) {
+        e /= length;
+    }
+    double along = dot(e2, e1, QUADRIC_SIZE);
+    for (int i = 0; i < QUADRIC_SIZE; ++i) {
+        e2[i] -= along * e1[i];
+    }
+    length = std::sqrt(dot(e2, e2, QUADRIC_SIZE));
+    if (length == 0.0) {
+        return false;
+    }
+    for (double& e : e2) {
+        e /= length;
+    }
+
+    // A = I - e1 e1^T - e2 e2^T, b = (p.e1) e1 + (p.e2) e2 - p, c = p.p - (p.e1)^2 - (p.e2)^2
+    out = {};
+    int k = 0;
+    for (int i = 0; i < QUADRIC_SIZE; ++i) {
+        for (int j = i; j < QUADRIC_SIZE; ++j) {
+            out.a[k++] = (i == j ? 1.0 : 0.0) - e1[i] * e1[j] - e2[i] * e2[j];
+        }
+    }
+    double pe1 = dot(p, e1, QUADRIC_SIZE);
+    double pe2 = dot(p, e2, QUADRIC_SIZE);
+    for (int i = 0; i < QUADRIC_SIZE; ++i) {
+        out.b[i] = pe1 * e1[i] + pe2 * e2[i] - p[i];
+    }
+    out.c = dot(p, p, QUADRIC_SIZE) - pe1 * pe1 - pe2 * pe2;
+    out.w = 1.0;
+    return true;
+}
+
+// Squared distance to the position plane n.x + d = 0, leaving UV free
+static void plane_quadric(const double* n, double d, Quadric& out) {
+    out = {};
+    int k = 0;
+    for (int i = 0; i < QUADRIC_SIZE; ++i) {
+        for (int j = i; j < QUADRIC_SIZE; ++j) {
+            out.a[k++] = i < 3 && j < 3 ? n[i] * n[j] : 0.0;
+        }
+    }
+    for (int i = 0; i < 3; ++i) {
+        out.b[i] = d * n[i];
+    }
+    out.c = d * d;
+    out.w = 1.0;
+}
+
+static void cross(const double* a, const double* b, double* out) {
+    out[0] = a[1] * b[2] - a[2] * b[1];
+    out[1] = a[2] * b[0] - a[0] * b[2];
+    out[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+static Uint64 edge_key(Uint32 a, Uint32 b) {
+    return ((Uint64)a << 32) | b;
+}
+
+struct Simplifier {
+    const VertexData* vertices;
+    std::vector<double> attributes; // QUADRIC_SIZE per vertex
+    std::vector<Quadric> quadrics;
+    std::vector<VertexKind> kinds;
+    std::vector<Uint32> twins;      // the other vertex at a seam vertex's position
+    std::vector<Uint32> triangles;
+    std::vector<bool> live;
+    std::vector<std::vector<Uint32>> vertex_triangles;
+};
+
+static const double* attributes_of(const Simplifier& s, Uint32 v) {
+    return s.attributes.data() + (size_t)v * QUADRIC_SIZE;
+}
+
+// Live triangles using both a and b; 1 means the edge is open
+static Uint32 edge_triangles(const Simplifier& s, Uint32 a, Uint32 b) {
+    Uint32 count = 0;
+    for (Uint32 t : s.vertex_triangles[a]) {
+        const Uint32* tri = &s.triangles[t * 3];
+        count += s.live[t] && (tri[0] == b || tri[1] == b || tri[2] == b) ? 1 : 0;
+    }
+    return count;
+}
+
+// Moving from onto to must not turn any remaining triangle around
+static bool collapse_keeps_orientation(const Simplifier& s, Uint32 from, Uint32 to) {
+    for (Uint32 t : s.vertex_triangles[from]) {
+        const Uint32* tri = &s.triangles[t * 3];
+        if (!s.live[t] || tri[0] == to || tri[1] == to || tri[2] == to) {
+            continue;
+        }
+        double before[3][3], after[3][3];
+        for (int k = 0; k < 3; ++k) {
+            const Vec3& p = s.vertices[tri[k]].position;
+            const Vec3& q = s.vertices[tri[k] == from ? to : tri[k]].position;
+            before[k][0] = p.x, before[k][1] = p.y, before[k][2] = p.z;
+            after[k][0] = q.x, after[k][1] = q.y, after[k][2] = q.z;
+        }
+        double e1[3], e2[3], f1[3], f2[3], n0[3], n1[3];
+        for (int i = 0; i < 3; ++i) {
+            e1[i] = before[1][i] - before[0][i];
+            e2[i] = before[2][i] - before[0][i];
+            f1[i] = after[1][i] - after[0][i];
+            f2[i] = after[2][i] - after[0][i];
+        }
+        cross(e1, e2, n0);
+        cross(f1, f2, n1);
+        if (dot(n0, n1, 3) <= 0.0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static double collapse_cost(const Simplifier& s, Uint32 from, Uint32 to) {
+    Quadric q = s.quadrics[from];
+    add_quadric(q, s.quadrics[to], 1.0);
+    return q.w > 0.0 ? SDL_max(evaluate_quadric(q, attributes_of(s, to)) / q.w, 0.0) : 0.0;
+}
+
+// The seam twin of from that slides along with it, and the twin of to it slides onto
+static bool find_twin_collapse(const Simplifier& s, Uint32 from, Uint32 to, Uint32& twin_from, Uint32& twin_to) {
+    twin_from = s.twins[from];
+    const Vec3& target = s.vertices[to].position;
+    for (Uint32 t : s.vertex_triangles[twin_from]) {
+        if (!s.live[t]) {
+            continue;
+        }
+        for (int k = 0; k < 3; ++k) {
+            Uint32 w = s.triangles[t * 3 + k];
+            if (w != twin_from && w != to && std::memcmp(&s.vertices[w].position, &target, sizeof(Vec3)) == 0
+                && edge_triangles(s, twin_from, w) == 1) {
+                twin_to = w;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+static bool best_collapse(const Simplifier& s, Uint32 from, Collapse& best) {
+    const VertexKind kind = s.kinds[from];
+    best.cost = DBL_MAX;
+    for (Uint32 t : s.vertex_triangles[from]) {
+        if (!s.live[t]) {
+            continue;
+        }
+        for (int k = 0; k < 3; ++k) {
+            Uint32 to = s.triangles[t * 3 + k];
+            if (to == from) {
+                continue;
+            }
+            if ((kind == VERTEX_BORDER || kind == VERTEX_SEAM) && edge_triangles(s, from, to) != 1) {
+                continue;
+            }
+            Uint32 twinFrom = UINT32_MAX, twinTo = UINT32_MAX;
+            if (kind == VERTEX_SEAM && !find_twin_collapse(s, from, to, twinFrom, twinTo)) {
+                continue;
+            }
+            double cost = collapse_cost(s, from, to);
+            if (twinFrom != UINT32_MAX) {
+                cost += collapse_cost(s, twinFrom, twinTo);
+            }
+            if (cost >= best.cost || !collapse_keeps_orientation(s, from, to)
+                || (twinFrom != UINT32_MAX && !collapse_keeps_orientation(s, twinFrom, twinTo))) {
+                continue;
+            }
+            best = { cost, from, to, twinFrom, twinTo };
+        }
+    }
+    return best.cost < DBL_MAX;
+}
+
+// Returns how many triangles disappeared
+static Uint32 apply_collapse(Simplifier& s, Uint32 from, Uint32 to) {
+    Uint32 removed = 0;
+    for (Uint32 t : s.vertex_triangles[from]) {
+        if (!s.live[t]) {
+            continue;
+        }
+        Uint32* tri = &s.triangles[t * 3];
+        bool hadTarget = tri[0] == to || tri[1] == to || tri[2] == to;
+        for (int k = 0; k < 3; ++k) {
+            tri[k] = tri[k] == from ? to : tri[k];
+        }
+        if (hadTarget) {
+            s.live[t] = false;
+            removed++;
+        } else {
+            s.vertex_triangles[to].push_back(t);
+        }
+    }
+    s.vertex_triangles[from].clear();
+    add_quadric(s.quadrics[to], s.quadrics[from], 1.0);
+    return removed;
+}
+
+static void classify_vertices(Simplifier& s, Uint32 vertex_count, Uint32 index_count) {
+    // Vertices sharing a position are UV seam twins
+    std::unordered_map<Uint64, Uint32> directed;
+    std::vector<Uint32> positionGroup(vertex_count);
+    std::vector<Uint32> groupSize(vertex_count, 0);
+    {
+        struct PositionHash {
+            size_t operator()(const Vec3& p) const {
+                Uint32 bits[3];
+                std::memcpy(bits, &p, sizeof(bits));
+                return (size_t)(bits[0] * 73856093u ^ bits[1] * 19349663u ^ bits[2] * 83492791u);
+            }
+        };
+        struct PositionEqual {
+            bool operator()(const Vec3& a, const Vec3& b) const {
+                return std::memcmp(&a, &b, sizeof(Vec3)) == 0;
+            }
+        };
+        std::unordered_map<Vec3, Uint32, PositionHash, PositionEqual> groups;
+        s.twins.assign(vertex_count, UINT32_MAX);
+        for (Uint32 v = 0; v < vertex_count; ++v) {
+            auto result = groups.emplace(s.vertices[v].position, v);
+            positionGroup[v] = result.first->second;
+            Uint32 first = result.first->second;
+            if (first != v) {
+                s.twins[first] = v;
+                s.twins[v] = first;
+            }
+        }
+    }
+    for (Uint32 i = 0; i < index_count; ++i) {
+        groupSize[positionGroup[s.triangles[i]]]++;
+    }
+    for (Uint32 i = 0; i < index_count; i += 3) {
+        for (int k = 0; k < 3; ++k) {
+            directed[edge_key(s.triangles[i + k], s.triangles[i + (k + 1) % 3])]++;
+        }
+    }
+
+    // Open edges by position: those with a reversed partner between the twins are seams, the rest borders
+    std::unordered_set<Uint64> openByPosition;
+    for (const auto& edge : directed) {
+        Uint32 a = (Uint32)(edge.first >> 32), b = (Uint32)edge.first;
+        if (directed.find(edge_key(b, a)) == directed.end()) {
+            openByPosition.insert(edge_key(positionGroup[a], positionGroup[b]));
+        }
+    }
+    std::vector<Uint32> openOut(vertex_count, 0), openIn(vertex_count, 0), borderEdges(vertex_count, 0);
+    for (const auto& edge : directed) {
+        Uint32 a = (Uint32)(edge.first >> 32), b = (Uint32)edge.first;
+        if (directed.find(edge_key(b, a)) != directed.end()) {
+            continue;
+        }
+        openOut[a] += edge.second;
+        openIn[b] += edge.second;
+        if (openByPosition.find(edge_key(positionGroup[b], positionGroup[a])) == openByPosition.end()) {
+            borderEdges[a]++;
+            borderEdges[b]++;
+        }
+    }
+
+    std::vector<Uint32> siblings(vertex_count, 0);
+    for (Uint32 v = 0; v < vertex_count; ++v) {
+        if (positionGroup[v] != v) {
+            siblings[positionGroup[v]]++;
+        }
+    }
+    s.kinds.assign(vertex_count, VERTEX_LOCKED);
+    for (Uint32 v = 0; v < vertex_count; ++v) {
+        Uint32 twinsHere = siblings[positionGroup[v]];
+        if (openOut[v] == 0 && openIn[v] == 0) {
+            s.kinds[v] = twinsHere == 0 ? VERTEX_MANIFOLD : VERTEX_LOCKED;
+        } else if (openOut[v] == 1 && openIn[v] == 1) {
+            if (twinsHere == 0 && borderEdges[v] == 2) {
+                s.kinds[v] = VERTEX_BORDER;
+            } else if (twinsHere == 1 && borderEdges[v] == 0) {
+                s.kinds[v] = VERTEX_SEAM;
+            }
+        }
+    }
+}
+
+float simplify_mesh(const VertexData* vertices, Uint32 vertex_count, const Uint32* indices, Uint32 index_count,
+    Uint32 target_index_count, float max_error, std::vector<Uint32>& out) {
+    out.assign(indices, indices + index_count);
+    if (index_count <= target_index_count || vertex_count == 0) {
+        return 0.0f;
+    }
+
+    Simplifier s;
+    s.vertices = vertices;
+    s.triangles.assign(indices, indices + index_count);
+    s.live.assign(index_count / 3, true);
+
+    // Positions go into the unit cube so UV and position error are comparable
+    Vec3 lo = vertices[0].position, hi = lo;
+    for (Uint32 v = 1; v < vertex_count; ++v) {
+        const Vec3& p = vertices[v].position;
+        lo = { SDL_min(lo.x, p.x), SDL_min(lo.y, p.y), SDL_min(lo.z, p.z) };
+        hi = { SDL_max(hi.x, p.x), SDL_max(hi.y, p.y), SDL_max(hi.z, p.z) };
+    }
+    float extent = SDL_max(SDL_max(hi.x - lo.x, hi.y - lo.y), hi.z - lo.z);
+    const double scale = extent > 0.0f ? 1.0 / extent : 1.0;
+    s.attributes.resize((size_t)vertex_count * QUADRIC_SIZE);
+    for (Uint32 v = 0; v < vertex_count; ++v) {
+        double* a = s.attributes.data() + (size_t)v * QUADRIC_SIZE;
+        a[0] = (vertices[v].position.x - lo.x) * scale;
+        a[1] = (vertices[v].position.y - lo.y) * scale;
+        a[2] = (vertices[v].position.z - lo.z) * scale;
+        a[3] = vertices[v].texcoord.x * SIMPLIFY_UV_WEIGHT;
+        a[4] = vertices[v].texcoord.y * SIMPLIFY_UV_WEIGHT;
+    }
+
+    classify_vertices(s, vertex_count, index_count);
+
+    // Area-weighted face quadrics, plus a plane standing on every open edge
+    s.quadrics.assign(vertex_count, Quadric{});
+    s.vertex_triangles.resize(vertex_count);
+    for (Uint32 i = 0; i < index_count; i += 3) {
+        const double* p[3] = { attributes_of(s, indices[i]), attributes_of(s, indices[i + 1]), attributes_of(s, indices[i + 2]) };
+        double e1[3], e2[3], normal[3];
+        for (int k = 0; k < 3; ++k) {
+            e1[k] = p[1][k] - p[0][k];
+            e2[k] = p[2][k] - p[0][k];
+        }
+        cross(e1, e2, normal);
+        double area = 0.5 * std::sqrt(dot(normal, normal, 3));
+
+        Quadric face;
+        if (triangle_quadric(p[0], p[1], p[2], face)) {
+            for (int k = 0; k < 3; ++k) {
+                add_quadric(s.quadrics[indices[i + k]], face, area);
+            }
+        }
+        for (int k = 0; k < 3; ++k) {
+            s.vertex_triangles[indices[i + k]].push_back(i / 3);
+        }
+    }
+    for (Uint32 i = 0; i < index_count && extent > 0.0f; i += 3) {
+        const double* p[3] = { attributes_of(s, indices[i]), attributes_of(s, indices[i + 1]), attributes_of(s, indices[i + 2]) };
+        double e1[3], e2[3], normal[3];
+        for (int k = 0; k < 3; ++k) {
+            e1[k] = p[1][k] - p[0][k];
+            e2[k] = p[2][k] - p[0][k];
+        }
+        cross(e1, e2, normal);
+        for (int k = 0; k < 3; ++k) {
+            Uint32 a = indices[i + k], b = indices[i + (k + 1) % 3];
+            if (edge_triangles(s, a, b) != 1) {
+                continue;
+            }
+            double edge[3], plane[3];
+            for (int j = 0; j < 3; ++j) {
+                edge[j] = p[(k + 1) % 3][j] - p[k][j];
+            }
+            cross(edge, normal, plane);
+            double length = std::sqrt(dot(plane, plane, 3));
+            if (length == 0.0) {
+                continue;
+            }
+            for (double& n : plane) {
+                n /= length;
+            }
+            Quadric border;
+            plane_quadric(plane, -dot(plane, p[k], 3), border);
+            double weight = BORDER_WEIGHT * dot(edge, edge, 3);
+            add_quadric(s.quadrics[a], border, weight);
+            add_quadric(s.quadrics[b], border, weight);
+        }
+    }
+
+    // Passes of independent collapses, cheapest first, each taking at most an eighth of the remaining excess
+    // so costs are refreshed often. Only vertices next to a collapse look for a new one.
+    const double maxCost = max_error < FLT_MAX ? (double)max_error * scale * max_error * scale : DBL_MAX;
+    Uint32 triangleCount = index_count / 3;
+    const Uint32 targetTriangles = target_index_count / 3;
+    double worstCost = 0.0;
+    std::vector<Collapse> best(vertex_count);
+    std::vector<bool> hasBest(vertex_count, false);
+    std::vector<bool> dirty(vertex_count, true);
+    std::vector<Collapse> collapses;
+    std::vector<Uint32> touched(vertex_count, 0);
+    Uint32 pass = 0;
+    bool stop = false;
+    while (triangleCount > targetTriangles && !stop) {
+        pass++;
+        collapses.clear();
+        for (Uint32 v = 0; v < vertex_count; ++v) {
+            if (s.kinds[v] == VERTEX_LOCKED || s.vertex_triangles[v].empty()) {
+                hasBest[v] = false;
+                continue;
+            }
+            // A seam pair is proposed once, from its lower vertex
+            bool seam = s.kinds[v] == VERTEX_SEAM;
+            if (seam && s.twins[v] < v) {
+                continue;
+            }
+            if (dirty[v] || (seam && dirty[s.twins[v]])) {
+                hasBest[v] = best_collapse(s, v, best[v]);
+            }
+            if (hasBest[v]) {
+                collapses.push_back(best[v]);
+            }
+        }
+        if (collapses.empty()) {
+            break;
+        }
+        std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) { return a.cost < b.cost; });
+        std::fill(dirty.begin(), dirty.end(), false);
+
+        const Uint32 passGoal = SDL_max((triangleCount - targetTriangles) / 8, 1u);
+        Uint32 removed = 0;
+        for (const Collapse& c : collapses) {
+            if (removed >= passGoal) {
+                break;
+            }
+            if (c.cost > maxCost) {
+                stop = true;
+                break;
+            }
+            if (touched[c.from] == pass || touched[c.to] == pass
+                || (c.twin_from != UINT32_MAX && (touched[c.twin_from] == pass || touched[c.twin_to] == pass))) {
+                continue;
+            }
+            // Everything around the target changed, so nothing there may move again this pass
+            const Uint32 pair[2][2] = { { c.from, c.to }, { c.twin_from, c.twin_to } };
+            for (const auto& edge : pair) {
+                if (edge[0] == UINT32_MAX) {
+                    continue;
+                }
+                removed += apply_collapse(s, edge[0], edge[1]);
+                touched[edge[0]] = pass;
+                for (Uint32 t : s.vertex_triangles[edge[1]]) {
+                    for (int k = 0; k < 3; ++k) {
+                        touched[s.triangles[t * 3 + k]] = pass;
+                        dirty[s.triangles[t * 3 + k]] = true;
+                    }
+                }
+            }
+            worstCost = SDL_max(worstCost, c.cost);
+        }
+        if (removed == 0) {
+            break;
+        }
+        triangleCount -= SDL_min(removed, triangleCount);
+    }
+
+    out.clear();
+    for (size_t t = 0; t < s.live.size(); ++t) {
+        if (s.live[t]) {
+            out.insert(out.end(), &s.triangles[t * 3], &s.triangles[t * 3] + 3);
+        }
+    }
+    return (float)(std::sqrt(worstCost) / scale);
+}
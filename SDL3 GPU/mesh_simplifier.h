@@ -0,0 +1,18 @@
+﻿#pragma once
+#include <vector>
+#include <SDL3/SDL.h>
+#include "mesh.h"
+
+// How much a UV unit counts against a unit of normalized position in the quadrics
+#define SIMPLIFY_UV_WEIGHT 1.0f
+
+// Quadric error simplification by half-edge collapse: a vertex is only ever merged into one of
+// its neighbours, so the result indexes the same vertex buffer as the input.
+// Quadrics span position and UV (Garland and Heckbert 1998). UV seam vertices collapse together
+// with their twin along the seam, open borders only along themselves, and anything else on a
+// seam or border stays put.
+// Writes the simplified triangles to out and returns the error of the worst collapse in model units,
+// UV drift counting as distance. Stops at target_index_count or before the first collapse costing
+// more than max_error.
+float simplify_mesh(const VertexData* vertices, Uint32 vertex_count, const Uint32* indices, Uint32 index_count,
+    Uint32 target_index_count, float max_error, std::vector<Uint32>& out);
@@ -0,0 +1,200 @@
+﻿#include "meshlet.h"
+#include <cmath>
+
+// Normals spreading further than this from the average leave a cone too wide to reject anything
+#define MESHLET_MIN_CONE_DOT 0.1f
+
+static Vec3 sub(const Vec3& a, const Vec3& b) {
+    return { a.x - b.x, a.y - b.y, a.z - b.z };
+}
+
+static float dot(const Vec3& a, const Vec3& b) {
+    return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+static Vec3 cross(const Vec3& a, const Vec3& b) {
+    return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x };
+}
+
+static bool normalize(Vec3& v) {
+    float length = std::sqrt(dot(v, v));
+    if (length == 0.0f) {
+        return false;
+    }
+    v = { v.x / length, v.y / length, v.z / length };
+    return true;
+}
+
+Uint32 build_meshlets(const VertexData* vertices, const Uint32* indices, Uint32 index_count, Uint32 vertex_count,
+    std::vector<Meshlet>& meshlets) {
+    // Which cluster last referenced each vertex, so membership is a single compare
+    std::vector<Uint32> owner(vertex_count, UINT32_MAX);
+    const size_t firstMeshlet = meshlets.size();
+    Uint32 current = UINT32_MAX;
+    Meshlet meshlet = {};
+
+    for (Uint32 i = 0; i + 2 < index_count; i += 3) {
+        Uint32 added = 0;
+        for (Uint32 k = 0; k < 3; ++k) {
+            if (owner[indices[i + k]] != current) {
+                added++;
+            }
+        }
+        // Repeated corners of a degenerate triangle are counted twice, which only errs on the small side
+        if (current == UINT32_MAX || meshlet.vertex_count + added > MESHLET_MAX_VERTICES || meshlet.index_count / 3 + 1 > MESHLET_MAX_TRIANGLES) {
+            if (current != UINT32_MAX) {
+                compute_meshlet_bounds(vertices, indices, meshlet);
+                meshlets.push_back(meshlet);
+            }
+            current = (Uint32)meshlets.size();
+            meshlet = {};
+            meshlet.first_index = i;
+        }
+        for (Uint32 k = 0; k < 3; ++k) {
+            Uint32& vertexOwner = owner[indices[i + k]];
+            if (vertexOwner != current) {
+                vertexOwner = current;
+                meshlet.vertex_count++;
+            }
+        }
+        meshlet.index_count += 3;
+    }
+    if (meshlet.index_count > 0) {
+        compute_meshlet_bounds(vertices, indices, meshlet);
+        meshlets.push_back(meshlet);
+    }
+    return (Uint32)(meshlets.size() - firstMeshlet);
+}
+
+void compute_meshlet_bounds(const VertexData* vertices, const Uint32* indices, Meshlet& meshlet) {
+    const Uint32* triangles = indices + meshlet.first_index;
+
+    // Sphere centred on the AABB, as for whole submeshes
+    Vec3 lo = vertices[triangles[0]].position;
+    Vec3 hi = lo;
+    for (Uint32 i = 1; i < meshlet.index_count; ++i) {
+        const Vec3& p = vertices[triangles[i]].position;
+        lo = { SDL_min(lo.x, p.x), SDL_min(lo.y, p.y), SDL_min(lo.z, p.z) };
+        hi = { SDL_max(hi.x, p.x), SDL_max(hi.y, p.y), SDL_max(hi.z, p.z) };
+    }
+    Vec3 center = { (lo.x + hi.x) * 0.5f, (lo.y + hi.y) * 0.5f, (lo.z + hi.z) * 0.5f };
+    float radiusSq = 0.0f;
+    for (Uint32 i = 0; i < meshlet.index_count; ++i) {
+        Vec3 d = sub(vertices[triangles[i]].position, center);
+        radiusSq = SDL_max(radiusSq, dot(d, d));
+    }
+    meshlet.center = center;
+    meshlet.radius = std::sqrt(radiusSq);
+
+    // Normal cone as meshoptimizer builds it: the axis averages the unit face normals and the
+    // cutoff comes from the one furthest from it
+    std::vector<Vec3> normals;
+    normals.reserve(meshlet.index_count / 3);
+    Vec3 axis = { 0.0f, 0.0f, 0.0f };
+    for (Uint32 i = 0; i < meshlet.index_count; i += 3) {
+        const Vec3& p0 = vertices[triangles[i]].position;
+        Vec3 n = cross(sub(vertices[triangles[i + 1]].position, p0), sub(vertices[triangles[i + 2]].position, p0));
+        // Degenerate triangles rasterize nothing, so they do not constrain the cone
+        if (!normalize(n)) {
+            normals.push_back({ 0.0f, 0.0f, 0.0f });
+            continue;
+        }
+        normals.push_back(n);
+        axis = { axis.x + n.x, axis.y + n.y, axis.z + n.z };
+    }
+
+    meshlet.cone_apex = center;
+    meshlet.cone_axis = { 0.0f, 0.0f, 1.0f };
+    meshlet.cone_cutoff = 1.0f;
+    if (!normalize(axis)) {
+        return;
+    }
+    float minDot = 1.0f;
+    for (const Vec3& n : normals) {
+        if (n.x != 0.0f || n.y != 0.0f || n.z != 0.0f) {
+            minDot = SDL_min(minDot, dot(n, axis));
+        }
+    }
+    meshlet.cone_axis = axis;
+    if (minDot <= MESHLET_MIN_CONE_DOT) {
+        return;
+    }
+
+    // Slide the apex back along the axis until it is behind every triangle's plane
+    float maxT = 0.0f;
+    for (size_t t = 0; t < normals.size(); ++t) {
+        const Vec3& n = normals[t];
+        if (n.x == 0.0f && n.y == 0.0f && n.z == 0.0f) {
+            continue;
+        }
+        float distance = dot(sub(center, vertices[triangles[t * 3]].position), n);
+        maxT = SDL_max(maxT, distance / dot(axis, n));
+    }
+    meshlet.cone_apex = { center.x - axis.x * maxT, center.y - axis.y * maxT, center.z - axis.z * maxT };
+    meshlet.cone_cutoff = std::sqrt(1.0f - minDot * minDot);
+}
+
+MeshletStats analyze_meshlets(const Meshlet* meshlets, Uint32 count) {
+    MeshletStats stats = {};
+    stats.meshlets = count;
+    for (Uint32 i = 0; i < count; ++i) {
+        stats.triangles += meshlets[i].index_count / 3;
+        stats.vertices += meshlets[i].vertex_count;
+        stats.cones += meshlets[i].cone_cutoff < 1.0f ? 1 : 0;
+    }
+    return stats;
+}
+
+MeshletVisibility classify_meshlet(const Meshlet& meshlet, const Frustum& frustum, const Vec3& eye) {
+    for (const glm::vec4& plane : frustum.planes) {
+        if (plane.x * meshlet.center.x + plane.y * meshlet.center.y + plane.z * meshlet.center.z + plane.w < -meshlet.radius) {
+            return MESHLET_OUTSIDE_FRUSTUM;
+        }
+    }
+    if (meshlet.cone_cutoff < 1.0f) {
+        Vec3 view = sub(meshlet.cone_apex, eye);
+        if (normalize(view) && dot(view, meshlet.cone_axis) >= meshlet.cone_cutoff) {
+            return MESHLET_BACKFACING;
+        }
+    }
+    return MESHLET_VISIBLE;
+}
+
+Uint32 cull_meshlets(const Meshlet* meshlets, Uint32 count, const Frustum& frustum, const Vec3& eye,
+    std::vector<MeshletDraw>& draws, MeshletCullStats& stats) {
+    const size_t firstDraw = draws.size();
+    bool extend = false;
+    for (Uint32 i = 0; i < count; ++i) {
+        const Meshlet& meshlet = meshlets[i];
+        stats.meshlets++;
+        stats.triangles += meshlet.index_count / 3;
+        MeshletVisibility visibility = classify_meshlet(meshlet, frustum, eye);
+        if (visibility != MESHLET_VISIBLE) {
+            stats.frustum_culled += visibility == MESHLET_OUTSIDE_FRUSTUM ? 1 : 0;
+            if (visibility == MESHLET_BACKFACING) {
+                stats.backface_culled++;
+                stats.triangles_backfacing += meshlet.index_count / 3;
+            }
+            extend = false;
+            continue;
+        }
+        stats.triangles_drawn += meshlet.index_count / 3;
+        // Clusters are stored back to back, so a run of survivors is one draw
+        if (extend) {
+            draws.back().index_count += meshlet.index_count;
+        } else {
+            draws.push_back({ meshlet.first_index, meshlet.index_count });
+        }
+        extend = true;
+    }
+    return (Uint32)(draws.size() - firstDraw);
+}
+
+void log_meshlet_cull_stats(const MeshletCullStats& stats) {
+    if (stats.meshlets == 0) {
+        return;
+    }
+    SDL_Log("Meshlet culling: %llu clusters tested, %.1f%% outside the frustum, %.1f%% backfacing, %.1f%% of triangles drawn",
+        (unsigned long long)stats.meshlets, 100.0 * stats.frustum_culled / stats.meshlets, 100.0 * stats.backface_culled / stats.meshlets,
+        stats.triangles > 0 ? 100.0 * stats.triangles_drawn / stats.triangles : 0.0);
+}
@@ -0,0 +1,55 @@
+﻿#pragma once
+#include <vector>
+#include <SDL3/SDL.h>
+#include "mesh.h"
+#include "culling.h"
+
+// Cluster limits that fit a 64 vertex / 126 primitive mesh shader workgroup with room to spare
+#define MESHLET_MAX_VERTICES 64
+#define MESHLET_MAX_TRIANGLES 124
+
+struct MeshletStats {
+    Uint32 meshlets;
+    Uint32 triangles;
+    Uint32 vertices; // summed over clusters, so shared vertices count once per cluster
+    Uint32 cones;    // clusters whose normal cone can reject them
+};
+
+enum MeshletVisibility {
+    MESHLET_VISIBLE,
+    MESHLET_OUTSIDE_FRUSTUM,
+    MESHLET_BACKFACING
+};
+
+// Neighbouring surviving clusters merged into one index range
+struct MeshletDraw {
+    Uint32 first_index; // relative to the submesh's first_index
+    Uint32 index_count;
+};
+
+struct MeshletCullStats {
+    Uint64 meshlets;
+    Uint64 frustum_culled;
+    Uint64 backface_culled;
+    Uint64 triangles;
+    Uint64 triangles_drawn;
+    Uint64 triangles_backfacing; // in clusters the cone rejected
+};
+
+// Splits a submesh's triangles, in their current order, into clusters appended to meshlets.
+// indices are relative to vertices. Returns how many clusters were added.
+Uint32 build_meshlets(const VertexData* vertices, const Uint32* indices, Uint32 index_count, Uint32 vertex_count,
+    std::vector<Meshlet>& meshlets);
+
+// Fills the bounding sphere and normal cone from the meshlet's index range
+void compute_meshlet_bounds(const VertexData* vertices, const Uint32* indices, Meshlet& meshlet);
+
+MeshletStats analyze_meshlets(const Meshlet* meshlets, Uint32 count);
+
+// frustum and eye are in the mesh's model space
+MeshletVisibility classify_meshlet(const Meshlet& meshlet, const Frustum& frustum, const Vec3& eye);
+// Appends the ranges of the clusters that survive and returns how many draws were added
+Uint32 cull_meshlets(const Meshlet* meshlets, Uint32 count, const Frustum& frustum, const Vec3& eye,
+    std::vector<MeshletDraw>& draws, MeshletCullStats& stats);
+
+void log_meshlet_cull_stats(const MeshletCullStats& stats);
@@ -0,0 +1,117 @@
+﻿#include "overdraw.h"
+#include <iostream>
+#include <cstring>
+
+struct OverdrawCounter {
+    SDL_GPUDevice* device;
+    SDL_GPUTexture* target;
+    SDL_GPUTransferBuffer* readback; // OVERDRAW_SLOTS images of width * height halves
+    Uint32 width, height;
+};
+
+// Counts are small integers, so only normal halves matter
+static float half_to_float(Uint16 h) {
+    Uint32 exponent = (h >> 10) & 0x1F;
+    Uint32 mantissa = h & 0x3FF;
+    if (exponent == 0) {
+        return mantissa * (1.0f / 16777216.0f);
+    }
+    Uint32 bits = ((Uint32)(h & 0x8000) << 16) | ((exponent + 112) << 23) | (mantissa << 13);
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+OverdrawCounter* create_overdraw_counter(SDL_GPUDevice* device) {
+    OverdrawCounter* counter = new OverdrawCounter();
+    counter->device = device;
+    return counter;
+}
+
+static void release_target(OverdrawCounter* counter) {
+    SDL_ReleaseGPUTexture(counter->device, counter->target);
+    SDL_ReleaseGPUTransferBuffer(counter->device, counter->readback);
+    counter->target = NULL;
+    counter->readback = NULL;
+    counter->width = 0;
+    counter->height = 0;
+}
+
+void destroy_overdraw_counter(OverdrawCounter* counter) {
+    if (counter == NULL) {
+        return;
+    }
+    release_target(counter);
+    delete counter;
+}
+
+SDL_GPUTexture* overdraw_target(OverdrawCounter* counter, Uint32 width, Uint32 height) {
+    if (counter->target && counter->width == width && counter->height == height) {
+        return counter->target;
+    }
+    release_target(counter);
+
+    SDL_GPUTextureCreateInfo info = {};
+    info.type = SDL_GPU_TEXTURETYPE_2D;
+    info.format = OVERDRAW_FORMAT;
+    info.usage = SDL_GPU_TEXTUREUSAGE_COLOR_TARGET;
+    info.width = width;
+    info.height = height;
+    info.layer_count_or_depth = 1;
+    info.num_levels = 1;
+    info.sample_count = SDL_GPU_SAMPLECOUNT_1;
+    counter->target = SDL_CreateGPUTexture(counter->device, &info);
+
+    SDL_GPUTransferBufferCreateInfo readbackInfo = {};
+    readbackInfo.usage = SDL_GPU_TRANSFERBUFFERUSAGE_DOWNLOAD;
+    readbackInfo.size = width * height * (Uint32)sizeof(Uint16) * OVERDRAW_SLOTS;
+    counter->readback = SDL_CreateGPUTransferBuffer(counter->device, &readbackInfo);
+    if (counter->target == NULL || counter->readback == NULL) {
+        std::cout << "Failed to create overdraw target. Error: " << SDL_GetError() << std::endl;
+        release_target(counter);
+        return NULL;
+    }
+    counter->width = width;
+    counter->height = height;
+    return counter->target;
+}
+
+void download_overdraw(OverdrawCounter* counter, SDL_GPUCommandBuffer* command_buffer, Uint32 slot) {
+    if (counter->target == NULL || slot >= OVERDRAW_SLOTS) {
+        return;
+    }
+    SDL_GPUCopyPass* copyPass = SDL_BeginGPUCopyPass(command_buffer);
+    SDL_GPUTextureRegion region = {};
+    region.texture = counter->target;
+    region.w = counter->width;
+    region.h = counter->height;
+    region.d = 1;
+    SDL_GPUTextureTransferInfo destination = {};
+    destination.transfer_buffer = counter->readback;
+    destination.offset = slot * counter->width * counter->height * (Uint32)sizeof(Uint16);
+    SDL_DownloadFromGPUTexture(copyPass, &region, &destination);
+    SDL_EndGPUCopyPass(copyPass);
+}
+
+bool read_overdraw(OverdrawCounter* counter, OverdrawStats* stats) {
+    if (counter->readback == NULL) {
+        return false;
+    }
+    SDL_WaitForGPUIdle(counter->device);
+    const Uint16* counts = (const Uint16*)SDL_MapGPUTransferBuffer(counter->device, counter->readback, false);
+    if (counts == NULL) {
+        std::cout << "Failed to map overdraw readback. Error: " << SDL_GetError() << std::endl;
+        return false;
+    }
+    const Uint32 pixels = counter->width * counter->height;
+    for (Uint32 slot = 0; slot < OVERDRAW_SLOTS; ++slot) {
+        stats[slot] = {};
+        for (Uint32 i = 0; i < pixels; ++i) {
+            Uint64 count = (Uint64)half_to_float(counts[slot * pixels + i]);
+            stats[slot].fragments += count;
+            stats[slot].covered_pixels += count > 0 ? 1 : 0;
+        }
+    }
+    SDL_UnmapGPUTransferBuffer(counter->device, counter->readback);
+    return true;
+}
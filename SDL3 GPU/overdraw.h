@@ -0,0 +1,26 @@
+﻿#pragma once
+#include <SDL3/SDL.h>
+
+// The scene is drawn again with a fragment shader writing 1 and additive blending into this format,
+// which blends everywhere and counts exactly up to 2048 fragments a pixel
+#define OVERDRAW_FORMAT SDL_GPU_TEXTUREFORMAT_R16_FLOAT
+// Counts downloaded side by side before one read_overdraw, e.g. without and with a depth prepass
+#define OVERDRAW_SLOTS 2
+
+struct OverdrawStats {
+    Uint64 fragments;      // fragments shaded
+    Uint64 covered_pixels; // pixels shaded at least once
+};
+
+// Measures overdraw: shaded fragments per covered pixel
+struct OverdrawCounter;
+
+OverdrawCounter* create_overdraw_counter(SDL_GPUDevice* device);
+void destroy_overdraw_counter(OverdrawCounter* counter);
+
+// The count target for a width x height pass, recreated when the size changed. Clear it to 0.
+SDL_GPUTexture* overdraw_target(OverdrawCounter* counter, Uint32 width, Uint32 height);
+// Records the download of the target into a slot; record after the pass that counted into it
+void download_overdraw(OverdrawCounter* counter, SDL_GPUCommandBuffer* command_buffer, Uint32 slot);
+// Waits for the GPU and sums each slot; call after submitting the downloads
+bool read_overdraw(OverdrawCounter* counter, OverdrawStats* stats);
@@ -0,0 +1,172 @@
+﻿#include "parallel_recording.h"
+#include <iostream>
+#include <vector>
+#include "profiler.h"
+
+#define BENCHMARK_MAX_THREADS 16
+
+struct ParallelRecorder {
+    SDL_GPUDevice* device;
+    SDL_GPUTexture* color;
+    SDL_GPUTextureFormat color_format;
+    Uint32 width, height;
+    // Job whose turn it is to submit
+    SDL_Mutex* mutex;
+    SDL_Condition* turn_changed;
+    Uint32 next_submit;
+};
+
+ParallelRecorder* create_parallel_recorder(SDL_GPUDevice* device) {
+    ParallelRecorder* recorder = new ParallelRecorder();
+    recorder->device = device;
+    recorder->mutex = SDL_CreateMutex();
+    recorder->turn_changed = SDL_CreateCondition();
+    return recorder;
+}
+
+void destroy_parallel_recorder(ParallelRecorder* recorder) {
+    if (recorder == NULL) {
+        return;
+    }
+    SDL_ReleaseGPUTexture(recorder->device, recorder->color);
+    SDL_DestroyCondition(recorder->turn_changed);
+    SDL_DestroyMutex(recorder->mutex);
+    delete recorder;
+}
+
+SDL_GPUTexture* acquire_scene_color(ParallelRecorder* recorder, SDL_GPUTextureFormat format, Uint32 width, Uint32 height) {
+    if (width == 0 || height == 0) {
+        return NULL;
+    }
+    if (recorder->color && recorder->color_format == format && recorder->width == width && recorder->height == height) {
+        return recorder->color;
+    }
+    SDL_ReleaseGPUTexture(recorder->device, recorder->color);
+
+    SDL_GPUTextureCreateInfo info = {};
+    info.type = SDL_GPU_TEXTURETYPE_2D;
+    info.format = format;
+    info.usage = SDL_GPU_TEXTUREUSAGE_COLOR_TARGET | SDL_GPU_TEXTUREUSAGE_SAMPLER;
+    info.width = width;
+    info.height = height;
+    info.layer_count_or_depth = 1;
+    info.num_levels = 1;
+    info.sample_count = SDL_GPU_SAMPLECOUNT_1;
+    recorder->color = SDL_CreateGPUTexture(recorder->device, &info);
+    if (!recorder->color) {
+        std::cout << "Failed to create scene color target. Error: " << SDL_GetError() << std::endl;
+    }
+    recorder->color_format = format;
+    recorder->width = width;
+    recorder->height = height;
+    return recorder->color;
+}
+
+bool record_parallel(ParallelRecorder* recorder, ThreadPool* pool, Uint32 job_count,
+    const std::function<void(SDL_GPUCommandBuffer* command_buffer, Uint32 job)>& record) {
+    recorder->next_submit = 0;
+    Uint32 failures = 0; // under the mutex
+
+    // Jobs are claimed in order, so every job before the one waiting for its turn is already being
+    // recorded by some thread and the wait always ends
+    auto run = [&](Uint32 begin, Uint32 end) {
+        for (Uint32 job = begin; job < end; ++job) {
+            SDL_GPUCommandBuffer* commandBuffer = SDL_AcquireGPUCommandBuffer(recorder->device);
+            if (commandBuffer) {
+                PROFILE_SCOPE("Record job");
+                record(commandBuffer, job);
+            }
+            PROFILE_SCOPE("Submit job");
+
+            SDL_LockMutex(recorder->mutex);
+            while (recorder->next_submit != job) {
+                SDL_WaitCondition(recorder->turn_changed, recorder->mutex);
+            }
+            if (!commandBuffer || !SDL_SubmitGPUCommandBuffer(commandBuffer)) {
+                std::cout << "Failed to record job " << job << ". Error: " << SDL_GetError() << std::endl;
+                failures++;
+            }
+            recorder->next_submit++;
+            SDL_BroadcastCondition(recorder->turn_changed);
+            SDL_UnlockMutex(recorder->mutex);
+        }
+    };
+    if (pool == NULL) {
+        run(0, job_count);
+    } else {
+        thread_pool_parallel_for(pool, job_count, 1, run);
+    }
+    return failures == 0;
+}
+
+bool record_render_queue_parallel(ParallelRecorder* recorder, ThreadPool* pool, RenderQueue* queue, Uint32 job_count,
+    const SDL_GPUColorTargetInfo& color, const SDL_GPUDepthStencilTargetInfo& depth, RenderQueueStats& stats) {
+    // An empty queue still needs one pass to clear the targets
+    const Uint32 count = render_queue_size(queue);
+    const Uint32 jobs = SDL_max(SDL_min(job_count, count), 1u);
+    std::vector<RenderQueueStats> jobStats(jobs);
+
+    bool recorded = record_parallel(recorder, pool, jobs, [&](SDL_GPUCommandBuffer* commandBuffer, Uint32 job) {
+        SDL_GPUColorTargetInfo jobColor = color;
+        SDL_GPUDepthStencilTargetInfo jobDepth = depth;
+        if (job > 0) {
+            jobColor.load_op = SDL_GPU_LOADOP_LOAD;
+            jobColor.cycle = false;
+            jobDepth.load_op = SDL_GPU_LOADOP_LOAD;
+            jobDepth.cycle = false;
+        }
+        if (job + 1 < jobs) {
+            jobDepth.store_op = SDL_GPU_STOREOP_STORE;
+        }
+
+        const Uint32 first = (Uint32)((Uint64)count * job / jobs);
+        const Uint32 last = (Uint32)((Uint64)count * (job + 1) / jobs);
+        SDL_GPURenderPass* renderPass = SDL_BeginGPURenderPass(commandBuffer, &jobColor, 1, &jobDepth);
+        submit_render_queue_range(queue, renderPass, commandBuffer, first, last - first, jobStats[job]);
+        SDL_EndGPURenderPass(renderPass);
+    });
+    for (const RenderQueueStats& s : jobStats) {
+        merge_render_queue_stats(stats, s);
+    }
+    return recorded;
+}
+
+void benchmark_parallel_recording(ParallelRecorder* recorder, RenderQueue* queue, const SDL_GPUColorTargetInfo& color,
+    const SDL_GPUDepthStencilTargetInfo& depth, int iterations) {
+    const double toMs = 1000.0 / SDL_GetPerformanceFrequency();
+    const Uint32 draws = render_queue_size(queue);
+
+    // The single-threaded encoder: one command buffer, one pass
+    double singleMs = 0.0;
+    for (int it = 0; it < iterations; ++it) {
+        RenderQueueStats stats = {};
+        Uint64 start = SDL_GetPerformanceCounter();
+        SDL_GPUCommandBuffer* commandBuffer = SDL_AcquireGPUCommandBuffer(recorder->device);
+        SDL_GPURenderPass* renderPass = SDL_BeginGPURenderPass(commandBuffer, &color, 1, &depth);
+        submit_render_queue(queue, renderPass, commandBuffer, stats);
+        SDL_EndGPURenderPass(renderPass);
+        SDL_SubmitGPUCommandBuffer(commandBuffer);
+        singleMs += (SDL_GetPerformanceCounter() - start) * toMs;
+        SDL_WaitForGPUIdle(recorder->device);
+    }
+    singleMs /= iterations;
+    SDL_Log("Recording %u draws, single-threaded encoder: %.3f ms", draws, singleMs);
+
+    // One job per thread; the calling thread is one of them
+    const int cores = SDL_GetNumLogicalCPUCores();
+    for (int threads = 1; threads <= BENCHMARK_MAX_THREADS; threads *= 2) {
+        ThreadPool* pool = threads > 1 ? create_thread_pool(threads - 1) : NULL;
+        double ms = 0.0;
+        for (int it = 0; it < iterations; ++it) {
+            RenderQueueStats stats = {};
+            Uint64 start = SDL_GetPerformanceCounter();
+            record_render_queue_parallel(recorder, pool, queue, (Uint32)threads, color, depth, stats);
+            ms += (SDL_GetPerformanceCounter() - start) * toMs;
+            SDL_WaitForGPUIdle(recorder->device);
+        }
+        ms /= iterations;
+        SDL_Log("  %2d threads%s: %.3f ms, %.2fx the single-threaded encoder, %llu steals", threads,
+            threads > cores ? " (oversubscribed)" : "", ms, singleMs / ms, (unsigned long long)(pool ? thread_pool_steals(pool) : 0));
+        destroy_thread_pool(pool);
+    }
+}
@@ -0,0 +1,30 @@
+﻿#pragma once
+#include <functional>
+#include <SDL3/SDL.h>
+#include "render_queue.h"
+#include "thread_pool.h"
+
+struct ParallelRecorder;
+
+ParallelRecorder* create_parallel_recorder(SDL_GPUDevice* device);
+void destroy_parallel_recorder(ParallelRecorder* recorder);
+
+// The offscreen color target parallel jobs draw into, since only the command buffer that acquires the
+// swapchain texture may draw to it. Recreated when the size changes; NULL for an empty size.
+SDL_GPUTexture* acquire_scene_color(ParallelRecorder* recorder, SDL_GPUTextureFormat format, Uint32 width, Uint32 height);
+
+// Calls record for every job on the pool's workers and the calling thread, each job into its own command
+// buffer acquired on the thread recording it. Jobs are taken and submitted in job order whenever they
+// finish recording. A NULL pool records every job on the calling thread. False if any command buffer
+// could not be acquired or submitted.
+bool record_parallel(ParallelRecorder* recorder, ThreadPool* pool, Uint32 job_count,
+    const std::function<void(SDL_GPUCommandBuffer* command_buffer, Uint32 job)>& record);
+
+// Draws the sorted queue as up to job_count contiguous runs, each in its own render pass. The first run
+// starts the targets the way color and depth say; the rest load what the runs before them drew.
+bool record_render_queue_parallel(ParallelRecorder* recorder, ThreadPool* pool, RenderQueue* queue, Uint32 job_count,
+    const SDL_GPUColorTargetInfo& color, const SDL_GPUDepthStencilTargetInfo& depth, RenderQueueStats& stats);
+
+// CPU time to record and submit a sorted queue on one to 16 threads, against one command buffer and pass
+void benchmark_parallel_recording(ParallelRecorder* recorder, RenderQueue* queue, const SDL_GPUColorTargetInfo& color,
+    const SDL_GPUDepthStencilTargetInfo& depth, int iterations);
@@ -0,0 +1,382 @@
+﻿#include "pipeline_cache.h"
+#include <stdio.h>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct PipelineEntry {
+    std::vector<Uint32> key; // normalized create info, compared on hash collisions
+    SDL_GPUGraphicsPipeline* pipeline;
+    SDL_GPUShader* vertex_shader;   // to find what a shader reload affects
+    SDL_GPUShader* fragment_shader;
+    std::string manifest_entry;
+    bool ready; // pipeline is NULL when creation failed; kept so the failure is not retried every frame
+};
+
+struct ShaderEntry {
+    std::string name;
+    SDL_GPUShader* shader;
+};
+
+struct PipelineCache {
+    SDL_GPUDevice* device;
+    ShaderLibrary* library;
+    SDL_Mutex* mutex;
+    SDL_Condition* created; // a pipeline became ready or a prewarm job finished
+    std::unordered_multimap<Uint64, std::unique_ptr<PipelineEntry>> pipelines;
+    std::vector<ShaderEntry> shaders;
+    Uint32 prewarm_pending;
+    PipelineCacheStats stats;
+};
+
+// Set while a prewarm job builds its entry, so its creations count as prewarmed
+static thread_local bool prewarming = false;
+
+PipelineCache* create_pipeline_cache(SDL_GPUDevice* device, ShaderLibrary* library) {
+    PipelineCache* cache = new PipelineCache();
+    cache->device = device;
+    cache->library = library;
+    cache->mutex = SDL_CreateMutex();
+    cache->created = SDL_CreateCondition();
+    cache->prewarm_pending = 0;
+    cache->stats = {};
+    return cache;
+}
+
+void destroy_pipeline_cache(PipelineCache* cache) {
+    if (cache == NULL) {
+        return;
+    }
+    SDL_LockMutex(cache->mutex);
+    while (cache->prewarm_pending > 0) {
+        SDL_WaitCondition(cache->created, cache->mutex);
+    }
+    SDL_UnlockMutex(cache->mutex);
+
+    for (auto& pipeline : cache->pipelines) {
+        SDL_ReleaseGPUGraphicsPipeline(cache->device, pipeline.second->pipeline);
+    }
+    for (ShaderEntry& shader : cache->shaders) {
+        SDL_ReleaseGPUShader(cache->device, shader.shader);
+    }
+    SDL_DestroyCondition(cache->created);
+    SDL_DestroyMutex(cache->mutex);
+    delete cache;
+}
+
+SDL_GPUShader* pipeline_cache_shader(PipelineCache* cache, const char* name) {
+    SDL_LockMutex(cache->mutex);
+    SDL_GPUShader* shader = NULL;
+    bool found = false;
+    for (const ShaderEntry& entry : cache->shaders) {
+        if (entry.name == name) {
+            shader = entry.shader;
+            found = true;
+            break;
+        }
+    }
+    // Failures are remembered too, so a missing shader is only reported once
+    if (!found) {
+        shader = create_library_shader(cache->device, cache->library, name);
+        cache->shaders.push_back({ name, shader });
+    }
+    SDL_UnlockMutex(cache->mutex);
+    return shader;
+}
+
+static void append_blend(std::vector<Uint32>& key, const SDL_GPUColorTargetBlendState& blend) {
+    key.push_back(blend.enable_blend);
+    if (blend.enable_blend) {
+        key.push_back(blend.src_color_blendfactor);
+        key.push_back(blend.dst_color_blendfactor);
+        key.push_back(blend.color_blend_op);
+        key.push_back(blend.src_alpha_blendfactor);
+        key.push_back(blend.dst_alpha_blendfactor);
+        key.push_back(blend.alpha_blend_op);
+    }
+    key.push_back(blend.enable_color_write_mask ? blend.color_write_mask : 0xF);
+}
+
+static void append_stencil(std::vector<Uint32>& key, const SDL_GPUStencilOpState& stencil) {
+    key.push_back(stencil.fail_op);
+    key.push_back(stencil.pass_op);
+    key.push_back(stencil.depth_fail_op);
+    key.push_back(stencil.compare_op);
+}
+
+static void append_float(std::vector<Uint32>& key, float value) {
+    Uint32 bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    key.push_back(bits);
+}
+
+// Field by field rather than the raw bytes, which would pick up padding, pointers and disabled state
+static void normalize_pipeline_info(const SDL_GPUGraphicsPipelineCreateInfo& info, std::vector<Uint32>& key) {
+    key.clear();
+    // Shaders are identified by object; pipeline_cache_shader keeps one object per name
+    const Uint64 vertexShader = (Uint64)(uintptr_t)info.vertex_shader;
+    const Uint64 fragmentShader = (Uint64)(uintptr_t)info.fragment_shader;
+    key.push_back((Uint32)vertexShader);
+    key.push_back((Uint32)(vertexShader >> 32));
+    key.push_back((Uint32)fragmentShader);
+    key.push_back((Uint32)(fragmentShader >> 32));
+
+    const SDL_GPUVertexInputState& input = info.vertex_input_state;
+    key.push_back(input.num_vertex_buffers);
+    for (Uint32 i = 0; i < input.num_vertex_buffers; ++i) {
+        const SDL_GPUVertexBufferDescription& buffer = input.vertex_buffer_descriptions[i];
+        key.push_back(buffer.slot);
+        key.push_back(buffer.pitch);
+        key.push_back(buffer.input_rate);
+    }
+    key.push_back(input.num_vertex_attributes);
+    for (Uint32 i = 0; i < input.num_vertex_attributes; ++i) {
+        const SDL_GPUVertexAttribute& attribute = input.vertex_attributes[i];
+        key.push_back(attribute.location);
+        key.push_back(attribute.buffer_slot);
+        key.push_back(attribute.format);
+        key.push_back(attribute.offset);
+    }
+    key.push_back(info.primitive_type);
+
+    const SDL_GPURasterizerState& rasterizer = info.rasterizer_state;
+    key.push_back(rasterizer.fill_mode);
+    key.push_back(rasterizer.cull_mode);
+    key.push_back(rasterizer.front_face);
+    key.push_back(rasterizer.enable_depth_clip);
+    key.push_back(rasterizer.enable_depth_bias);
+    if (rasterizer.enable_depth_bias) {
+        append_float(key, rasterizer.depth_bias_constant_factor);
+        append_float(key, rasterizer.depth_bias_clamp);
+        append_float(key, rasterizer.depth_bias_slope_factor);
+    }
+
+    const SDL_GPUMultisampleState& multisample = info.multisample_state;
+    key.push_back(multisample.sample_count);
+    key.push_back(multisample.enable_mask ? multisample.sample_mask : 0xFFFFFFFF);
+
+    const SDL_GPUGraphicsPipelineTargetInfo& targets = info.target_info;
+    key.push_back(targets.num_color_targets);
+    for (Uint32 i = 0; i < targets.num_color_targets; ++i) {
+        key.push_back(targets.color_target_descriptions[i].format);
+        append_blend(key, targets.color_target_descriptions[i].blend_state);
+    }
+    key.push_back(targets.has_depth_stencil_target);
+    if (targets.has_depth_stencil_target) {
+        const SDL_GPUDepthStencilState& depth = info.depth_stencil_state;
+        key.push_back(targets.depth_stencil_format);
+        key.push_back(depth.enable_depth_test);
+        if (depth.enable_depth_test) {
+            key.push_back(depth.enable_depth_write);
+            key.push_back(depth.compare_op);
+        }
+        key.push_back(depth.enable_stencil_test);
+        if (depth.enable_stencil_test) {
+            append_stencil(key, depth.front_stencil_state);
+            append_stencil(key, depth.back_stencil_state);
+            key.push_back(depth.compare_mask);
+            key.push_back(depth.write_mask);
+        }
+    }
+    key.push_back(info.props);
+}
+
+static Uint64 hash_key(const std::vector<Uint32>& key) {
+    // FNV-1a over 32-bit words
+    Uint64 hash = 0xcbf29ce484222325ull;
+    for (Uint32 word : key) {
+        hash ^= word;
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+Uint64 hash_pipeline_info(const SDL_GPUGraphicsPipelineCreateInfo& info) {
+    std::vector<Uint32> key;
+    normalize_pipeline_info(info, key);
+    return hash_key(key);
+}
+
+SDL_GPUGraphicsPipeline* get_graphics_pipeline(PipelineCache* cache, const SDL_GPUGraphicsPipelineCreateInfo& info,
+    const char* manifest_entry) {
+    std::vector<Uint32> key;
+    normalize_pipeline_info(info, key);
+    const Uint64 hash = hash_key(key);
+
+    SDL_LockMutex(cache->mutex);
+    auto range = cache->pipelines.equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it) {
+        PipelineEntry* entry = it->second.get();
+        if (entry->key != key) {
+            continue;
+        }
+        if (!prewarming) {
+            cache->stats.hits++;
+            cache->stats.waits += !entry->ready;
+        }
+        while (!entry->ready) {
+            SDL_WaitCondition(cache->created, cache->mutex);
+        }
+        SDL_UnlockMutex(cache->mutex);
+        return entry->pipeline;
+    }
+
+    // Claim the entry before creating, so other threads asking for it wait instead of creating a duplicate
+    PipelineEntry* entry = new PipelineEntry();
+    entry->key = std::move(key);
+    entry->pipeline = NULL;
+    entry->vertex_shader = info.vertex_shader;
+    entry->fragment_shader = info.fragment_shader;
+    entry->ready = false;
+    cache->pipelines.emplace(hash, std::unique_ptr<PipelineEntry>(entry));
+    SDL_UnlockMutex(cache->mutex);
+
+    const Uint64 start = SDL_GetPerformanceCounter();
+    SDL_GPUGraphicsPipeline* pipeline = SDL_CreateGPUGraphicsPipeline(cache->device, &info);
+    const double seconds = (double)(SDL_GetPerformanceCounter() - start) / SDL_GetPerformanceFrequency();
+    if (!pipeline) {
+        fprintf(stderr, "ERROR: SDL_CreateGPUGraphicsPipeline failed: %s\n", SDL_GetError());
+    }
+
+    SDL_LockMutex(cache->mutex);
+    entry->pipeline = pipeline;
+    entry->ready = true;
+    if (prewarming) {
+        cache->stats.prewarmed++;
+        cache->stats.prewarm_seconds += seconds;
+    } else {
+        cache->stats.misses++;
+        cache->stats.create_seconds += seconds;
+    }
+    if (pipeline && manifest_entry) {
+        entry->manifest_entry = manifest_entry;
+    }
+    SDL_BroadcastCondition(cache->created);
+    SDL_UnlockMutex(cache->mutex);
+    return pipeline;
+}
+
+bool pipeline_cache_reload_shader(PipelineCache* cache, const ShaderBlob& blob) {
+    SDL_GPUShader* shader = create_blob_shader(cache->device, blob);
+    if (shader == NULL) {
+        return false;
+    }
+
+    // Pipelines still being created may be using the old shader
+    SDL_LockMutex(cache->mutex);
+    for (;;) {
+        bool creating = cache->prewarm_pending > 0;
+        for (const auto& pipeline : cache->pipelines) {
+            creating = creating || !pipeline.second->ready;
+        }
+        if (!creating) {
+            break;
+        }
+        SDL_WaitCondition(cache->created, cache->mutex);
+    }
+
+    SDL_GPUShader* old = NULL;
+    bool found = false;
+    for (ShaderEntry& entry : cache->shaders) {
+        if (entry.name == blob.name) {
+            old = entry.shader;
+            entry.shader = shader;
+            found = true;
+        }
+    }
+    if (!found) {
+        cache->shaders.push_back({ blob.name, shader });
+    }
+    // Dropped pipelines are recreated with the new shader on their next get_graphics_pipeline.
+    // SDL_GPU defers the release until frames in flight no longer use them. Failed creations are
+    // dropped on every reload too, since the edit may be what fixes them.
+    Uint32 dropped = 0;
+    for (auto it = cache->pipelines.begin(); it != cache->pipelines.end();) {
+        const PipelineEntry& entry = *it->second;
+        if (entry.pipeline == NULL || (old != NULL && (entry.vertex_shader == old || entry.fragment_shader == old))) {
+            if (entry.pipeline) {
+                SDL_ReleaseGPUGraphicsPipeline(cache->device, entry.pipeline);
+            }
+            it = cache->pipelines.erase(it);
+            dropped++;
+        } else {
+            ++it;
+        }
+    }
+    SDL_UnlockMutex(cache->mutex);
+
+    SDL_ReleaseGPUShader(cache->device, old);
+    SDL_Log("Reloaded %s, dropping %u pipelines", blob.name.c_str(), dropped);
+    return true;
+}
+
+void prewarm_pipeline_cache(PipelineCache* cache, ThreadPool* pool, const char* manifest_path,
+    std::function<void(PipelineCache* cache, const char* entry)> build) {
+    size_t size = 0;
+    char* text = (char*)SDL_LoadFile(manifest_path, &size);
+    if (text == NULL) {
+        return;
+    }
+    std::vector<std::string> entries;
+    std::string line;
+    for (size_t i = 0; i <= size; ++i) {
+        if (i < size && text[i] != '\n' && text[i] != '\r') {
+            line += text[i];
+            continue;
+        }
+        if (!line.empty() && line[0] != '#') {
+            entries.push_back(line);
+        }
+        line.clear();
+    }
+    SDL_free(text);
+
+    SDL_LockMutex(cache->mutex);
+    cache->prewarm_pending += (Uint32)entries.size();
+    SDL_UnlockMutex(cache->mutex);
+    for (std::string& entry : entries) {
+        thread_pool_submit(pool, [cache, build, entry]() {
+            prewarming = true;
+            build(cache, entry.c_str());
+            prewarming = false;
+
+            SDL_LockMutex(cache->mutex);
+            cache->prewarm_pending--;
+            SDL_BroadcastCondition(cache->created);
+            SDL_UnlockMutex(cache->mutex);
+        });
+    }
+}
+
+bool save_pipeline_manifest(PipelineCache* cache, const char* manifest_path, const char* header) {
+    std::string text = std::string("# ") + header + "\n";
+    SDL_LockMutex(cache->mutex);
+    for (const auto& pipeline : cache->pipelines) {
+        if (!pipeline.second->manifest_entry.empty()) {
+            text += pipeline.second->manifest_entry + "\n";
+        }
+    }
+    SDL_UnlockMutex(cache->mutex);
+
+    if (!SDL_SaveFile(manifest_path, text.data(), text.size())) {
+        fprintf(stderr, "ERROR: SDL_SaveFile(%s) failed: %s\n", manifest_path, SDL_GetError());
+        return false;
+    }
+    return true;
+}
+
+PipelineCacheStats pipeline_cache_stats(PipelineCache* cache) {
+    SDL_LockMutex(cache->mutex);
+    PipelineCacheStats stats = cache->stats;
+    SDL_UnlockMutex(cache->mutex);
+    return stats;
+}
+
+void log_pipeline_cache_stats(PipelineCache* cache) {
+    const PipelineCacheStats stats = pipeline_cache_stats(cache);
+    SDL_Log("Pipeline cache: %llu hits (%llu waited for another thread creating it), %llu misses in %.2f ms, %llu prewarmed in %.2f ms",
+        (unsigned long long)stats.hits, (unsigned long long)stats.waits, (unsigned long long)stats.misses,
+        stats.create_seconds * 1000.0, (unsigned long long)stats.prewarmed, stats.prewarm_seconds * 1000.0);
+}
@@ -0,0 +1,48 @@
+﻿#pragma once
+#include <functional>
+#include <SDL3/SDL.h>
+#include "shader_library.h"
+#include "thread_pool.h"
+
+struct PipelineCacheStats {
+    Uint64 hits;
+    Uint64 misses;          // created on first use, with the caller waiting
+    Uint64 waits;           // hits that waited for another thread still creating the pipeline
+    Uint64 prewarmed;       // created ahead of use from the manifest
+    double create_seconds;  // in SDL_CreateGPUGraphicsPipeline on misses
+    double prewarm_seconds; // in SDL_CreateGPUGraphicsPipeline on the prewarming threads
+};
+
+struct PipelineCache;
+
+// Pipelines and shaders handed out stay owned by the cache until destroy_pipeline_cache
+PipelineCache* create_pipeline_cache(SDL_GPUDevice* device, ShaderLibrary* library);
+// Waits for prewarming to finish first
+void destroy_pipeline_cache(PipelineCache* cache);
+
+// Creates each shader of the library once; NULL when it has no such shader
+SDL_GPUShader* pipeline_cache_shader(PipelineCache* cache, const char* name);
+
+// Hash of everything in info that affects the pipeline, following its pointers and skipping the
+// fields of disabled state, so equivalent create infos hash the same however they were filled
+Uint64 hash_pipeline_info(const SDL_GPUGraphicsPipelineCreateInfo& info);
+
+// The pipeline for info, created on first use. Safe on any thread; asking for a pipeline another
+// thread is creating waits for that one. manifest_entry is the line prewarm_pipeline_cache needs to
+// rebuild info on a later run, NULL to leave it out of the manifest.
+SDL_GPUGraphicsPipeline* get_graphics_pipeline(PipelineCache* cache, const SDL_GPUGraphicsPipelineCreateInfo& info,
+    const char* manifest_entry);
+
+// Swaps the library's shader of the same name for blob and drops every pipeline built with the old
+// one. Call between frames and fetch pipelines again afterwards; false keeps the old shader.
+bool pipeline_cache_reload_shader(PipelineCache* cache, const ShaderBlob& blob);
+
+// Returns at once and passes every line of the manifest to build on the pool, which should end in
+// get_graphics_pipeline. Lines starting with # are comments. A missing manifest prewarms nothing.
+void prewarm_pipeline_cache(PipelineCache* cache, ThreadPool* pool, const char* manifest_path,
+    std::function<void(PipelineCache* cache, const char* entry)> build);
+// Writes the entry of every pipeline created so far after the given header comment
+bool save_pipeline_manifest(PipelineCache* cache, const char* manifest_path, const char* header);
+
+PipelineCacheStats pipeline_cache_stats(PipelineCache* cache);
+void log_pipeline_cache_stats(PipelineCache* cache);
@@ -0,0 +1,215 @@
+﻿#include "profiler.h"
+#include <stdio.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+std::atomic<bool> profilerEnabled{ false };
+
+struct ProfileEvent {
+    const char* name;
+    Uint64 start, end;
+};
+
+// Single producer (its thread) and single consumer (profiler_end_frame)
+struct ThreadEvents {
+    SDL_ThreadID thread_id;
+    const char* name;
+    ProfileEvent events[PROFILER_THREAD_EVENTS];
+    std::atomic<Uint64> head; // written by the producer
+    std::atomic<Uint64> tail; // written by the consumer
+    std::atomic<Uint64> dropped;
+};
+
+struct TraceEvent {
+    ProfileEvent event;
+    Uint32 track;
+};
+
+struct Profiler {
+    SDL_Mutex* mutex; // guards tracks while a thread registers
+    std::vector<ThreadEvents*> tracks;
+    ThreadEvents* gpu;
+    SDL_ThreadID main_thread;
+    Uint64 origin;
+    bool trace;
+    std::vector<TraceEvent> trace_events;
+    Uint64 trace_dropped;
+
+    double frame_ms[PROFILER_FRAME_HISTORY];
+    Uint64 frame_count;
+};
+
+static Profiler* profiler = NULL;
+static thread_local ThreadEvents* threadEvents = NULL;
+
+static ThreadEvents* register_track(const char* name) {
+    ThreadEvents* track = new ThreadEvents();
+    track->thread_id = SDL_GetCurrentThreadID();
+    track->name = name;
+    SDL_LockMutex(profiler->mutex);
+    profiler->tracks.push_back(track);
+    SDL_UnlockMutex(profiler->mutex);
+    return track;
+}
+
+void enable_profiler(bool trace) {
+    if (profiler != NULL) {
+        return;
+    }
+    profiler = new Profiler();
+    profiler->mutex = SDL_CreateMutex();
+    profiler->main_thread = SDL_GetCurrentThreadID();
+    profiler->origin = SDL_GetPerformanceCounter();
+    profiler->trace = trace;
+    if (trace) {
+        profiler->trace_events.reserve(PROFILER_THREAD_EVENTS);
+    }
+    profiler->gpu = register_track("GPU");
+    profilerEnabled.store(true, std::memory_order_release);
+}
+
+void shutdown_profiler() {
+    if (profiler == NULL) {
+        return;
+    }
+    profilerEnabled.store(false, std::memory_order_relaxed);
+    for (ThreadEvents* track : profiler->tracks) {
+        delete track;
+    }
+    SDL_DestroyMutex(profiler->mutex);
+    delete profiler;
+    profiler = NULL;
+    threadEvents = NULL;
+}
+
+static void push_event(ThreadEvents* track, const char* name, Uint64 start, Uint64 end) {
+    const Uint64 head = track->head.load(std::memory_order_relaxed);
+    if (head - track->tail.load(std::memory_order_acquire) >= PROFILER_THREAD_EVENTS) {
+        track->dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    ProfileEvent& event = track->events[head % PROFILER_THREAD_EVENTS];
+    event.name = name;
+    event.start = start;
+    event.end = end;
+    track->head.store(head + 1, std::memory_order_release);
+}
+
+void profile_event(const char* name, Uint64 start, Uint64 end) {
+    if (threadEvents == NULL) {
+        // Pairs with enable_profiler, so a thread seeing it on also sees the profiler it set up
+        if (!profilerEnabled.load(std::memory_order_acquire)) {
+            return;
+        }
+        threadEvents = register_track(SDL_GetCurrentThreadID() == profiler->main_thread ? "Main" : "Worker");
+    }
+    push_event(threadEvents, name, start, end);
+}
+
+void profile_gpu_event(const char* name, Uint64 start, Uint64 end) {
+    if (profiler_enabled()) {
+        push_event(profiler->gpu, name, start, end);
+    }
+}
+
+// Empties every ring, keeping the scopes for the trace if one was asked for
+static void collect_events() {
+    SDL_LockMutex(profiler->mutex);
+    for (Uint32 t = 0; t < (Uint32)profiler->tracks.size(); ++t) {
+        ThreadEvents* track = profiler->tracks[t];
+        const Uint64 head = track->head.load(std::memory_order_acquire);
+        Uint64 tail = track->tail.load(std::memory_order_relaxed);
+        for (; tail != head && profiler->trace; ++tail) {
+            if (profiler->trace_events.size() < PROFILER_TRACE_EVENTS) {
+                profiler->trace_events.push_back({ track->events[tail % PROFILER_THREAD_EVENTS], t });
+            } else {
+                profiler->trace_dropped++;
+            }
+        }
+        track->tail.store(head, std::memory_order_release);
+    }
+    SDL_UnlockMutex(profiler->mutex);
+}
+
+void profiler_end_frame(Uint64 frame_start, Uint64 frame_end) {
+    if (!profiler_enabled()) {
+        return;
+    }
+    profiler->frame_ms[profiler->frame_count % PROFILER_FRAME_HISTORY] = (double)(frame_end - frame_start) * 1000.0 / SDL_GetPerformanceFrequency();
+    profiler->frame_count++;
+    collect_events();
+    // Rolling report, once per full window
+    if (profiler->frame_count % PROFILER_FRAME_HISTORY == 0) {
+        log_profiler_frame_stats();
+    }
+}
+
+ProfilerFrameStats profiler_frame_stats() {
+    ProfilerFrameStats stats = {};
+    if (profiler == NULL || profiler->frame_count == 0) {
+        return stats;
+    }
+    stats.frames = (Uint32)SDL_min(profiler->frame_count, (Uint64)PROFILER_FRAME_HISTORY);
+    std::vector<double> sorted(profiler->frame_ms, profiler->frame_ms + stats.frames);
+    std::sort(sorted.begin(), sorted.end());
+    // Nearest rank
+    auto percentile = [&](double p) { return sorted[(size_t)SDL_ceil(p * stats.frames) - 1]; };
+    stats.p50_ms = percentile(0.50);
+    stats.p95_ms = percentile(0.95);
+    stats.p99_ms = percentile(0.99);
+    stats.max_ms = sorted.back();
+    return stats;
+}
+
+void log_profiler_frame_stats() {
+    ProfilerFrameStats stats = profiler_frame_stats();
+    if (stats.frames == 0) {
+        return;
+    }
+    SDL_Log("Frame time over the last %u frames: p50 %.2f ms, p95 %.2f ms, p99 %.2f ms, max %.2f ms",
+        stats.frames, stats.p50_ms, stats.p95_ms, stats.p99_ms, stats.max_ms);
+}
+
+bool write_profiler_trace(const char* path) {
+    if (profiler == NULL || !profiler->trace) {
+        return false;
+    }
+    collect_events();
+
+    const double microseconds = 1000000.0 / SDL_GetPerformanceFrequency();
+    std::string json = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    char line[256];
+    Uint64 dropped = profiler->trace_dropped;
+    for (Uint32 t = 0; t < (Uint32)profiler->tracks.size(); ++t) {
+        const ThreadEvents* track = profiler->tracks[t];
+        char trackName[64];
+        if (track == profiler->gpu) {
+            SDL_snprintf(trackName, sizeof(trackName), "%s", track->name);
+        } else {
+            SDL_snprintf(trackName, sizeof(trackName), "%s %llu", track->name, (unsigned long long)track->thread_id);
+        }
+        SDL_snprintf(line, sizeof(line), "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}},\n",
+            t, trackName);
+        json += line;
+        dropped += track->dropped.load(std::memory_order_relaxed);
+    }
+    for (const TraceEvent& trace : profiler->trace_events) {
+        // Earlier than the origin happens for GPU spans of frames submitted before profiling began
+        const double start = trace.event.start > profiler->origin ? (trace.event.start - profiler->origin) * microseconds : 0.0;
+        SDL_snprintf(line, sizeof(line), "{\"ph\":\"X\",\"name\":\"%s\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f},\n",
+            trace.event.name, trace.track, start, (trace.event.end - trace.event.start) * microseconds);
+        json += line;
+    }
+    // JSON has no trailing commas
+    json.resize(json.size() - 2);
+    json += "\n]}\n";
+
+    if (!SDL_SaveFile(path, json.data(), json.size())) {
+        fprintf(stderr, "ERROR: SDL_SaveFile(%s) failed: %s\n", path, SDL_GetError());
+        return false;
+    }
+    SDL_Log("Wrote %llu profiler events to %s%s", (unsigned long long)profiler->trace_events.size(), path,
+        dropped ? " (some were dropped, the buffers were full)" : "");
+    return true;
+}
@@ -0,0 +1,62 @@
+﻿#pragma once
+#include <atomic>
+#include <SDL3/SDL.h>
+
+// Scopes one thread can close between two profiler_end_frame calls before newer ones are dropped
+#define PROFILER_THREAD_EVENTS 16384
+// Scopes kept for the trace; later ones are counted but not written
+#define PROFILER_TRACE_EVENTS (1 << 20)
+// Frames the frame time percentiles are taken over
+#define PROFILER_FRAME_HISTORY 1024
+
+// Process-wide so scopes can open on any thread without a handle. Off by default; a scope then
+// costs one relaxed load and a branch.
+extern std::atomic<bool> profilerEnabled;
+
+inline bool profiler_enabled() {
+    return profilerEnabled.load(std::memory_order_relaxed);
+}
+
+// The calling thread becomes the main thread of the trace. With trace false only frame times are kept.
+void enable_profiler(bool trace);
+// Call once every thread that recorded scopes has exited or stopped recording
+void shutdown_profiler();
+
+// name must outlive the profiler, normally a string literal. Each thread writes its own ring; nothing locks
+// except the first event of a thread.
+void profile_event(const char* name, Uint64 start, Uint64 end);
+// Spans on the GPU track, recorded from one thread only
+void profile_gpu_event(const char* name, Uint64 start, Uint64 end);
+
+struct ProfileScope {
+    const char* name;
+    Uint64 start;
+
+    explicit ProfileScope(const char* scope_name) {
+        name = profiler_enabled() ? scope_name : NULL;
+        start = name ? SDL_GetPerformanceCounter() : 0;
+    }
+    ~ProfileScope() {
+        if (name) {
+            profile_event(name, start, SDL_GetPerformanceCounter());
+        }
+    }
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+// Times the rest of the enclosing block; nested scopes show up nested in the trace
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+
+// Main thread, once per frame: adds the frame time to the rolling history and collects every thread's scopes
+void profiler_end_frame(Uint64 frame_start, Uint64 frame_end);
+
+struct ProfilerFrameStats {
+    Uint32 frames; // in the rolling window, at most PROFILER_FRAME_HISTORY
+    double p50_ms, p95_ms, p99_ms, max_ms;
+};
+
+ProfilerFrameStats profiler_frame_stats();
+void log_profiler_frame_stats();
+// Chrome trace event JSON, which Perfetto and chrome://tracing both open
+bool write_profiler_trace(const char* path);
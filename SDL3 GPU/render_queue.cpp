@@ -0,0 +1,308 @@
+﻿#include "render_queue.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#define RADIX_BITS 8
+#define RADIX_BUCKETS (1 << RADIX_BITS)
+#define RADIX_PASSES (64 / RADIX_BITS)
+
+struct SortEntry {
+    Uint64 key;
+    Uint32 item;
+};
+
+struct RenderQueue {
+    std::vector<SDL_GPUGraphicsPipeline*> pipelines;
+    std::vector<SDL_GPUTextureSamplerBinding> materials;
+    std::vector<DrawItem> items;
+    std::vector<Uint8> uniforms;
+    std::vector<SortEntry> order;
+    std::vector<SortEntry> scratch;
+};
+
+RenderQueue* create_render_queue() {
+    return new RenderQueue();
+}
+
+void destroy_render_queue(RenderQueue* queue) {
+    delete queue;
+}
+
+Uint32 render_queue_pipeline(RenderQueue* queue, SDL_GPUGraphicsPipeline* pipeline) {
+    for (size_t i = 0; i < queue->pipelines.size(); ++i) {
+        if (queue->pipelines[i] == pipeline) {
+            return (Uint32)i;
+        }
+    }
+    queue->pipelines.push_back(pipeline);
+    return (Uint32)queue->pipelines.size() - 1;
+}
+
+void clear_render_queue_pipelines(RenderQueue* queue) {
+    queue->pipelines.clear();
+}
+
+Uint32 render_queue_material(RenderQueue* queue, const SDL_GPUTextureSamplerBinding& binding) {
+    for (size_t i = 0; i < queue->materials.size(); ++i) {
+        if (queue->materials[i].texture == binding.texture && queue->materials[i].sampler == binding.sampler) {
+            return (Uint32)i;
+        }
+    }
+    queue->materials.push_back(binding);
+    return (Uint32)queue->materials.size() - 1;
+}
+
+Uint64 render_key(Uint32 pass, Uint32 pipeline, Uint32 material, float depth) {
+    // Non-negative floats order the same as their bit patterns
+    Uint32 depthBits = 0;
+    if (depth > 0.0f) {
+        std::memcpy(&depthBits, &depth, sizeof(depthBits));
+    }
+    Uint64 key = pass & ((1u << RENDER_KEY_PASS_BITS) - 1);
+    key = (key << RENDER_KEY_PIPELINE_BITS) | (pipeline & ((1u << RENDER_KEY_PIPELINE_BITS) - 1));
+    key = (key << RENDER_KEY_MATERIAL_BITS) | (material & ((1u << RENDER_KEY_MATERIAL_BITS) - 1));
+    return (key << RENDER_KEY_DEPTH_BITS) | depthBits;
+}
+
+void reset_render_queue(RenderQueue* queue) {
+    queue->items.clear();
+    queue->uniforms.clear();
+    queue->order.clear();
+}
+
+Uint32 queue_uniforms(RenderQueue* queue, const void* data, Uint32 size) {
+    const Uint32 offset = (Uint32)queue->uniforms.size();
+    queue->uniforms.resize(offset + size);
+    std::memcpy(queue->uniforms.data() + offset, data, size);
+    return offset;
+}
+
+void queue_draw(RenderQueue* queue, const DrawItem& item) {
+    queue->items.push_back(item);
+}
+
+static void radix_sort(std::vector<SortEntry>& entries, std::vector<SortEntry>& scratch) {
+    const size_t count = entries.size();
+    // Every digit's histogram in one read of the keys
+    Uint32 histograms[RADIX_PASSES][RADIX_BUCKETS] = {};
+    for (const SortEntry& entry : entries) {
+        for (int pass = 0; pass < RADIX_PASSES; ++pass) {
+            histograms[pass][(entry.key >> (pass * RADIX_BITS)) & (RADIX_BUCKETS - 1)]++;
+        }
+    }
+
+    scratch.resize(count);
+    SortEntry* source = entries.data();
+    SortEntry* destination = scratch.data();
+    for (int pass = 0; pass < RADIX_PASSES; ++pass) {
+        Uint32* histogram = histograms[pass];
+        const Uint32 digit = (Uint32)(source[0].key >> (pass * RADIX_BITS)) & (RADIX_BUCKETS - 1);
+        if (histogram[digit] == count) {
+            continue;
+        }
+        Uint32 offset = 0;
+        for (int b = 0; b < RADIX_BUCKETS; ++b) {
+            const Uint32 bucket = histogram[b];
+            histogram[b] = offset;
+            offset += bucket;
+        }
+        for (size_t i = 0; i < count; ++i) {
+            const SortEntry& entry = source[i];
+            destination[histogram[(entry.key >> (pass * RADIX_BITS)) & (RADIX_BUCKETS - 1)]++] = entry;
+        }
+        std::swap(source, destination);
+    }
+    if (source != entries.data()) {
+        entries.swap(scratch);
+    }
+}
+
+void sort_render_queue(RenderQueue* queue, RenderQueueStats& stats) {
+    const Uint64 start = SDL_GetPerformanceCounter();
+    const Uint32 count = (Uint32)queue->items.size();
+    queue->order.resize(count);
+    for (Uint32 i = 0; i < count; ++i) {
+        queue->order[i].key = queue->items[i].key;
+        queue->order[i].item = i;
+    }
+    if (count > 1) {
+        radix_sort(queue->order, queue->scratch);
+    }
+    stats.sorts++;
+    stats.sorted_items += count;
+    stats.sort_seconds += (double)(SDL_GetPerformanceCounter() - start) / SDL_GetPerformanceFrequency();
+}
+
+static bool same_binding(const SDL_GPUBufferBinding& a, const SDL_GPUBufferBinding& b) {
+    return a.buffer == b.buffer && a.offset == b.offset;
+}
+
+Uint32 submit_render_queue(RenderQueue* queue, SDL_GPURenderPass* render_pass, SDL_GPUCommandBuffer* command_buffer,
+    RenderQueueStats& stats) {
+    return submit_render_queue_range(queue, render_pass, command_buffer, 0, (Uint32)queue->order.size(), stats);
+}
+
+Uint32 submit_render_queue_range(RenderQueue* queue, SDL_GPURenderPass* render_pass, SDL_GPUCommandBuffer* command_buffer,
+    Uint32 first, Uint32 count, RenderQueueStats& stats) {
+    // What the render pass has bound; nothing at the start of a pass
+    const DrawItem* bound = NULL;
+    Uint32 boundUniform = UINT32_MAX;
+    for (Uint32 i = first; i < first + count; ++i) {
+        const DrawItem& item = queue->items[queue->order[i].item];
+
+        bool bindPipeline = !bound || item.pipeline != bound->pipeline;
+        bool bindVertexBuffers = !bound || item.vertex_buffer_count != bound->vertex_buffer_count;
+        for (Uint32 slot = 0; slot < item.vertex_buffer_count && !bindVertexBuffers; ++slot) {
+            bindVertexBuffers = !same_binding(item.vertex_buffers[slot], bound->vertex_buffers[slot]);
+        }
+        bool bindIndexBuffer = !bound || !same_binding(item.index_buffer, bound->index_buffer) ||
+            item.index_element_size != bound->index_element_size;
+        bool bindSamplers = !bound || item.material != bound->material;
+        bool pushUniforms = item.uniform_size != 0 && item.uniform != boundUniform;
+
+        // Items without uniform data never push any, so there is nothing to avoid either
+        const bool needs[RENDER_BIND_COUNT] = { true, true, true, true, item.uniform_size != 0 };
+        const bool binds[RENDER_BIND_COUNT] = { bindPipeline, bindVertexBuffers, bindIndexBuffer, bindSamplers, pushUniforms };
+        for (int b = 0; b < RENDER_BIND_COUNT; ++b) {
+            stats.binds[b] += binds[b];
+            stats.avoided[b] += needs[b] && !binds[b];
+        }
+        bound = &item;
+        if (pushUniforms) {
+            boundUniform = item.uniform;
+        }
+        if (render_pass == NULL) {
+            continue;
+        }
+
+        if (bindPipeline) {
+            SDL_BindGPUGraphicsPipeline(render_pass, queue->pipelines[item.pipeline]);
+        }
+        if (bindVertexBuffers) {
+            SDL_BindGPUVertexBuffers(render_pass, 0, item.vertex_buffers, item.vertex_buffer_count);
+        }
+        if (bindIndexBuffer) {
+            SDL_BindGPUIndexBuffer(render_pass, &item.index_buffer, item.index_element_size);
+        }
+        if (bindSamplers) {
+            SDL_BindGPUFragmentSamplers(render_pass, 0, &queue->materials[item.material], 1);
+        }
+        if (pushUniforms) {
+            SDL_PushGPUVertexUniformData(command_buffer, 0, queue->uniforms.data() + item.uniform, item.uniform_size);
+        }
+        SDL_DrawGPUIndexedPrimitives(render_pass, item.num_indices, item.num_instances, item.first_index, item.vertex_offset, 0);
+    }
+    stats.draws += count;
+    return count;
+}
+
+Uint32 render_queue_size(const RenderQueue* queue) {
+    return (Uint32)queue->order.size();
+}
+
+void merge_render_queue_stats(RenderQueueStats& stats, const RenderQueueStats& other) {
+    stats.draws += other.draws;
+    stats.sorts += other.sorts;
+    stats.sorted_items += other.sorted_items;
+    stats.sort_seconds += other.sort_seconds;
+    for (int b = 0; b < RENDER_BIND_COUNT; ++b) {
+        stats.binds[b] += other.binds[b];
+        stats.avoided[b] += other.avoided[b];
+    }
+}
+
+static const char* renderBindNames[RENDER_BIND_COUNT] = { "pipeline", "vertex buffers", "index buffer", "samplers", "uniforms" };
+
+void log_render_queue_stats(const RenderQueueStats& stats) {
+    if (stats.draws == 0) {
+        return;
+    }
+    SDL_Log("Render queue: %llu draws, sorting %.3f ms per 100k items", (unsigned long long)stats.draws,
+        stats.sort_seconds * 1000.0 * 100000.0 / SDL_max(stats.sorted_items, 1));
+    for (int b = 0; b < RENDER_BIND_COUNT; ++b) {
+        SDL_Log("  %-14s %llu binds, %llu avoided", renderBindNames[b], (unsigned long long)stats.binds[b],
+            (unsigned long long)stats.avoided[b]);
+    }
+}
+
+void benchmark_render_queue(Uint32 count, int iterations) {
+    // A scene's worth of state: a few pipelines, many materials, meshes spread over a few buffers
+    const Uint32 pipelineCount = 8;
+    const Uint32 materialCount = 256;
+    const Uint32 meshCount = 64;
+    Uint32 state = 12345;
+    auto random = [&state]() {
+        state = state * 1664525u + 1013904223u;
+        return state >> 8;
+    };
+
+    RenderQueue* queue = create_render_queue();
+    for (Uint32 i = 0; i < pipelineCount; ++i) {
+        render_queue_pipeline(queue, (SDL_GPUGraphicsPipeline*)(uintptr_t)(i + 1));
+    }
+    for (Uint32 i = 0; i < materialCount; ++i) {
+        SDL_GPUTextureSamplerBinding binding = {};
+        binding.texture = (SDL_GPUTexture*)(uintptr_t)(i + 1);
+        render_queue_material(queue, binding);
+    }
+    for (Uint32 i = 0; i < count; ++i) {
+        const Uint32 mesh = random() % meshCount;
+        DrawItem item = {};
+        item.pipeline = random() % pipelineCount;
+        item.material = random() % materialCount;
+        item.vertex_buffers[0].buffer = (SDL_GPUBuffer*)(uintptr_t)(mesh / 16 + 1);
+        item.vertex_buffer_count = 1;
+        item.index_buffer.buffer = item.vertex_buffers[0].buffer;
+        item.index_element_size = SDL_GPU_INDEXELEMENTSIZE_16BIT;
+        item.num_indices = 3;
+        item.num_instances = 1;
+        item.key = render_key(0, item.pipeline, item.material, 1.0f + (float)(random() % 1000));
+        queue_draw(queue, item);
+    }
+
+    // Submission order, as if every draw went straight to the encoder
+    RenderQueueStats unsorted = {};
+    queue->order.resize(count);
+    for (Uint32 i = 0; i < count; ++i) {
+        queue->order[i] = { queue->items[i].key, i };
+    }
+    submit_render_queue(queue, NULL, NULL, unsorted);
+
+    RenderQueueStats sorted = {};
+    for (int it = 0; it < iterations; ++it) {
+        sort_render_queue(queue, sorted);
+    }
+    RenderQueueStats encoded = {};
+    submit_render_queue(queue, NULL, NULL, encoded);
+    for (Uint32 i = 1; i < count; ++i) {
+        if (queue->order[i - 1].key > queue->order[i].key) {
+            fprintf(stderr, "ERROR: render queue out of order at item %u\n", i);
+            break;
+        }
+    }
+
+    const double toMs = 1000.0 / SDL_GetPerformanceFrequency();
+    std::vector<Uint64> keys(count);
+    double stdMs = 0.0;
+    for (int it = 0; it < iterations; ++it) {
+        for (Uint32 i = 0; i < count; ++i) {
+            keys[i] = queue->items[i].key;
+        }
+        Uint64 start = SDL_GetPerformanceCounter();
+        std::sort(keys.begin(), keys.end());
+        stdMs += (SDL_GetPerformanceCounter() - start) * toMs;
+    }
+
+    SDL_Log("Render queue, %u items: radix sort %.3f ms, std::sort %.3f ms", count,
+        sorted.sort_seconds * 1000.0 / iterations, stdMs / iterations);
+    for (int b = 0; b < RENDER_BIND_COUNT; ++b) {
+        if (b == RENDER_BIND_UNIFORMS) {
+            continue;
+        }
+        SDL_Log("  %-14s %llu binds unsorted, %llu sorted (%llu avoided)", renderBindNames[b], (unsigned long long)unsorted.binds[b],
+            (unsigned long long)encoded.binds[b], (unsigned long long)encoded.avoided[b]);
+    }
+    destroy_render_queue(queue);
+}
@@ -0,0 +1,84 @@
+﻿#pragma once
+#include <SDL3/SDL.h>
+
+// Sort key fields, most significant first. Ids wider than their field only weaken the grouping:
+// the encoder compares the real state before skipping a bind.
+#define RENDER_KEY_PASS_BITS 4
+#define RENDER_KEY_PIPELINE_BITS 12
+#define RENDER_KEY_MATERIAL_BITS 16
+#define RENDER_KEY_DEPTH_BITS 32
+
+// Every binding one draw needs. pipeline and material are ids registered with the queue; uniform is
+// an offset from queue_uniforms, pushed to vertex uniform slot 0 when uniform_size is not 0.
+struct DrawItem {
+    Uint64 key;
+    Uint32 pipeline;
+    Uint32 material;
+    SDL_GPUBufferBinding vertex_buffers[2];
+    Uint32 vertex_buffer_count;
+    SDL_GPUBufferBinding index_buffer;
+    SDL_GPUIndexElementSize index_element_size;
+    Uint32 uniform;
+    Uint32 uniform_size;
+    Uint32 num_indices;
+    Uint32 num_instances;
+    Uint32 first_index;
+    Sint32 vertex_offset;
+};
+
+enum RenderBind {
+    RENDER_BIND_PIPELINE,
+    RENDER_BIND_VERTEX_BUFFERS,
+    RENDER_BIND_INDEX_BUFFER,
+    RENDER_BIND_SAMPLERS,
+    RENDER_BIND_UNIFORMS,
+    RENDER_BIND_COUNT
+};
+
+struct RenderQueueStats {
+    Uint64 draws;
+    Uint64 sorts;
+    Uint64 sorted_items;
+    double sort_seconds;
+    Uint64 binds[RENDER_BIND_COUNT];
+    // Binds a draw would have made unconditionally but whose state was already bound
+    Uint64 avoided[RENDER_BIND_COUNT];
+};
+
+struct RenderQueue;
+
+RenderQueue* create_render_queue();
+void destroy_render_queue(RenderQueue* queue);
+
+// Registrations outlive reset_render_queue; the same pipeline or binding always gets the same id
+Uint32 render_queue_pipeline(RenderQueue* queue, SDL_GPUGraphicsPipeline* pipeline);
+Uint32 render_queue_material(RenderQueue* queue, const SDL_GPUTextureSamplerBinding& binding);
+// Forgets every pipeline registration once pipelines have been released and rebuilt (shader reloads),
+// so ids stay dense within RENDER_KEY_PIPELINE_BITS. Earlier ids are invalid; call it between frames.
+void clear_render_queue_pipelines(RenderQueue* queue);
+
+// Opaque passes sort front to back: smaller depth first, anything behind the eye first of all
+Uint64 render_key(Uint32 pass, Uint32 pipeline, Uint32 material, float depth);
+
+// Drops the items and uniform data of the last frame
+void reset_render_queue(RenderQueue* queue);
+// Copies size bytes of uniform data for items to share; returns the offset to put in DrawItem::uniform
+Uint32 queue_uniforms(RenderQueue* queue, const void* data, Uint32 size);
+void queue_draw(RenderQueue* queue, const DrawItem& item);
+
+// LSD radix sort of the keys, eight bits a pass, skipping passes where every key shares the digit.
+// Items with equal keys keep the order they were queued in.
+void sort_render_queue(RenderQueue* queue, RenderQueueStats& stats);
+// Records the sorted items, skipping binds of state that is already bound. A NULL render pass only
+// counts the binds. Returns the number of draws.
+Uint32 submit_render_queue(RenderQueue* queue, SDL_GPURenderPass* render_pass, SDL_GPUCommandBuffer* command_buffer,
+    RenderQueueStats& stats);
+// Same for count sorted items from first on, as if nothing were bound before them. Ranges may be
+// recorded on different threads as long as each has its own stats.
+Uint32 submit_render_queue_range(RenderQueue* queue, SDL_GPURenderPass* render_pass, SDL_GPUCommandBuffer* command_buffer,
+    Uint32 first, Uint32 count, RenderQueueStats& stats);
+Uint32 render_queue_size(const RenderQueue* queue);
+void merge_render_queue_stats(RenderQueueStats& stats, const RenderQueueStats& other);
+
+void log_render_queue_stats(const RenderQueueStats& stats);
+void benchmark_render_queue(Uint32 count, int iterations);
@@ -0,0 +1,81 @@
+﻿#include "scene_pipeline.h"
+#include <stdio.h>
+#include "depth_buffer.h"
+
+SDL_GPUGraphicsPipeline* get_scene_pipeline(PipelineCache* cache, const ScenePipelineDesc& desc) {
+    SDL_GPUShader* vertexShader = pipeline_cache_shader(cache, vertex_shader_name(desc.vertex_format));
+    SDL_GPUShader* fragmentShader = pipeline_cache_shader(cache, desc.fragment_shader);
+    if (vertexShader == NULL || fragmentShader == NULL) {
+        return NULL;
+    }
+
+    SDL_GPUColorTargetBlendState blendState = {};
+    blendState.enable_blend = desc.additive;
+    blendState.src_color_blendfactor = SDL_GPU_BLENDFACTOR_ONE;
+    blendState.dst_color_blendfactor = SDL_GPU_BLENDFACTOR_ONE;
+    blendState.color_blend_op = SDL_GPU_BLENDOP_ADD;
+    blendState.src_alpha_blendfactor = SDL_GPU_BLENDFACTOR_ONE;
+    blendState.dst_alpha_blendfactor = SDL_GPU_BLENDFACTOR_ONE;
+    blendState.alpha_blend_op = SDL_GPU_BLENDOP_ADD;
+
+    SDL_GPUColorTargetDescription color_target_descriptions = {};
+    color_target_descriptions.format = desc.color_format;
+    color_target_descriptions.blend_state = blendState;
+    color_target_descriptions.blend_state.enable_color_write_mask = desc.depth_only;
+    color_target_descriptions.blend_state.color_write_mask = 0;
+
+    SDL_GPUGraphicsPipelineTargetInfo target_info = {};
+    target_info.num_color_targets = 1;
+    target_info.color_target_descriptions = &color_target_descriptions;
+    target_info.depth_stencil_format = desc.depth_format;
+    target_info.has_depth_stencil_target = true;
+
+    // Vertex input state, matching the format the mesh was cached in
+    VertexInputLayout vertexLayout = vertex_input_layout(desc.vertex_format);
+
+    SDL_GPUVertexInputState vertexInputState = {};
+    vertexInputState.num_vertex_buffers = vertexLayout.num_buffers;
+    vertexInputState.vertex_buffer_descriptions = vertexLayout.buffers;
+    vertexInputState.num_vertex_attributes = vertexLayout.num_attributes;
+    vertexInputState.vertex_attributes = vertexLayout.attributes;
+
+    // Pipeline creation
+    SDL_GPUGraphicsPipelineCreateInfo pipelineInfo = {};
+    pipelineInfo.vertex_shader = vertexShader;
+    pipelineInfo.fragment_shader = fragmentShader;
+    pipelineInfo.primitive_type = SDL_GPU_PRIMITIVETYPE_TRIANGLELIST;
+    pipelineInfo.target_info = target_info;
+    pipelineInfo.vertex_input_state = vertexInputState;
+    // Meshlet cone culling drops backfacing clusters, so the rasterizer has to drop backfaces too
+    pipelineInfo.rasterizer_state.cull_mode = desc.cull_backfaces ? SDL_GPU_CULLMODE_BACK : SDL_GPU_CULLMODE_NONE;
+    pipelineInfo.rasterizer_state.front_face = SDL_GPU_FRONTFACE_COUNTER_CLOCKWISE;
+    pipelineInfo.depth_stencil_state.enable_depth_test = true;
+    pipelineInfo.depth_stencil_state.enable_depth_write = !desc.after_prepass;
+    pipelineInfo.depth_stencil_state.compare_op = desc.after_prepass ? DEPTH_COMPARE_OP_AFTER_PREPASS : DEPTH_COMPARE_OP;
+
+    char entry[1024];
+    snprintf(entry, sizeof(entry), "%d %d %d %d %d %d %d %s", (int)desc.vertex_format, (int)desc.color_format,
+        (int)desc.depth_format, desc.cull_backfaces, desc.depth_only, desc.after_prepass, desc.additive,
+        desc.fragment_shader);
+    return get_graphics_pipeline(cache, pipelineInfo, entry);
+}
+
+void build_scene_pipeline(PipelineCache* cache, const char* entry) {
+    int vertexFormat, colorFormat, depthFormat, cullBackfaces, depthOnly, afterPrepass, additive;
+    char fragmentShader[SHADER_NAME_SIZE];
+    if (sscanf(entry, "%d %d %d %d %d %d %d %47s", &vertexFormat, &colorFormat, &depthFormat, &cullBackfaces,
+            &depthOnly, &afterPrepass, &additive, fragmentShader) != 8) {
+        fprintf(stderr, "ERROR: Malformed pipeline manifest entry: %s\n", entry);
+        return;
+    }
+    ScenePipelineDesc desc = {};
+    desc.vertex_format = (VertexFormat)vertexFormat;
+    desc.color_format = (SDL_GPUTextureFormat)colorFormat;
+    desc.depth_format = (SDL_GPUTextureFormat)depthFormat;
+    desc.fragment_shader = fragmentShader;
+    desc.cull_backfaces = cullBackfaces != 0;
+    desc.depth_only = depthOnly != 0;
+    desc.after_prepass = afterPrepass != 0;
+    desc.additive = additive != 0;
+    get_scene_pipeline(cache, desc);
+}
@@ -0,0 +1,24 @@
+﻿#pragma once
+#include <SDL3/SDL.h>
+#include "pipeline_cache.h"
+#include "vertex_format.h"
+
+// Everything that differs between the scene's pipelines
+struct ScenePipelineDesc {
+    SDL_GPUTextureFormat color_format;
+    SDL_GPUTextureFormat depth_format;
+    VertexFormat vertex_format;
+    const char* fragment_shader; // shader library name
+    bool cull_backfaces;
+    bool depth_only;    // prepass: keeps the color target so it can share a render pass, but writes nothing to it
+    bool after_prepass; // depth is already final: test against it without writing
+    bool additive;      // sum fragments instead of replacing them, for counting overdraw
+};
+
+// Header comment of the manifest lines get_scene_pipeline records
+#define SCENE_PIPELINE_MANIFEST_HEADER \
+    "vertex_format color_format depth_format cull_backfaces depth_only after_prepass additive fragment_shader"
+
+SDL_GPUGraphicsPipeline* get_scene_pipeline(PipelineCache* cache, const ScenePipelineDesc& desc);
+// Rebuilds the pipeline of one manifest line; the build function for prewarm_pipeline_cache
+void build_scene_pipeline(PipelineCache* cache, const char* entry);
@@ -0,0 +1,5 @@
+#version 460
+
+// Depth prepass: only the depth the rasterizer writes matters, nothing is shaded
+void main() {
+}
@@ -0,0 +1,8 @@
+#version 460
+
+// Overdraw measurement: every shaded fragment adds one to its pixel through additive blending
+layout(location=0) out vec4 frag_count;
+
+void main() {
+	frag_count = vec4(1.0);
+}
@@ -0,0 +1,27 @@
+#version 460
+
+// mvp is projection * view; the model matrix comes per instance
+layout(set=1,binding=0)uniform UBO{
+	mat4 mvp;
+	mat4 dequantize;
+};
+
+layout(location=0) in vec4 position;	
+layout(location=1) in vec2 texcoord;	
+#ifdef PACKED_COLOR
+layout(location=2) in vec4 inColor;
+#endif
+layout(location=3) in mat4 instanceModel;
+
+layout(location=0) out vec4 color;
+layout(location=1) out vec2 outTexcoord;
+
+void main(){
+	gl_Position = mvp * instanceModel * (dequantize * vec4(position.xyz,1));
+#ifdef PACKED_COLOR
+	color = inColor;
+#else
+	color = vec4(1);
+#endif
+	outTexcoord = texcoord;
+}
@@ -0,0 +1,417 @@
+﻿#include "shader_library.h"
+#include <stdio.h>
+#include <algorithm>
+#include <cstring>
+
+// The SPIR-V enumerants reflect_spirv needs
+#define SPIRV_MAGIC 0x07230203u
+#define SPIRV_OP_EXECUTION_MODE 16
+#define SPIRV_OP_TYPE_IMAGE 25
+#define SPIRV_OP_TYPE_SAMPLED_IMAGE 27
+#define SPIRV_OP_TYPE_ARRAY 28
+#define SPIRV_OP_TYPE_RUNTIME_ARRAY 29
+#define SPIRV_OP_TYPE_STRUCT 30
+#define SPIRV_OP_TYPE_POINTER 32
+#define SPIRV_OP_CONSTANT 43
+#define SPIRV_OP_VARIABLE 59
+#define SPIRV_OP_DECORATE 71
+#define SPIRV_EXECUTION_MODE_LOCAL_SIZE 17
+#define SPIRV_DECORATION_BUFFER_BLOCK 3
+#define SPIRV_DECORATION_DESCRIPTOR_SET 34
+#define SPIRV_STORAGE_UNIFORM_CONSTANT 0
+#define SPIRV_STORAGE_UNIFORM 2
+#define SPIRV_STORAGE_STORAGE_BUFFER 12
+
+// What reflect_spirv needs to know about one id
+struct SpirvId {
+    Uint32 opcode;
+    Uint32 operands[3]; // types: element or pointee type, storage class, image sampled mode; constants: value
+    Uint32 descriptor_set;
+    bool has_descriptor_set;
+    bool buffer_block;
+};
+
+bool parse_shader_stage(const char* extension, Uint32& stage) {
+    if (SDL_strcmp(extension, "vert") == 0) {
+        stage = SDL_GPU_SHADERSTAGE_VERTEX;
+    } else if (SDL_strcmp(extension, "frag") == 0) {
+        stage = SDL_GPU_SHADERSTAGE_FRAGMENT;
+    } else if (SDL_strcmp(extension, "comp") == 0) {
+        stage = SHADER_STAGE_COMPUTE;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool reflect_spirv(const Uint8* code, size_t size, ShaderReflection& reflection) {
+    reflection = {};
+    if (size < 5 * sizeof(Uint32) || size % sizeof(Uint32) != 0) {
+        return false;
+    }
+    std::vector<Uint32> words(size / sizeof(Uint32));
+    std::memcpy(words.data(), code, size);
+    if (words[0] != SPIRV_MAGIC) {
+        return false;
+    }
+
+    std::vector<SpirvId> ids(words[3]);
+    bool compute = false;
+    for (size_t i = 5; i < words.size();) {
+        Uint32 count = words[i] >> 16;
+        Uint32 opcode = words[i] & 0xffff;
+        if (count == 0 || i + count > words.size()) {
+            return false;
+        }
+        // Only the instructions read below; others may not start with an id at all
+        bool tracked = opcode == SPIRV_OP_EXECUTION_MODE || opcode == SPIRV_OP_CONSTANT || opcode == SPIRV_OP_VARIABLE
+            || opcode == SPIRV_OP_DECORATE || (opcode >= SPIRV_OP_TYPE_IMAGE && opcode <= SPIRV_OP_TYPE_POINTER);
+        if (!tracked) {
+            i += count;
+            continue;
+        }
+        const Uint32* op = &words[i + 1];
+        // All of them store their result or target id in the first or second operand
+        Uint32 result = count > 1 ? op[0] : 0;
+        if (opcode == SPIRV_OP_CONSTANT || opcode == SPIRV_OP_VARIABLE) {
+            result = count > 2 ? op[1] : 0;
+        }
+        if (result >= ids.size()) {
+            return false;
+        }
+
+        switch (opcode) {
+        case SPIRV_OP_EXECUTION_MODE:
+            if (count >= 6 && op[1] == SPIRV_EXECUTION_MODE_LOCAL_SIZE) {
+                compute = true;
+                reflection.threadcount[0] = op[2];
+                reflection.threadcount[1] = op[3];
+                reflection.threadcount[2] = op[4];
+            }
+            break;
+        case SPIRV_OP_TYPE_IMAGE:
+            if (count >= 8) {
+                ids[result].opcode = opcode;
+                ids[result].operands[2] = op[6];
+            }
+            break;
+        case SPIRV_OP_TYPE_SAMPLED_IMAGE:
+            ids[result].opcode = opcode;
+            break;
+        case SPIRV_OP_TYPE_ARRAY:
+        case SPIRV_OP_TYPE_RUNTIME_ARRAY:
+            if (count >= 3) {
+                ids[result].opcode = opcode;
+                ids[result].operands[0] = op[1];
+                ids[result].operands[1] = count >= 4 ? op[2] : 0;
+            }
+            break;
+        case SPIRV_OP_TYPE_STRUCT:
+            ids[result].opcode = opcode;
+            break;
+        case SPIRV_OP_TYPE_POINTER:
+            if (count >= 4) {
+                ids[result].opcode = opcode;
+                ids[result].operands[0] = op[2];
+                ids[result].operands[1] = op[1];
+            }
+            break;
+        case SPIRV_OP_CONSTANT:
+            if (count >= 4) {
+                ids[result].opcode = opcode;
+                ids[result].operands[0] = op[2];
+            }
+            break;
+        case SPIRV_OP_VARIABLE:
+            if (count >= 4) {
+                ids[result].opcode = opcode;
+                ids[result].operands[0] = op[0];
+                ids[result].operands[1] = op[2];
+            }
+            break;
+        case SPIRV_OP_DECORATE:
+            if (count >= 3) {
+                if (op[1] == SPIRV_DECORATION_DESCRIPTOR_SET && count >= 4) {
+                    ids[result].has_descriptor_set = true;
+                    ids[result].descriptor_set = op[2];
+                }
+                ids[result].buffer_block |= op[1] == SPIRV_DECORATION_BUFFER_BLOCK;
+            }
+            break;
+        }
+        i += count;
+    }
+
+    for (const SpirvId& variable : ids) {
+        if (variable.opcode != SPIRV_OP_VARIABLE || !variable.has_descriptor_set || variable.operands[0] >= ids.size()) {
+            continue;
+        }
+        Uint32 storage = variable.operands[1];
+        if (storage != SPIRV_STORAGE_UNIFORM_CONSTANT && storage != SPIRV_STORAGE_UNIFORM && storage != SPIRV_STORAGE_STORAGE_BUFFER) {
+            continue;
+        }
+
+        // Arrays of resources take one slot per element
+        Uint32 type = ids[variable.operands[0]].operands[0];
+        Uint32 elements = 1;
+        while (type < ids.size() && (ids[type].opcode == SPIRV_OP_TYPE_ARRAY || ids[type].opcode == SPIRV_OP_TYPE_RUNTIME_ARRAY)) {
+            Uint32 length = ids[type].operands[1];
+            if (ids[type].opcode == SPIRV_OP_TYPE_ARRAY && length < ids.size()) {
+                elements *= ids[length].operands[0];
+            }
+            type = ids[type].operands[0];
+        }
+        if (type >= ids.size()) {
+            return false;
+        }
+
+        // SDL_GPU puts a compute shader's read-write resources in set 1
+        bool readwrite = compute && variable.descriptor_set == 1;
+        const SpirvId& resource = ids[type];
+        if (resource.opcode == SPIRV_OP_TYPE_SAMPLED_IMAGE || (resource.opcode == SPIRV_OP_TYPE_IMAGE && resource.operands[2] != 2)) {
+            reflection.num_samplers += elements;
+        } else if (resource.opcode == SPIRV_OP_TYPE_IMAGE) {
+            (readwrite ? reflection.num_readwrite_storage_textures : reflection.num_storage_textures) += elements;
+        } else if (resource.opcode == SPIRV_OP_TYPE_STRUCT) {
+            if (storage == SPIRV_STORAGE_STORAGE_BUFFER || resource.buffer_block) {
+                (readwrite ? reflection.num_readwrite_storage_buffers : reflection.num_storage_buffers) += elements;
+            } else {
+                reflection.num_uniform_buffers += elements;
+            }
+        }
+    }
+    return true;
+}
+
+static bool entry_before(const ShaderBlob& a, const ShaderBlob& b) {
+    int order = a.name.compare(b.name);
+    return order != 0 ? order < 0 : a.format < b.format;
+}
+
+bool write_shader_library(const char* path, std::vector<ShaderBlob>& blobs) {
+    std::sort(blobs.begin(), blobs.end(), entry_before);
+
+    ShaderLibraryHeader header = {};
+    header.magic = SHADER_LIBRARY_MAGIC;
+    header.version = SHADER_LIBRARY_VERSION;
+    header.num_entries = (Uint32)blobs.size();
+    header.data_offset = (sizeof(ShaderLibraryHeader) + blobs.size() * sizeof(ShaderLibraryEntry) + 15) & ~15ull;
+
+    std::vector<ShaderLibraryEntry> entries;
+    Uint64 offset = 0;
+    for (const ShaderBlob& blob : blobs) {
+        if (blob.name.size() >= SHADER_NAME_SIZE || blob.entrypoint.size() >= SHADER_ENTRYPOINT_SIZE) {
+            fprintf(stderr, "ERROR: Shader name or entry point too long: %s\n", blob.name.c_str());
+            return false;
+        }
+        ShaderLibraryEntry entry = {};
+        std::memcpy(entry.name, blob.name.c_str(), blob.name.size());
+        std::memcpy(entry.entrypoint, blob.entrypoint.c_str(), blob.entrypoint.size());
+        entry.stage = blob.stage;
+        entry.format = blob.format;
+        entry.reflection = blob.reflection;
+        entry.offset = offset;
+        entry.size = blob.code.size();
+        entries.push_back(entry);
+        // SPIR-V is read as words straight from the mapping
+        offset = (offset + entry.size + 15) & ~15ull;
+    }
+    header.data_size = offset;
+
+    std::vector<Uint8> file(header.data_offset + header.data_size, 0);
+    std::memcpy(file.data(), &header, sizeof(header));
+    if (!entries.empty()) {
+        std::memcpy(file.data() + sizeof(header), entries.data(), entries.size() * sizeof(ShaderLibraryEntry));
+    }
+    for (size_t i = 0; i < blobs.size(); ++i) {
+        if (!blobs[i].code.empty()) {
+            std::memcpy(file.data() + header.data_offset + entries[i].offset, blobs[i].code.data(), blobs[i].code.size());
+        }
+    }
+
+    std::string tmpPath = std::string(path) + ".tmp";
+    if (!SDL_SaveFile(tmpPath.c_str(), file.data(), file.size())) {
+        fprintf(stderr, "ERROR: SDL_SaveFile(%s) failed: %s\n", tmpPath.c_str(), SDL_GetError());
+        return false;
+    }
+    if (!SDL_RenamePath(tmpPath.c_str(), path)) {
+        fprintf(stderr, "ERROR: SDL_RenamePath(%s) failed: %s\n", path, SDL_GetError());
+        SDL_RemovePath(tmpPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+struct ShaderLibrary {
+    MappedFile file;
+    const ShaderLibraryEntry* entries;
+    Uint32 num_entries;
+    const Uint8* data;
+    SDL_GPUShaderFormat formats;
+};
+
+ShaderLibrary* open_shader_library(const char* path) {
+    MappedFile file;
+    if (!map_file(path, file)) {
+        fprintf(stderr, "ERROR: Shader library (%s) does not exist.\n", path);
+        return NULL;
+    }
+
+    const ShaderLibraryHeader* header = (const ShaderLibraryHeader*)file.data;
+    bool valid = file.size >= sizeof(ShaderLibraryHeader)
+        && header->magic == SHADER_LIBRARY_MAGIC
+        && header->version == SHADER_LIBRARY_VERSION
+        && sizeof(ShaderLibraryHeader) + (Uint64)header->num_entries * sizeof(ShaderLibraryEntry) <= header->data_offset
+        && header->data_offset + header->data_size <= file.size;
+
+    const ShaderLibraryEntry* entries = (const ShaderLibraryEntry*)(file.data + sizeof(ShaderLibraryHeader));
+    for (Uint32 i = 0; valid && i < header->num_entries; ++i) {
+        valid = entries[i].offset + entries[i].size <= header->data_size
+            && entries[i].name[SHADER_NAME_SIZE - 1] == '\0'
+            && entries[i].entrypoint[SHADER_ENTRYPOINT_SIZE - 1] == '\0';
+    }
+    if (!valid) {
+        fprintf(stderr, "ERROR: Shader library (%s) is invalid or from another version.\n", path);
+        unmap_file(file);
+        return NULL;
+    }
+
+    ShaderLibrary* library = new ShaderLibrary();
+    library->file = file;
+    library->entries = entries;
+    library->num_entries = header->num_entries;
+    library->data = file.data + header->data_offset;
+    library->formats = SDL_GPU_SHADERFORMAT_INVALID;
+    for (Uint32 i = 0; i < header->num_entries; ++i) {
+        library->formats |= entries[i].format;
+    }
+    return library;
+}
+
+void close_shader_library(ShaderLibrary* library) {
+    if (library == NULL) {
+        return;
+    }
+    unmap_file(library->file);
+    delete library;
+}
+
+SDL_GPUShaderFormat shader_library_formats(ShaderLibrary* library) {
+    return library->formats;
+}
+
+const ShaderLibraryEntry* find_library_shader(ShaderLibrary* library, SDL_GPUShaderFormat formats, const char* name) {
+    const ShaderLibraryEntry* end = library->entries + library->num_entries;
+    const ShaderLibraryEntry* first = std::lower_bound(library->entries, end, name,
+        [](const ShaderLibraryEntry& entry, const char* key) { return SDL_strcmp(entry.name, key) < 0; });
+
+    // SPIR-V first where the device takes several, then the native formats
+    const SDL_GPUShaderFormat preferred[] = {
+        SDL_GPU_SHADERFORMAT_SPIRV, SDL_GPU_SHADERFORMAT_DXIL, SDL_GPU_SHADERFORMAT_METALLIB,
+        SDL_GPU_SHADERFORMAT_MSL, SDL_GPU_SHADERFORMAT_DXBC
+    };
+    for (SDL_GPUShaderFormat format : preferred) {
+        if ((formats & format) == 0) {
+            continue;
+        }
+        for (const ShaderLibraryEntry* entry = first; entry != end && SDL_strcmp(entry->name, name) == 0; ++entry) {
+            if (entry->format == format) {
+                return entry;
+            }
+        }
+    }
+    fprintf(stderr, "ERROR: Shader library has no %s for this device.\n", name);
+    return NULL;
+}
+
+// One stage's code, in the archive mapping or in a blob compiled at runtime
+struct ShaderCode {
+    const char* name;
+    const Uint8* code;
+    size_t size;
+    const char* entrypoint;
+    Uint32 stage;
+    SDL_GPUShaderFormat format;
+    const ShaderReflection* reflection;
+};
+
+static SDL_GPUShader* create_shader(SDL_GPUDevice* device, const ShaderCode& code) {
+    if (code.stage == SHADER_STAGE_COMPUTE) {
+        fprintf(stderr, "ERROR: %s is a compute shader.\n", code.name);
+        return NULL;
+    }
+
+    SDL_GPUShaderCreateInfo shader_info = {};
+    shader_info.code = code.code;
+    shader_info.code_size = code.size;
+    shader_info.entrypoint = code.entrypoint;
+    shader_info.format = code.format;
+    shader_info.stage = (SDL_GPUShaderStage)code.stage;
+    shader_info.num_samplers = code.reflection->num_samplers;
+    shader_info.num_storage_textures = code.reflection->num_storage_textures;
+    shader_info.num_storage_buffers = code.reflection->num_storage_buffers;
+    shader_info.num_uniform_buffers = code.reflection->num_uniform_buffers;
+
+    SDL_GPUShader* shader = SDL_CreateGPUShader(device, &shader_info);
+    if (shader == NULL) {
+        fprintf(stderr, "ERROR: SDL_CreateGPUShader(%s) failed: %s\n", code.name, SDL_GetError());
+    }
+    return shader;
+}
+
+static SDL_GPUComputePipeline* create_compute_pipeline(SDL_GPUDevice* device, const ShaderCode& code) {
+    if (code.stage != SHADER_STAGE_COMPUTE) {
+        fprintf(stderr, "ERROR: %s is not a compute shader.\n", code.name);
+        return NULL;
+    }
+
+    const ShaderReflection& reflection = *code.reflection;
+    SDL_GPUComputePipelineCreateInfo info = {};
+    info.code = code.code;
+    info.code_size = code.size;
+    info.entrypoint = code.entrypoint;
+    info.format = code.format;
+    info.num_samplers = reflection.num_samplers;
+    info.num_readonly_storage_textures = reflection.num_storage_textures;
+    info.num_readonly_storage_buffers = reflection.num_storage_buffers;
+    info.num_readwrite_storage_textures = reflection.num_readwrite_storage_textures;
+    info.num_readwrite_storage_buffers = reflection.num_readwrite_storage_buffers;
+    info.num_uniform_buffers = reflection.num_uniform_buffers;
+    info.threadcount_x = reflection.threadcount[0];
+    info.threadcount_y = reflection.threadcount[1];
+    info.threadcount_z = reflection.threadcount[2];
+
+    SDL_GPUComputePipeline* pipeline = SDL_CreateGPUComputePipeline(device, &info);
+    if (pipeline == NULL) {
+        fprintf(stderr, "ERROR: SDL_CreateGPUComputePipeline(%s) failed: %s\n", code.name, SDL_GetError());
+    }
+    return pipeline;
+}
+
+static ShaderCode library_code(ShaderLibrary* library, const ShaderLibraryEntry& entry) {
+    return { entry.name, library->data + entry.offset, (size_t)entry.size, entry.entrypoint, entry.stage,
+        entry.format, &entry.reflection };
+}
+
+static ShaderCode blob_code(const ShaderBlob& blob) {
+    return { blob.name.c_str(), blob.code.data(), blob.code.size(), blob.entrypoint.c_str(), blob.stage,
+        blob.format, &blob.reflection };
+}
+
+SDL_GPUShader* create_library_shader(SDL_GPUDevice* device, ShaderLibrary* library, const char* name) {
+    const ShaderLibraryEntry* entry = find_library_shader(library, SDL_GetGPUShaderFormats(device), name);
+    return entry ? create_shader(device, library_code(library, *entry)) : NULL;
+}
+
+SDL_GPUComputePipeline* create_library_compute_pipeline(SDL_GPUDevice* device, ShaderLibrary* library, const char* name) {
+    const ShaderLibraryEntry* entry = find_library_shader(library, SDL_GetGPUShaderFormats(device), name);
+    return entry ? create_compute_pipeline(device, library_code(library, *entry)) : NULL;
+}
+
+SDL_GPUShader* create_blob_shader(SDL_GPUDevice* device, const ShaderBlob& blob) {
+    return create_shader(device, blob_code(blob));
+}
+
+SDL_GPUComputePipeline* create_blob_compute_pipeline(SDL_GPUDevice* device, const ShaderBlob& blob) {
+    return create_compute_pipeline(device, blob_code(blob));
+}
@@ -0,0 +1,81 @@
+﻿#pragma once
+#include <string>
+#include <vector>
+#include <SDL3/SDL.h>
+#include "mapped_file.h"
+
+#define SHADER_LIBRARY_MAGIC 0x4c485347u // "GSHL"
+#define SHADER_LIBRARY_VERSION 1
+#define SHADER_LIBRARY_EXTENSION ".gpushaders"
+#define SHADER_NAME_SIZE 48
+#define SHADER_ENTRYPOINT_SIZE 16
+
+// SDL_GPUShaderStage has no compute stage; compute shaders become pipelines directly
+#define SHADER_STAGE_COMPUTE 2u
+
+// Resources a stage binds, counted the way SDL_GPU wants them. Compute shaders split storage
+// resources into read-only and read-write; graphics stages only have the read-only counts.
+struct ShaderReflection {
+    Uint32 num_samplers;
+    Uint32 num_storage_textures;
+    Uint32 num_storage_buffers;
+    Uint32 num_uniform_buffers;
+    Uint32 num_readwrite_storage_textures;
+    Uint32 num_readwrite_storage_buffers;
+    Uint32 threadcount[3];
+};
+
+// On-disk layout: header, ShaderLibraryEntry table sorted by name, code (offsets relative to data_offset)
+struct ShaderLibraryHeader {
+    Uint32 magic;
+    Uint32 version;
+    Uint32 num_entries;
+    Uint32 reserved;
+    Uint64 data_offset;
+    Uint64 data_size;
+};
+
+// One stage in one format. Names drop the format from the compiled file name, so
+// shader.spv.frag and shader.msl.frag are both "shader.frag".
+struct ShaderLibraryEntry {
+    char name[SHADER_NAME_SIZE];
+    char entrypoint[SHADER_ENTRYPOINT_SIZE];
+    Uint32 stage;
+    Uint32 format; // a single SDL_GPUShaderFormat bit
+    ShaderReflection reflection;
+    Uint64 offset;
+    Uint64 size;
+};
+
+// A stage to pack, as the packer collects them
+struct ShaderBlob {
+    std::string name;
+    std::string entrypoint;
+    Uint32 stage;
+    SDL_GPUShaderFormat format;
+    ShaderReflection reflection;
+    std::vector<Uint8> code;
+};
+
+// vert, frag or comp, as compiled shader file names end
+bool parse_shader_stage(const char* extension, Uint32& stage);
+// Counts the resources of a SPIR-V module by descriptor set and type; false if it is not valid SPIR-V
+bool reflect_spirv(const Uint8* code, size_t size, ShaderReflection& reflection);
+bool write_shader_library(const char* path, std::vector<ShaderBlob>& blobs);
+
+struct ShaderLibrary;
+
+// Maps the archive once; NULL when it is missing or from another version
+ShaderLibrary* open_shader_library(const char* path);
+void close_shader_library(ShaderLibrary* library);
+// Every format packed, for SDL_CreateGPUDevice to pick a backend that can run them
+SDL_GPUShaderFormat shader_library_formats(ShaderLibrary* library);
+
+// The entry for name in the best of formats, NULL if it has none
+const ShaderLibraryEntry* find_library_shader(ShaderLibrary* library, SDL_GPUShaderFormat formats, const char* name);
+// Created straight from the mapping with the archive's reflected resource counts
+SDL_GPUShader* create_library_shader(SDL_GPUDevice* device, ShaderLibrary* library, const char* name);
+SDL_GPUComputePipeline* create_library_compute_pipeline(SDL_GPUDevice* device, ShaderLibrary* library, const char* name);
+// The same for a stage compiled at runtime
+SDL_GPUShader* create_blob_shader(SDL_GPUDevice* device, const ShaderBlob& blob);
+SDL_GPUComputePipeline* create_blob_compute_pipeline(SDL_GPUDevice* device, const ShaderBlob& blob);
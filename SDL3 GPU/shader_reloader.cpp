@@ -0,0 +1,273 @@
+﻿#include "shader_reloader.h"
+#include <stdio.h>
+#include <atomic>
+#include <map>
+#include <set>
+#include <string>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+// How long the watcher blocks per check; sources quiet for this long after an edit get compiled
+#define WATCH_INTERVAL_MS 50
+
+struct ShaderReloader {
+    std::string source_dir;
+    std::string compiler;
+    std::vector<ShaderVariant> variants;
+    SDL_Thread* thread;
+    std::atomic<bool> running;
+    SDL_Mutex* mutex;
+    ShaderReload pending;
+    bool has_pending;
+#ifdef __linux__
+    int inotify_fd;
+#endif
+    std::map<std::string, Sint64> modify_times;
+};
+
+static bool is_source(const std::string& file) {
+    return file.find(".glsl.") != std::string::npos && file.back() != '~';
+}
+
+// Blocks up to WATCH_INTERVAL_MS and adds the sources that changed meanwhile; false if none did
+static bool collect_changes(ShaderReloader* reloader, std::set<std::string>& changed) {
+    bool any = false;
+#ifdef __linux__
+    pollfd fd = { reloader->inotify_fd, POLLIN, 0 };
+    if (reloader->inotify_fd >= 0) {
+        if (poll(&fd, 1, WATCH_INTERVAL_MS) <= 0) {
+            return false;
+        }
+        alignas(inotify_event) char buffer[4096];
+        ssize_t size = read(reloader->inotify_fd, buffer, sizeof(buffer));
+        for (ssize_t offset = 0; offset < size;) {
+            const inotify_event* event = (const inotify_event*)(buffer + offset);
+            if (event->len > 0 && is_source(event->name)) {
+                changed.insert(event->name);
+                any = true;
+            }
+            offset += sizeof(inotify_event) + event->len;
+        }
+        return any;
+    }
+#endif
+    // Polling fallback: compare every source's modification time
+    SDL_Delay(WATCH_INTERVAL_MS);
+    int count = 0;
+    char** files = SDL_GlobDirectory(reloader->source_dir.c_str(), "*.glsl.*", 0, &count);
+    for (int i = 0; files && i < count; ++i) {
+        SDL_PathInfo info;
+        std::string path = reloader->source_dir + "/" + files[i];
+        if (!is_source(files[i]) || !SDL_GetPathInfo(path.c_str(), &info)) {
+            continue;
+        }
+        auto known = reloader->modify_times.find(files[i]);
+        if (known != reloader->modify_times.end() && known->second != info.modify_time) {
+            changed.insert(files[i]);
+            any = true;
+        }
+        reloader->modify_times[files[i]] = info.modify_time;
+    }
+    SDL_free(files);
+    return any;
+}
+
+// Runs the compiler to SPIR-V and reflects the result; compiler output goes to the log on failure
+static bool compile_shader(ShaderReloader* reloader, const std::string& source, const std::string& name,
+    const char* define, ShaderBlob& blob) {
+    size_t stageDot = name.find_last_of('.');
+    if (stageDot == std::string::npos || !parse_shader_stage(name.c_str() + stageDot + 1, blob.stage)) {
+        return false;
+    }
+    std::string sourcePath = reloader->source_dir + "/" + source;
+    std::string outputPath = reloader->source_dir + "/" + name.substr(0, stageDot) + ".spv" + name.substr(stageDot);
+    std::string tmpPath = outputPath + ".tmp";
+    std::string stageArg = "-fshader-stage=" + name.substr(stageDot + 1);
+    std::string defineArg = define ? std::string("-D") + define : std::string();
+
+    std::vector<const char*> args = { reloader->compiler.c_str(), stageArg.c_str() };
+    if (define) {
+        args.push_back(defineArg.c_str());
+    }
+    args.push_back(sourcePath.c_str());
+    args.push_back("-o");
+    args.push_back(tmpPath.c_str());
+    args.push_back(NULL);
+
+    SDL_PropertiesID props = SDL_CreateProperties();
+    SDL_SetPointerProperty(props, SDL_PROP_PROCESS_CREATE_ARGS_POINTER, (void*)args.data());
+    SDL_SetNumberProperty(props, SDL_PROP_PROCESS_CREATE_STDOUT_NUMBER, SDL_PROCESS_STDIO_APP);
+    SDL_SetBooleanProperty(props, SDL_PROP_PROCESS_CREATE_STDERR_TO_STDOUT_BOOLEAN, true);
+    SDL_Process* process = SDL_CreateProcessWithProperties(props);
+    SDL_DestroyProperties(props);
+    if (process == NULL) {
+        fprintf(stderr, "ERROR: SDL_CreateProcess(%s) failed: %s\n", reloader->compiler.c_str(), SDL_GetError());
+        return false;
+    }
+    int exitCode = -1;
+    char* output = (char*)SDL_ReadProcess(process, NULL, &exitCode);
+    SDL_DestroyProcess(process);
+    if (exitCode != 0) {
+        fprintf(stderr, "ERROR: Compiling %s failed:\n%s\n", name.c_str(), output ? output : "");
+        SDL_free(output);
+        SDL_RemovePath(tmpPath.c_str());
+        return false;
+    }
+    SDL_free(output);
+
+    size_t codeSize;
+    void* code = SDL_LoadFile(tmpPath.c_str(), &codeSize);
+    if (code == NULL) {
+        fprintf(stderr, "ERROR: SDL_LoadFile(%s) failed: %s\n", tmpPath.c_str(), SDL_GetError());
+        return false;
+    }
+    blob.name = name;
+    blob.entrypoint = "main";
+    blob.format = SDL_GPU_SHADERFORMAT_SPIRV;
+    blob.code.assign((const Uint8*)code, (const Uint8*)code + codeSize);
+    SDL_free(code);
+    if (!reflect_spirv(blob.code.data(), blob.code.size(), blob.reflection)) {
+        fprintf(stderr, "ERROR: %s compiled to invalid SPIR-V\n", name.c_str());
+        return false;
+    }
+    if (!SDL_RenamePath(tmpPath.c_str(), outputPath.c_str())) {
+        fprintf(stderr, "ERROR: SDL_RenamePath(%s) failed: %s\n", outputPath.c_str(), SDL_GetError());
+    }
+    return true;
+}
+
+static void compile_batch(ShaderReloader* reloader, const std::set<std::string>& sources, Uint64 changed_at) {
+    ShaderReload batch = {};
+    batch.changed_at = changed_at;
+    for (const std::string& source : sources) {
+        // shader.glsl.frag -> shader.frag
+        size_t glsl = source.find(".glsl.");
+        std::string name = source.substr(0, glsl) + source.substr(glsl + 5);
+        ShaderBlob blob = {};
+        if (compile_shader(reloader, source, name, NULL, blob)) {
+            batch.shaders.push_back(std::move(blob));
+        }
+        for (const ShaderVariant& variant : reloader->variants) {
+            blob = {};
+            if (source == variant.source && compile_shader(reloader, source, variant.name, variant.define, blob)) {
+                batch.shaders.push_back(std::move(blob));
+            }
+        }
+    }
+    if (batch.shaders.empty()) {
+        return;
+    }
+    double ms = (double)(SDL_GetPerformanceCounter() - changed_at) * 1000.0 / SDL_GetPerformanceFrequency();
+    SDL_Log("Recompiled %zu shaders %.0f ms after the edit", batch.shaders.size(), ms);
+
+    // A batch the main loop has not taken yet absorbs this one, newer code winning
+    SDL_LockMutex(reloader->mutex);
+    if (!reloader->has_pending) {
+        reloader->pending = std::move(batch);
+        reloader->has_pending = true;
+    } else {
+        for (ShaderBlob& blob : batch.shaders) {
+            bool replaced = false;
+            for (ShaderBlob& pending : reloader->pending.shaders) {
+                if (pending.name == blob.name) {
+                    pending = std::move(blob);
+                    replaced = true;
+                    break;
+                }
+            }
+            if (!replaced) {
+                reloader->pending.shaders.push_back(std::move(blob));
+            }
+        }
+    }
+    SDL_UnlockMutex(reloader->mutex);
+}
+
+static int watch_shaders(void* data) {
+    ShaderReloader* reloader = (ShaderReloader*)data;
+    std::set<std::string> changed;
+    Uint64 changedAt = 0;
+    while (reloader->running.load(std::memory_order_acquire)) {
+        if (collect_changes(reloader, changed)) {
+            if (changedAt == 0) {
+                changedAt = SDL_GetPerformanceCounter();
+            }
+        } else if (!changed.empty()) {
+            // Editors save in several writes; compile once the sources have been quiet for an interval
+            compile_batch(reloader, changed, changedAt);
+            changed.clear();
+            changedAt = 0;
+        }
+    }
+    return 0;
+}
+
+ShaderReloader* create_shader_reloader(const char* source_dir, const char* compiler,
+    const ShaderVariant* variants, Uint32 variant_count) {
+    ShaderReloader* reloader = new ShaderReloader();
+    reloader->source_dir = source_dir;
+    reloader->compiler = compiler;
+    reloader->variants.assign(variants, variants + variant_count);
+    reloader->mutex = SDL_CreateMutex();
+    reloader->pending = {};
+    reloader->has_pending = false;
+    bool notified = false;
+#ifdef __linux__
+    reloader->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    // Editors either rewrite the file or move a new one over it
+    if (reloader->inotify_fd >= 0 && inotify_add_watch(reloader->inotify_fd, source_dir, IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        fprintf(stderr, "ERROR: inotify_add_watch(%s) failed, polling instead\n", source_dir);
+        close(reloader->inotify_fd);
+        reloader->inotify_fd = -1;
+    }
+    notified = reloader->inotify_fd >= 0;
+#endif
+    if (!notified) {
+        // The first scan only records the current modification times
+        std::set<std::string> ignored;
+        collect_changes(reloader, ignored);
+    }
+
+    reloader->running.store(true, std::memory_order_release);
+    reloader->thread = SDL_CreateThread(watch_shaders, "ShaderReloader", reloader);
+    if (reloader->thread == NULL) {
+        fprintf(stderr, "ERROR: SDL_CreateThread failed: %s\n", SDL_GetError());
+        destroy_shader_reloader(reloader);
+        return NULL;
+    }
+    SDL_Log("Watching %s for shader edits", source_dir);
+    return reloader;
+}
+
+void destroy_shader_reloader(ShaderReloader* reloader) {
+    if (reloader == NULL) {
+        return;
+    }
+    reloader->running.store(false, std::memory_order_release);
+    if (reloader->thread) {
+        SDL_WaitThread(reloader->thread, NULL);
+    }
+#ifdef __linux__
+    if (reloader->inotify_fd >= 0) {
+        close(reloader->inotify_fd);
+    }
+#endif
+    SDL_DestroyMutex(reloader->mutex);
+    delete reloader;
+}
+
+bool poll_shader_reloader(ShaderReloader* reloader, ShaderReload& reload) {
+    SDL_LockMutex(reloader->mutex);
+    bool ready = reloader->has_pending;
+    if (ready) {
+        reload = std::move(reloader->pending);
+        reloader->pending = {};
+        reloader->has_pending = false;
+    }
+    SDL_UnlockMutex(reloader->mutex);
+    return ready;
+}
@@ -0,0 +1,30 @@
+﻿#pragma once
+#include <vector>
+#include <SDL3/SDL.h>
+#include "shader_library.h"
+
+// A library shader built from a source with a define, besides the one the source's own name gives
+struct ShaderVariant {
+    const char* source; // e.g. "shader_packed.glsl.vert"
+    const char* name;   // e.g. "shader_packed_color.vert"
+    const char* define; // e.g. "PACKED_COLOR"
+};
+
+// Shaders recompiled from one burst of edits
+struct ShaderReload {
+    std::vector<ShaderBlob> shaders;
+    Uint64 changed_at; // performance counter at the first edit
+};
+
+// Development mode: a background thread watches the *.glsl.* sources in source_dir (inotify on
+// Linux, modification times elsewhere) and recompiles edited ones to SPIR-V with the glslc-compatible
+// compiler. shader.glsl.frag becomes the library shader shader.frag and is also written back as
+// shader.spv.frag, so the next build packs it.
+struct ShaderReloader;
+
+ShaderReloader* create_shader_reloader(const char* source_dir, const char* compiler,
+    const ShaderVariant* variants, Uint32 variant_count);
+void destroy_shader_reloader(ShaderReloader* reloader);
+
+// Takes the latest finished batch, if any. Call at a frame boundary and swap all of it before drawing.
+bool poll_shader_reloader(ShaderReloader* reloader, ShaderReload& reload);
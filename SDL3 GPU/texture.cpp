@@ -0,0 +1,174 @@
+﻿#include "texture.h"
+#include <cstring>
+#include <stdio.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TEXTURE_SSE2 1
+#endif
+
+Uint32 mip_level_count(Uint32 width, Uint32 height) {
+    Uint32 levels = 1;
+    Uint32 size = SDL_max(width, height);
+    while (size > 1) {
+        size >>= 1;
+        levels++;
+    }
+    return levels;
+}
+
+static void downsample_rows_scalar(const Uint8* src, Uint32 src_width, Uint32 src_height, Uint8* dst, Uint32 y, Uint32 first_x) {
+    const Uint32 dstWidth = SDL_max(src_width >> 1, 1u);
+    const Uint8* row0 = src + (size_t)SDL_min(y * 2, src_height - 1) * src_width * 4;
+    const Uint8* row1 = src + (size_t)SDL_min(y * 2 + 1, src_height - 1) * src_width * 4;
+    Uint8* out = dst + (size_t)y * dstWidth * 4;
+
+    for (Uint32 x = first_x; x < dstWidth; ++x) {
+        Uint32 x0 = SDL_min(x * 2, src_width - 1) * 4;
+        Uint32 x1 = SDL_min(x * 2 + 1, src_width - 1) * 4;
+        for (Uint32 c = 0; c < 4; ++c) {
+            out[x * 4 + c] = (Uint8)((row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) >> 2);
+        }
+    }
+}
+
+void downsample_rgba8_scalar(const Uint8* src, Uint32 src_width, Uint32 src_height, Uint8* dst) {
+    const Uint32 dstHeight = SDL_max(src_height >> 1, 1u);
+    for (Uint32 y = 0; y < dstHeight; ++y) {
+        downsample_rows_scalar(src, src_width, src_height, dst, y, 0);
+    }
+}
+
+void downsample_rgba8(const Uint8* src, Uint32 src_width, Uint32 src_height, Uint8* dst) {
+#ifdef TEXTURE_SSE2
+    const Uint32 dstWidth = SDL_max(src_width >> 1, 1u);
+    const Uint32 dstHeight = SDL_max(src_height >> 1, 1u);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i round = _mm_set1_epi16(2);
+
+    for (Uint32 y = 0; y < dstHeight; ++y) {
+        const Uint8* row0 = src + (size_t)SDL_min(y * 2, src_height - 1) * src_width * 4;
+        const Uint8* row1 = src + (size_t)SDL_min(y * 2 + 1, src_height - 1) * src_width * 4;
+        Uint8* out = dst + (size_t)y * dstWidth * 4;
+
+        // 4 output texels from 8x2 source texels per step; the odd-width tail goes through the scalar path
+        Uint32 x = 0;
+        for (; x + 4 <= dstWidth && (x + 4) * 2 <= src_width; x += 4) {
+            __m128i a0 = _mm_loadu_si128((const __m128i*)(row0 + x * 8));
+            __m128i a1 = _mm_loadu_si128((const __m128i*)(row0 + x * 8 + 16));
+            __m128i b0 = _mm_loadu_si128((const __m128i*)(row1 + x * 8));
+            __m128i b1 = _mm_loadu_si128((const __m128i*)(row1 + x * 8 + 16));
+
+            // Vertical sums, two texels per register as 16-bit channels
+            __m128i s0 = _mm_add_epi16(_mm_unpacklo_epi8(a0, zero), _mm_unpacklo_epi8(b0, zero));
+            __m128i s1 = _mm_add_epi16(_mm_unpackhi_epi8(a0, zero), _mm_unpackhi_epi8(b0, zero));
+            __m128i s2 = _mm_add_epi16(_mm_unpacklo_epi8(a1, zero), _mm_unpacklo_epi8(b1, zero));
+            __m128i s3 = _mm_add_epi16(_mm_unpackhi_epi8(a1, zero), _mm_unpackhi_epi8(b1, zero));
+
+            // Horizontal pairs: even texels + odd texels
+            __m128i lo = _mm_add_epi16(_mm_unpacklo_epi64(s0, s1), _mm_unpackhi_epi64(s0, s1));
+            __m128i hi = _mm_add_epi16(_mm_unpacklo_epi64(s2, s3), _mm_unpackhi_epi64(s2, s3));
+            lo = _mm_srli_epi16(_mm_add_epi16(lo, round), 2);
+            hi = _mm_srli_epi16(_mm_add_epi16(hi, round), 2);
+
+            _mm_storeu_si128((__m128i*)(out + x * 4), _mm_packus_epi16(lo, hi));
+        }
+        if (x < dstWidth) {
+            downsample_rows_scalar(src, src_width, src_height, dst, y, x);
+        }
+    }
+#else
+    downsample_rgba8_scalar(src, src_width, src_height, dst);
+#endif
+}
+
+MipChain generate_mip_chain(const Uint8* rgba, Uint32 width, Uint32 height, Uint32 num_levels) {
+    MipChain chain;
+    Uint32 offset = 0;
+    Uint32 w = width, h = height;
+    for (Uint32 i = 0; i < num_levels; ++i) {
+        MipLevel level = { w, h, offset, w * h * 4 };
+        chain.levels.push_back(level);
+        offset += level.size;
+        w = SDL_max(w >> 1, 1u);
+        h = SDL_max(h >> 1, 1u);
+    }
+
+    chain.data.resize(offset);
+    std::memcpy(chain.data.data(), rgba, chain.levels[0].size);
+    for (Uint32 i = 1; i < num_levels; ++i) {
+        const MipLevel& parent = chain.levels[i - 1];
+        downsample_rgba8(chain.data.data() + parent.offset, parent.width, parent.height, chain.data.data() + chain.levels[i].offset);
+    }
+    return chain;
+}
+
+SDL_GPUSampler* create_texture_sampler(SDL_GPUDevice* device, float max_anisotropy) {
+    SDL_GPUSamplerCreateInfo samplerCreateInfo = {};
+    samplerCreateInfo.min_filter = SDL_GPU_FILTER_LINEAR;
+    samplerCreateInfo.mag_filter = SDL_GPU_FILTER_LINEAR;
+    samplerCreateInfo.mipmap_mode = SDL_GPU_SAMPLERMIPMAPMODE_LINEAR;
+    samplerCreateInfo.address_mode_u = SDL_GPU_SAMPLERADDRESSMODE_REPEAT;
+    samplerCreateInfo.address_mode_v = SDL_GPU_SAMPLERADDRESSMODE_REPEAT;
+    samplerCreateInfo.address_mode_w = SDL_GPU_SAMPLERADDRESSMODE_REPEAT;
+    samplerCreateInfo.min_lod = 0.0f;
+    samplerCreateInfo.max_lod = 1000.0f;
+    samplerCreateInfo.enable_anisotropy = max_anisotropy > 1.0f;
+    samplerCreateInfo.max_anisotropy = max_anisotropy;
+
+    SDL_GPUSampler* sampler = SDL_CreateGPUSampler(device, &samplerCreateInfo);
+    if (sampler == NULL) {
+        fprintf(stderr, "ERROR: SDL_CreateGPUSampler failed: %s\n", SDL_GetError());
+    }
+    return sampler;
+}
+
+void benchmark_mip_generation(Uint32 width, Uint32 height, int iterations) {
+    std::vector<Uint8> image((size_t)width * height * 4);
+    Uint32 state = 12345;
+    for (Uint8& value : image) {
+        state = state * 1664525u + 1013904223u;
+        value = (Uint8)(state >> 24);
+    }
+
+    std::vector<Uint8> scalarOut((size_t)SDL_max(width >> 1, 1u) * SDL_max(height >> 1, 1u) * 4);
+    const Uint32 levels = mip_level_count(width, height);
+    const double toMs = 1000.0 / SDL_GetPerformanceFrequency();
+    double scalarMs = 0.0, simdMs = 0.0;
+    size_t chainBytes = 0;
+
+    for (int i = 0; i < iterations; ++i) {
+        // Scalar: the same chain built level by level with the reference filter
+        Uint64 start = SDL_GetPerformanceCounter();
+        std::vector<Uint8> level = image;
+        Uint32 w = width, h = height;
+        for (Uint32 l = 1; l < levels; ++l) {
+            downsample_rgba8_scalar(level.data(), w, h, scalarOut.data());
+            w = SDL_max(w >> 1, 1u);
+            h = SDL_max(h >> 1, 1u);
+            level.assign(scalarOut.begin(), scalarOut.begin() + (size_t)w * h * 4);
+        }
+        scalarMs += (SDL_GetPerformanceCounter() - start) * toMs;
+
+        start = SDL_GetPerformanceCounter();
+        MipChain chain = generate_mip_chain(image.data(), width, height, levels);
+        simdMs += (SDL_GetPerformanceCounter() - start) * toMs;
+        chainBytes = chain.data.size();
+    }
+
+    SDL_Log("Mip generation %ux%u, %u levels, %zu bytes: scalar %.3f ms, SIMD %.3f ms",
+        width, height, levels, chainBytes, scalarMs / iterations, simdMs / iterations);
+
+    // A surface covering N texels on screen samples the level whose size is closest to N;
+    // without mips every fetch walks the full base level.
+    const Uint64 baseBytes = (Uint64)width * height * 4;
+    for (Uint32 coverage = SDL_max(width, height); coverage >= 64; coverage >>= 2) {
+        Uint32 lod = 0;
+        while ((SDL_max(width, height) >> (lod + 1)) >= coverage && lod + 1 < levels) {
+            lod++;
+        }
+        Uint64 levelBytes = (Uint64)SDL_max(width >> lod, 1u) * SDL_max(height >> lod, 1u) * 4;
+        SDL_Log("  %4u px footprint: samples level %u, %llu bytes resident vs %llu without mips",
+            coverage, lod, (unsigned long long)levelBytes, (unsigned long long)baseBytes);
+    }
+}
@@ -0,0 +1,36 @@
+﻿#pragma once
+#include <vector>
+#include <SDL3/SDL.h>
+
+enum MipmapMode {
+    MIPMAP_NONE = 0,
+    MIPMAP_CPU = 1, // box-filtered on the CPU and uploaded with the base level
+    MIPMAP_GPU = 2  // SDL_GenerateMipmapsForGPUTexture after the base level upload
+};
+
+struct MipLevel {
+    Uint32 width;
+    Uint32 height;
+    Uint32 offset;
+    Uint32 size;
+};
+
+// Tightly packed RGBA8 levels, largest first
+struct MipChain {
+    std::vector<Uint8> data;
+    std::vector<MipLevel> levels;
+};
+
+Uint32 mip_level_count(Uint32 width, Uint32 height);
+
+// Halves an RGBA8 image with a 2x2 box filter, clamping at odd edges
+void downsample_rgba8(const Uint8* src, Uint32 src_width, Uint32 src_height, Uint8* dst);
+void downsample_rgba8_scalar(const Uint8* src, Uint32 src_width, Uint32 src_height, Uint8* dst);
+
+MipChain generate_mip_chain(const Uint8* rgba, Uint32 width, Uint32 height, Uint32 num_levels);
+
+// Trilinear sampler, anisotropic when max_anisotropy > 1
+SDL_GPUSampler* create_texture_sampler(SDL_GPUDevice* device, float max_anisotropy);
+
+// Times scalar and SIMD chain generation and reports the bytes a minified draw would touch per level
+void benchmark_mip_generation(Uint32 width, Uint32 height, int iterations);
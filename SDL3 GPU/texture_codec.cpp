@@ -0,0 +1,466 @@
+﻿#include "texture_codec.h"
+#include <cmath>
+#include <cstring>
+
+const char* texture_codec_name(TextureCodec codec) {
+    switch (codec) {
+    case TEXTURE_CODEC_BC1:
+        return "bc1";
+    case TEXTURE_CODEC_BC3:
+        return "bc3";
+    case TEXTURE_CODEC_BC7:
+        return "bc7";
+    default:
+        return "rgba8";
+    }
+}
+
+SDL_GPUTextureFormat texture_codec_gpu_format(TextureCodec codec) {
+    switch (codec) {
+    case TEXTURE_CODEC_BC1:
+        return SDL_GPU_TEXTUREFORMAT_BC1_RGBA_UNORM;
+    case TEXTURE_CODEC_BC3:
+        return SDL_GPU_TEXTUREFORMAT_BC3_RGBA_UNORM;
+    case TEXTURE_CODEC_BC7:
+        return SDL_GPU_TEXTUREFORMAT_BC7_RGBA_UNORM;
+    default:
+        return SDL_GPU_TEXTUREFORMAT_R8G8B8A8_UNORM;
+    }
+}
+
+static Uint32 block_bytes(TextureCodec codec) {
+    return codec == TEXTURE_CODEC_BC1 ? 8 : 16;
+}
+
+Uint32 texture_codec_level_size(TextureCodec codec, Uint32 width, Uint32 height) {
+    if (codec == TEXTURE_CODEC_RGBA8) {
+        return width * height * 4;
+    }
+    return ((width + 3) / 4) * ((height + 3) / 4) * block_bytes(codec);
+}
+
+// Gathers a 4x4 block, clamping at the image edge
+static void load_block(const Uint8* rgba, Uint32 width, Uint32 height, Uint32 bx, Uint32 by, Uint8 block[16][4]) {
+    for (Uint32 y = 0; y < 4; ++y) {
+        Uint32 sy = SDL_min(by * 4 + y, height - 1);
+        for (Uint32 x = 0; x < 4; ++x) {
+            Uint32 sx = SDL_min(bx * 4 + x, width - 1);
+            std::memcpy(block[y * 4 + x], rgba + ((size_t)sy * width + sx) * 4, 4);
+        }
+    }
+}
+
+static void store_block(Uint8* rgba, Uint32 width, Uint32 height, Uint32 bx, Uint32 by, const Uint8 block[16][4]) {
+    for (Uint32 y = 0; y < 4 && by * 4 + y < height; ++y) {
+        for (Uint32 x = 0; x < 4 && bx * 4 + x < width; ++x) {
+            std::memcpy(rgba + ((size_t)(by * 4 + y) * width + bx * 4 + x) * 4, block[y * 4 + x], 4);
+        }
+    }
+}
+
+// Principal axis of the block in the first `channels` channels, endpoints at the extreme projections
+static void fit_endpoints(const Uint8 block[16][4], int channels, float lo[4], float hi[4]) {
+    float mean[4] = {};
+    for (int i = 0; i < 16; ++i) {
+        for (int c = 0; c < channels; ++c) {
+            mean[c] += block[i][c] / 16.0f;
+        }
+    }
+
+    float cov[4][4] = {};
+    for (int i = 0; i < 16; ++i) {
+        for (int a = 0; a < channels; ++a) {
+            for (int b = 0; b < channels; ++b) {
+                cov[a][b] += (block[i][a] - mean[a]) * (block[i][b] - mean[b]);
+            }
+        }
+    }
+
+    // Power iteration converges quickly on a 3x3/4x4 covariance
+    float axis[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+    for (int iteration = 0; iteration < 8; ++iteration) {
+        float next[4] = {};
+        float length = 0.0f;
+        for (int a = 0; a < channels; ++a) {
+            for (int b = 0; b < channels; ++b) {
+                next[a] += cov[a][b] * axis[b];
+            }
+            length += next[a] * next[a];
+        }
+        if (length < 1e-12f) {
+            break;
+        }
+        length = std::sqrt(length);
+        for (int a = 0; a < channels; ++a) {
+            axis[a] = next[a] / length;
+        }
+    }
+
+    float minT = 0.0f, maxT = 0.0f;
+    for (int i = 0; i < 16; ++i) {
+        float t = 0.0f;
+        for (int c = 0; c < channels; ++c) {
+            t += (block[i][c] - mean[c]) * axis[c];
+        }
+        minT = SDL_min(minT, t);
+        maxT = SDL_max(maxT, t);
+    }
+
+    // Inset by 1/16 of the range; extremes are usually outliers of the interpolated palette
+    float inset = (maxT - minT) / 16.0f;
+    minT += inset;
+    maxT -= inset;
+    for (int c = 0; c < channels; ++c) {
+        lo[c] = SDL_clamp(mean[c] + axis[c] * minT, 0.0f, 255.0f);
+        hi[c] = SDL_clamp(mean[c] + axis[c] * maxT, 0.0f, 255.0f);
+    }
+}
+
+static int color_distance(const Uint8* a, const Uint8* b, int channels) {
+    int distance = 0;
+    for (int c = 0; c < channels; ++c) {
+        int d = (int)a[c] - (int)b[c];
+        distance += d * d;
+    }
+    return distance;
+}
+
+static int nearest_index(const Uint8* color, const Uint8 (*palette)[4], int count, int channels) {
+    int best = 0;
+    int bestDistance = INT32_MAX;
+    for (int i = 0; i < count; ++i) {
+        int distance = color_distance(color, palette[i], channels);
+        if (distance < bestDistance) {
+            bestDistance = distance;
+            best = i;
+        }
+    }
+    return best;
+}
+
+// ---- BC1 ----
+
+static Uint16 pack_565(const float rgb[3]) {
+    Uint16 r = (Uint16)(rgb[0] * 31.0f / 255.0f + 0.5f);
+    Uint16 g = (Uint16)(rgb[1] * 63.0f / 255.0f + 0.5f);
+    Uint16 b = (Uint16)(rgb[2] * 31.0f / 255.0f + 0.5f);
+    return (Uint16)((r << 11) | (g << 5) | b);
+}
+
+static void unpack_565(Uint16 color, Uint8 out[4]) {
+    Uint8 r = (color >> 11) & 31, g = (color >> 5) & 63, b = color & 31;
+    out[0] = (Uint8)((r << 3) | (r >> 2));
+    out[1] = (Uint8)((g << 2) | (g >> 4));
+    out[2] = (Uint8)((b << 3) | (b >> 2));
+    out[3] = 255;
+}
+
+static void bc1_palette(Uint16 c0, Uint16 c1, Uint8 palette[4][4]) {
+    unpack_565(c0, palette[0]);
+    unpack_565(c1, palette[1]);
+    for (int c = 0; c < 3; ++c) {
+        if (c0 > c1) {
+            palette[2][c] = (Uint8)((2 * palette[0][c] + palette[1][c] + 1) / 3);
+            palette[3][c] = (Uint8)((palette[0][c] + 2 * palette[1][c] + 1) / 3);
+        } else {
+            palette[2][c] = (Uint8)((palette[0][c] + palette[1][c]) / 2);
+            palette[3][c] = 0;
+        }
+    }
+    palette[2][3] = 255;
+    palette[3][3] = c0 > c1 ? 255 : 0;
+}
+
+static void encode_bc1_block(const Uint8 block[16][4], Uint8 out[8]) {
+    float lo[4], hi[4];
+    fit_endpoints(block, 3, lo, hi);
+    Uint16 c0 = pack_565(hi), c1 = pack_565(lo);
+    if (c0 < c1) {
+        Uint16 swap = c0;
+        c0 = c1;
+        c1 = swap;
+    }
+
+    Uint32 indices = 0;
+    if (c0 != c1) {
+        Uint8 palette[4][4];
+        bc1_palette(c0, c1, palette);
+        for (int i = 0; i < 16; ++i) {
+            indices |= (Uint32)nearest_index(block[i], palette, 4, 3) << (i * 2);
+        }
+    }
+
+    std::memcpy(out, &c0, 2);
+    std::memcpy(out + 2, &c1, 2);
+    std::memcpy(out + 4, &indices, 4);
+}
+
+static void decode_bc1_block(const Uint8 in[8], Uint8 block[16][4]) {
+    Uint16 c0, c1;
+    Uint32 indices;
+    std::memcpy(&c0, in, 2);
+    std::memcpy(&c1, in + 2, 2);
+    std::memcpy(&indices, in + 4, 4);
+
+    Uint8 palette[4][4];
+    bc1_palette(c0, c1, palette);
+    for (int i = 0; i < 16; ++i) {
+        std::memcpy(block[i], palette[(indices >> (i * 2)) & 3], 4);
+    }
+}
+
+// ---- BC4 (BC3 alpha) ----
+
+static void bc4_palette(Uint8 a0, Uint8 a1, Uint8 palette[8]) {
+    palette[0] = a0;
+    palette[1] = a1;
+    for (int i = 1; i < 7; ++i) {
+        palette[i + 1] = (Uint8)(((7 - i) * a0 + i * a1 + 3) / 7);
+    }
+}
+
+static void encode_bc4_block(const Uint8 block[16][4], int channel, Uint8 out[8]) {
+    Uint8 a0 = 0, a1 = 255;
+    for (int i = 0; i < 16; ++i) {
+        a0 = SDL_max(a0, block[i][channel]);
+        a1 = SDL_min(a1, block[i][channel]);
+    }
+
+    Uint64 bits = 0;
+    if (a0 != a1) {
+        Uint8 palette[8];
+        bc4_palette(a0, a1, palette);
+        for (int i = 0; i < 16; ++i) {
+            int best = 0, bestDistance = 256;
+            for (int p = 0; p < 8; ++p) {
+                int distance = SDL_abs((int)block[i][channel] - (int)palette[p]);
+                if (distance < bestDistance) {
+                    bestDistance = distance;
+                    best = p;
+                }
+            }
+            bits |= (Uint64)best << (i * 3);
+        }
+    }
+
+    out[0] = a0;
+    out[1] = a1;
+    for (int i = 0; i < 6; ++i) {
+        out[2 + i] = (Uint8)(bits >> (i * 8));
+    }
+}
+
+static void decode_bc4_block(const Uint8 in[8], int channel, Uint8 block[16][4]) {
+    Uint8 palette[8];
+    bc4_palette(in[0], in[1], palette);
+    Uint64 bits = 0;
+    for (int i = 0; i < 6; ++i) {
+        bits |= (Uint64)in[2 + i] << (i * 8);
+    }
+    for (int i = 0; i < 16; ++i) {
+        block[i][channel] = palette[(bits >> (i * 3)) & 7];
+    }
+}
+
+// ---- BC7 mode 6: one subset, RGBA 7.7.7.7 endpoints + unique p-bits, 4-bit indices ----
+
+static const int bc7_weights4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+struct BitWriter {
+    Uint64 words[2];
+    int position;
+
+    void write(Uint64 value, int count) {
+        for (int i = 0; i < count; ++i, ++position) {
+            words[position >> 6] |= ((value >> i) & 1) << (position & 63);
+        }
+    }
+};
+
+struct BitReader {
+    Uint64 words[2];
+    int position;
+
+    Uint32 read(int count) {
+        Uint32 value = 0;
+        for (int i = 0; i < count; ++i, ++position) {
+            value |= (Uint32)((words[position >> 6] >> (position & 63)) & 1) << i;
+        }
+        return value;
+    }
+};
+
+static void bc7_palette(const Uint8 e0[4], const Uint8 e1[4], Uint8 palette[16][4]) {
+    for (int i = 0; i < 16; ++i) {
+        for (int c = 0; c < 4; ++c) {
+            palette[i][c] = (Uint8)(((64 - bc7_weights4[i]) * e0[c] + bc7_weights4[i] * e1[c] + 32) >> 6);
+        }
+    }
+}
+
+// Quantizes an endpoint to 7 bits per channel plus a shared p-bit, whichever p-bit fits better
+static void quantize_bc7_endpoint(const float value[4], Uint8 quantized[4], Uint8& pbit, Uint8 expanded[4]) {
+    float bestError = 1e30f;
+    for (Uint8 p = 0; p < 2; ++p) {
+        Uint8 q[4], e[4];
+        float error = 0.0f;
+        for (int c = 0; c < 4; ++c) {
+            int v = (int)std::floor((value[c] - p) / 2.0f + 0.5f);
+            q[c] = (Uint8)SDL_clamp(v, 0, 127);
+            e[c] = (Uint8)((q[c] << 1) | p);
+            error += (e[c] - value[c]) * (e[c] - value[c]);
+        }
+        if (error < bestError) {
+            bestError = error;
+            pbit = p;
+            std::memcpy(quantized, q, 4);
+            std::memcpy(expanded, e, 4);
+        }
+    }
+}
+
+static void encode_bc7_block(const Uint8 block[16][4], Uint8 out[16]) {
+    float lo[4], hi[4];
+    fit_endpoints(block, 4, lo, hi);
+
+    Uint8 q[2][4], e[2][4], p[2];
+    quantize_bc7_endpoint(lo, q[0], p[0], e[0]);
+    quantize_bc7_endpoint(hi, q[1], p[1], e[1]);
+
+    Uint8 palette[16][4];
+    bc7_palette(e[0], e[1], palette);
+    int indices[16];
+    for (int i = 0; i < 16; ++i) {
+        indices[i] = nearest_index(block[i], palette, 16, 4);
+    }
+
+    // The anchor index is stored with its top bit implied zero; swap endpoints to make that true
+    if (indices[0] & 8) {
+        for (int c = 0; c < 4; ++c) {
+            Uint8 swap = q[0][c];
+            q[0][c] = q[1][c];
+            q[1][c] = swap;
+        }
+        Uint8 swap = p[0];
+        p[0] = p[1];
+        p[1] = swap;
+        for (int i = 0; i < 16; ++i) {
+            indices[i] = 15 - indices[i];
+        }
+    }
+
+    BitWriter writer = {};
+    writer.write(1 << 6, 7);
+    for (int c = 0; c < 4; ++c) {
+        writer.write(q[0][c], 7);
+        writer.write(q[1][c], 7);
+    }
+    writer.write(p[0], 1);
+    writer.write(p[1], 1);
+    for (int i = 0; i < 16; ++i) {
+        writer.write(indices[i], i == 0 ? 3 : 4);
+    }
+    std::memcpy(out, writer.words, 16);
+}
+
+static void decode_bc7_block(const Uint8 in[16], Uint8 block[16][4]) {
+    BitReader reader = {};
+    std::memcpy(reader.words, in, 16);
+    if (reader.read(7) != (1 << 6)) {
+        // Not mode 6: decode as the error color like hardware does for reserved modes
+        std::memset(block, 0, 16 * 4);
+        return;
+    }
+
+    Uint8 q[2][4], e[2][4];
+    for (int c = 0; c < 4; ++c) {
+        q[0][c] = (Uint8)reader.read(7);
+        q[1][c] = (Uint8)reader.read(7);
+    }
+    Uint8 p0 = (Uint8)reader.read(1), p1 = (Uint8)reader.read(1);
+    for (int c = 0; c < 4; ++c) {
+        e[0][c] = (Uint8)((q[0][c] << 1) | p0);
+        e[1][c] = (Uint8)((q[1][c] << 1) | p1);
+    }
+
+    Uint8 palette[16][4];
+    bc7_palette(e[0], e[1], palette);
+    for (int i = 0; i < 16; ++i) {
+        std::memcpy(block[i], palette[reader.read(i == 0 ? 3 : 4)], 4);
+    }
+}
+
+void encode_texture_level(TextureCodec codec, const Uint8* rgba, Uint32 width, Uint32 height, Uint8* out) {
+    if (codec == TEXTURE_CODEC_RGBA8) {
+        std::memcpy(out, rgba, (size_t)width * height * 4);
+        return;
+    }
+
+    const Uint32 blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+    const Uint32 stride = block_bytes(codec);
+    Uint8 block[16][4];
+    for (Uint32 by = 0; by < blocksY; ++by) {
+        for (Uint32 bx = 0; bx < blocksX; ++bx) {
+            load_block(rgba, width, height, bx, by, block);
+            Uint8* dest = out + ((size_t)by * blocksX + bx) * stride;
+            switch (codec) {
+            case TEXTURE_CODEC_BC1:
+                encode_bc1_block(block, dest);
+                break;
+            case TEXTURE_CODEC_BC3:
+                encode_bc4_block(block, 3, dest);
+                encode_bc1_block(block, dest + 8);
+                break;
+            default:
+                encode_bc7_block(block, dest);
+                break;
+            }
+        }
+    }
+}
+
+void decode_texture_level(TextureCodec codec, const Uint8* blocks, Uint32 width, Uint32 height, Uint8* rgba) {
+    if (codec == TEXTURE_CODEC_RGBA8) {
+        std::memcpy(rgba, blocks, (size_t)width * height * 4);
+        return;
+    }
+
+    const Uint32 blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+    const Uint32 stride = block_bytes(codec);
+    Uint8 block[16][4];
+    for (Uint32 by = 0; by < blocksY; ++by) {
+        for (Uint32 bx = 0; bx < blocksX; ++bx) {
+            const Uint8* source = blocks + ((size_t)by * blocksX + bx) * stride;
+            switch (codec) {
+            case TEXTURE_CODEC_BC1:
+                decode_bc1_block(source, block);
+                break;
+            case TEXTURE_CODEC_BC3:
+                decode_bc1_block(source + 8, block);
+                decode_bc4_block(source, 3, block);
+                break;
+            default:
+                decode_bc7_block(source, block);
+                break;
+            }
+            store_block(rgba, width, height, bx, by, block);
+        }
+    }
+}
+
+double texture_psnr(const Uint8* a, const Uint8* b, Uint32 width, Uint32 height, bool include_alpha) {
+    const int channels = include_alpha ? 4 : 3;
+    double squaredError = 0.0;
+    const size_t pixels = (size_t)width * height;
+    for (size_t i = 0; i < pixels; ++i) {
+        for (int c = 0; c < channels; ++c) {
+            double d = (double)a[i * 4 + c] - (double)b[i * 4 + c];
+            squaredError += d * d;
+        }
+    }
+    double mse = squaredError / (double)(pixels * channels);
+    if (mse <= 0.0) {
+        return 99.0;
+    }
+    return 10.0 * std::log10(255.0 * 255.0 / mse);
+}
@@ -0,0 +1,23 @@
+﻿#pragma once
+#include <vector>
+#include <SDL3/SDL.h>
+
+enum TextureCodec {
+    TEXTURE_CODEC_RGBA8 = 0,
+    TEXTURE_CODEC_BC1 = 1, // RGB, 8 bytes per 4x4 block
+    TEXTURE_CODEC_BC3 = 2, // RGB + BC4 alpha, 16 bytes per block
+    TEXTURE_CODEC_BC7 = 3  // RGBA mode 6, 16 bytes per block
+};
+
+const char* texture_codec_name(TextureCodec codec);
+SDL_GPUTextureFormat texture_codec_gpu_format(TextureCodec codec);
+
+// Encoded size of one width x height level; BCn pads partial blocks
+Uint32 texture_codec_level_size(TextureCodec codec, Uint32 width, Uint32 height);
+
+// RGBA8 <-> block data for one level. Decoding only understands what the encoder emits.
+void encode_texture_level(TextureCodec codec, const Uint8* rgba, Uint32 width, Uint32 height, Uint8* out);
+void decode_texture_level(TextureCodec codec, const Uint8* blocks, Uint32 width, Uint32 height, Uint8* rgba);
+
+// Peak signal-to-noise ratio over RGB, plus alpha when include_alpha is set
+double texture_psnr(const Uint8* a, const Uint8* b, Uint32 width, Uint32 height, bool include_alpha);
@@ -0,0 +1,217 @@
+﻿#include "thread_pool.h"
+#include <stdio.h>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <vector>
+
+// Each worker pops the newest job of its own queue and steals the oldest from the others when it runs dry
+struct WorkerQueue {
+    SDL_Mutex* mutex;
+    std::deque<std::function<void()>> jobs;
+};
+
+struct ThreadPool;
+
+struct Worker {
+    ThreadPool* pool;
+    Uint32 index;
+};
+
+struct ThreadPool {
+    std::vector<SDL_Thread*> threads;
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::vector<std::unique_ptr<WorkerQueue>> queues;
+    std::atomic<Uint32> next_queue; // round robin for jobs submitted from outside the pool
+    std::atomic<int> pending;       // queued jobs nobody has taken yet; briefly negative while a submit races a take
+    std::atomic<Uint64> steals;
+    SDL_Mutex* sleep_mutex;
+    SDL_Condition* wake;
+    bool quit;
+};
+
+// The worker running on this thread, so jobs a job submits land on its own queue
+static thread_local const Worker* currentWorker = NULL;
+
+static bool pop_job(WorkerQueue& queue, bool newest, std::function<void()>& job) {
+    SDL_LockMutex(queue.mutex);
+    bool found = !queue.jobs.empty();
+    if (found && newest) {
+        job = std::move(queue.jobs.back());
+        queue.jobs.pop_back();
+    } else if (found) {
+        job = std::move(queue.jobs.front());
+        queue.jobs.pop_front();
+    }
+    SDL_UnlockMutex(queue.mutex);
+    return found;
+}
+
+static bool take_job(ThreadPool* pool, Uint32 index, std::function<void()>& job) {
+    const Uint32 count = (Uint32)pool->queues.size();
+    bool found = pop_job(*pool->queues[index], true, job);
+    for (Uint32 k = 1; k < count && !found; ++k) {
+        found = pop_job(*pool->queues[(index + k) % count], false, job);
+        if (found) {
+            pool->steals++;
+        }
+    }
+    if (found) {
+        pool->pending--;
+    }
+    return found;
+}
+
+static int worker_main(void* data) {
+    const Worker* worker = (const Worker*)data;
+    ThreadPool* pool = worker->pool;
+    currentWorker = worker;
+    for (;;) {
+        std::function<void()> job;
+        if (take_job(pool, worker->index, job)) {
+            job();
+            continue;
+        }
+        SDL_LockMutex(pool->sleep_mutex);
+        while (pool->pending <= 0 && !pool->quit) {
+            SDL_WaitCondition(pool->wake, pool->sleep_mutex);
+        }
+        const bool done = pool->pending <= 0 && pool->quit;
+        SDL_UnlockMutex(pool->sleep_mutex);
+        if (done) {
+            return 0;
+        }
+    }
+}
+
+ThreadPool* create_thread_pool(int num_threads) {
+    if (num_threads <= 0) {
+        num_threads = SDL_max(SDL_GetNumLogicalCPUCores() - 1, 1);
+    }
+
+    ThreadPool* pool = new ThreadPool();
+    pool->next_queue = 0;
+    pool->pending = 0;
+    pool->steals = 0;
+    pool->sleep_mutex = SDL_CreateMutex();
+    pool->wake = SDL_CreateCondition();
+    pool->quit = false;
+    // Every queue exists before any worker starts stealing from them
+    for (int i = 0; i < num_threads; ++i) {
+        pool->queues.push_back(std::make_unique<WorkerQueue>());
+        pool->queues.back()->mutex = SDL_CreateMutex();
+        pool->workers.push_back(std::make_unique<Worker>(Worker{ pool, (Uint32)i }));
+    }
+    for (int i = 0; i < num_threads; ++i) {
+        SDL_Thread* thread = SDL_CreateThread(worker_main, "worker", pool->workers[i].get());
+        if (thread == NULL) {
+            fprintf(stderr, "ERROR: SDL_CreateThread failed: %s\n", SDL_GetError());
+            break;
+        }
+        pool->threads.push_back(thread);
+    }
+    return pool;
+}
+
+void destroy_thread_pool(ThreadPool* pool) {
+    if (pool == NULL) {
+        return;
+    }
+
+    SDL_LockMutex(pool->sleep_mutex);
+    pool->quit = true;
+    SDL_BroadcastCondition(pool->wake);
+    SDL_UnlockMutex(pool->sleep_mutex);
+
+    for (SDL_Thread* thread : pool->threads) {
+        SDL_WaitThread(thread, NULL);
+    }
+    for (std::unique_ptr<WorkerQueue>& queue : pool->queues) {
+        SDL_DestroyMutex(queue->mutex);
+    }
+    SDL_DestroyCondition(pool->wake);
+    SDL_DestroyMutex(pool->sleep_mutex);
+    delete pool;
+}
+
+void thread_pool_submit(ThreadPool* pool, std::function<void()> job) {
+    // Without workers (thread creation failed) run inline rather than never
+    if (pool->threads.empty()) {
+        job();
+        return;
+    }
+
+    const Uint32 index = currentWorker && currentWorker->pool == pool ?
+        currentWorker->index : pool->next_queue++ % (Uint32)pool->threads.size();
+    WorkerQueue& queue = *pool->queues[index];
+    SDL_LockMutex(queue.mutex);
+    queue.jobs.push_back(std::move(job));
+    SDL_UnlockMutex(queue.mutex);
+
+    // Counted before taking the sleep mutex, so a worker checking pending under it cannot miss the job
+    pool->pending++;
+    SDL_LockMutex(pool->sleep_mutex);
+    SDL_SignalCondition(pool->wake);
+    SDL_UnlockMutex(pool->sleep_mutex);
+}
+
+// Shared with the helper jobs, which may only start after the caller has returned
+struct ParallelFor {
+    std::function<void(Uint32, Uint32)> fn;
+    Uint32 count;
+    Uint32 grain;
+    Uint32 num_chunks;
+    std::atomic<Uint32> next_chunk;
+    std::atomic<Uint32> finished_chunks;
+    SDL_Semaphore* done;
+
+    ~ParallelFor() {
+        SDL_DestroySemaphore(done);
+    }
+};
+
+static void run_chunks(ParallelFor& work) {
+    for (;;) {
+        Uint32 chunk = work.next_chunk.fetch_add(1);
+        if (chunk >= work.num_chunks) {
+            return;
+        }
+        Uint32 begin = chunk * work.grain;
+        work.fn(begin, SDL_min(begin + work.grain, work.count));
+        if (work.finished_chunks.fetch_add(1) + 1 == work.num_chunks) {
+            SDL_SignalSemaphore(work.done);
+        }
+    }
+}
+
+void thread_pool_parallel_for(ThreadPool* pool, Uint32 count, Uint32 grain, std::function<void(Uint32 begin, Uint32 end)> fn) {
+    if (count == 0) {
+        return;
+    }
+    grain = SDL_max(grain, 1u);
+    std::shared_ptr<ParallelFor> work = std::make_shared<ParallelFor>();
+    work->fn = std::move(fn);
+    work->count = count;
+    work->grain = grain;
+    work->num_chunks = (count + grain - 1) / grain;
+    work->next_chunk = 0;
+    work->finished_chunks = 0;
+    work->done = SDL_CreateSemaphore(0);
+
+    Uint32 helpers = SDL_min((Uint32)pool->threads.size(), work->num_chunks - 1);
+    for (Uint32 i = 0; i < helpers; ++i) {
+        thread_pool_submit(pool, [work]() {
+            run_chunks(*work);
+        });
+    }
+    run_chunks(*work);
+    SDL_WaitSemaphore(work->done);
+}
+
+int thread_pool_size(ThreadPool* pool) {
+    return (int)pool->threads.size();
+}
+
+Uint64 thread_pool_steals(ThreadPool* pool) {
+    return pool->steals;
+}
@@ -0,0 +1,20 @@
+﻿#pragma once
+#include <functional>
+#include <SDL3/SDL.h>
+
+// Work-stealing: every worker has its own job queue. Jobs submitted by a job go to its worker's queue,
+// others are dealt round robin, and idle workers steal the oldest jobs of busy ones.
+struct ThreadPool;
+
+// num_threads <= 0 uses one thread per logical core minus the main thread
+ThreadPool* create_thread_pool(int num_threads);
+// Finishes every queued job before joining the workers
+void destroy_thread_pool(ThreadPool* pool);
+
+void thread_pool_submit(ThreadPool* pool, std::function<void()> job);
+// Runs fn over [0, count) in chunks of grain on the workers and the calling thread; returns when
+// every chunk has finished, even if some workers are still busy with earlier jobs
+void thread_pool_parallel_for(ThreadPool* pool, Uint32 count, Uint32 grain, std::function<void(Uint32 begin, Uint32 end)> fn);
+int thread_pool_size(ThreadPool* pool);
+// Jobs taken from another worker's queue so far
+Uint64 thread_pool_steals(ThreadPool* pool);
@@ -0,0 +1,230 @@
+﻿// Meshlet inspector: builds the clusters and levels of detail the mesh cache would store and reports
+// how well the clusters cull and what each level costs.
+//
+//   meshlet_tool <model> [--views N] [--validate]
+//
+// Culling efficiency is measured from N cameras spread evenly around the mesh, each looking at its
+// centre from 2.5 bounding radii away. --validate also checks every cluster against its limits,
+// its bounds and, for each camera, that every cluster the cone rejects really only has backfaces,
+// and that every level of detail is a smaller, in-range index list.
+#include <stdio.h>
+#include <cmath>
+#include <vector>
+#include <SDL3/SDL.h>
+#include <glm/glm.hpp>
+#include <glm/ext/matrix_clip_space.hpp>
+#include <glm/ext/matrix_transform.hpp>
+#include "mesh.h"
+#include "mesh_optimizer.h"
+#include "meshlet.h"
+#include "culling.h"
+
+// Relative slack for float comparisons in --validate
+#define VALIDATE_EPSILON 1e-4f
+
+static bool validate_lods(const MeshData& mesh, const Submesh& submesh) {
+    const Uint32* indices = mesh.indices.data() + submesh.first_index;
+    bool passed = submesh.lod_count >= 1 && submesh.lod_count <= MAX_MESH_LODS
+        && submesh.lods[0].first_index == 0 && submesh.lods[0].index_count == submesh.index_count;
+    for (Uint32 l = 1; l < submesh.lod_count && passed; ++l) {
+        const SubmeshLod& lod = submesh.lods[l];
+        const SubmeshLod& previous = submesh.lods[l - 1];
+        if (lod.index_count % 3 != 0 || lod.index_count >= previous.index_count || lod.error < previous.error
+            || lod.first_index != previous.first_index + previous.index_count) {
+            printf("  LOD %u: %u indices at %u, error %g does not follow the previous level\n", l, lod.index_count, lod.first_index, lod.error);
+            passed = false;
+        }
+        for (Uint32 i = 0; i < lod.index_count && passed; ++i) {
+            if (indices[lod.first_index + i] >= submesh.vertex_count) {
+                printf("  LOD %u: index %u out of the submesh's %u vertices\n", l, indices[lod.first_index + i], submesh.vertex_count);
+                passed = false;
+            }
+        }
+    }
+    return passed;
+}
+
+static bool validate_meshlets(const MeshData& mesh, const Submesh& submesh) {
+    const VertexData* vertices = mesh.vertices.data() + submesh.vertex_offset;
+    const Uint32* indices = mesh.indices.data() + submesh.first_index;
+    std::vector<Uint32> seen(submesh.vertex_count, UINT32_MAX);
+    Uint32 nextIndex = 0;
+    bool passed = true;
+
+    for (Uint32 m = 0; m < submesh.meshlet_count; ++m) {
+        const Meshlet& meshlet = mesh.meshlets[submesh.first_meshlet + m];
+        Uint32 unique = 0;
+        for (Uint32 i = 0; i < meshlet.index_count; ++i) {
+            Uint32 index = indices[meshlet.first_index + i];
+            if (seen[index] != m) {
+                seen[index] = m;
+                unique++;
+            }
+            const Vec3& p = vertices[index].position;
+            float dx = p.x - meshlet.center.x, dy = p.y - meshlet.center.y, dz = p.z - meshlet.center.z;
+            if (std::sqrt(dx * dx + dy * dy + dz * dz) > meshlet.radius * (1.0f + VALIDATE_EPSILON) + VALIDATE_EPSILON) {
+                printf("  meshlet %u: vertex %u outside its bounding sphere\n", m, index);
+                passed = false;
+                break;
+            }
+        }
+        // Clusters have to tile the submesh's index range in order
+        if (meshlet.first_index != nextIndex || meshlet.index_count % 3 != 0) {
+            printf("  meshlet %u: index range %u+%u does not follow the previous one at %u\n", m, meshlet.first_index, meshlet.index_count, nextIndex);
+            passed = false;
+        }
+        if (unique != meshlet.vertex_count || unique > MESHLET_MAX_VERTICES || meshlet.index_count / 3 > MESHLET_MAX_TRIANGLES) {
+            printf("  meshlet %u: %u vertices (%u stored), %u triangles exceed the limits\n", m, unique, meshlet.vertex_count, meshlet.index_count / 3);
+            passed = false;
+        }
+        nextIndex = meshlet.first_index + meshlet.index_count;
+    }
+    if (nextIndex != submesh.index_count) {
+        printf("  meshlets cover %u of %u indices\n", nextIndex, submesh.index_count);
+        passed = false;
+    }
+    return passed;
+}
+
+// A cone rejection is wrong if any triangle with area could face the eye
+static bool validate_backfacing(const MeshData& mesh, const Submesh& submesh, const Meshlet& meshlet, const Vec3& eye) {
+    const VertexData* vertices = mesh.vertices.data() + submesh.vertex_offset;
+    const Uint32* indices = mesh.indices.data() + submesh.first_index + meshlet.first_index;
+    for (Uint32 i = 0; i < meshlet.index_count; i += 3) {
+        glm::vec3 p0(vertices[indices[i]].position.x, vertices[indices[i]].position.y, vertices[indices[i]].position.z);
+        glm::vec3 p1(vertices[indices[i + 1]].position.x, vertices[indices[i + 1]].position.y, vertices[indices[i + 1]].position.z);
+        glm::vec3 p2(vertices[indices[i + 2]].position.x, vertices[indices[i + 2]].position.y, vertices[indices[i + 2]].position.z);
+        glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+        glm::vec3 view = p0 - glm::vec3(eye.x, eye.y, eye.z);
+        float length = glm::length(n) * glm::length(view);
+        if (length > 0.0f && glm::dot(n, view) < -VALIDATE_EPSILON * length) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    const char* input = NULL;
+    Uint32 views = 64;
+    bool validate = false;
+    for (int i = 1; i < argc; ++i) {
+        if (SDL_strcmp(argv[i], "--views") == 0 && i + 1 < argc) {
+            // SDL_max evaluates its arguments twice
+            views = (Uint32)SDL_max(SDL_atoi(argv[i + 1]), 1);
+            i++;
+        } else if (SDL_strcmp(argv[i], "--validate") == 0) {
+            validate = true;
+        } else {
+            input = argv[i];
+        }
+    }
+    if (input == NULL) {
+        fprintf(stderr, "usage: meshlet_tool <model> [--views N] [--validate]\n");
+        return 1;
+    }
+
+    MeshData mesh = load_model(input);
+    if (mesh.vertices.empty() || mesh.indices.empty()) {
+        return 1;
+    }
+    optimize_mesh(mesh);
+
+    bool passed = true;
+    Vec3 lo = mesh.submeshes[0].bounds_min, hi = mesh.submeshes[0].bounds_max;
+    size_t triangles = 0;
+    for (const Submesh& submesh : mesh.submeshes) {
+        triangles += submesh.index_count / 3;
+    }
+    printf("%s: %zu submeshes, %zu triangles, %zu clusters (limits %u vertices, %u triangles)\n", input,
+        mesh.submeshes.size(), triangles, mesh.meshlets.size(), MESHLET_MAX_VERTICES, MESHLET_MAX_TRIANGLES);
+    for (size_t s = 0; s < mesh.submeshes.size(); ++s) {
+        const Submesh& submesh = mesh.submeshes[s];
+        const Meshlet* meshlets = mesh.meshlets.data() + submesh.first_meshlet;
+        MeshletStats stats = analyze_meshlets(meshlets, submesh.meshlet_count);
+        Uint32 minTriangles = UINT32_MAX, maxTriangles = 0;
+        float radius = 0.0f;
+        for (Uint32 m = 0; m < submesh.meshlet_count; ++m) {
+            minTriangles = SDL_min(minTriangles, meshlets[m].index_count / 3);
+            maxTriangles = SDL_max(maxTriangles, meshlets[m].index_count / 3);
+            radius += meshlets[m].radius;
+        }
+        if (stats.meshlets > 0) {
+            printf("  submesh %zu: %u clusters, triangles %u-%u (%.1f avg, %.0f%% full), vertices %.1f avg (%.0f%% full), "
+                "radius %.3f of the submesh's, %.0f%% with a normal cone\n", s, stats.meshlets, minTriangles, maxTriangles,
+                (float)stats.triangles / stats.meshlets, 100.0f * stats.triangles / (stats.meshlets * MESHLET_MAX_TRIANGLES),
+                (float)stats.vertices / stats.meshlets, 100.0f * stats.vertices / (stats.meshlets * MESHLET_MAX_VERTICES),
+                submesh.sphere_radius > 0.0f ? radius / stats.meshlets / submesh.sphere_radius : 0.0f, 100.0f * stats.cones / stats.meshlets);
+        }
+        for (Uint32 l = 1; l < submesh.lod_count; ++l) {
+            printf("  submesh %zu LOD %u: %u triangles (%.1f%%), error %g (%.3f%% of the radius)\n", s, l,
+                submesh.lods[l].index_count / 3, 100.0f * submesh.lods[l].index_count / SDL_max(submesh.index_count, 1u),
+                submesh.lods[l].error, submesh.sphere_radius > 0.0f ? 100.0f * submesh.lods[l].error / submesh.sphere_radius : 0.0f);
+        }
+        if (validate && !(validate_meshlets(mesh, submesh) && validate_lods(mesh, submesh))) {
+            printf("  submesh %zu: FAIL\n", s);
+            passed = false;
+        }
+        lo = { SDL_min(lo.x, submesh.bounds_min.x), SDL_min(lo.y, submesh.bounds_min.y), SDL_min(lo.z, submesh.bounds_min.z) };
+        hi = { SDL_max(hi.x, submesh.bounds_max.x), SDL_max(hi.y, submesh.bounds_max.y), SDL_max(hi.z, submesh.bounds_max.z) };
+    }
+
+    // Cameras on a Fibonacci sphere around the whole mesh
+    const glm::vec3 center((lo.x + hi.x) * 0.5f, (lo.y + hi.y) * 0.5f, (lo.z + hi.z) * 0.5f);
+    const float radius = SDL_max(glm::length(glm::vec3(hi.x, hi.y, hi.z) - center), 1e-6f);
+    const glm::mat4 projection = glm::perspectiveRH_ZO(glm::radians(60.0f), 1.0f, radius * 0.01f, radius * 10.0f);
+    MeshletCullStats cullStats = {};
+    Uint64 backfacingTriangles = 0, totalTriangles = 0, badCones = 0;
+    std::vector<MeshletDraw> draws;
+    Uint64 drawCount = 0;
+    for (Uint32 v = 0; v < views; ++v) {
+        float y = 1.0f - 2.0f * (v + 0.5f) / views;
+        float ring = std::sqrt(SDL_max(0.0f, 1.0f - y * y));
+        float phi = v * 2.39996323f;
+        const glm::vec3 direction(std::cos(phi) * ring, y, std::sin(phi) * ring);
+        const glm::vec3 eye = center + direction * radius * 2.5f;
+        const glm::vec3 up = std::fabs(direction.y) > 0.99f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+        const Frustum frustum = extract_frustum(projection * glm::lookAt(eye, center, up));
+        const Vec3 eyePosition = { eye.x, eye.y, eye.z };
+
+        for (const Submesh& submesh : mesh.submeshes) {
+            const Meshlet* meshlets = mesh.meshlets.data() + submesh.first_meshlet;
+            draws.clear();
+            drawCount += cull_meshlets(meshlets, submesh.meshlet_count, frustum, eyePosition, draws, cullStats);
+
+            // The best any per-triangle backface test could do, for comparison
+            const VertexData* vertices = mesh.vertices.data() + submesh.vertex_offset;
+            const Uint32* indices = mesh.indices.data() + submesh.first_index;
+            for (Uint32 i = 0; i < submesh.index_count; i += 3) {
+                glm::vec3 p0(vertices[indices[i]].position.x, vertices[indices[i]].position.y, vertices[indices[i]].position.z);
+                glm::vec3 p1(vertices[indices[i + 1]].position.x, vertices[indices[i + 1]].position.y, vertices[indices[i + 1]].position.z);
+                glm::vec3 p2(vertices[indices[i + 2]].position.x, vertices[indices[i + 2]].position.y, vertices[indices[i + 2]].position.z);
+                backfacingTriangles += glm::dot(glm::cross(p1 - p0, p2 - p0), p0 - eye) >= 0.0f ? 1 : 0;
+                totalTriangles++;
+            }
+
+            for (Uint32 m = 0; m < submesh.meshlet_count && validate; ++m) {
+                if (classify_meshlet(meshlets[m], frustum, eyePosition) == MESHLET_BACKFACING
+                    && !validate_backfacing(mesh, submesh, meshlets[m], eyePosition)) {
+                    badCones++;
+                }
+            }
+        }
+    }
+
+    printf("Culling over %u views: %.1f%% of clusters outside the frustum, %.1f%% rejected by their cone, "
+        "%.1f%% of triangles drawn in %.1f draws per view\n", views,
+        100.0 * cullStats.frustum_culled / SDL_max(cullStats.meshlets, 1ull),
+        100.0 * cullStats.backface_culled / SDL_max(cullStats.meshlets, 1ull),
+        100.0 * cullStats.triangles_drawn / SDL_max(cullStats.triangles, 1ull), (double)drawCount / views);
+    printf("Cone rejection removes %.1f%% of triangles; per-triangle backface culling would remove %.1f%%\n",
+        100.0 * cullStats.triangles_backfacing / SDL_max(cullStats.triangles, 1ull), 100.0 * backfacingTriangles / SDL_max(totalTriangles, 1ull));
+    if (validate && badCones > 0) {
+        printf("FAIL: %llu cone rejections hid front-facing triangles\n", (unsigned long long)badCones);
+        passed = false;
+    }
+    if (validate) {
+        printf("%s\n", passed ? "Validation passed" : "Validation FAILED");
+    }
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,449 @@
+﻿// Renderer benchmark suite: times the CPU hot paths on synthetic, seeded data sets from 1K to 10M
+// elements and prints one JSON object per line for every benchmark and size, so runs on two commits
+// can be compared without a GPU.
+//
+//   renderer_bench [--filter NAME] [--max-elements N] [--min-time SECONDS] [--output PATH]
+//                  [--compare BASELINE] [--threshold PERCENT]
+//
+// --filter runs the benchmarks whose name contains NAME. --compare reads the lines an earlier run wrote
+// and fails when a benchmark's median time grew by more than --threshold percent (10 by default).
+// Benchmarks stop below 10M where that size would need more than about a gigabyte.
+#include <stdio.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <SDL3/SDL.h>
+#include <glm/glm.hpp>
+#include <glm/ext/matrix_clip_space.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include "mesh.h"
+#include "vertex_format.h"
+#include "transform_batch.h"
+#include "culling.h"
+#include "render_queue.h"
+#include "texture.h"
+#include "texture_codec.h"
+#include "thread_pool.h"
+
+#define BENCH_MIN_ELEMENTS 1000u
+#define BENCH_MAX_ELEMENTS 10000000u
+#define BENCH_MIN_ITERATIONS 3
+#define BENCH_MAX_ITERATIONS 10000
+#define BENCH_MESH_PATH "renderer_bench.tmp.obj"
+
+struct BenchOptions {
+    double min_time;  // seconds each benchmark and size is repeated for
+    ThreadPool* pool;
+};
+
+struct BenchResult {
+    std::string name;
+    Uint32 elements;
+    Uint32 iterations;
+    double min_ms;
+    double median_ms;
+    Uint64 bytes; // touched per iteration, 0 when throughput is not meaningful
+};
+
+// The suite's only source of randomness, so every run sees the same data
+struct Lcg {
+    Uint32 state = 12345;
+    Uint32 next() {
+        state = state * 1664525u + 1013904223u;
+        return state >> 8;
+    }
+    // [-1, 1)
+    float unit() {
+        return (float)next() / 16777216.0f * 2.0f - 1.0f;
+    }
+};
+
+// Keeps results alive so the optimizer cannot drop the work producing them
+static volatile Uint64 benchSink = 0;
+
+// Repeats run for at least min_time and BENCH_MIN_ITERATIONS, after one untimed warm-up
+template <typename Run>
+static BenchResult measure(const char* name, Uint32 elements, Uint64 bytes, const BenchOptions& options, Run&& run) {
+    run();
+    const double toMs = 1000.0 / SDL_GetPerformanceFrequency();
+    std::vector<double> times;
+    double total = 0.0;
+    while ((int)times.size() < BENCH_MIN_ITERATIONS || (total < options.min_time * 1000.0 && times.size() < BENCH_MAX_ITERATIONS)) {
+        Uint64 start = SDL_GetPerformanceCounter();
+        run();
+        times.push_back((SDL_GetPerformanceCounter() - start) * toMs);
+        total += times.back();
+    }
+    std::sort(times.begin(), times.end());
+
+    BenchResult result = {};
+    result.name = name;
+    result.elements = elements;
+    result.iterations = (Uint32)times.size();
+    result.min_ms = times.front();
+    result.median_ms = times[times.size() / 2];
+    result.bytes = bytes;
+    return result;
+}
+
+// A flat side x side vertex grid with two triangles per cell, elements vertices in total
+static MeshData grid_mesh(Uint32 elements) {
+    const Uint32 side = SDL_max((Uint32)std::sqrt((double)elements), 2u);
+    Lcg random;
+    MeshData mesh;
+    mesh.vertices.resize((size_t)side * side);
+    for (Uint32 y = 0; y < side; ++y) {
+        for (Uint32 x = 0; x < side; ++x) {
+            VertexData& vertex = mesh.vertices[(size_t)y * side + x];
+            vertex.position = { (float)x, random.unit() * 0.25f, (float)y };
+            vertex.texcoord = { (float)x / (side - 1), (float)y / (side - 1) };
+            vertex.color = { 1.0f, 1.0f, 1.0f, 1.0f };
+        }
+    }
+    mesh.indices.reserve((size_t)(side - 1) * (side - 1) * 6);
+    for (Uint32 y = 0; y + 1 < side; ++y) {
+        for (Uint32 x = 0; x + 1 < side; ++x) {
+            const Uint32 i = y * side + x;
+            mesh.indices.insert(mesh.indices.end(), { i, i + side, i + 1, i + 1, i + side, i + side + 1 });
+        }
+    }
+    Submesh submesh = {};
+    submesh.index_count = (Uint32)mesh.indices.size();
+    submesh.vertex_count = (Uint32)mesh.vertices.size();
+    submesh.index_size = sizeof(Uint32);
+    mesh.submeshes.push_back(submesh);
+    return mesh;
+}
+
+static void random_transforms(TransformSoA& transforms, Uint32 count) {
+    resize_transforms(transforms, count);
+    Lcg random;
+    for (Uint32 i = 0; i < count; ++i) {
+        glm::quat q = glm::normalize(glm::quat(random.unit(), random.unit(), random.unit(), random.unit()));
+        transforms.position_x[i] = random.unit() * 500.0f;
+        transforms.position_y[i] = random.unit() * 500.0f;
+        transforms.position_z[i] = random.unit() * 500.0f;
+        transforms.rotation_x[i] = q.x;
+        transforms.rotation_y[i] = q.y;
+        transforms.rotation_z[i] = q.z;
+        transforms.rotation_w[i] = q.w;
+        transforms.scale_x[i] = 1.0f + random.unit() * 0.5f;
+        transforms.scale_y[i] = 1.0f + random.unit() * 0.5f;
+        transforms.scale_z[i] = 1.0f + random.unit() * 0.5f;
+    }
+}
+
+// Square RGBA8 image of about elements pixels, its side a multiple of the 4x4 block size
+static std::vector<Uint8> noise_image(Uint32 elements, Uint32& side) {
+    side = SDL_max(((Uint32)std::sqrt((double)elements) + 3) & ~3u, 4u);
+    Lcg random;
+    std::vector<Uint8> rgba((size_t)side * side * 4);
+    for (Uint32 y = 0; y < side; ++y) {
+        for (Uint32 x = 0; x < side; ++x) {
+            Uint8* pixel = &rgba[((size_t)y * side + x) * 4];
+            // Gradients with a little noise, closer to a photo than pure noise
+            pixel[0] = (Uint8)((x * 255 / side + random.next() % 16) & 0xFF);
+            pixel[1] = (Uint8)((y * 255 / side + random.next() % 16) & 0xFF);
+            pixel[2] = (Uint8)(((x + y) * 127 / side) & 0xFF);
+            pixel[3] = 255;
+        }
+    }
+    return rgba;
+}
+
+static const glm::mat4 benchProjection = glm::perspectiveRH_ZO(glm::radians(70.0f), 4.0f / 3.0f, 0.1f, 1000.0f);
+
+static BenchResult bench_load_model(const BenchOptions& options, Uint32 elements) {
+    // Assimp only imports from files, so the grid goes through a temporary OBJ
+    const MeshData grid = grid_mesh(elements);
+    std::string obj;
+    obj.reserve(grid.vertices.size() * 48 + grid.indices.size() * 8);
+    char line[128];
+    for (const VertexData& vertex : grid.vertices) {
+        SDL_snprintf(line, sizeof(line), "v %g %g %g\nvt %g %g\n", vertex.position.x, vertex.position.y, vertex.position.z,
+            vertex.texcoord.x, vertex.texcoord.y);
+        obj += line;
+    }
+    for (size_t i = 0; i < grid.indices.size(); i += 3) {
+        const Uint32 a = grid.indices[i] + 1, b = grid.indices[i + 1] + 1, c = grid.indices[i + 2] + 1;
+        SDL_snprintf(line, sizeof(line), "f %u/%u %u/%u %u/%u\n", a, a, b, b, c, c);
+        obj += line;
+    }
+    if (!SDL_SaveFile(BENCH_MESH_PATH, obj.data(), obj.size())) {
+        fprintf(stderr, "ERROR: SDL_SaveFile(%s) failed: %s\n", BENCH_MESH_PATH, SDL_GetError());
+    }
+    BenchResult result = measure("load_model", (Uint32)grid.vertices.size(), obj.size(), options, [&]() {
+        benchSink = benchSink + load_model(BENCH_MESH_PATH).vertices.size();
+    });
+    SDL_RemovePath(BENCH_MESH_PATH);
+    return result;
+}
+
+static BenchResult bench_pack_vertices(const BenchOptions& options, Uint32 elements) {
+    const MeshData mesh = grid_mesh(elements);
+    const VertexQuantization quantization = compute_vertex_quantization(mesh);
+    return measure("pack_vertices", (Uint32)mesh.vertices.size(), mesh.vertices.size() * sizeof(VertexData), options, [&]() {
+        benchSink = benchSink + pack_vertices(mesh, VERTEX_FORMAT_PACKED, quantization).size();
+    });
+}
+
+static BenchResult bench_transform_batch(const BenchOptions& options, Uint32 elements, ThreadPool* pool, const char* name) {
+    TransformSoA transforms;
+    random_transforms(transforms, elements);
+    std::vector<glm::mat4> matrices(elements);
+    return measure(name, elements, (Uint64)elements * sizeof(glm::mat4), options, [&]() {
+        transform_batch(pool, transforms, TRANSFORM_OUTPUT_MAT4, &benchProjection, matrices.data());
+    });
+}
+
+static BenchResult bench_transform_batch_single(const BenchOptions& options, Uint32 elements) {
+    return bench_transform_batch(options, elements, NULL, "transform_batch");
+}
+
+static BenchResult bench_transform_batch_pool(const BenchOptions& options, Uint32 elements) {
+    return bench_transform_batch(options, elements, options.pool, "transform_batch_pool");
+}
+
+static BenchResult bench_cull_spheres(const BenchOptions& options, Uint32 elements) {
+    SphereSoA spheres;
+    resize_spheres(spheres, elements);
+    Lcg random;
+    for (Uint32 i = 0; i < elements; ++i) {
+        spheres.center_x[i] = random.unit() * 500.0f;
+        spheres.center_y[i] = random.unit() * 500.0f;
+        spheres.center_z[i] = random.unit() * 500.0f;
+        spheres.radius[i] = 1.0f + std::fabs(random.unit()) * 4.0f;
+    }
+    const Frustum frustum = extract_frustum(benchProjection);
+    const CullKernel kernel = best_cull_kernel();
+    std::vector<Uint32> visible(elements);
+    return measure("cull_spheres", elements, 0, options, [&]() {
+        benchSink = benchSink + cull_spheres(kernel, frustum, spheres, visible.data());
+    });
+}
+
+// What cull_instances does per submesh: bounds into world space, frustum test, survivors gathered
+static BenchResult bench_cull_instances(const BenchOptions& options, Uint32 elements) {
+    TransformSoA transforms;
+    random_transforms(transforms, elements);
+    const Frustum frustum = extract_frustum(benchProjection);
+    const CullKernel kernel = best_cull_kernel();
+    SphereSoA spheres;
+    std::vector<Uint32> indices;
+    TransformSoA visible;
+    return measure("cull_instances", elements, 0, options, [&]() {
+        transform_spheres(transforms, { 0.0f, 0.5f, 0.0f }, 1.0f, spheres);
+        indices.resize(elements);
+        indices.resize(cull_spheres(kernel, frustum, spheres, indices.data()));
+        gather_transforms(transforms, indices.data(), (Uint32)indices.size(), visible);
+        benchSink = benchSink + indices.size();
+    });
+}
+
+static BenchResult bench_sort_render_queue(const BenchOptions& options, Uint32 elements) {
+    // The same scene shape benchmark_render_queue uses: a few pipelines, many materials, meshes over a few buffers
+    const Uint32 pipelineCount = 8;
+    const Uint32 materialCount = 256;
+    const Uint32 meshCount = 64;
+    Lcg random;
+    RenderQueue* queue = create_render_queue();
+    for (Uint32 i = 0; i < pipelineCount; ++i) {
+        render_queue_pipeline(queue, (SDL_GPUGraphicsPipeline*)(uintptr_t)(i + 1));
+    }
+    for (Uint32 i = 0; i < materialCount; ++i) {
+        SDL_GPUTextureSamplerBinding binding = {};
+        binding.texture = (SDL_GPUTexture*)(uintptr_t)(i + 1);
+        render_queue_material(queue, binding);
+    }
+    for (Uint32 i = 0; i < elements; ++i) {
+        DrawItem item = {};
+        item.pipeline = random.next() % pipelineCount;
+        item.material = random.next() % materialCount;
+        item.vertex_buffers[0].buffer = (SDL_GPUBuffer*)(uintptr_t)(random.next() % meshCount / 16 + 1);
+        item.vertex_buffer_count = 1;
+        item.index_buffer.buffer = item.vertex_buffers[0].buffer;
+        item.num_indices = 3;
+        item.num_instances = 1;
+        item.key = render_key(0, item.pipeline, item.material, 1.0f + (float)(random.next() % 1000));
+        queue_draw(queue, item);
+    }
+    RenderQueueStats stats = {};
+    BenchResult result = measure("sort_render_queue", elements, 0, options, [&]() {
+        sort_render_queue(queue, stats);
+    });
+    destroy_render_queue(queue);
+    return result;
+}
+
+static BenchResult bench_decode_texture(const BenchOptions& options, Uint32 elements, TextureCodec codec, const char* name) {
+    Uint32 side = 0;
+    const std::vector<Uint8> rgba = noise_image(elements, side);
+    std::vector<Uint8> blocks(texture_codec_level_size(codec, side, side));
+    encode_texture_level(codec, rgba.data(), side, side, blocks.data());
+    std::vector<Uint8> decoded(rgba.size());
+    return measure(name, side * side, decoded.size(), options, [&]() {
+        decode_texture_level(codec, blocks.data(), side, side, decoded.data());
+    });
+}
+
+static BenchResult bench_decode_bc1(const BenchOptions& options, Uint32 elements) {
+    return bench_decode_texture(options, elements, TEXTURE_CODEC_BC1, "decode_bc1");
+}
+
+static BenchResult bench_decode_bc7(const BenchOptions& options, Uint32 elements) {
+    return bench_decode_texture(options, elements, TEXTURE_CODEC_BC7, "decode_bc7");
+}
+
+static BenchResult bench_mip_chain(const BenchOptions& options, Uint32 elements) {
+    Uint32 side = 0;
+    const std::vector<Uint8> rgba = noise_image(elements, side);
+    const Uint32 levels = mip_level_count(side, side);
+    return measure("generate_mip_chain", side * side, rgba.size(), options, [&]() {
+        benchSink = benchSink + generate_mip_chain(rgba.data(), side, side, levels).data.size();
+    });
+}
+
+// One instance matrix per element, the copy upload_instance_data makes into mapped upload memory
+static BenchResult bench_staging_memcpy(const BenchOptions& options, Uint32 elements) {
+    const size_t size = (size_t)elements * sizeof(glm::mat4);
+    std::vector<Uint8> source(size), staging(size);
+    Lcg random;
+    for (size_t i = 0; i < size; i += 4) {
+        const Uint32 value = random.next();
+        std::memcpy(&source[i], &value, sizeof(value));
+    }
+    return measure("staging_memcpy", elements, size, options, [&]() {
+        std::memcpy(staging.data(), source.data(), size);
+        benchSink = benchSink + staging[size - 1];
+    });
+}
+
+struct Benchmark {
+    const char* name;
+    Uint32 max_elements; // keeps the largest data set near a gigabyte
+    BenchResult (*run)(const BenchOptions& options, Uint32 elements);
+};
+
+static const Benchmark benchmarks[] = {
+    { "load_model", 1000000, bench_load_model },
+    { "pack_vertices", BENCH_MAX_ELEMENTS, bench_pack_vertices },
+    { "transform_batch", 1000000, bench_transform_batch_single },
+    { "transform_batch_pool", 1000000, bench_transform_batch_pool },
+    { "cull_spheres", BENCH_MAX_ELEMENTS, bench_cull_spheres },
+    { "cull_instances", 1000000, bench_cull_instances },
+    { "sort_render_queue", 1000000, bench_sort_render_queue },
+    { "decode_bc1", BENCH_MAX_ELEMENTS, bench_decode_bc1 },
+    { "decode_bc7", BENCH_MAX_ELEMENTS, bench_decode_bc7 },
+    { "generate_mip_chain", BENCH_MAX_ELEMENTS, bench_mip_chain },
+    { "staging_memcpy", 1000000, bench_staging_memcpy },
+};
+
+static std::string result_json(const BenchResult& result) {
+    char line[512];
+    int length = SDL_snprintf(line, sizeof(line), "{\"benchmark\":\"%s\",\"elements\":%u,\"iterations\":%u,\"min_ms\":%.6f,\"median_ms\":%.6f,\"ns_per_element\":%.3f",
+        result.name.c_str(), result.elements, result.iterations, result.min_ms, result.median_ms, result.median_ms * 1e6 / result.elements);
+    if (result.bytes > 0) {
+        length += SDL_snprintf(line + length, sizeof(line) - length, ",\"mb_per_s\":%.1f", result.bytes / (result.median_ms * 1000.0));
+    }
+    SDL_snprintf(line + length, sizeof(line) - length, "}\n");
+    return line;
+}
+
+// Compares medians against the lines of an earlier run; returns false on a regression
+static bool compare_results(const char* baseline_path, const std::vector<BenchResult>& results, double threshold) {
+    size_t size = 0;
+    char* baseline = (char*)SDL_LoadFile(baseline_path, &size);
+    if (baseline == NULL) {
+        fprintf(stderr, "ERROR: SDL_LoadFile(%s) failed: %s\n", baseline_path, SDL_GetError());
+        return false;
+    }
+    bool passed = true;
+    Uint32 compared = 0;
+    for (char* line = baseline; line && *line;) {
+        char* next = std::strchr(line, '\n');
+        if (next) {
+            *next++ = '\0';
+        }
+        char name[64];
+        Uint32 elements = 0, iterations = 0;
+        double minMs = 0.0, medianMs = 0.0;
+        if (sscanf(line, "{\"benchmark\":\"%63[^\"]\",\"elements\":%u,\"iterations\":%u,\"min_ms\":%lf,\"median_ms\":%lf",
+            name, &elements, &iterations, &minMs, &medianMs) == 5) {
+            for (const BenchResult& result : results) {
+                if (result.name != name || result.elements != elements) {
+                    continue;
+                }
+                const double change = (result.median_ms / medianMs - 1.0) * 100.0;
+                const bool regressed = change > threshold;
+                fprintf(stderr, "%-22s %9u: %10.4f ms -> %10.4f ms (%+6.1f%%)%s\n", name, elements, medianMs, result.median_ms, change,
+                    regressed ? "  REGRESSION" : "");
+                passed &= !regressed;
+                compared++;
+            }
+        }
+        line = next;
+    }
+    SDL_free(baseline);
+    fprintf(stderr, "%u results compared, %s\n", compared, passed ? "no regressions" : "regressions found");
+    return passed;
+}
+
+int main(int argc, char* argv[]) {
+    const char* filter = NULL;
+    const char* outputPath = NULL;
+    const char* baselinePath = NULL;
+    Uint32 maxElements = BENCH_MAX_ELEMENTS;
+    double threshold = 10.0;
+    BenchOptions options = {};
+    options.min_time = 0.25;
+    for (int i = 1; i < argc; ++i) {
+        if (SDL_strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            filter = argv[++i];
+        } else if (SDL_strcmp(argv[i], "--max-elements") == 0 && i + 1 < argc) {
+            maxElements = (Uint32)SDL_max(SDL_atoi(argv[i + 1]), 1);
+            i++;
+        } else if (SDL_strcmp(argv[i], "--min-time") == 0 && i + 1 < argc) {
+            options.min_time = SDL_atof(argv[++i]);
+        } else if (SDL_strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            outputPath = argv[++i];
+        } else if (SDL_strcmp(argv[i], "--compare") == 0 && i + 1 < argc) {
+            baselinePath = argv[++i];
+        } else if (SDL_strcmp(argv[i], "--threshold") == 0 && i + 1 < argc) {
+            threshold = SDL_atof(argv[++i]);
+        } else {
+            fprintf(stderr, "usage: renderer_bench [--filter NAME] [--max-elements N] [--min-time SECONDS] [--output PATH]\n"
+                "                      [--compare BASELINE] [--threshold PERCENT]\n");
+            return 1;
+        }
+    }
+
+    options.pool = create_thread_pool(0);
+    fprintf(stderr, "Transform kernel %s, cull kernel %s, %d pool threads\n", transform_kernel_name(best_transform_kernel()),
+        cull_kernel_name(best_cull_kernel()), thread_pool_size(options.pool));
+    std::vector<BenchResult> results;
+    std::string json;
+    for (const Benchmark& benchmark : benchmarks) {
+        if (filter && !SDL_strstr(benchmark.name, filter)) {
+            continue;
+        }
+        for (Uint32 elements = BENCH_MIN_ELEMENTS; elements <= SDL_min(benchmark.max_elements, maxElements); elements *= 10) {
+            results.push_back(benchmark.run(options, elements));
+            const std::string line = result_json(results.back());
+            fputs(line.c_str(), stdout);
+            fflush(stdout);
+            json += line;
+        }
+    }
+    destroy_thread_pool(options.pool);
+
+    if (outputPath && !SDL_SaveFile(outputPath, json.data(), json.size())) {
+        fprintf(stderr, "ERROR: SDL_SaveFile(%s) failed: %s\n", outputPath, SDL_GetError());
+        return 1;
+    }
+    if (baselinePath && !compare_results(baselinePath, results, threshold)) {
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,133 @@
+﻿// Shader packer: every compiled stage in every format the build produced -> one .gpushaders library.
+//
+//   shader_packer <shader directory> [output]
+//
+// Packs each <name>.<format>.<stage> file in the directory, format one of spv, dxil, dxbc, msl or
+// metallib and stage one of vert, frag or comp, as the library entry <name>.<stage>. Resource counts
+// are reflected from the stage's SPIR-V and shared with its other formats, so every stage needs one.
+#include <stdio.h>
+#include <map>
+#include <string>
+#include <vector>
+#include <SDL3/SDL.h>
+#include "shader_library.h"
+
+struct ShaderFormatInfo {
+    const char* extension;
+    SDL_GPUShaderFormat format;
+    const char* entrypoint; // what the compiler names main
+};
+
+static const ShaderFormatInfo shaderFormats[] = {
+    { "spv", SDL_GPU_SHADERFORMAT_SPIRV, "main" },
+    { "dxil", SDL_GPU_SHADERFORMAT_DXIL, "main" },
+    { "dxbc", SDL_GPU_SHADERFORMAT_DXBC, "main" },
+    // SPIRV-Cross renames main, which is reserved in Metal
+    { "msl", SDL_GPU_SHADERFORMAT_MSL, "main0" },
+    { "metallib", SDL_GPU_SHADERFORMAT_METALLIB, "main0" },
+};
+
+static const char* format_name(SDL_GPUShaderFormat format) {
+    for (const ShaderFormatInfo& info : shaderFormats) {
+        if (info.format == format) {
+            return info.extension;
+        }
+    }
+    return "?";
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: shader_packer <shader directory> [output]\n");
+        return 1;
+    }
+    std::string directory = argv[1];
+    std::string output = argc > 2 ? argv[2] : directory + "/shaders" SHADER_LIBRARY_EXTENSION;
+
+    int count = 0;
+    char** files = SDL_GlobDirectory(directory.c_str(), "*.*.*", 0, &count);
+    if (files == NULL) {
+        fprintf(stderr, "ERROR: SDL_GlobDirectory(%s) failed: %s\n", directory.c_str(), SDL_GetError());
+        return 1;
+    }
+
+    std::vector<ShaderBlob> blobs;
+    for (int i = 0; i < count; ++i) {
+        std::string file = files[i];
+        size_t stageDot = file.find_last_of('.');
+        size_t formatDot = file.find_last_of('.', stageDot - 1);
+        Uint32 stage;
+        if (formatDot == std::string::npos || !parse_shader_stage(file.c_str() + stageDot + 1, stage)) {
+            continue;
+        }
+        // Sources (.glsl.) and anything else without a known format stay out
+        std::string extension = file.substr(formatDot + 1, stageDot - formatDot - 1);
+        const ShaderFormatInfo* format = NULL;
+        for (const ShaderFormatInfo& info : shaderFormats) {
+            if (extension == info.extension) {
+                format = &info;
+            }
+        }
+        if (format == NULL) {
+            continue;
+        }
+
+        std::string path = directory + "/" + file;
+        size_t codeSize;
+        void* code = SDL_LoadFile(path.c_str(), &codeSize);
+        if (code == NULL) {
+            fprintf(stderr, "ERROR: SDL_LoadFile(%s) failed: %s\n", path.c_str(), SDL_GetError());
+            SDL_free(files);
+            return 1;
+        }
+        ShaderBlob blob = {};
+        blob.name = file.substr(0, formatDot) + file.substr(stageDot);
+        blob.entrypoint = format->entrypoint;
+        blob.stage = stage;
+        blob.format = format->format;
+        blob.code.assign((const Uint8*)code, (const Uint8*)code + codeSize);
+        SDL_free(code);
+        blobs.push_back(std::move(blob));
+    }
+    SDL_free(files);
+
+    // Reflect every stage's SPIR-V and hand the counts to its other formats
+    std::map<std::string, ShaderReflection> reflections;
+    for (const ShaderBlob& blob : blobs) {
+        if (blob.format != SDL_GPU_SHADERFORMAT_SPIRV) {
+            continue;
+        }
+        ShaderReflection reflection;
+        if (!reflect_spirv(blob.code.data(), blob.code.size(), reflection)) {
+            fprintf(stderr, "ERROR: %s is not valid SPIR-V\n", blob.name.c_str());
+            return 1;
+        }
+        if (blob.stage == SHADER_STAGE_COMPUTE && reflection.threadcount[0] == 0) {
+            fprintf(stderr, "ERROR: %s has no local size\n", blob.name.c_str());
+            return 1;
+        }
+        reflections[blob.name] = reflection;
+    }
+    for (ShaderBlob& blob : blobs) {
+        auto reflection = reflections.find(blob.name);
+        if (reflection == reflections.end()) {
+            fprintf(stderr, "ERROR: %s has no SPIR-V to reflect its resources from\n", blob.name.c_str());
+            return 1;
+        }
+        blob.reflection = reflection->second;
+    }
+
+    if (!write_shader_library(output.c_str(), blobs)) {
+        return 1;
+    }
+    size_t total = 0;
+    for (const ShaderBlob& blob : blobs) {
+        const ShaderReflection& r = blob.reflection;
+        printf("  %-28s %-8s %6zu bytes  samplers %u, storage textures %u/%u, storage buffers %u/%u, uniform buffers %u\n",
+            blob.name.c_str(), format_name(blob.format), blob.code.size(), r.num_samplers, r.num_storage_textures,
+            r.num_readwrite_storage_textures, r.num_storage_buffers, r.num_readwrite_storage_buffers, r.num_uniform_buffers);
+        total += blob.code.size();
+    }
+    printf("%s: %zu shaders, %zu bytes of code\n", output.c_str(), blobs.size(), total);
+    return 0;
+}
@@ -0,0 +1,142 @@
+﻿// Offline texture cooker: PNG/JPG/... -> .gputex with a prebuilt, block-compressed mip chain.
+//
+//   texture_cooker <input> [output] [--codec bc1|bc3|bc7] [--verify] [--min-psnr dB] [--force]
+//
+// Without --codec, opaque images become BC1 and images with alpha BC7.
+// --verify decodes every level again and fails when its PSNR drops below --min-psnr.
+#include <stdio.h>
+#include <string>
+#include <SDL3/SDL.h>
+#include <stb/stb_image.h>
+#include "cooked_texture.h"
+
+static bool has_alpha(const Uint8* rgba, size_t pixels) {
+    for (size_t i = 0; i < pixels; ++i) {
+        if (rgba[i * 4 + 3] != 255) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool parse_codec(const char* name, TextureCodec& codec) {
+    const TextureCodec codecs[] = { TEXTURE_CODEC_RGBA8, TEXTURE_CODEC_BC1, TEXTURE_CODEC_BC3, TEXTURE_CODEC_BC7 };
+    for (TextureCodec candidate : codecs) {
+        if (SDL_strcmp(name, texture_codec_name(candidate)) == 0) {
+            codec = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool verify_cooked_texture(const char* path, const MipChain& chain, double min_psnr) {
+    CookedTexture cooked;
+    if (!open_cooked_texture(path, cooked)) {
+        return false;
+    }
+
+    bool passed = true;
+    for (Uint32 i = 0; i < cooked.header->num_levels; ++i) {
+        const MipLevel& level = cooked.levels[i];
+        std::vector<Uint8> decoded((size_t)level.width * level.height * 4);
+        decode_texture_level(cooked.codec, cooked.data + level.offset, level.width, level.height, decoded.data());
+
+        const Uint8* original = chain.data.data() + chain.levels[i].offset;
+        double rgb = texture_psnr(original, decoded.data(), level.width, level.height, false);
+        double rgba = texture_psnr(original, decoded.data(), level.width, level.height, true);
+        bool ok = rgb >= min_psnr;
+        printf("  level %2u %5ux%-5u PSNR rgb %6.2f dB, rgba %6.2f dB %s\n", i, level.width, level.height, rgb, rgba, ok ? "" : "FAIL");
+        passed = passed && ok;
+    }
+
+    close_cooked_texture(cooked);
+    return passed;
+}
+
+int main(int argc, char* argv[]) {
+    const char* input = NULL;
+    std::string output;
+    TextureCodec codec = TEXTURE_CODEC_RGBA8;
+    bool codecSet = false, verify = false, force = false;
+    double minPsnr = 30.0;
+
+    for (int i = 1; i < argc; ++i) {
+        if (SDL_strcmp(argv[i], "--codec") == 0 && i + 1 < argc) {
+            if (!parse_codec(argv[++i], codec)) {
+                fprintf(stderr, "ERROR: Unknown codec %s\n", argv[i]);
+                return 1;
+            }
+            codecSet = true;
+        } else if (SDL_strcmp(argv[i], "--verify") == 0) {
+            verify = true;
+        } else if (SDL_strcmp(argv[i], "--force") == 0) {
+            force = true;
+        } else if (SDL_strcmp(argv[i], "--min-psnr") == 0 && i + 1 < argc) {
+            minPsnr = SDL_atof(argv[++i]);
+        } else if (input == NULL) {
+            input = argv[i];
+        } else {
+            output = argv[i];
+        }
+    }
+
+    if (input == NULL) {
+        fprintf(stderr, "usage: texture_cooker <input> [output] [--codec bc1|bc3|bc7] [--verify] [--min-psnr dB] [--force]\n");
+        return 1;
+    }
+    if (output.empty()) {
+        output = input;
+        size_t dot = output.find_last_of('.');
+        if (dot != std::string::npos) {
+            output.erase(dot);
+        }
+        output += COOKED_TEXTURE_EXTENSION;
+    }
+
+    Uint64 sourceHash = hash_file(input);
+    int width, height;
+    stbi_uc* pixels = stbi_load(input, &width, &height, NULL, 4);
+    if (pixels == NULL || sourceHash == 0) {
+        fprintf(stderr, "ERROR: stbi_load(%s) failed: %s\n", input, stbi_failure_reason());
+        return 1;
+    }
+    if (!codecSet) {
+        codec = has_alpha(pixels, (size_t)width * height) ? TEXTURE_CODEC_BC7 : TEXTURE_CODEC_BC1;
+    }
+
+    MipChain chain = generate_mip_chain(pixels, width, height, mip_level_count(width, height));
+    stbi_image_free(pixels);
+
+    CookedTexture existing;
+    bool upToDate = false;
+    if (!force && open_cooked_texture(output.c_str(), existing)) {
+        upToDate = existing.header->source_hash == sourceHash && existing.codec == codec;
+        close_cooked_texture(existing);
+    }
+
+    if (upToDate) {
+        printf("%s is up to date\n", output.c_str());
+    } else {
+        Uint64 start = SDL_GetPerformanceCounter();
+        if (!write_cooked_texture(output.c_str(), sourceHash, codec, chain)) {
+            return 1;
+        }
+        double ms = (double)(SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency();
+
+        CookedTexture cooked;
+        if (!open_cooked_texture(output.c_str(), cooked)) {
+            return 1;
+        }
+        printf("%s: %dx%d, %u levels, %s, %zu -> %llu bytes (%.1fx) in %.1f ms\n", output.c_str(), width, height,
+            cooked.header->num_levels, texture_codec_name(codec), chain.data.size(),
+            (unsigned long long)cooked.header->data_size, (double)chain.data.size() / cooked.header->data_size, ms);
+        close_cooked_texture(cooked);
+    }
+
+    if (verify && !verify_cooked_texture(output.c_str(), chain, minPsnr)) {
+        fprintf(stderr, "ERROR: %s fails the %.1f dB round-trip threshold\n", output.c_str(), minPsnr);
+        return 1;
+    }
+    return 0;
+}
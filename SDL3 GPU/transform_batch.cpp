@@ -0,0 +1,416 @@
+﻿#include "transform_batch.h"
+#include <stdio.h>
+#include <cmath>
+#include <glm/ext/matrix_clip_space.hpp>
+#include <glm/ext/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <immintrin.h>
+#include <glm/simd/matrix.h>
+#define TRANSFORM_SSE2 1
+#endif
+
+// AVX2 and AVX-512 are compiled in on x64 and only called after a runtime CPU check
+#if defined(TRANSFORM_SSE2) && (defined(__x86_64__) || defined(_M_X64))
+#define TRANSFORM_AVX 1
+#if defined(_MSC_VER) && !defined(__clang__)
+#define TARGET_AVX2
+#define TARGET_AVX512
+#else
+#define TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define TARGET_AVX512 __attribute__((target("avx512f")))
+#endif
+#endif
+
+// Instances per thread job; large enough to amortize the hand-off
+#define TRANSFORM_GRAIN 4096
+
+void resize_transforms(TransformSoA& transforms, Uint32 count) {
+    transforms.position_x.resize(count, 0.0f);
+    transforms.position_y.resize(count, 0.0f);
+    transforms.position_z.resize(count, 0.0f);
+    transforms.rotation_x.resize(count, 0.0f);
+    transforms.rotation_y.resize(count, 0.0f);
+    transforms.rotation_z.resize(count, 0.0f);
+    transforms.rotation_w.resize(count, 1.0f);
+    transforms.scale_x.resize(count, 1.0f);
+    transforms.scale_y.resize(count, 1.0f);
+    transforms.scale_z.resize(count, 1.0f);
+}
+
+Uint32 transform_count(const TransformSoA& transforms) {
+    return (Uint32)transforms.position_x.size();
+}
+
+Uint32 transform_output_size(TransformOutput output) {
+    return output == TRANSFORM_OUTPUT_MAT4 ? 16 * sizeof(float) : 12 * sizeof(float);
+}
+
+TransformKernel best_transform_kernel() {
+#ifdef TRANSFORM_AVX
+    static const TransformKernel kernel = SDL_HasAVX512F() ? TRANSFORM_KERNEL_AVX512 :
+        SDL_HasAVX2() ? TRANSFORM_KERNEL_AVX2 : TRANSFORM_KERNEL_SSE2;
+    return kernel;
+#elif defined(TRANSFORM_SSE2)
+    return TRANSFORM_KERNEL_SSE2;
+#else
+    return TRANSFORM_KERNEL_SCALAR;
+#endif
+}
+
+const char* transform_kernel_name(TransformKernel kernel) {
+    switch (kernel) {
+    case TRANSFORM_KERNEL_SSE2:
+        return "SSE2";
+    case TRANSFORM_KERNEL_AVX2:
+        return "AVX2";
+    case TRANSFORM_KERNEL_AVX512:
+        return "AVX-512";
+    default:
+        return "scalar";
+    }
+}
+
+static void transform_scalar(const TransformSoA& t, Uint32 begin, Uint32 end, TransformOutput output, float* out) {
+    const Uint32 stride = transform_output_size(output) / sizeof(float);
+    for (Uint32 i = begin; i < end; ++i) {
+        float x = t.rotation_x[i], y = t.rotation_y[i], z = t.rotation_z[i], w = t.rotation_w[i];
+        float xx = 2.0f * x * x, yy = 2.0f * y * y, zz = 2.0f * z * z;
+        float xy = 2.0f * x * y, xz = 2.0f * x * z, yz = 2.0f * y * z;
+        float wx = 2.0f * w * x, wy = 2.0f * w * y, wz = 2.0f * w * z;
+        float sx = t.scale_x[i], sy = t.scale_y[i], sz = t.scale_z[i];
+
+        // m[column][row], as glm::mat3_cast with the scale folded into each column
+        float m[4][3] = {
+            { (1.0f - yy - zz) * sx, (xy + wz) * sx, (xz - wy) * sx },
+            { (xy - wz) * sy, (1.0f - xx - zz) * sy, (yz + wx) * sy },
+            { (xz + wy) * sz, (yz - wx) * sz, (1.0f - xx - yy) * sz },
+            { t.position_x[i], t.position_y[i], t.position_z[i] }
+        };
+
+        float* o = out + (size_t)i * stride;
+        if (output == TRANSFORM_OUTPUT_MAT4) {
+            for (int c = 0; c < 4; ++c) {
+                o[c * 4 + 0] = m[c][0];
+                o[c * 4 + 1] = m[c][1];
+                o[c * 4 + 2] = m[c][2];
+                o[c * 4 + 3] = c == 3 ? 1.0f : 0.0f;
+            }
+        } else {
+            for (int r = 0; r < 3; ++r) {
+                for (int c = 0; c < 4; ++c) {
+                    o[r * 4 + c] = m[c][r];
+                }
+            }
+        }
+    }
+}
+
+#ifdef TRANSFORM_SSE2
+// The twelve affine terms for 4 instances, one instance per lane
+struct AffineLanes {
+    __m128 m[4][3];
+};
+
+// Turns lane-per-instance terms into per-instance rows or columns and stores 4 instances
+static inline void store_affine4(const AffineLanes& a, TransformOutput output, float* out) {
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    if (output == TRANSFORM_OUTPUT_MAT4) {
+        for (int c = 0; c < 4; ++c) {
+            __m128 r0 = a.m[c][0], r1 = a.m[c][1], r2 = a.m[c][2], r3 = c == 3 ? one : zero;
+            _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+            _mm_storeu_ps(out + 0 * 16 + c * 4, r0);
+            _mm_storeu_ps(out + 1 * 16 + c * 4, r1);
+            _mm_storeu_ps(out + 2 * 16 + c * 4, r2);
+            _mm_storeu_ps(out + 3 * 16 + c * 4, r3);
+        }
+        return;
+    }
+    for (int r = 0; r < 3; ++r) {
+        __m128 c0 = a.m[0][r], c1 = a.m[1][r], c2 = a.m[2][r], c3 = a.m[3][r];
+        _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+        _mm_storeu_ps(out + 0 * 12 + r * 4, c0);
+        _mm_storeu_ps(out + 1 * 12 + r * 4, c1);
+        _mm_storeu_ps(out + 2 * 12 + r * 4, c2);
+        _mm_storeu_ps(out + 3 * 12 + r * 4, c3);
+    }
+}
+
+static void transform_sse2(const TransformSoA& t, Uint32 begin, Uint32 end, TransformOutput output, float* out) {
+    const Uint32 stride = transform_output_size(output) / sizeof(float);
+    const __m128 one = _mm_set1_ps(1.0f);
+    Uint32 i = begin;
+    for (; i + 4 <= end; i += 4) {
+        __m128 x = _mm_loadu_ps(&t.rotation_x[i]);
+        __m128 y = _mm_loadu_ps(&t.rotation_y[i]);
+        __m128 z = _mm_loadu_ps(&t.rotation_z[i]);
+        __m128 w = _mm_loadu_ps(&t.rotation_w[i]);
+        __m128 x2 = _mm_add_ps(x, x), y2 = _mm_add_ps(y, y), z2 = _mm_add_ps(z, z);
+        __m128 xx = _mm_mul_ps(x, x2), yy = _mm_mul_ps(y, y2), zz = _mm_mul_ps(z, z2);
+        __m128 xy = _mm_mul_ps(x, y2), xz = _mm_mul_ps(x, z2), yz = _mm_mul_ps(y, z2);
+        __m128 wx = _mm_mul_ps(w, x2), wy = _mm_mul_ps(w, y2), wz = _mm_mul_ps(w, z2);
+        __m128 sx = _mm_loadu_ps(&t.scale_x[i]);
+        __m128 sy = _mm_loadu_ps(&t.scale_y[i]);
+        __m128 sz = _mm_loadu_ps(&t.scale_z[i]);
+
+        AffineLanes a;
+        a.m[0][0] = _mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(yy, zz)), sx);
+        a.m[0][1] = _mm_mul_ps(_mm_add_ps(xy, wz), sx);
+        a.m[0][2] = _mm_mul_ps(_mm_sub_ps(xz, wy), sx);
+        a.m[1][0] = _mm_mul_ps(_mm_sub_ps(xy, wz), sy);
+        a.m[1][1] = _mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(xx, zz)), sy);
+        a.m[1][2] = _mm_mul_ps(_mm_add_ps(yz, wx), sy);
+        a.m[2][0] = _mm_mul_ps(_mm_add_ps(xz, wy), sz);
+        a.m[2][1] = _mm_mul_ps(_mm_sub_ps(yz, wx), sz);
+        a.m[2][2] = _mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(xx, yy)), sz);
+        a.m[3][0] = _mm_loadu_ps(&t.position_x[i]);
+        a.m[3][1] = _mm_loadu_ps(&t.position_y[i]);
+        a.m[3][2] = _mm_loadu_ps(&t.position_z[i]);
+        store_affine4(a, output, out + (size_t)i * stride);
+    }
+    transform_scalar(t, i, end, output, out);
+}
+#endif
+
+#ifdef TRANSFORM_AVX
+TARGET_AVX2 static void transform_avx2(const TransformSoA& t, Uint32 begin, Uint32 end, TransformOutput output, float* out) {
+    const Uint32 stride = transform_output_size(output) / sizeof(float);
+    const __m256 one = _mm256_set1_ps(1.0f);
+    Uint32 i = begin;
+    for (; i + 8 <= end; i += 8) {
+        __m256 x = _mm256_loadu_ps(&t.rotation_x[i]);
+        __m256 y = _mm256_loadu_ps(&t.rotation_y[i]);
+        __m256 z = _mm256_loadu_ps(&t.rotation_z[i]);
+        __m256 w = _mm256_loadu_ps(&t.rotation_w[i]);
+        __m256 x2 = _mm256_add_ps(x, x), y2 = _mm256_add_ps(y, y), z2 = _mm256_add_ps(z, z);
+        __m256 xx = _mm256_mul_ps(x, x2), yy = _mm256_mul_ps(y, y2), zz = _mm256_mul_ps(z, z2);
+        __m256 xy = _mm256_mul_ps(x, y2), xz = _mm256_mul_ps(x, z2), yz = _mm256_mul_ps(y, z2);
+        __m256 wx = _mm256_mul_ps(w, x2), wy = _mm256_mul_ps(w, y2), wz = _mm256_mul_ps(w, z2);
+        __m256 sx = _mm256_loadu_ps(&t.scale_x[i]);
+        __m256 sy = _mm256_loadu_ps(&t.scale_y[i]);
+        __m256 sz = _mm256_loadu_ps(&t.scale_z[i]);
+
+        __m256 m[4][3];
+        m[0][0] = _mm256_mul_ps(_mm256_sub_ps(one, _mm256_add_ps(yy, zz)), sx);
+        m[0][1] = _mm256_mul_ps(_mm256_add_ps(xy, wz), sx);
+        m[0][2] = _mm256_mul_ps(_mm256_sub_ps(xz, wy), sx);
+        m[1][0] = _mm256_mul_ps(_mm256_sub_ps(xy, wz), sy);
+        m[1][1] = _mm256_mul_ps(_mm256_sub_ps(one, _mm256_add_ps(xx, zz)), sy);
+        m[1][2] = _mm256_mul_ps(_mm256_add_ps(yz, wx), sy);
+        m[2][0] = _mm256_mul_ps(_mm256_add_ps(xz, wy), sz);
+        m[2][1] = _mm256_mul_ps(_mm256_sub_ps(yz, wx), sz);
+        m[2][2] = _mm256_mul_ps(_mm256_sub_ps(one, _mm256_add_ps(xx, yy)), sz);
+        m[3][0] = _mm256_loadu_ps(&t.position_x[i]);
+        m[3][1] = _mm256_loadu_ps(&t.position_y[i]);
+        m[3][2] = _mm256_loadu_ps(&t.position_z[i]);
+
+        AffineLanes low, high;
+        for (int c = 0; c < 4; ++c) {
+            for (int r = 0; r < 3; ++r) {
+                low.m[c][r] = _mm256_castps256_ps128(m[c][r]);
+                high.m[c][r] = _mm256_extractf128_ps(m[c][r], 1);
+            }
+        }
+        store_affine4(low, output, out + (size_t)i * stride);
+        store_affine4(high, output, out + (size_t)(i + 4) * stride);
+    }
+    transform_sse2(t, i, end, output, out);
+}
+
+TARGET_AVX512 static void transform_avx512(const TransformSoA& t, Uint32 begin, Uint32 end, TransformOutput output, float* out) {
+    const Uint32 stride = transform_output_size(output) / sizeof(float);
+    const __m512 one = _mm512_set1_ps(1.0f);
+    Uint32 i = begin;
+    for (; i + 16 <= end; i += 16) {
+        __m512 x = _mm512_loadu_ps(&t.rotation_x[i]);
+        __m512 y = _mm512_loadu_ps(&t.rotation_y[i]);
+        __m512 z = _mm512_loadu_ps(&t.rotation_z[i]);
+        __m512 w = _mm512_loadu_ps(&t.rotation_w[i]);
+        __m512 x2 = _mm512_add_ps(x, x), y2 = _mm512_add_ps(y, y), z2 = _mm512_add_ps(z, z);
+        __m512 xx = _mm512_mul_ps(x, x2), yy = _mm512_mul_ps(y, y2), zz = _mm512_mul_ps(z, z2);
+        __m512 xy = _mm512_mul_ps(x, y2), xz = _mm512_mul_ps(x, z2), yz = _mm512_mul_ps(y, z2);
+        __m512 wx = _mm512_mul_ps(w, x2), wy = _mm512_mul_ps(w, y2), wz = _mm512_mul_ps(w, z2);
+        __m512 sx = _mm512_loadu_ps(&t.scale_x[i]);
+        __m512 sy = _mm512_loadu_ps(&t.scale_y[i]);
+        __m512 sz = _mm512_loadu_ps(&t.scale_z[i]);
+
+        __m512 m[4][3];
+        m[0][0] = _mm512_mul_ps(_mm512_sub_ps(one, _mm512_add_ps(yy, zz)), sx);
+        m[0][1] = _mm512_mul_ps(_mm512_add_ps(xy, wz), sx);
+        m[0][2] = _mm512_mul_ps(_mm512_sub_ps(xz, wy), sx);
+        m[1][0] = _mm512_mul_ps(_mm512_sub_ps(xy, wz), sy);
+        m[1][1] = _mm512_mul_ps(_mm512_sub_ps(one, _mm512_add_ps(xx, zz)), sy);
+        m[1][2] = _mm512_mul_ps(_mm512_add_ps(yz, wx), sy);
+        m[2][0] = _mm512_mul_ps(_mm512_add_ps(xz, wy), sz);
+        m[2][1] = _mm512_mul_ps(_mm512_sub_ps(yz, wx), sz);
+        m[2][2] = _mm512_mul_ps(_mm512_sub_ps(one, _mm512_add_ps(xx, yy)), sz);
+        m[3][0] = _mm512_loadu_ps(&t.position_x[i]);
+        m[3][1] = _mm512_loadu_ps(&t.position_y[i]);
+        m[3][2] = _mm512_loadu_ps(&t.position_z[i]);
+
+        AffineLanes quarter[4];
+        for (int c = 0; c < 4; ++c) {
+            for (int r = 0; r < 3; ++r) {
+                quarter[0].m[c][r] = _mm512_extractf32x4_ps(m[c][r], 0);
+                quarter[1].m[c][r] = _mm512_extractf32x4_ps(m[c][r], 1);
+                quarter[2].m[c][r] = _mm512_extractf32x4_ps(m[c][r], 2);
+                quarter[3].m[c][r] = _mm512_extractf32x4_ps(m[c][r], 3);
+            }
+        }
+        for (int q = 0; q < 4; ++q) {
+            store_affine4(quarter[q], output, out + (size_t)(i + q * 4) * stride);
+        }
+    }
+    transform_sse2(t, i, end, output, out);
+}
+#endif
+
+// parent * local for every matrix already written, while it is still in cache
+static void apply_parent(const glm::mat4& parent, Uint32 begin, Uint32 end, float* out) {
+#ifdef TRANSFORM_SSE2
+    glm_vec4 p[4] = { _mm_loadu_ps(&parent[0][0]), _mm_loadu_ps(&parent[1][0]), _mm_loadu_ps(&parent[2][0]), _mm_loadu_ps(&parent[3][0]) };
+    for (Uint32 i = begin; i < end; ++i) {
+        float* o = out + (size_t)i * 16;
+        glm_vec4 local[4] = { _mm_loadu_ps(o), _mm_loadu_ps(o + 4), _mm_loadu_ps(o + 8), _mm_loadu_ps(o + 12) };
+        glm_vec4 world[4];
+        glm_mat4_mul(p, local, world);
+        _mm_storeu_ps(o, world[0]);
+        _mm_storeu_ps(o + 4, world[1]);
+        _mm_storeu_ps(o + 8, world[2]);
+        _mm_storeu_ps(o + 12, world[3]);
+    }
+#else
+    glm::mat4* matrices = (glm::mat4*)out;
+    for (Uint32 i = begin; i < end; ++i) {
+        matrices[i] = parent * matrices[i];
+    }
+#endif
+}
+
+void transform_batch_range(TransformKernel kernel, const TransformSoA& transforms, Uint32 first, Uint32 count,
+    TransformOutput output, const glm::mat4* parent, void* out) {
+    float* o = (float*)out;
+    const Uint32 end = first + count;
+    switch (kernel) {
+#ifdef TRANSFORM_AVX
+    case TRANSFORM_KERNEL_AVX512:
+        transform_avx512(transforms, first, end, output, o);
+        break;
+    case TRANSFORM_KERNEL_AVX2:
+        transform_avx2(transforms, first, end, output, o);
+        break;
+#endif
+#ifdef TRANSFORM_SSE2
+    case TRANSFORM_KERNEL_SSE2:
+        transform_sse2(transforms, first, end, output, o);
+        break;
+#endif
+    default:
+        transform_scalar(transforms, first, end, output, o);
+        break;
+    }
+
+    if (parent != NULL && output == TRANSFORM_OUTPUT_MAT4) {
+        apply_parent(*parent, first, end, o);
+    }
+}
+
+void transform_batch(ThreadPool* pool, const TransformSoA& transforms, TransformOutput output, const glm::mat4* parent, void* out) {
+    const TransformKernel kernel = best_transform_kernel();
+    const Uint32 count = transform_count(transforms);
+    if (pool == NULL || count <= TRANSFORM_GRAIN) {
+        transform_batch_range(kernel, transforms, 0, count, output, parent, out);
+        return;
+    }
+    thread_pool_parallel_for(pool, count, TRANSFORM_GRAIN, [&](Uint32 begin, Uint32 end) {
+        transform_batch_range(kernel, transforms, begin, end - begin, output, parent, out);
+    });
+}
+
+void benchmark_transform_batch(Uint32 count, int iterations) {
+    TransformSoA transforms;
+    resize_transforms(transforms, count);
+    Uint32 state = 12345;
+    auto random = [&state]() {
+        state = state * 1664525u + 1013904223u;
+        return (float)(state >> 8) / 16777216.0f * 2.0f - 1.0f;
+    };
+    for (Uint32 i = 0; i < count; ++i) {
+        glm::quat q = glm::normalize(glm::quat(random(), random(), random(), random()));
+        transforms.position_x[i] = random() * 100.0f;
+        transforms.position_y[i] = random() * 100.0f;
+        transforms.position_z[i] = random() * 100.0f;
+        transforms.rotation_x[i] = q.x;
+        transforms.rotation_y[i] = q.y;
+        transforms.rotation_z[i] = q.z;
+        transforms.rotation_w[i] = q.w;
+        transforms.scale_x[i] = 1.0f + random() * 0.5f;
+        transforms.scale_y[i] = 1.0f + random() * 0.5f;
+        transforms.scale_z[i] = 1.0f + random() * 0.5f;
+    }
+
+    const glm::mat4 parent = glm::perspective(glm::radians(70.0f), 4.0f / 3.0f, 0.1f, 1000.0f);
+    const double toSeconds = 1.0 / SDL_GetPerformanceFrequency();
+    std::vector<glm::mat4> reference(count), result(count);
+
+    // Naive: what the frame loop did per object, glm::translate * rotate * scale then parent *
+    double seconds = 0.0;
+    for (int it = 0; it < iterations; ++it) {
+        Uint64 start = SDL_GetPerformanceCounter();
+        for (Uint32 i = 0; i < count; ++i) {
+            glm::quat q(transforms.rotation_w[i], transforms.rotation_x[i], transforms.rotation_y[i], transforms.rotation_z[i]);
+            glm::mat4 model = glm::translate(glm::mat4(1.0f), glm::vec3(transforms.position_x[i], transforms.position_y[i], transforms.position_z[i])) *
+                glm::mat4_cast(q) * glm::scale(glm::mat4(1.0f), glm::vec3(transforms.scale_x[i], transforms.scale_y[i], transforms.scale_z[i]));
+            reference[i] = parent * model;
+        }
+        seconds += (SDL_GetPerformanceCounter() - start) * toSeconds;
+    }
+    SDL_Log("Transform batch, %u instances: naive glm %.1f M matrices/s", count, count * iterations / seconds / 1e6);
+
+    auto check = [&](const char* name) {
+        float maxError = 0.0f;
+        for (Uint32 i = 0; i < count; ++i) {
+            for (int c = 0; c < 4; ++c) {
+                glm::vec4 d = glm::abs(result[i][c] - reference[i][c]);
+                maxError = SDL_max(maxError, SDL_max(SDL_max(d.x, d.y), SDL_max(d.z, d.w)));
+            }
+        }
+        if (maxError > 1e-3f) {
+            fprintf(stderr, "ERROR: %s transforms differ from glm by %g\n", name, maxError);
+        }
+    };
+
+    const TransformKernel best = best_transform_kernel();
+    for (int k = TRANSFORM_KERNEL_SCALAR; k <= best; ++k) {
+        seconds = 0.0;
+        for (int it = 0; it < iterations; ++it) {
+            Uint64 start = SDL_GetPerformanceCounter();
+            transform_batch_range((TransformKernel)k, transforms, 0, count, TRANSFORM_OUTPUT_MAT4, &parent, result.data());
+            seconds += (SDL_GetPerformanceCounter() - start) * toSeconds;
+        }
+        check(transform_kernel_name((TransformKernel)k));
+        SDL_Log("  %-8s single thread %.1f M matrices/s", transform_kernel_name((TransformKernel)k), count * iterations / seconds / 1e6);
+    }
+
+    ThreadPool* pool = create_thread_pool(0);
+    seconds = 0.0;
+    for (int it = 0; it < iterations; ++it) {
+        Uint64 start = SDL_GetPerformanceCounter();
+        transform_batch(pool, transforms, TRANSFORM_OUTPUT_MAT4, &parent, result.data());
+        seconds += (SDL_GetPerformanceCounter() - start) * toSeconds;
+    }
+    check("threaded");
+    SDL_Log("  %-8s %d threads  %.1f M matrices/s", transform_kernel_name(best), thread_pool_size(pool) + 1, count * iterations / seconds / 1e6);
+
+    std::vector<float> rows((size_t)count * 12);
+    seconds = 0.0;
+    for (int it = 0; it < iterations; ++it) {
+        Uint64 start = SDL_GetPerformanceCounter();
+        transform_batch(pool, transforms, TRANSFORM_OUTPUT_3X4, NULL, rows.data());
+        seconds += (SDL_GetPerformanceCounter() - start) * toSeconds;
+    }
+    SDL_Log("  %-8s %d threads  %.1f M 3x4 matrices/s (no parent)", transform_kernel_name(best), thread_pool_size(pool) + 1, count * iterations / seconds / 1e6);
+    destroy_thread_pool(pool);
+}
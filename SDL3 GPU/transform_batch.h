@@ -0,0 +1,42 @@
+﻿#pragma once
+#include <vector>
+#include <SDL3/SDL.h>
+#include <glm/glm.hpp>
+#include "thread_pool.h"
+
+// Instance transforms as structure-of-arrays so kernels load 4, 8 or 16 of each component at once
+struct TransformSoA {
+    std::vector<float> position_x, position_y, position_z;
+    std::vector<float> rotation_x, rotation_y, rotation_z, rotation_w; // unit quaternion
+    std::vector<float> scale_x, scale_y, scale_z;
+};
+
+enum TransformOutput {
+    TRANSFORM_OUTPUT_MAT4, // column-major glm::mat4, 64 bytes
+    TRANSFORM_OUTPUT_3X4   // first three rows of the matrix, row-major, 48 bytes
+};
+
+enum TransformKernel {
+    TRANSFORM_KERNEL_SCALAR,
+    TRANSFORM_KERNEL_SSE2,
+    TRANSFORM_KERNEL_AVX2,
+    TRANSFORM_KERNEL_AVX512
+};
+
+void resize_transforms(TransformSoA& transforms, Uint32 count);
+Uint32 transform_count(const TransformSoA& transforms);
+Uint32 transform_output_size(TransformOutput output);
+
+// Widest kernel this CPU supports, checked once at runtime
+TransformKernel best_transform_kernel();
+const char* transform_kernel_name(TransformKernel kernel);
+
+// Writes parent * T * R * S for instances [first, first + count) to out, which is indexed from first.
+// parent may be NULL; it only applies to mat4 output.
+void transform_batch_range(TransformKernel kernel, const TransformSoA& transforms, Uint32 first, Uint32 count,
+    TransformOutput output, const glm::mat4* parent, void* out);
+
+// The whole array with the best kernel, split across pool when there is enough work; pool may be NULL
+void transform_batch(ThreadPool* pool, const TransformSoA& transforms, TransformOutput output, const glm::mat4* parent, void* out);
+
+void benchmark_transform_batch(Uint32 count, int iterations);
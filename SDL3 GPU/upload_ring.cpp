@@ -0,0 +1,215 @@
+﻿#include "upload_ring.h"
+#include <stdio.h>
+#include <iostream>
+#include <deque>
+
+// Space handed out between two submits, released together when their fence signals
+struct UploadRegion {
+    SDL_GPUFence* fence;
+    Uint64 submission;
+    Uint32 size;
+};
+
+struct UploadRing {
+    SDL_GPUDevice* device;
+    SDL_GPUTransferBuffer* transfer_buffer;
+    Uint8* mapped;
+    Uint32 capacity;
+    Uint32 head;          // next free byte
+    Uint32 used;          // bytes between the oldest live region and head, wrapping
+    Uint32 pending_begin; // head before the allocations not yet submitted
+    Uint32 pending_size;
+    Uint64 next_submission;
+    Uint64 completed_submission;
+    std::deque<UploadRegion> in_flight;
+    UploadRingStats stats;
+};
+
+UploadRing* create_upload_ring(SDL_GPUDevice* device, Uint32 size) {
+    SDL_GPUTransferBufferCreateInfo transferBufferInfo = {};
+    transferBufferInfo.usage = SDL_GPU_TRANSFERBUFFERUSAGE_UPLOAD;
+    transferBufferInfo.size = size;
+    SDL_GPUTransferBuffer* transferBuffer = SDL_CreateGPUTransferBuffer(device, &transferBufferInfo);
+    if (!transferBuffer) {
+        std::cout << "Failed to create upload ring. Error: " << SDL_GetError() << std::endl;
+        return NULL;
+    }
+
+    UploadRing* ring = new UploadRing();
+    ring->device = device;
+    ring->transfer_buffer = transferBuffer;
+    ring->capacity = size;
+    ring->next_submission = 1;
+    ring->stats.capacity = size;
+    return ring;
+}
+
+static void release_region(UploadRing* ring) {
+    UploadRegion& region = ring->in_flight.front();
+    SDL_ReleaseGPUFence(ring->device, region.fence);
+    ring->completed_submission = region.submission;
+    ring->used -= region.size;
+    ring->in_flight.pop_front();
+}
+
+void upload_ring_update(UploadRing* ring) {
+    // Submissions retire in order, so stop at the first one still running
+    while (!ring->in_flight.empty() && SDL_QueryGPUFence(ring->device, ring->in_flight.front().fence)) {
+        release_region(ring);
+    }
+    if (ring->used == 0) {
+        ring->head = 0;
+    }
+}
+
+static bool wait_oldest(UploadRing* ring) {
+    if (ring->in_flight.empty()) {
+        return false;
+    }
+    SDL_WaitForGPUFences(ring->device, true, &ring->in_flight.front().fence, 1);
+    release_region(ring);
+    ring->stats.stalls++;
+    return true;
+}
+
+// Finds room for size bytes at or after head, returning the offset and the bytes consumed
+static bool find_space(const UploadRing* ring, Uint32 size, Uint32 alignment, Uint32& offset, Uint32& consumed) {
+    if (ring->used == 0) {
+        offset = 0;
+        consumed = size;
+        return size <= ring->capacity;
+    }
+
+    Uint32 tail = (ring->head + ring->capacity - ring->used) % ring->capacity;
+    Uint32 aligned = (ring->head + alignment - 1) & ~(alignment - 1);
+    if (ring->head >= tail) {
+        // Free space is [head, capacity) followed by [0, tail)
+        if ((Uint64)aligned + size <= ring->capacity) {
+            offset = aligned;
+            consumed = aligned - ring->head + size;
+            return true;
+        }
+        if (size < tail) {
+            // Wrap, and count the skipped end of the buffer as used until this region retires
+            offset = 0;
+            consumed = ring->capacity - ring->head + size;
+            return true;
+        }
+        return false;
+    }
+    // Stop short of tail so head == tail only ever means empty
+    if ((Uint64)aligned + size < tail) {
+        offset = aligned;
+        consumed = aligned - ring->head + size;
+        return true;
+    }
+    return false;
+}
+
+bool upload_ring_allocate(UploadRing* ring, Uint32 size, Uint32 alignment, UploadAllocation& allocation) {
+    if (size > ring->capacity) {
+        fprintf(stderr, "ERROR: upload of %u bytes does not fit the %u byte upload ring\n", size, ring->capacity);
+        return false;
+    }
+
+    upload_ring_update(ring);
+    Uint32 offset = 0;
+    Uint32 consumed = 0;
+    while (!find_space(ring, size, alignment, offset, consumed)) {
+        if (!wait_oldest(ring)) {
+            return false;
+        }
+        upload_ring_update(ring);
+    }
+
+    if (!ring->mapped) {
+        ring->mapped = (Uint8*)SDL_MapGPUTransferBuffer(ring->device, ring->transfer_buffer, false);
+        if (!ring->mapped) {
+            std::cout << "Failed to map upload ring. Error: " << SDL_GetError() << std::endl;
+            return false;
+        }
+    }
+
+    if (ring->pending_size == 0) {
+        ring->pending_begin = ring->head;
+    }
+    ring->head = offset + size;
+    ring->used += consumed;
+    ring->pending_size += consumed;
+
+    ring->stats.bytes_uploaded += size;
+    ring->stats.allocations++;
+    if (ring->used > ring->stats.high_water_mark) {
+        ring->stats.high_water_mark = ring->used;
+    }
+
+    allocation.transfer_buffer = ring->transfer_buffer;
+    allocation.offset = offset;
+    allocation.data = ring->mapped + offset;
+    return true;
+}
+
+void upload_ring_flush(UploadRing* ring) {
+    if (ring->mapped) {
+        SDL_UnmapGPUTransferBuffer(ring->device, ring->transfer_buffer);
+        ring->mapped = NULL;
+    }
+}
+
+Uint64 upload_ring_submit(UploadRing* ring, SDL_GPUCommandBuffer* command_buffer) {
+    upload_ring_flush(ring);
+
+    SDL_GPUFence* fence = SDL_SubmitGPUCommandBufferAndAcquireFence(command_buffer);
+    if (fence == NULL) {
+        std::cout << "Failed to submit upload. Error: " << SDL_GetError() << std::endl;
+        // Nothing will read the pending space, so hand it straight back
+        ring->used -= ring->pending_size;
+        ring->head = ring->pending_begin;
+        ring->pending_size = 0;
+        return 0;
+    }
+
+    UploadRegion region = {};
+    region.fence = fence;
+    region.submission = ring->next_submission++;
+    region.size = ring->pending_size;
+    ring->in_flight.push_back(region);
+    ring->pending_size = 0;
+    ring->stats.submissions++;
+    return region.submission;
+}
+
+bool upload_ring_complete(UploadRing* ring, Uint64 submission) {
+    return submission <= ring->completed_submission;
+}
+
+void upload_ring_wait(UploadRing* ring, Uint64 submission) {
+    while (submission > ring->completed_submission && wait_oldest(ring)) {
+    }
+    upload_ring_update(ring);
+}
+
+const UploadRingStats& upload_ring_stats(const UploadRing* ring) {
+    return ring->stats;
+}
+
+void log_upload_ring_stats(const UploadRing* ring) {
+    const UploadRingStats& stats = ring->stats;
+    SDL_Log("Upload ring: %.2f MB in %llu allocations over %llu submits, %llu stalls, high water %.2f / %.2f MB",
+        stats.bytes_uploaded / (1024.0 * 1024.0), (unsigned long long)stats.allocations,
+        (unsigned long long)stats.submissions, (unsigned long long)stats.stalls,
+        stats.high_water_mark / (1024.0 * 1024.0), stats.capacity / (1024.0 * 1024.0));
+}
+
+void destroy_upload_ring(UploadRing* ring) {
+    if (ring == NULL) {
+        return;
+    }
+    if (ring->mapped) {
+        SDL_UnmapGPUTransferBuffer(ring->device, ring->transfer_buffer);
+    }
+    while (wait_oldest(ring)) {
+    }
+    SDL_ReleaseGPUTransferBuffer(ring->device, ring->transfer_buffer);
+    delete ring;
+}
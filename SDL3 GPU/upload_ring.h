@@ -0,0 +1,51 @@
+﻿#pragma once
+#include <SDL3/SDL.h>
+
+// Source offsets for buffer copies only need to be word aligned; block-compressed texture
+// copies want a whole block
+#define UPLOAD_BUFFER_ALIGNMENT 4
+#define UPLOAD_TEXTURE_ALIGNMENT 16
+
+struct UploadAllocation {
+    SDL_GPUTransferBuffer* transfer_buffer;
+    Uint32 offset;
+    Uint8* data; // mapped until the next upload_ring_submit
+};
+
+struct UploadRingStats {
+    Uint64 bytes_uploaded;
+    Uint64 allocations;
+    Uint64 submissions;
+    Uint64 stalls;          // times an allocation had to wait on the GPU for space
+    Uint32 high_water_mark; // most bytes ever in use, alignment and wrap padding included
+    Uint32 capacity;
+};
+
+struct UploadRing;
+
+// One persistent transfer buffer of the given size, reused as a ring for every upload
+UploadRing* create_upload_ring(SDL_GPUDevice* device, Uint32 size);
+// Waits for every submission still reading the ring
+void destroy_upload_ring(UploadRing* ring);
+
+// Reserves size bytes until the command buffer recording the copies has completed. Waits on the
+// oldest submission when the ring is full. Returns false when the space is held by allocations not
+// yet submitted (submit and retry) or when size exceeds the ring.
+bool upload_ring_allocate(UploadRing* ring, Uint32 size, Uint32 alignment, UploadAllocation& allocation);
+
+// Unmaps the ring and submits command_buffer, which must hold the copies for every allocation
+// since the last submit. Returns a submission id for upload_ring_complete, 0 on failure.
+Uint64 upload_ring_submit(UploadRing* ring, SDL_GPUCommandBuffer* command_buffer);
+
+// Unmaps the ring so a command buffer holding copies of earlier allocations can be submitted ahead of
+// upload_ring_submit. Their space stays pending until then and is remapped by the next allocation.
+void upload_ring_flush(UploadRing* ring);
+
+// Reclaims the space of finished submissions without blocking; call once per frame
+void upload_ring_update(UploadRing* ring);
+bool upload_ring_complete(UploadRing* ring, Uint64 submission);
+// Blocks until the given submission has finished
+void upload_ring_wait(UploadRing* ring, Uint64 submission);
+
+const UploadRingStats& upload_ring_stats(const UploadRing* ring);
+void log_upload_ring_stats(const UploadRing* ring);
@@ -0,0 +1,164 @@
+﻿#include "vertex_format.h"
+#include <cstring>
+#include <glm/packing.hpp>
+#include <glm/ext/matrix_transform.hpp>
+
+Uint32 vertex_format_stride(VertexFormat format) {
+    switch (format) {
+    case VERTEX_FORMAT_PACKED:
+        return sizeof(PackedVertex);
+    case VERTEX_FORMAT_PACKED_NO_COLOR:
+        return sizeof(PackedVertexNoColor);
+    default:
+        return sizeof(VertexData);
+    }
+}
+
+const char* vertex_format_name(VertexFormat format) {
+    switch (format) {
+    case VERTEX_FORMAT_PACKED:
+        return "packed";
+    case VERTEX_FORMAT_PACKED_NO_COLOR:
+        return "packed (no color)";
+    default:
+        return "full";
+    }
+}
+
+VertexFormat select_vertex_format(const MeshData& mesh, bool allow_packed) {
+    if (!allow_packed) {
+        return VERTEX_FORMAT_FULL;
+    }
+    for (const VertexData& vertex : mesh.vertices) {
+        if (vertex.color.r != 1.0f || vertex.color.g != 1.0f || vertex.color.b != 1.0f || vertex.color.a != 1.0f) {
+            return VERTEX_FORMAT_PACKED;
+        }
+    }
+    return VERTEX_FORMAT_PACKED_NO_COLOR;
+}
+
+VertexQuantization compute_vertex_quantization(const MeshData& mesh) {
+    glm::vec3 minimum(0.0f), maximum(0.0f);
+    if (!mesh.vertices.empty()) {
+        const Vec3& first = mesh.vertices[0].position;
+        minimum = maximum = glm::vec3(first.x, first.y, first.z);
+    }
+    for (const VertexData& vertex : mesh.vertices) {
+        glm::vec3 position(vertex.position.x, vertex.position.y, vertex.position.z);
+        minimum = glm::min(minimum, position);
+        maximum = glm::max(maximum, position);
+    }
+
+    VertexQuantization quantization = {};
+    for (int i = 0; i < 3; ++i) {
+        quantization.offset[i] = minimum[i];
+        // Flat axes still need a non-zero scale to stay invertible
+        quantization.scale[i] = maximum[i] > minimum[i] ? maximum[i] - minimum[i] : 1.0f;
+    }
+    return quantization;
+}
+
+glm::mat4 dequantization_matrix(const VertexQuantization& quantization) {
+    glm::mat4 matrix = glm::translate(glm::mat4(1.0f), glm::vec3(quantization.offset[0], quantization.offset[1], quantization.offset[2]));
+    return glm::scale(matrix, glm::vec3(quantization.scale[0], quantization.scale[1], quantization.scale[2]));
+}
+
+static void quantize_position(const Vec3& position, const VertexQuantization& quantization, Uint16 out[4]) {
+    const float values[3] = { position.x, position.y, position.z };
+    for (int i = 0; i < 3; ++i) {
+        float normalized = (values[i] - quantization.offset[i]) / quantization.scale[i];
+        out[i] = (Uint16)(glm::clamp(normalized, 0.0f, 1.0f) * 65535.0f + 0.5f);
+    }
+    out[3] = 65535;
+}
+
+std::vector<Uint8> pack_vertices(const MeshData& mesh, VertexFormat format, const VertexQuantization& quantization) {
+    const Uint32 stride = vertex_format_stride(format);
+    std::vector<Uint8> packed(mesh.vertices.size() * stride);
+
+    if (format == VERTEX_FORMAT_FULL) {
+        std::memcpy(packed.data(), mesh.vertices.data(), packed.size());
+        return packed;
+    }
+
+    for (size_t i = 0; i < mesh.vertices.size(); ++i) {
+        const VertexData& vertex = mesh.vertices[i];
+        PackedVertex out = {};
+        quantize_position(vertex.position, quantization, out.position);
+        out.texcoord = glm::packHalf2x16(glm::vec2(vertex.texcoord.x, vertex.texcoord.y));
+        out.color = glm::packUnorm4x8(glm::vec4(vertex.color.r, vertex.color.g, vertex.color.b, vertex.color.a));
+        // PackedVertexNoColor is a prefix of PackedVertex
+        std::memcpy(packed.data() + i * stride, &out, stride);
+    }
+    return packed;
+}
+
+// Mat4 per instance, one FLOAT4 attribute per column
+static void add_instance_attributes(VertexInputLayout& layout) {
+    layout.buffers[1].slot = 1;
+    layout.buffers[1].pitch = sizeof(glm::mat4);
+    layout.buffers[1].input_rate = SDL_GPU_VERTEXINPUTRATE_INSTANCE;
+    layout.num_buffers = 2;
+    for (Uint32 column = 0; column < 4; ++column) {
+        SDL_GPUVertexAttribute& attribute = layout.attributes[layout.num_attributes++];
+        attribute.location = INSTANCE_ATTRIBUTE_LOCATION + column;
+        attribute.buffer_slot = 1;
+        attribute.format = SDL_GPU_VERTEXELEMENTFORMAT_FLOAT4;
+        attribute.offset = column * sizeof(glm::vec4);
+    }
+}
+
+VertexInputLayout vertex_input_layout(VertexFormat format) {
+    VertexInputLayout layout = {};
+    layout.buffers[0].slot = 0;
+    layout.buffers[0].pitch = vertex_format_stride(format);
+    layout.buffers[0].input_rate = SDL_GPU_VERTEXINPUTRATE_VERTEX;
+
+    if (format == VERTEX_FORMAT_FULL) {
+        //Position
+        layout.attributes[0].location = 0;
+        layout.attributes[0].format = SDL_GPU_VERTEXELEMENTFORMAT_FLOAT3;
+        layout.attributes[0].offset = offsetof(VertexData, position);
+        //Texcoord
+        layout.attributes[1].location = 1;
+        layout.attributes[1].format = SDL_GPU_VERTEXELEMENTFORMAT_FLOAT2;
+        layout.attributes[1].offset = offsetof(VertexData, texcoord);
+        //color
+        layout.attributes[2].location = 2;
+        layout.attributes[2].format = SDL_GPU_VERTEXELEMENTFORMAT_FLOAT4;
+        layout.attributes[2].offset = offsetof(VertexData, color);
+        layout.num_attributes = 3;
+        add_instance_attributes(layout);
+        return layout;
+    }
+
+    //Position
+    layout.attributes[0].location = 0;
+    layout.attributes[0].format = SDL_GPU_VERTEXELEMENTFORMAT_USHORT4_NORM;
+    layout.attributes[0].offset = offsetof(PackedVertex, position);
+    //Texcoord
+    layout.attributes[1].location = 1;
+    layout.attributes[1].format = SDL_GPU_VERTEXELEMENTFORMAT_HALF2;
+    layout.attributes[1].offset = offsetof(PackedVertex, texcoord);
+    layout.num_attributes = 2;
+    if (format == VERTEX_FORMAT_PACKED) {
+        //color
+        layout.attributes[2].location = 2;
+        layout.attributes[2].format = SDL_GPU_VERTEXELEMENTFORMAT_UBYTE4_NORM;
+        layout.attributes[2].offset = offsetof(PackedVertex, color);
+        layout.num_attributes = 3;
+    }
+    add_instance_attributes(layout);
+    return layout;
+}
+
+const char* vertex_shader_name(VertexFormat format) {
+    switch (format) {
+    case VERTEX_FORMAT_PACKED:
+        return "shader_packed_color.vert";
+    case VERTEX_FORMAT_PACKED_NO_COLOR:
+        return "shader_packed.vert";
+    default:
+        return "shader.vert";
+    }
+}
@@ -0,0 +1,55 @@
+﻿#pragma once
+#include <vector>
+#include <SDL3/SDL.h>
+#include <glm/glm.hpp>
+#include "mesh.h"
+
+enum VertexFormat {
+    VERTEX_FORMAT_FULL = 0,           // VertexData, 36 bytes
+    VERTEX_FORMAT_PACKED = 1,         // PackedVertex, 16 bytes
+    VERTEX_FORMAT_PACKED_NO_COLOR = 2 // PackedVertexNoColor, 12 bytes
+};
+
+// Positions as UNORM16 inside the mesh bounds, UVs as half floats, color as UBYTE4_NORM
+struct PackedVertex {
+    Uint16 position[4];
+    Uint32 texcoord;
+    Uint32 color;
+};
+
+struct PackedVertexNoColor {
+    Uint16 position[4];
+    Uint32 texcoord;
+};
+
+// Maps UNORM16 positions back to model space: position = offset + unorm * scale
+struct VertexQuantization {
+    float offset[3];
+    float scale[3];
+};
+
+// Per-instance model matrix columns occupy locations 3-6, fed from buffer slot 1
+#define INSTANCE_ATTRIBUTE_LOCATION 3
+
+struct VertexInputLayout {
+    SDL_GPUVertexBufferDescription buffers[2];
+    Uint32 num_buffers;
+    SDL_GPUVertexAttribute attributes[7];
+    Uint32 num_attributes;
+};
+
+Uint32 vertex_format_stride(VertexFormat format);
+const char* vertex_format_name(VertexFormat format);
+
+// Picks the smallest format that represents the mesh, FULL when packing is disallowed
+VertexFormat select_vertex_format(const MeshData& mesh, bool allow_packed);
+
+VertexQuantization compute_vertex_quantization(const MeshData& mesh);
+glm::mat4 dequantization_matrix(const VertexQuantization& quantization);
+
+// Encodes mesh.vertices in the given format
+std::vector<Uint8> pack_vertices(const MeshData& mesh, VertexFormat format, const VertexQuantization& quantization);
+
+VertexInputLayout vertex_input_layout(VertexFormat format);
+// Shader library name of the vertex shader reading this format
+const char* vertex_shader_name(VertexFormat format);
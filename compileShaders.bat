@@ -1,2 +1,10 @@
-glslc "D:\Projects\Visual Studio\SDL3 GPU\SDL3 GPU\shader\shader.glsl.frag" -o "D:\Projects\Visual Studio\SDL3 GPU\SDL3 GPU\shader\shader.spv.frag"
-glslc "D:\Projects\Visual Studio\SDL3 GPU\SDL3 GPU\shader\shader.glsl.vert" -o "D:\Projects\Visual Studio\SDL3 GPU\SDL3 GPU\shader\shader.spv.vert"
+rem Same stages the CMake build compiles, for rebuilding them by hand; paths are relative to this script
+set SHADERS=%~dp0SDL3 GPU\shader
+glslc "%SHADERS%\shader.glsl.frag" -o "%SHADERS%\shader.spv.frag"
+glslc "%SHADERS%\shader.glsl.vert" -o "%SHADERS%\shader.spv.vert"
+glslc "%SHADERS%\shader_packed.glsl.vert" -fshader-stage=vert -o "%SHADERS%\shader_packed.spv.vert"
+glslc "%SHADERS%\shader_packed.glsl.vert" -fshader-stage=vert -DPACKED_COLOR -o "%SHADERS%\shader_packed_color.spv.vert"
+glslc "%SHADERS%\cull.glsl.comp" -fshader-stage=comp -o "%SHADERS%\cull.spv.comp"
+glslc "%SHADERS%\depth_pyramid.glsl.comp" -fshader-stage=comp -o "%SHADERS%\depth_pyramid.spv.comp"
+glslc "%SHADERS%\depth_only.glsl.frag" -fshader-stage=frag -o "%SHADERS%\depth_only.spv.frag"
+glslc "%SHADERS%\overdraw.glsl.frag" -fshader-stage=frag -o "%SHADERS%\overdraw.spv.frag"